@@ -0,0 +1,171 @@
+//! \file BenchUtil.h
+//! \brief Clocks, CPU accounting, percentiles and DLL loading shared by the benchmarks.
+
+#ifndef _BENCHUTIL_H_
+#define _BENCHUTIL_H_
+
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#include <time.h>
+#include <sys/resource.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include "../src/BroadcastProtocol.h"
+#include "../src/Platform.h"
+
+//! Monotonic clock in nanoseconds.
+inline unsigned long long BenchNow()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! CPU time consumed by the whole process, in nanoseconds.
+inline unsigned long long ProcessCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 100;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//! CPU time consumed by the calling thread, in nanoseconds.
+inline unsigned long long ThreadCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 100;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+//! Sleeps until the deadline, spinning for the last stretch so kHz rates stay accurate.
+inline void PaceUntil(unsigned long long deadline)
+{
+	const unsigned long long spin = 2000000;
+	for (;;)
+	{
+		unsigned long long now = BenchNow();
+		if (now >= deadline)
+			return;
+		if (deadline - now > spin)
+			std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - spin));
+		else
+			std::this_thread::yield();
+	}
+}
+
+//! Nearest rank percentile of an unsorted sample set, sorts it in place.
+inline unsigned long long Percentile(std::vector<unsigned long long>& samples, double percentile)
+{
+	if (samples.empty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	size_t rank = (size_t)(percentile * samples.size() + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	if (rank > samples.size())
+		rank = samples.size();
+	return samples[rank - 1];
+}
+
+//! Sets a variable the library reads when it starts its workers.
+inline void SetBenchEnvironment(const char* name, const char* value)
+{
+#ifdef _WIN32
+	SetEnvironmentVariableA(name, value);
+#else
+	setenv(name, value, 1);
+#endif
+}
+
+//! Installs broadcast in the settings and enables it globally and for the app, or the reader never delivers.
+inline bool PrepareSettings(const char* title)
+{
+	const std::string root = std::string(RZBROADCAST_REG_SUBKEY);
+	const std::string app = root + "\\" + title + ".exe";
+	for (const std::string& key : { root, app })
+	{
+		if (!CSettings::CreateKey(key) || !CSettings::SetDword(key, "Enable", 1))
+			return false;
+	}
+	return true;
+}
+
+//! Exports of the Chroma Broadcast library, resolved at run time like SDK clients do.
+struct CChromaBroadcastLibrary
+{
+	typedef RZRESULT(*INITEX)(int index, const char* title);
+	typedef RZRESULT(*UNINIT)();
+	typedef RZRESULT(*REGISTEREVENTNOTIFICATION)(RzChromaBroadcastAPI::RZEVENTNOTIFICATIONCALLBACK callback);
+	typedef RZRESULT(*UNREGISTEREVENTNOTIFICATION)();
+	typedef RZRESULT(*GETMETRICS)(RzChromaBroadcastAPI::CHROMA_BROADCAST_METRICS* metrics);
+	typedef RZRESULT(*CREATECONTEXTEX)(int index, const char* title, RZBROADCASTCONTEXT* context);
+	typedef RZRESULT(*DESTROYCONTEXT)(RZBROADCASTCONTEXT context);
+	typedef RZRESULT(*REGISTERCONTEXTNOTIFICATION)(RZBROADCASTCONTEXT context, RzChromaBroadcastAPI::RZCONTEXTNOTIFICATIONCALLBACK callback, void* user);
+
+	INITEX InitEx = nullptr;
+	UNINIT UnInit = nullptr;
+	REGISTEREVENTNOTIFICATION RegisterEventNotification = nullptr;
+	UNREGISTEREVENTNOTIFICATION UnRegisterEventNotification = nullptr;
+	GETMETRICS GetMetrics = nullptr;
+	//! Missing from libraries older than the context API.
+	CREATECONTEXTEX CreateContextEx = nullptr;
+	DESTROYCONTEXT DestroyContext = nullptr;
+	REGISTERCONTEXTNOTIFICATION RegisterContextNotification = nullptr;
+
+	bool Load(const char* path = nullptr)
+	{
+#ifdef _WIN32
+		HMODULE module = path ? LoadLibraryA(path) : nullptr;
+		if (!module)
+			module = LoadLibraryA(sizeof(void*) == 8 ? "RzChromaBroadcastAPI64.dll" : "RzChromaBroadcastAPI.dll");
+		if (!module)
+			return false;
+		auto resolve = [&](const char* name) { return (void*)GetProcAddress(module, name); };
+#else
+		void* module = dlopen(path ? path : "libRzChromaBroadcastAPI.so", RTLD_NOW);
+		if (!module)
+		{
+			fprintf(stderr, "%s\n", dlerror());
+			return false;
+		}
+		auto resolve = [&](const char* name) { return dlsym(module, name); };
+#endif
+		InitEx = (INITEX)resolve("InitEx");
+		UnInit = (UNINIT)resolve("UnInit");
+		RegisterEventNotification = (REGISTEREVENTNOTIFICATION)resolve("RegisterEventNotification");
+		UnRegisterEventNotification = (UNREGISTEREVENTNOTIFICATION)resolve("UnRegisterEventNotification");
+		GetMetrics = (GETMETRICS)resolve("GetMetrics");
+		CreateContextEx = (CREATECONTEXTEX)resolve("CreateContextEx");
+		DestroyContext = (DESTROYCONTEXT)resolve("DestroyContext");
+		RegisterContextNotification = (REGISTERCONTEXTNOTIFICATION)resolve("RegisterContextNotification");
+		return InitEx && UnInit && RegisterEventNotification && UnRegisterEventNotification && GetMetrics;
+	}
+};
+
+#endif
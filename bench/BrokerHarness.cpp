@@ -0,0 +1,496 @@
+//! \file BrokerHarness.cpp
+//! \brief Runs chroma-broker and N client processes against the synthetic writer and checks every client gets the
+//! broadcast frames and only its own app specific frames, with a single library thread and no polling of its own.
+//! The harness also follows the broker's frame ring as a plain reader and checks its sequence numbers and timestamps.
+//! One more client creates a context over the apps the broker serves a process, which must be refused, and checks
+//! the others still go LIVE and get the broadcast frames. Linux only.
+//!
+//! Usage: broker-harness [-l library] [-b chroma-broker] [-c clients] [-d seconds] [-r rate_hz]
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <RzErrors.h>
+#include "../src/BrokerProtocol.h"
+#include "../src/FrameRing.h"
+#include "BenchUtil.h"
+#include "SyntheticWriter.h"
+
+using namespace RzChromaBroadcastAPI;
+
+extern char** environ;
+
+static const int HARNESS_APP_INDEX = 4300;
+static const RZID HARNESS_UNKNOWN_APP = 4399;
+//! Apps of the client with one context over BROKER_MAX_APPS, its client number is HARNESS_CROWDED_CLIENT.
+static const int HARNESS_CROWDED_APP_INDEX = 4350;
+static const int HARNESS_CROWDED_CLIENT = -1;
+
+struct CClientCounters
+{
+	RZID Index = 0;
+	std::atomic<unsigned long> Broadcast{0};
+	std::atomic<unsigned long> Own{0};
+	std::atomic<unsigned long> Foreign{0};
+	std::atomic<unsigned long> Live{0};
+};
+
+static std::string ClientTitle(int client)
+{
+	return "ChromaBroadcastBrokerClient" + std::to_string(client);
+}
+
+static std::string CrowdedTitle(DWORD app)
+{
+	return "ChromaBroadcastBrokerCrowded" + std::to_string(app);
+}
+
+static int ThreadCount()
+{
+	int count = 0;
+	DIR* dir = opendir("/proc/self/task");
+	if (!dir)
+		return -1;
+	while (struct dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] != '.')
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+static RZRESULT ClientCallback(RZBROADCASTCONTEXT context, CHROMA_BROADCAST_TYPE type, PRZPARAM pData, void* user)
+{
+	CClientCounters* counters = (CClientCounters*)user;
+	if (type == BROADCAST_STATUS)
+	{
+		if ((CHROMA_BROADCAST_STATUS)(size_t)pData == LIVE)
+			counters->Live++;
+		return RZRESULT_SUCCESS;
+	}
+
+	const CHROMA_BROADCAST_EFFECT* effect = (const CHROMA_BROADCAST_EFFECT*)pData;
+	if (effect->IsAppSpecific != 1)
+		counters->Broadcast++;
+	else if (effect->CL2 == counters->Index)
+		counters->Own++;
+	else
+		counters->Foreign++;
+	return RZRESULT_SUCCESS;
+}
+
+//! Client process: one context, reports the threads it added, counts frames until stdin closes.
+static int RunClient(const char* library, int client)
+{
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library) || !api.CreateContextEx)
+	{
+		fprintf(stderr, "client %d: failed to load the library\n", client);
+		return 1;
+	}
+
+	CClientCounters counters;
+	counters.Index = HARNESS_APP_INDEX + client;
+	int threadsBefore = ThreadCount();
+	RZBROADCASTCONTEXT context = nullptr;
+	RZRESULT result = api.CreateContextEx((int)counters.Index, ClientTitle(client).c_str(), &context);
+	if (result != RZRESULT_SUCCESS || api.RegisterContextNotification(context, ClientCallback, &counters) != RZRESULT_SUCCESS)
+	{
+		fprintf(stderr, "client %d: CreateContextEx returned %ld\n", client, (long)result);
+		return 1;
+	}
+	printf("ready %d\n", ThreadCount() - threadsBefore);
+	fflush(stdout);
+
+	char line[64];
+	while (fgets(line, sizeof(line), stdin))
+		;
+
+	api.DestroyContext(context);
+	printf("result %lu %lu %lu %lu\n", counters.Broadcast.load(), counters.Own.load(), counters.Foreign.load(), counters.Live.load());
+	fflush(stdout);
+	return 0;
+}
+
+//! Crowded client process: BROKER_MAX_APPS contexts and one more, reports what creating the last returned and how
+//! many of the others went LIVE and got broadcast frames.
+static int RunCrowdedClient(const char* library)
+{
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library) || !api.CreateContextEx)
+	{
+		fprintf(stderr, "crowded client: failed to load the library\n");
+		return 1;
+	}
+
+	int threadsBefore = ThreadCount();
+	std::vector<CClientCounters> counters(BROKER_MAX_APPS);
+	std::vector<RZBROADCASTCONTEXT> contexts(BROKER_MAX_APPS, nullptr);
+	for (DWORD i = 0; i < BROKER_MAX_APPS; i++)
+	{
+		counters[i].Index = HARNESS_CROWDED_APP_INDEX + i;
+		RZRESULT result = api.CreateContextEx((int)counters[i].Index, CrowdedTitle(i).c_str(), &contexts[i]);
+		if (result != RZRESULT_SUCCESS || api.RegisterContextNotification(contexts[i], ClientCallback, &counters[i]) != RZRESULT_SUCCESS)
+		{
+			fprintf(stderr, "crowded client: CreateContextEx %lu returned %ld\n", (unsigned long)i, (long)result);
+			return 1;
+		}
+	}
+	RZBROADCASTCONTEXT extra = nullptr;
+	RZRESULT rejected = api.CreateContextEx(HARNESS_CROWDED_APP_INDEX + BROKER_MAX_APPS, CrowdedTitle(BROKER_MAX_APPS).c_str(), &extra);
+	printf("ready %d\n", ThreadCount() - threadsBefore);
+	fflush(stdout);
+
+	char line[64];
+	while (fgets(line, sizeof(line), stdin))
+		;
+
+	if (rejected == RZRESULT_SUCCESS)
+		api.DestroyContext(extra);
+	unsigned long live = 0, broadcast = 0;
+	for (DWORD i = 0; i < BROKER_MAX_APPS; i++)
+	{
+		api.DestroyContext(contexts[i]);
+		live += counters[i].Live.load() ? 1 : 0;
+		broadcast += counters[i].Broadcast.load() ? 1 : 0;
+	}
+	printf("crowded %ld %lu %lu\n", (long)rejected, live, broadcast);
+	fflush(stdout);
+	return 0;
+}
+
+struct CClientProcess
+{
+	pid_t Pid = 0;
+	FILE* In = nullptr;
+	FILE* Out = nullptr;
+	int Threads = -1;
+	unsigned long Broadcast = 0, Own = 0, Foreign = 0, Live = 0;
+	unsigned long SentOwn = 0;
+	bool Reported = false;
+};
+
+static bool SpawnClient(const char* self, const char* library, int client, CClientProcess& process)
+{
+	int in[2], out[2];
+	if (pipe(in) || pipe(out))
+		return false;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, in[1]);
+	posix_spawn_file_actions_addclose(&actions, out[0]);
+
+	std::string index = std::to_string(client);
+	std::vector<char*> argv = { (char*)self, (char*)"--client", (char*)index.c_str() };
+	if (client == HARNESS_CROWDED_CLIENT)
+		argv = { (char*)self, (char*)"--crowded" };
+	if (library)
+	{
+		argv.push_back((char*)"-l");
+		argv.push_back((char*)library);
+	}
+	argv.push_back(nullptr);
+
+	int error = posix_spawn(&process.Pid, self, &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(in[0]);
+	close(out[1]);
+	if (error)
+	{
+		close(in[1]);
+		close(out[0]);
+		return false;
+	}
+	process.In = fdopen(in[1], "w");
+	process.Out = fdopen(out[0], "r");
+	return true;
+}
+
+static pid_t SpawnBroker(const std::string& path)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	pid_t pid = 0;
+	char* argv[] = { (char*)path.c_str(), nullptr };
+	int error = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	return error ? 0 : pid;
+}
+
+//! Waits until the broker owns its page and reports Synapse live.
+static bool WaitForBroker(pid_t broker, unsigned int milliseconds)
+{
+	unsigned long long deadline = BenchNow() + milliseconds * 1000000ULL;
+	CSharedMemory memory;
+	while (BenchNow() < deadline)
+	{
+		if (memory.Data() || memory.Open(RZBROADCAST_BROKER_SHARED_MEMORY, sizeof(RZBrokerPage), SHARED_MEMORY_READ_ONLY, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		{
+			const RZBrokerPage* page = (const RZBrokerPage*)memory.Data();
+			if (page->ProcessId.load() == (DWORD)broker && page->Status.load() == BROKER_STATUS_LIVE)
+				return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+//! Result of following the broker ring next to the clients.
+struct CRingCheck
+{
+	unsigned long Frames = 0;
+	unsigned long long Missed = 0;
+	unsigned long Disordered = 0;   //!< Frames whose sequence or timestamp went backwards.
+	unsigned long Foreign = 0;      //!< Frames for the app nobody serves.
+};
+
+//! Reads everything the broker published since the reader was opened.
+static void CheckRing(CFrameRingReader& ring, CRingCheck& check)
+{
+	RZFrameRingEntry entry;
+	ULONGLONG missed = 0;
+	ULONGLONG lastSequence = ring.Position();
+	ULONGLONG lastTimestamp = 0;
+	while (ring.Read(entry, missed))
+	{
+		check.Missed += missed;
+		if (entry.Sequence != lastSequence + missed + 1 || entry.Timestamp < lastTimestamp)
+			check.Disordered++;
+		if (entry.Frame.effect.IsAppSpecific == 1 && entry.Frame.index == HARNESS_UNKNOWN_APP)
+			check.Foreign++;
+		lastSequence = entry.Sequence;
+		lastTimestamp = entry.Timestamp;
+		check.Frames++;
+	}
+	check.Missed += missed;
+}
+
+static std::string SiblingPath(const char* self, const char* name)
+{
+	std::string path = self;
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? std::string("./") + name : path.substr(0, slash + 1) + name;
+}
+
+int main(int argc, char** argv)
+{
+	const char* library = nullptr;
+	std::string brokerPath = SiblingPath(argv[0], "chroma-broker");
+	int clients = 4;
+	double seconds = 2.0;
+	double rate = 200.0;
+
+	if (argc >= 3 && !strcmp(argv[1], "--client"))
+	{
+		int client = atoi(argv[2]);
+		if (argc >= 5 && !strcmp(argv[3], "-l"))
+			library = argv[4];
+		return RunClient(library, client);
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--crowded"))
+	{
+		if (argc >= 4 && !strcmp(argv[2], "-l"))
+			library = argv[3];
+		return RunCrowdedClient(library);
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			library = argv[++i];
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			brokerPath = argv[++i];
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			clients = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [-l library] [-b chroma-broker] [-c clients] [-d seconds] [-r rate_hz]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (clients < 1 || clients > (int)BROKER_MAX_CLIENTS || rate <= 0)
+	{
+		fprintf(stderr, "clients must be 1 to %lu and the rate positive\n", (unsigned long)BROKER_MAX_CLIENTS);
+		return 1;
+	}
+
+	for (int client = 0; client < clients; client++)
+	{
+		if (!PrepareSettings(ClientTitle(client).c_str()))
+		{
+			fprintf(stderr, "Failed to enable broadcast in the settings\n");
+			return 1;
+		}
+	}
+	for (DWORD app = 0; app <= BROKER_MAX_APPS; app++)
+	{
+		if (!PrepareSettings(CrowdedTitle(app).c_str()))
+		{
+			fprintf(stderr, "Failed to enable broadcast in the settings\n");
+			return 1;
+		}
+	}
+
+	CSyntheticWriter writer;
+	if (!writer.Open())
+	{
+		fprintf(stderr, "Failed to create the broadcast shared memory and event\n");
+		return 1;
+	}
+
+	pid_t broker = SpawnBroker(brokerPath);
+	if (!broker || !WaitForBroker(broker, 5000))
+	{
+		fprintf(stderr, "%s did not come up\n", brokerPath.c_str());
+		if (broker)
+		{
+			kill(broker, SIGTERM);
+			waitpid(broker, nullptr, 0);
+		}
+		return 1;
+	}
+
+	// The ring is sized for the whole run at the default rates, a plain reader must see every frame in order
+	char ringName[128];
+	snprintf(ringName, sizeof(ringName), RZBROADCAST_BROKER_RING, (unsigned long)broker);
+	CFrameRingReader ring;
+	CRingCheck ringCheck;
+	bool ringOpen = ring.Open(ringName);
+
+	std::vector<CClientProcess> processes(clients);
+	bool failed = false;
+	for (int client = 0; client < clients && !failed; client++)
+	{
+		CClientProcess& process = processes[client];
+		if (!SpawnClient(argv[0], library, client, process) || fscanf(process.Out, " ready %d", &process.Threads) != 1)
+		{
+			fprintf(stderr, "client %d did not start\n", client);
+			failed = true;
+		}
+	}
+	CClientProcess crowded;
+	if (!failed && (!SpawnClient(argv[0], library, HARNESS_CROWDED_CLIENT, crowded) || fscanf(crowded.Out, " ready %d", &crowded.Threads) != 1))
+	{
+		fprintf(stderr, "the crowded client did not start\n");
+		failed = true;
+	}
+
+	// Frame i goes to everyone, to one client, or to an app nobody serves, in turn
+	unsigned long sentBroadcast = 0, sentUnknown = 0;
+	if (!failed)
+	{
+		CHROMA_BROADCAST_EFFECT effect;
+		memset(&effect, 0, sizeof(effect));
+		unsigned long long period = (unsigned long long)(1e9 / rate);
+		unsigned long long start = BenchNow();
+		unsigned long frames = (unsigned long)(seconds * rate);
+		for (unsigned long i = 0; i < frames; i++)
+		{
+			int kind = (int)(i % (clients + 2));
+			RZID index = 0;
+			if (kind == clients)
+				index = HARNESS_UNKNOWN_APP;
+			else if (kind < clients)
+				index = HARNESS_APP_INDEX + kind;
+
+			effect.CL1 = (RZCOLOR)i;
+			effect.CL2 = index;
+			effect.IsAppSpecific = index ? 1 : 0;
+			writer.Publish(effect, index);
+
+			if (kind == clients + 1)
+				sentBroadcast++;
+			else if (kind == clients)
+				sentUnknown++;
+			else
+				processes[kind].SentOwn++;
+			PaceUntil(start + (i + 1) * period);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (ringOpen)
+		CheckRing(ring, ringCheck);
+
+	for (CClientProcess& process : processes)
+	{
+		if (process.In)
+			fclose(process.In);
+	}
+	if (crowded.In)
+		fclose(crowded.In);
+	long rejected = RZRESULT_SUCCESS;
+	if (crowded.Out)
+	{
+		crowded.Reported = fscanf(crowded.Out, " crowded %ld %lu %lu", &rejected, &crowded.Live, &crowded.Broadcast) == 3;
+		fclose(crowded.Out);
+	}
+	if (crowded.Pid)
+		waitpid(crowded.Pid, nullptr, 0);
+	for (CClientProcess& process : processes)
+	{
+		if (process.Out)
+		{
+			process.Reported = fscanf(process.Out, " result %lu %lu %lu %lu", &process.Broadcast, &process.Own, &process.Foreign, &process.Live) == 4;
+			fclose(process.Out);
+		}
+		if (process.Pid)
+			waitpid(process.Pid, nullptr, 0);
+	}
+
+	kill(broker, SIGTERM);
+	int brokerStatus = 0;
+	waitpid(broker, &brokerStatus, 0);
+	writer.Close();
+
+	printf("%d clients, %lu broadcast, %lu unknown app and %lu app specific frames per client at %.0f Hz\n",
+		clients, sentBroadcast, sentUnknown, processes[0].SentOwn, rate);
+	printf("%-7s %8s %10s %8s %8s %5s %10s\n", "client", "threads", "broadcast", "own", "foreign", "live", "delivered");
+	for (int client = 0; client < clients; client++)
+	{
+		CClientProcess& process = processes[client];
+		unsigned long sent = sentBroadcast + process.SentOwn;
+		printf("%-7d %8d %10lu %8lu %8lu %5lu %9.1f%%\n", client, process.Threads, process.Broadcast, process.Own, process.Foreign, process.Live,
+			sent ? 100.0 * (process.Broadcast + process.Own) / sent : 0.0);
+
+		// One routing thread, no monitor; frames for other apps never reach the client. The Synapse ring only
+		// keeps the newest frame for readers, so frames lost to an overloaded machine are reported, not failed.
+		if (!process.Reported || process.Threads != 1 || process.Foreign || !(process.Broadcast + process.Own)
+			|| process.Broadcast > sentBroadcast || process.Own > process.SentOwn)
+			failed = true;
+	}
+	if (!WIFEXITED(brokerStatus) || WEXITSTATUS(brokerStatus))
+		failed = true;
+
+	// Context BROKER_MAX_APPS + 1 is refused, the others are all served
+	printf("crowded %8d %lu of %lu apps live, %lu with broadcast frames, app %lu returned %ld\n", crowded.Threads, crowded.Live,
+		(unsigned long)BROKER_MAX_APPS, crowded.Broadcast, (unsigned long)BROKER_MAX_APPS + 1, rejected);
+	if (!crowded.Reported || crowded.Threads != 1 || rejected != RZRESULT_NO_MORE_ITEMS || crowded.Live != BROKER_MAX_APPS
+		|| crowded.Broadcast != BROKER_MAX_APPS)
+		failed = true;
+
+	printf("ring    %lu slots, %lu frames, %llu missed, %lu out of order\n", (unsigned long)ring.Depth(), ringCheck.Frames, ringCheck.Missed, ringCheck.Disordered);
+	if (!ringOpen || !ringCheck.Frames || ringCheck.Disordered || ringCheck.Foreign)
+		failed = true;
+
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
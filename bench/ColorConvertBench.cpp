@@ -0,0 +1,165 @@
+//! \file ColorConvertBench.cpp
+//! \brief Colors converted per second on one core by each supported instruction set, for every layout, against the
+//! scalar kernels, and a byte for byte comparison of every level's output with the scalar output.
+//!
+//! Usage: color-convert-bench [-n colors] [-g gamma] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../src/ColorConvert.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Each measurement runs for at least this much CPU time.
+static const unsigned long long BENCH_MIN_CPU = 200000000ULL;
+
+struct RZBenchLayout
+{
+	const char* Name;
+	COLOR_LAYOUT Layout;
+	bool Gamma;
+};
+
+//! Converts the colors until BENCH_MIN_CPU passed, returns the colors per second.
+static double Measure(const CColorConverter& converter, const RZBenchLayout& layout, const std::vector<RZCOLOR>& colors, std::vector<BYTE>& out)
+{
+	unsigned long long converted = 0;
+	unsigned long long cpu0 = ThreadCpuTime(), cpu1 = cpu0;
+	while (cpu1 - cpu0 < BENCH_MIN_CPU)
+	{
+		for (int i = 0; i < 16; i++)
+			converter.Convert(layout.Layout, colors.data(), colors.size(), out.data());
+		converted += 16 * colors.size();
+		cpu1 = ThreadCpuTime();
+	}
+	return converted / ((cpu1 - cpu0) / 1e9);
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "color-convert-bench.json";
+	// An odd count, so the vector kernels also hand a tail to the scalar ones
+	size_t count = 10000 + 7;
+	float gamma = 2.2f;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+			gamma = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n colors] [-g gamma] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Every byte value in every channel, then pseudo random colors
+	std::vector<RZCOLOR> colors(count);
+	unsigned long long state = 0x9E3779B97F4A7C15ULL;
+	for (size_t i = 0; i < count; i++)
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		colors[i] = i < 256 ? (RZCOLOR)(i * 0x01010101) : (RZCOLOR)(state >> 32);
+	}
+
+	const RZBenchLayout layouts[] = {
+		{ "rgb", COLOR_LAYOUT_RGB, false },
+		{ "grb", COLOR_LAYOUT_GRB, false },
+		{ "grb_gamma", COLOR_LAYOUT_GRB, true },
+		{ "hsv", COLOR_LAYOUT_HSV, false },
+		{ "linear", COLOR_LAYOUT_LINEAR, false },
+	};
+
+	printf("%zu colors, best level %s\n", count, CSimd::Name(CSimd::Level()));
+	printf("%10s %7s %14s %8s %6s\n", "layout", "level", "colors_per_s", "speedup", "output");
+
+	nlohmann::json runs = nlohmann::json::array();
+	bool failed = false;
+	for (const RZBenchLayout& layout : layouts)
+	{
+		CColorConverter reference(SIMD_SCALAR);
+		if (layout.Gamma)
+			reference.SetGamma(gamma);
+		std::vector<BYTE> expected(CColorConverter::OutputSize(layout.Layout, count));
+		reference.Convert(layout.Layout, colors.data(), count, expected.data());
+		double scalarRate = 0;
+
+		for (int level = SIMD_SCALAR; level < SIMD_LEVEL_COUNT; level++)
+		{
+			if (!CSimd::IsSupported((SIMD_LEVEL)level))
+				continue;
+
+			CColorConverter converter((SIMD_LEVEL)level);
+			if (layout.Gamma)
+				converter.SetGamma(gamma);
+			std::vector<BYTE> out(expected.size());
+			converter.Convert(layout.Layout, colors.data(), count, out.data());
+			bool same = out == expected;
+			if (!same)
+				failed = true;
+
+			double rate = Measure(converter, layout, colors, out);
+			if (level == SIMD_SCALAR)
+				scalarRate = rate;
+			double speedup = scalarRate > 0 ? rate / scalarRate : 0.0;
+			printf("%10s %7s %14.0f %7.2fx %6s\n", layout.Name, CSimd::Name((SIMD_LEVEL)level), rate, speedup, same ? "same" : "DIFF");
+			runs.push_back({
+				{"layout", layout.Name},
+				{"level", CSimd::Name((SIMD_LEVEL)level)},
+				{"colors_per_second", rate},
+				{"speedup", speedup},
+				{"same_output", same},
+			});
+		}
+	}
+
+	// Effects go through the same kernels after their colors are gathered
+	std::vector<CHROMA_BROADCAST_EFFECT> effects(count / 5);
+	for (size_t i = 0; i < effects.size(); i++)
+		memcpy(&effects[i].CL1, &colors[i * 5], 5 * sizeof(RZCOLOR));
+	CColorConverter converter;
+	std::vector<BYTE> packed(CColorConverter::OutputSize(COLOR_LAYOUT_GRB, effects.size() * 5));
+	std::vector<BYTE> expected(packed.size());
+	converter.Convert(COLOR_LAYOUT_GRB, effects.data(), effects.size(), packed.data());
+	converter.Convert(COLOR_LAYOUT_GRB, colors.data(), effects.size() * 5, expected.data());
+	unsigned long long converted = 0;
+	unsigned long long cpu0 = ThreadCpuTime(), cpu1 = cpu0;
+	while (cpu1 - cpu0 < BENCH_MIN_CPU)
+	{
+		converter.Convert(COLOR_LAYOUT_GRB, effects.data(), effects.size(), packed.data());
+		converted += effects.size();
+		cpu1 = ThreadCpuTime();
+	}
+	double effectRate = converted / ((cpu1 - cpu0) / 1e9);
+	bool effectsSame = packed == expected;
+	if (!effectsSame)
+		failed = true;
+	printf("%10s %7s %14.0f effects per second, %s\n", "effects", CSimd::Name(converter.Level()), effectRate, effectsSame ? "same" : "DIFF");
+
+	nlohmann::json report = {
+		{"benchmark", "color_convert"},
+		{"colors", count},
+		{"gamma", gamma},
+		{"best_level", CSimd::Name(CSimd::Level())},
+		{"runs", runs},
+		{"effects_per_second", effectRate},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+//! \file DdpSinkBench.cpp
+//! \brief End to end latency of network LED controllers: frames published by a synthetic writer reach the broadcast
+//! callback of the library, are rendered by CLedOutput and handed to CDdpSink, which sends them over DDP and WLED
+//! realtime UDP to receivers on the loopback interface. Each receiver puts the packets of a frame back together,
+//! checks them against the frame rendered and takes the time from the callback to the last packet. A run within the
+//! frame rate of the controllers should deliver every frame, a run above it should drop the stale frames and keep
+//! the latency under a frame interval of the controllers.
+//!
+//! Usage: ddp-sink-bench [-l library] [-n leds] [-c controllers] [-d seconds_per_run] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <RzErrors.h>
+#include "../src/DdpSink.h"
+#include "../src/LedOutput.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+#include "SyntheticWriter.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const int BENCH_APP_INDEX = 4243;
+static const char BENCH_APP_TITLE[] = "ChromaBroadcastDdpBench";
+
+//! Frames rendered are kept this many frames back for the receivers to compare with.
+static const DWORD FRAME_RING = 256;
+static const DWORD MAX_FRAMES = 0x10000;
+static const size_t MAX_SAMPLES = 1 << 20;
+
+//! A receiver standing in for one controller.
+struct RZReceiver
+{
+	CUdpSocket Socket;
+	CThread Thread;
+	RZLedController Config;
+	std::vector<BYTE> Frame;                //!< LEDs of the frame being put back together.
+	size_t Received;                        //!< Bytes of it received.
+	BYTE LastSequence;
+	std::vector<unsigned long long> Latencies;
+	std::atomic<unsigned long long> Complete;
+	std::atomic<unsigned long long> Bad;
+};
+
+static CLedOutput Output;
+static CDdpSink Sink;
+static CEvent StopReceivers;
+static size_t Leds = 2400;
+static std::vector<BYTE> Frames;
+static std::vector<RZLedController> Layout;
+static std::unique_ptr<std::atomic<unsigned long long>[]> CallbackTimes;
+static std::atomic<DWORD> CurrentRun(0);
+static std::atomic<bool> Live(false);
+static std::atomic<unsigned long long> Callbacks(0);
+
+//! Renders the frame, stamps its sequence number into the first LED of each controller and submits it.
+static RZRESULT BenchCallback(CHROMA_BROADCAST_TYPE type, PRZPARAM pData)
+{
+	unsigned long long now = BenchNow();
+	if (type == BROADCAST_STATUS)
+	{
+		Live.store((CHROMA_BROADCAST_STATUS)(size_t)pData == LIVE);
+		return RZRESULT_SUCCESS;
+	}
+
+	const CHROMA_BROADCAST_EFFECT* effect = (const CHROMA_BROADCAST_EFFECT*)pData;
+	if (!CurrentRun.load(std::memory_order_relaxed) || effect->CL2 != CurrentRun.load(std::memory_order_relaxed))
+		return RZRESULT_SUCCESS;
+
+	DWORD seq = effect->CL1 & (MAX_FRAMES - 1);
+	CallbackTimes[seq].store(now, std::memory_order_relaxed);
+	BYTE* frame = &Frames[(seq % FRAME_RING) * Leds * 3];
+	Output.Render(*effect, frame, false);
+	for (const RZLedController& controller : Layout)
+	{
+		BYTE* first = frame + controller.FirstLed * 3;
+		first[0] = 0;
+		first[1] = (BYTE)(seq >> 8);
+		first[2] = (BYTE)seq;
+	}
+	Sink.Submit(frame);
+	Callbacks++;
+	return RZRESULT_SUCCESS;
+}
+
+static unsigned Get16(const BYTE* p)
+{
+	return (unsigned)p[0] << 8 | p[1];
+}
+
+//! Checks the frame put back together against the frame rendered and takes its latency.
+static void Finish(RZReceiver& receiver, unsigned long long now)
+{
+	size_t size = receiver.Frame.size();
+	DWORD seq = receiver.Frame[1] << 8 | receiver.Frame[2];
+	const BYTE* expected = &Frames[(seq % FRAME_RING) * Leds * 3 + receiver.Config.FirstLed * 3];
+	unsigned long long callback = CallbackTimes[seq].load(std::memory_order_relaxed);
+	if (receiver.Received != size || memcmp(receiver.Frame.data(), expected, size) || !callback)
+		receiver.Bad++;
+	else
+	{
+		receiver.Complete++;
+		if (receiver.Latencies.size() < MAX_SAMPLES)
+			receiver.Latencies.push_back(now - callback);
+	}
+	receiver.Received = 0;
+}
+
+static DWORD Receive(void* parameter)
+{
+	RZReceiver& receiver = *(RZReceiver*)parameter;
+	BYTE packet[2048];
+	size_t channels = receiver.Frame.size();
+	while (!StopReceivers.IsSet())
+	{
+		int size = receiver.Socket.Receive(packet, sizeof(packet), 50);
+		unsigned long long now = BenchNow();
+		if (size <= 0)
+			continue;
+
+		size_t offset, length;
+		const BYTE* data;
+		bool last;
+		if (receiver.Config.Protocol == LED_PROTOCOL_DDP)
+		{
+			if (size < (int)DDP_HEADER_SIZE || (packet[0] & 0xFE) != 0x40 || packet[2] != 0x0B || packet[3] != 1)
+			{
+				receiver.Bad++;
+				continue;
+			}
+			// Every packet of a frame has its sequence number, the frames sent count 1 to 15
+			if (!receiver.Received && packet[1] != receiver.LastSequence % 15 + 1)
+				receiver.Bad++;
+			receiver.LastSequence = packet[1];
+			offset = (size_t)packet[4] << 24 | (size_t)packet[5] << 16 | (size_t)packet[6] << 8 | packet[7];
+			length = Get16(packet + 8);
+			data = packet + DDP_HEADER_SIZE;
+			last = (packet[0] & 1) != 0;
+			if ((size_t)size != DDP_HEADER_SIZE + length)
+			{
+				receiver.Bad++;
+				continue;
+			}
+		}
+		else
+		{
+			bool drgb = packet[0] == 2;
+			size_t header = drgb ? 2 : 4;
+			if (size < (int)header || (packet[0] != 2 && packet[0] != 4) || packet[1] != receiver.Config.Timeout ||
+				drgb != (channels <= WLED_DRGB_LEDS * 3))
+			{
+				receiver.Bad++;
+				continue;
+			}
+			offset = drgb ? 0 : Get16(packet + 2) * 3;
+			length = size - header;
+			data = packet + header;
+			last = offset + length == channels;
+		}
+
+		if (offset + length > channels)
+		{
+			receiver.Bad++;
+			continue;
+		}
+		memcpy(&receiver.Frame[offset], data, length);
+		receiver.Received += length;
+		if (last)
+			Finish(receiver, now);
+	}
+	return 0;
+}
+
+//! Strips of 144 LEDs with gradients through all five colors.
+static bool Setup(size_t leds)
+{
+	const size_t STRIP = 144;
+	const int forward[] = { 0, 1, 2, 3, 4 };
+	CZoneMap& map = Output.GetMap();
+	map.Reset(leds);
+	for (size_t first = 0; first < leds; first += STRIP)
+		map.AddGradient(first, leds - first < STRIP ? leds - first : STRIP, forward, 5);
+	return Output.Reset(8);
+}
+
+int main(int argc, char** argv)
+{
+	const char* library = nullptr;
+	const char* output = "ddp-sink-bench.json";
+	size_t controllers = 4;
+	double seconds = 3.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			library = argv[++i];
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			Leds = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			controllers = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-l library] [-n leds] [-c controllers] [-d seconds_per_run] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// DDP and WLED take turns, the first two get twice the LEDs so both protocols split frames into packets
+	size_t weights = 0;
+	for (size_t i = 0; i < controllers; i++)
+		weights += (i / 2) % 2 ? 1 : 2;
+	if (!controllers || Leds < weights)
+	{
+		fprintf(stderr, "Need at least one controller and %zu LEDs\n", weights);
+		return 1;
+	}
+
+	DWORD loopback = 0;
+	CUdpSocket::ParseAddress("127.0.0.1", loopback);
+	std::vector<std::unique_ptr<RZReceiver>> receivers;
+	for (size_t i = 0, first = 0; i < controllers; i++)
+	{
+		size_t weight = (i / 2) % 2 ? 1 : 2;
+		size_t leds = i + 1 == controllers ? Leds - first : Leds * weight / weights;
+		receivers.emplace_back(new RZReceiver());
+		RZReceiver& receiver = *receivers.back();
+		if (!receiver.Socket.Open(0, loopback))
+		{
+			fprintf(stderr, "Failed to open a receiver socket\n");
+			return 1;
+		}
+		receiver.Socket.SetBuffers(0, 4 << 20);
+		receiver.Config = CDdpSink::Defaults(i % 2 ? LED_PROTOCOL_WLED : LED_PROTOCOL_DDP, loopback, first, leds);
+		receiver.Config.Port = receiver.Socket.Port();
+		receiver.Frame.assign(leds * 3, 0);
+		receiver.Latencies.reserve(MAX_SAMPLES);
+		Layout.push_back(receiver.Config);
+		first += leds;
+	}
+
+	if (!Setup(Leds))
+	{
+		fprintf(stderr, "Failed to set up the LED output\n");
+		return 1;
+	}
+	Frames.assign(FRAME_RING * Leds * 3, 0);
+	CallbackTimes.reset(new std::atomic<unsigned long long>[MAX_FRAMES]);
+
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library))
+	{
+		fprintf(stderr, "Failed to load the Chroma Broadcast library\n");
+		return 1;
+	}
+	if (!PrepareSettings(BENCH_APP_TITLE))
+	{
+		fprintf(stderr, "Failed to enable broadcast in the settings (run elevated on Windows)\n");
+		return 1;
+	}
+	CSyntheticWriter writer;
+	if (!writer.Open())
+	{
+		fprintf(stderr, "Failed to create the broadcast shared memory and event\n");
+		return 1;
+	}
+	RZRESULT result = api.InitEx(BENCH_APP_INDEX, BENCH_APP_TITLE);
+	if (result != RZRESULT_SUCCESS)
+	{
+		fprintf(stderr, "InitEx failed with %ld\n", (long)result);
+		return 1;
+	}
+	api.RegisterEventNotification(BenchCallback);
+
+	CHROMA_BROADCAST_EFFECT effect;
+	memset(&effect, 0, sizeof(effect));
+	for (int i = 0; i < 100 && !Live.load(); i++)
+	{
+		effect.CL1 = i;
+		writer.Publish(effect);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	if (!Live.load())
+	{
+		fprintf(stderr, "The reader never went LIVE, check the broadcast settings\n");
+		api.UnInit();
+		return 1;
+	}
+
+	for (auto& receiver : receivers)
+		receiver->Thread.Start(Receive, receiver.get());
+
+	struct RZRun
+	{
+		const char* Name;
+		unsigned int RateHz;
+		DWORD MaxFps;
+	};
+	const RZRun runs[] = { { "paced", 60, LED_CONTROLLER_DEFAULT_FPS }, { "overload", 240, 60 } };
+
+	printf("%zu LEDs on %zu controllers\n", Leds, controllers);
+	printf("%9s %8s %7s %9s %8s %8s %5s %9s %9s %9s\n", "run", "rate_hz", "max_fps", "published", "sent", "dropped", "bad", "p50_us", "p99_us", "max_us");
+	nlohmann::json results = nlohmann::json::array();
+	bool failed = false;
+	DWORD run = 0;
+	for (const RZRun& settings : runs)
+	{
+		for (size_t i = 0; i < Layout.size(); i++)
+		{
+			Layout[i].MaxFps = settings.MaxFps;
+			receivers[i]->Config.MaxFps = settings.MaxFps;
+			receivers[i]->Received = 0;
+			receivers[i]->LastSequence = 0;
+			receivers[i]->Complete = 0;
+			receivers[i]->Bad = 0;
+			receivers[i]->Latencies.clear();
+		}
+		std::string error;
+		if (!Sink.Open(Layout, Leds, error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			api.UnInit();
+			return 1;
+		}
+		for (DWORD i = 0; i < MAX_FRAMES; i++)
+			CallbackTimes[i].store(0, std::memory_order_relaxed);
+		Callbacks = 0;
+		CurrentRun.store(++run);
+
+		unsigned long long frames = (unsigned long long)(settings.RateHz * seconds);
+		if (frames > MAX_FRAMES - 1)
+			frames = MAX_FRAMES - 1;
+		unsigned long long period = 1000000000ULL / settings.RateHz;
+		unsigned long long start = BenchNow();
+		effect.CL2 = run;
+		for (DWORD seq = 1; seq <= frames; seq++)
+		{
+			PaceUntil(start + seq * period);
+			effect.CL1 = seq;
+			effect.CL3 = seq * 2654435761u;
+			writer.Publish(effect);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		CurrentRun.store(0);
+
+		RZLedControllerStats total;
+		memset(&total, 0, sizeof(total));
+		for (size_t i = 0; i < Layout.size(); i++)
+		{
+			RZLedControllerStats stats;
+			Sink.GetStats(i, stats);
+			total.Frames += stats.Frames;
+			total.Dropped += stats.Dropped;
+			total.Packets += stats.Packets;
+			total.Failed += stats.Failed;
+		}
+		Sink.Close();
+
+		std::vector<unsigned long long> samples;
+		unsigned long long complete = 0, bad = 0;
+		for (auto& receiver : receivers)
+		{
+			samples.insert(samples.end(), receiver->Latencies.begin(), receiver->Latencies.end());
+			complete += receiver->Complete;
+			bad += receiver->Bad;
+		}
+		double p50 = Percentile(samples, 0.50) / 1000.0;
+		double p99 = Percentile(samples, 0.99) / 1000.0;
+		double max = samples.empty() ? 0.0 : samples.back() / 1000.0;
+
+		// Every frame sent arrives whole on the loopback interface
+		bool ok = !bad && !total.Failed && complete == total.Frames && total.Frames;
+		failed = failed || !ok;
+		printf("%9s %8u %7lu %9llu %8llu %8llu %5llu %9.1f %9.1f %9.1f\n", settings.Name, settings.RateHz, (unsigned long)settings.MaxFps,
+			(unsigned long long)Callbacks, total.Frames, total.Dropped, bad, p50, p99, max);
+		fflush(stdout);
+		results.push_back({
+			{"run", settings.Name},
+			{"rate_hz", settings.RateHz},
+			{"max_fps", settings.MaxFps},
+			{"published", frames},
+			{"delivered_to_callback", (unsigned long long)Callbacks},
+			{"controller_frames_sent", total.Frames},
+			{"controller_frames_received", complete},
+			{"controller_frames_dropped", total.Dropped},
+			{"packets", total.Packets},
+			{"bad", bad},
+			{"latency_us", { {"p50", p50}, {"p99", p99}, {"max", max} }},
+		});
+	}
+
+	api.UnRegisterEventNotification();
+	api.UnInit();
+	writer.Close();
+	StopReceivers.Set();
+	for (auto& receiver : receivers)
+		receiver->Thread.Join(INFINITE);
+
+	nlohmann::json layout = nlohmann::json::array();
+	for (const RZLedController& controller : Layout)
+	{
+		layout.push_back({
+			{"protocol", controller.Protocol == LED_PROTOCOL_DDP ? "ddp" : "wled"},
+			{"first_led", controller.FirstLed},
+			{"leds", controller.Leds},
+			{"packet_gap_us", controller.PacketGap},
+		});
+	}
+	nlohmann::json report = {
+		{"benchmark", "ddp_sink"},
+		{"leds", Leds},
+		{"seconds_per_run", seconds},
+		{"controllers", layout},
+		{"results", results},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+//! \file DmxSinkBench.cpp
+//! \brief Universes per second CDmxSink sends over E1.31 and Art-Net, to a receiver on the loopback interface.
+//! The receiver first checks every packet of a run of frames sent one at a time, header, universe, sequence number,
+//! channels and sync, then counts what arrives while the sink sends flat out. Fails when a packet is wrong, a
+//! frame allocates or the socket refuses packets.
+//!
+//! Usage: dmx-sink-bench [-n leds] [-f frames] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "../src/DmxSink.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+static std::atomic<unsigned long long> Allocations(0);
+
+void* operator new(size_t size)
+{
+	Allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+//! Frames sent one at a time and checked, below 255 so sequence numbers do not wrap.
+static const unsigned long VERIFIED_FRAMES = 200;
+
+static BYTE Channel(unsigned long frame, size_t channel)
+{
+	return (BYTE)(frame * 31 + channel * 7);
+}
+
+static unsigned Get16(const BYTE* p)
+{
+	return (unsigned)p[0] << 8 | p[1];
+}
+
+struct RZReceiver
+{
+	CUdpSocket Socket;
+	CThread Thread;
+	CEvent Stop;
+	RZDmxConfig Config;
+	size_t Channels;
+	std::atomic<bool> Verify;
+	std::atomic<unsigned long long> Packets;
+	std::atomic<unsigned long long> Syncs;
+	std::atomic<unsigned long long> Bad;
+};
+
+//! Checks one packet against the frame its sequence number stands for.
+static bool Check(const RZReceiver& receiver, const BYTE* packet, int size, bool& sync)
+{
+	const RZDmxConfig& config = receiver.Config;
+	const BYTE* data;
+	size_t universe, channels;
+	unsigned long frame;
+	sync = false;
+	if (config.Protocol == DMX_PROTOCOL_E131)
+	{
+		if (size < 22 || memcmp(packet + 4, "ASC-E1.17", 10))
+			return false;
+		if (packet[21] == 0x08)
+		{
+			sync = true;
+			return size == (int)E131_SYNC_SIZE && Get16(packet + 45) == config.SyncUniverse;
+		}
+		if (size < (int)E131_HEADER_SIZE || packet[21] != 0x04 || packet[125] != 0 || Get16(packet + 109) != config.SyncUniverse)
+			return false;
+		universe = Get16(packet + 113) - config.FirstUniverse;
+		channels = Get16(packet + 123) - 1;
+		frame = packet[111] - 1;
+		data = packet + E131_HEADER_SIZE;
+		if ((size_t)size != E131_HEADER_SIZE + channels || (Get16(packet + 16) & 0x0FFF) != (unsigned)size - 16)
+			return false;
+	}
+	else
+	{
+		if (size < (int)ARTNET_SYNC_SIZE || memcmp(packet, "Art-Net", 8) || Get16(packet + 10) != 14)
+			return false;
+		if (packet[9] == 0x52)
+		{
+			sync = true;
+			return size == (int)ARTNET_SYNC_SIZE;
+		}
+		if (size < (int)ARTNET_HEADER_SIZE || packet[9] != 0x50)
+			return false;
+		universe = (packet[14] | packet[15] << 8) - config.FirstUniverse;
+		channels = Get16(packet + 16);
+		frame = packet[12] - 1;
+		data = packet + ARTNET_HEADER_SIZE;
+		if ((size_t)size != ARTNET_HEADER_SIZE + channels || channels & 1)
+			return false;
+	}
+
+	size_t first = universe * config.ChannelsPerUniverse;
+	if (first >= receiver.Channels)
+		return false;
+	size_t expected = receiver.Channels - first < config.ChannelsPerUniverse ? receiver.Channels - first : config.ChannelsPerUniverse;
+	if (channels != expected + (config.Protocol == DMX_PROTOCOL_ARTNET ? expected & 1 : 0))
+		return false;
+	for (size_t i = 0; i < expected; i++)
+	{
+		if (data[i] != Channel(frame, first + i))
+			return false;
+	}
+	return true;
+}
+
+static DWORD Receive(void* parameter)
+{
+	RZReceiver& receiver = *(RZReceiver*)parameter;
+	BYTE packet[1024];
+	while (!receiver.Stop.IsSet())
+	{
+		int size = receiver.Socket.Receive(packet, sizeof(packet), 50);
+		if (size <= 0)
+			continue;
+		bool sync = false;
+		if (receiver.Verify && !Check(receiver, packet, size, sync))
+			receiver.Bad++;
+		if (sync)
+			receiver.Syncs++;
+		receiver.Packets++;
+	}
+	return 0;
+}
+
+//! Waits until the receiver got count packets, or nothing arrived for a while.
+static void Drain(RZReceiver& receiver, unsigned long long count)
+{
+	unsigned long long last = receiver.Packets, quiet = BenchNow();
+	while (receiver.Packets < count && BenchNow() - quiet < 200000000ULL)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		if (receiver.Packets != last)
+		{
+			last = receiver.Packets;
+			quiet = BenchNow();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "dmx-sink-bench.json";
+	size_t leds = 10000;
+	unsigned long frames = 5000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			leds = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			frames = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n leds] [-f frames] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	DWORD loopback = 0;
+	CUdpSocket::ParseAddress("127.0.0.1", loopback);
+	printf("%zu LEDs, %zu channels\n", leds, leds * 3);
+	printf("%7s %9s %10s %12s %10s %9s %7s %6s %11s\n", "proto", "universes", "us_frame", "universes_s", "cpu_us_fr", "received", "sync", "check", "allocations");
+
+	nlohmann::json runs = nlohmann::json::array();
+	bool failed = false;
+	for (int protocol = DMX_PROTOCOL_E131; protocol <= DMX_PROTOCOL_ARTNET; protocol++)
+	{
+		RZReceiver receiver;
+		receiver.Verify = true;
+		receiver.Packets = 0;
+		receiver.Syncs = 0;
+		receiver.Bad = 0;
+		receiver.Channels = leds * 3;
+		if (!receiver.Socket.Open(0, loopback))
+		{
+			fprintf(stderr, "Failed to open the receiver socket\n");
+			return 1;
+		}
+		receiver.Socket.SetBuffers(0, 16 << 20);
+
+		RZDmxConfig config = CDmxSink::Defaults((DMX_PROTOCOL)protocol);
+		config.Destination = loopback;
+		config.Port = receiver.Socket.Port();
+		config.SyncUniverse = protocol == DMX_PROTOCOL_E131 ? 64000 - 1 : 1;
+		receiver.Config = config;
+
+		CDmxSink sink;
+		std::string error;
+		if (!sink.Open(config, leds * 3, error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		size_t packets = sink.Universes() + 1;
+		receiver.Thread.Start(Receive, &receiver);
+
+		// One frame at a time, each packet checked
+		for (unsigned long f = 0; f < VERIFIED_FRAMES; f++)
+		{
+			BYTE* frame = sink.Frame();
+			for (size_t c = 0; c < sink.Channels(); c++)
+				frame[c] = Channel(f, c);
+			sink.Send();
+			Drain(receiver, (f + 1) * packets);
+		}
+		bool same = !receiver.Bad && receiver.Packets == VERIFIED_FRAMES * packets && receiver.Syncs == VERIFIED_FRAMES;
+		receiver.Verify = false;
+		unsigned long long before = receiver.Packets;
+
+		// Flat out
+		sink.ResetStats();
+		unsigned long long allocations = Allocations;
+		unsigned long long start = BenchNow(), cpu0 = ThreadCpuTime();
+		for (unsigned long f = 0; f < frames; f++)
+		{
+			sink.Frame()[0] = (BYTE)f;
+			sink.Send();
+		}
+		unsigned long long cpu1 = ThreadCpuTime(), end = BenchNow();
+		allocations = Allocations - allocations;
+		Drain(receiver, before + sink.GetStats().Packets);
+		double received = sink.GetStats().Packets ? (double)(receiver.Packets - before) / sink.GetStats().Packets : 0.0;
+		receiver.Stop.Set();
+		receiver.Thread.Join(INFINITE);
+
+		bool ok = same && !allocations && !sink.GetStats().Failed;
+		failed = failed || !ok;
+		double us = frames ? (end - start) / 1e3 / frames : 0.0;
+		double cpuUs = frames ? (cpu1 - cpu0) / 1e3 / frames : 0.0;
+		double rate = us > 0 ? sink.Universes() * 1e6 / us : 0.0;
+		const char* name = protocol == DMX_PROTOCOL_E131 ? "e131" : "artnet";
+		printf("%7s %9zu %10.2f %12.0f %10.2f %8.1f%% %7s %6s %11llu\n", name, sink.Universes(), us, rate, cpuUs, received * 100,
+			config.SyncUniverse ? "yes" : "no", same ? "ok" : "BAD", allocations);
+		runs.push_back({
+			{"protocol", name},
+			{"universes", sink.Universes()},
+			{"us_per_frame", us},
+			{"universes_per_second", rate},
+			{"cpu_us_per_frame", cpuUs},
+			{"bytes_per_frame", frames ? sink.GetStats().Bytes / frames : 0},
+			{"received_share", received},
+			{"packets_checked", VERIFIED_FRAMES * packets},
+			{"packets_correct", same},
+			{"send_failures", sink.GetStats().Failed},
+			{"allocations", allocations},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "dmx_sink"},
+		{"leds", leds},
+		{"channels", leds * 3},
+		{"frames", frames},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+//! \file EffectCodecBench.cpp
+//! \brief Frames per second one core encodes and decodes with the effect codec, and the bytes a frame takes against
+//! the 28 of an app index and a raw CHROMA_BROADCAST_EFFECT, for streams that mostly hold still, fade smoothly, jump
+//! at random and switch apps. Checks every frame decodes to the frame encoded, that neither side allocates, and that
+//! a decoder losing 1% of the frames shows none wrong and is back on the next keyframe.
+//!
+//! Usage: effect-codec-bench [-n frames] [-p passes] [-k keyframe_interval] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "../src/EffectCodec.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static std::atomic<unsigned long long> Allocations(0);
+
+void* operator new(size_t size)
+{
+	Allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+static const size_t RAW_BYTES = sizeof(RZID) + sizeof(CHROMA_BROADCAST_EFFECT);
+//! Frames out of 10000 the lossy decoder never sees.
+static const DWORD LOSS_PER_10000 = 100;
+
+enum STREAM_KIND
+{
+	STREAM_STATIC,
+	STREAM_FADE,
+	STREAM_RANDOM,
+	STREAM_APPS,
+	STREAM_KINDS,
+};
+
+static const char* KindName(DWORD kind)
+{
+	static const char* const names[STREAM_KINDS] = { "static", "fade", "random", "apps" };
+	return names[kind];
+}
+
+static DWORD Random(DWORD& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static BYTE Triangle(DWORD t)
+{
+	t %= 510;
+	return (BYTE)(t < 256 ? t : 510 - t);
+}
+
+//! Static: one color changes every 30 frames. Fade: every color breathes a few levels a frame. Random: every color
+//! jumps each frame. Apps: a fading effect whose app changes every 200 frames and flips IsAppSpecific with it.
+static void Generate(DWORD kind, std::vector<RZEventData>& frames)
+{
+	DWORD state = 0x9E3779B9 + kind;
+	DWORD colors[EFFECT_COLORS] = { 0xFF0000, 0x00FF00, 0x0000FF, 0xFFFFFF, 0x202020 };
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		DWORD t = (DWORD)i;
+		switch (kind)
+		{
+		case STREAM_STATIC:
+			if (i % 30 == 29)
+				colors[i / 30 % EFFECT_COLORS] = Random(state) & 0xFFFFFF;
+			break;
+		case STREAM_FADE:
+		case STREAM_APPS:
+			for (DWORD c = 0; c < EFFECT_COLORS; c++)
+				colors[c] = Triangle(t * (c + 1)) | (DWORD)Triangle(t * 2 + c * 60) << 8 | (DWORD)Triangle(t * 3 + c * 90) << 16;
+			break;
+		default:
+			for (DWORD c = 0; c < EFFECT_COLORS; c++)
+				colors[c] = Random(state) & 0xFFFFFF;
+			break;
+		}
+
+		RZEventData& frame = frames[i];
+		memset(&frame, 0, sizeof(frame));
+		frame.index = kind == STREAM_APPS ? 1000 + (DWORD)(i / 200 % 7) * 331 : 4244;
+		frame.effect.CL1 = colors[0];
+		frame.effect.CL2 = colors[1];
+		frame.effect.CL3 = colors[2];
+		frame.effect.CL4 = colors[3];
+		frame.effect.CL5 = colors[4];
+		frame.effect.IsAppSpecific = kind == STREAM_APPS && i / 200 % 2 ? TRUE : FALSE;
+	}
+}
+
+static bool SameFrame(const RZEventData& a, const RZEventData& b)
+{
+	return a.index == b.index && !memcmp(&a.effect, &b.effect, sizeof(a.effect));
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "effect-codec-bench.json";
+	size_t count = 100000;
+	DWORD passes = 20;
+	DWORD interval = EFFECT_DEFAULT_KEYFRAME_INTERVAL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			passes = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+			interval = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n frames] [-p passes] [-k keyframe_interval] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!count || !passes || !interval)
+	{
+		fprintf(stderr, "The frames, passes and keyframe interval have to be above 0\n");
+		return 1;
+	}
+
+	std::vector<RZEventData> frames(count);
+	std::vector<BYTE> encoded(count * EFFECT_MAX_ENCODED);
+	std::vector<size_t> offsets(count + 1);
+	bool failed = false;
+
+	printf("%zu frames, %lu passes, a keyframe every %lu frames, %zu raw bytes a frame\n", count, (unsigned long)passes,
+		(unsigned long)interval, RAW_BYTES);
+	printf("%8s %12s %12s %9s %7s %6s %7s %8s %7s %6s\n", "stream", "enc_fps", "dec_fps", "bytes_fr", "ratio", "allocs", "exact",
+		"dropped", "resync", "check");
+	nlohmann::json runs = nlohmann::json::array();
+
+	for (DWORD kind = 0; kind < STREAM_KINDS; kind++)
+	{
+		Generate(kind, frames);
+		CEffectEncoder encoder(interval);
+		CEffectDecoder decoder;
+		RZEventData decoded;
+
+		unsigned long long allocations = Allocations;
+		unsigned long long cpu0 = ThreadCpuTime();
+		for (DWORD pass = 0; pass < passes; pass++)
+		{
+			encoder.Reset(interval);
+			size_t at = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				offsets[i] = at;
+				at += encoder.Encode(frames[i], encoded.data() + at);
+			}
+			offsets[count] = at;
+		}
+		unsigned long long cpu1 = ThreadCpuTime();
+
+		size_t mismatches = 0;
+		for (DWORD pass = 0; pass < passes; pass++)
+		{
+			decoder.Reset();
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t used = 0;
+				if (decoder.Decode(encoded.data() + offsets[i], offsets[i + 1] - offsets[i], decoded, &used) != EFFECT_DECODE_FRAME ||
+					used != offsets[i + 1] - offsets[i] || !SameFrame(decoded, frames[i]))
+					mismatches++;
+			}
+		}
+		unsigned long long cpu2 = ThreadCpuTime();
+
+		// Drops 1% of the frames at random, never the last, the decoder must show only right frames and be back at the
+		// first keyframe after each loss
+		DWORD state = 12345 + kind;
+		CEffectDecoder lossy;
+		unsigned long long lost = 0, wrong = 0, late = 0;
+		size_t lossAt = 0;
+		bool recovering = false;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (i + 1 < count && Random(state) % 10000 < LOSS_PER_10000)
+			{
+				lost++;
+				lossAt = i;
+				recovering = true;
+				continue;
+			}
+			EFFECT_DECODE result = lossy.Decode(encoded.data() + offsets[i], offsets[i + 1] - offsets[i], decoded);
+			if (result == EFFECT_DECODE_FRAME)
+			{
+				if (!SameFrame(decoded, frames[i]))
+					wrong++;
+				// The first keyframe is at most interval frames after the last frame lost
+				if (recovering && i - lossAt > interval)
+					late++;
+				recovering = false;
+			}
+			else if (result == EFFECT_DECODE_INVALID || !recovering)
+				wrong++;
+		}
+		allocations = Allocations - allocations;
+
+		const RZEffectCodecStats& encoderStats = encoder.GetStats();
+		const RZEffectCodecStats& lossyStats = lossy.GetStats();
+		double encodeRate = cpu1 > cpu0 ? (double)count * passes / ((cpu1 - cpu0) / 1e9) : 0.0;
+		double decodeRate = cpu2 > cpu1 ? (double)count * passes / ((cpu2 - cpu1) / 1e9) : 0.0;
+		double bytes = (double)offsets[count] / count;
+		bool exact = !mismatches;
+		bool ok = exact && !allocations && !wrong && !late && lossyStats.Lost == lost;
+		failed = failed || !ok;
+
+		printf("%8s %12.0f %12.0f %9.2f %6.1fx %6llu %7s %8llu %7s %6s\n", KindName(kind), encodeRate, decodeRate, bytes,
+			RAW_BYTES / bytes, allocations, exact ? "yes" : "NO", lossyStats.Dropped, late ? "LATE" : "ok", ok ? "ok" : "BAD");
+		runs.push_back({
+			{"stream", KindName(kind)},
+			{"encode_frames_per_second_per_core", encodeRate},
+			{"decode_frames_per_second_per_core", decodeRate},
+			{"bytes_per_frame", bytes},
+			{"raw_bytes_per_frame", RAW_BYTES},
+			{"compression_ratio", RAW_BYTES / bytes},
+			{"keyframes", encoderStats.Keyframes},
+			{"allocations", allocations},
+			{"round_trip_exact", exact},
+			{"lossy_frames_lost", lost},
+			{"lossy_lost_counted", lossyStats.Lost},
+			{"lossy_frames_dropped", lossyStats.Dropped},
+			{"lossy_wrong_frames", wrong},
+			{"lossy_late_recoveries", late},
+			{"ok", ok},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "effect_codec"},
+		{"frames", count},
+		{"passes", passes},
+		{"keyframe_interval", interval},
+		{"loss_percent", LOSS_PER_10000 / 100.0},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+//! \file FramePacerBench.cpp
+//! \brief Feeds the frame pacer streams on a simulated clock: steady at 144 Hz, delayed 0 to 6 ms at random by the
+//! writer's scheduling with a tenth of the frames up to 12 ms late, the same with the reader stalling 1.5 s every
+//! 5 s, and 60 Hz switching to 144 Hz. Compares how far the intervals between frames stray from those they were
+//! written at before and after the pacer, and reports the latency it adds and the CPU a frame costs. Fails on a
+//! frame lost or reordered, an allocation, a latency over the maximum delay, or paced intervals straying further
+//! than the limit at the 99th percentile.
+//!
+//! Usage: frame-pacer-bench [-n frames] [-d min_delay_us] [-m max_delay_us] [-j max_p99_interval_error_us] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "../src/FramePacer.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static std::atomic<unsigned long long> Allocations(0);
+
+void* operator new(size_t size)
+{
+	Allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+enum STREAM_KIND
+{
+	STREAM_STEADY,
+	STREAM_BURSTY,
+	STREAM_STALLS,
+	STREAM_RATE_CHANGE,
+	STREAM_KINDS,
+};
+
+static const char* KindName(DWORD kind)
+{
+	static const char* const names[STREAM_KINDS] = { "steady", "bursty", "stalls", "rate_change" };
+	return names[kind];
+}
+
+static DWORD Random(DWORD& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+//! Time each frame was written and reached the reader, in nanoseconds. Frames written during a stall are
+//! overwritten in the Synapse ring before the reader is back, they never arrive.
+static void Generate(DWORD kind, size_t count, std::vector<unsigned long long>& written, std::vector<unsigned long long>& arrived)
+{
+	DWORD state = 0x2545F491 + kind;
+	const unsigned long long start = 1000000000ULL;
+	const unsigned long long stall = 1500000000ULL, stallEvery = 5000000000ULL;
+	written.clear();
+	arrived.clear();
+	unsigned long long at = start, last = 0;
+	for (size_t i = 0; written.size() < count; i++)
+	{
+		unsigned long long period = kind == STREAM_RATE_CHANGE && i < count / 2 ? 16666667ULL : 6944444ULL;
+		at += period;
+		unsigned long long delay = 0;
+		switch (kind)
+		{
+		case STREAM_STEADY:
+			delay = Random(state) % 300000;
+			break;
+		case STREAM_RATE_CHANGE:
+			delay = Random(state) % 2000000;
+			break;
+		default:
+			delay = Random(state) % 6000000;
+			if (Random(state) % 10 == 0)
+				delay = 6000000 + Random(state) % 6000000;
+			break;
+		}
+		if (kind == STREAM_STALLS && (at - start) % stallEvery > stallEvery - stall)
+			continue;
+		// The reader gets frames in the order they were written, a late one holds back those after it
+		last = std::max(last, at + delay);
+		written.push_back(at);
+		arrived.push_back(last);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "frame-pacer-bench.json";
+	size_t count = 50000;
+	RZFramePacerConfig config = CFramePacer::Defaults();
+	double maxError = 1000.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			config.MinDelay = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			config.MaxDelay = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			maxError = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n frames] [-d min_delay_us] [-m max_delay_us] [-j max_p99_interval_error_us] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (count < 1000 || config.MaxDelay < config.MinDelay)
+	{
+		fprintf(stderr, "The bench needs 1000 frames or more, and a maximum delay no lower than the minimum\n");
+		return 1;
+	}
+
+	std::vector<unsigned long long> written, arrived, played(count), inErrors, outErrors, latencies;
+	written.reserve(count);
+	arrived.reserve(count);
+	inErrors.reserve(count);
+	outErrors.reserve(count);
+	latencies.reserve(count);
+	std::vector<DWORD> order(count);
+	CFramePacer pacer;
+	bool failed = false;
+
+	printf("%zu frames a stream, %lu to %lu us of delay\n", count, (unsigned long)config.MinDelay, (unsigned long)config.MaxDelay);
+	printf("%12s %9s %9s %7s %9s %9s %9s %9s %7s %6s %6s %6s %6s\n", "stream", "in_p99_us", "out_p99_us", "gain", "lat_p50", "lat_p99",
+		"delay_us", "ns_frame", "underrun", "resets", "rates", "allocs", "check");
+	nlohmann::json runs = nlohmann::json::array();
+
+	for (DWORD kind = 0; kind < STREAM_KINDS; kind++)
+	{
+		Generate(kind, count, written, arrived);
+		pacer.Configure(config);
+
+		// Pops each frame at its slot exactly, as a reader woken on time would
+		unsigned long long allocations = Allocations;
+		unsigned long long cpu0 = ThreadCpuTime();
+		size_t in = 0, out = 0;
+		RZEventData frame;
+		memset(&frame, 0, sizeof(frame));
+		while (out < count && (in < count || pacer.Buffered()))
+		{
+			unsigned long long due = pacer.NextDue();
+			if (in < count && (!due || arrived[in] < due))
+			{
+				frame.effect.CL1 = (RZCOLOR)in;
+				pacer.Push(frame, arrived[in]);
+				in++;
+				continue;
+			}
+			while (out < count && pacer.Pop(due, frame))
+			{
+				order[out] = frame.effect.CL1;
+				played[out++] = due;
+			}
+		}
+		unsigned long long cpu1 = ThreadCpuTime();
+		allocations = Allocations - allocations;
+		RZFramePacerStats stats;
+		pacer.GetStats(stats);
+
+		// Intervals are compared with those the frames were written at, the ones across a stall are left out
+		inErrors.clear();
+		outErrors.clear();
+		latencies.clear();
+		unsigned long long reordered = 0, latencyMax = 0;
+		for (size_t i = 0; i < out; i++)
+		{
+			DWORD id = order[i];
+			if (i && id <= order[i - 1])
+				reordered++;
+			unsigned long long latency = played[i] - arrived[id];
+			latencies.push_back(latency);
+			latencyMax = std::max(latencyMax, latency);
+			if (!i || id != order[i - 1] + 1 || written[id] - written[id - 1] > 20000000ULL)
+				continue;
+			long long expected = (long long)(written[id] - written[id - 1]);
+			long long before = (long long)(arrived[id] - arrived[id - 1]) - expected;
+			long long after = (long long)(played[i] - played[i - 1]) - expected;
+			inErrors.push_back((unsigned long long)(before < 0 ? -before : before));
+			outErrors.push_back((unsigned long long)(after < 0 ? -after : after));
+		}
+
+		unsigned long long lost = count - out;
+		double inP99 = Percentile(inErrors, 0.99) / 1e3, outP99 = Percentile(outErrors, 0.99) / 1e3;
+		double lat50 = Percentile(latencies, 0.50) / 1e3, lat99 = Percentile(latencies, 0.99) / 1e3;
+		double cost = (double)(cpu1 - cpu0) / count;
+		bool ok = !lost && !reordered && !allocations && !stats.Overflows && outP99 <= maxError && latencyMax <= config.MaxDelay * 1000ULL;
+		failed = failed || !ok;
+
+		printf("%12s %9.1f %9.1f %6.1fx %9.1f %9.1f %9lu %9.1f %7llu %6llu %6llu %6llu %6s\n", KindName(kind), inP99, outP99,
+			outP99 > 0 ? inP99 / outP99 : 0.0, lat50, lat99, (unsigned long)stats.Delay, cost, stats.Underruns, stats.Resets,
+			stats.RateChanges, allocations, ok ? "ok" : "BAD");
+		runs.push_back({
+			{"stream", KindName(kind)},
+			{"input_interval_error_p99_us", inP99},
+			{"paced_interval_error_p99_us", outP99},
+			{"latency_p50_us", lat50},
+			{"latency_p99_us", lat99},
+			{"latency_max_us", latencyMax / 1e3},
+			{"final_delay_us", stats.Delay},
+			{"interval_us", stats.Interval},
+			{"jitter_p99_us", stats.Jitter},
+			{"cpu_ns_per_frame", cost},
+			{"underruns", stats.Underruns},
+			{"overflows", stats.Overflows},
+			{"resets", stats.Resets},
+			{"rate_changes", stats.RateChanges},
+			{"lost", lost},
+			{"reordered", reordered},
+			{"allocations", allocations},
+			{"ok", ok},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "frame_pacer"},
+		{"frames", count},
+		{"min_delay_us", config.MinDelay},
+		{"max_delay_us", config.MaxDelay},
+		{"max_p99_interval_error_us", maxError},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+//! \file InitUnInitBench.cpp
+//! \brief Cost of InitEx and UnInit in a tight loop, with the reader busy on a live ring or idle.
+//!
+//! Usage: init-uninit-bench [-l library] [-n iterations] [-i] [-o results.json]
+//!   -i  idle: no synthetic writer, the broadcast thread stays in its first wait
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <RzErrors.h>
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+#include "SyntheticWriter.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const int BENCH_APP_INDEX = 4243;
+static const char BENCH_APP_TITLE[] = "ChromaBroadcastInitBench";
+
+static RZRESULT BenchCallback(CHROMA_BROADCAST_TYPE type, PRZPARAM pData)
+{
+	return RZRESULT_SUCCESS;
+}
+
+static nlohmann::json Summary(std::vector<unsigned long long>& samples)
+{
+	return {
+		{"p50", Percentile(samples, 0.50) / 1000.0},
+		{"p99", Percentile(samples, 0.99) / 1000.0},
+		{"p99_9", Percentile(samples, 0.999) / 1000.0},
+		{"max", samples.empty() ? 0.0 : samples.back() / 1000.0},
+	};
+}
+
+int main(int argc, char** argv)
+{
+	const char* library = nullptr;
+	const char* output = "init-uninit-bench.json";
+	unsigned int iterations = 10000;
+	bool idle = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			library = argv[++i];
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-i"))
+			idle = true;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-l library] [-n iterations] [-i] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library))
+	{
+		fprintf(stderr, "Failed to load the Chroma Broadcast library\n");
+		return 1;
+	}
+
+	if (!PrepareSettings(BENCH_APP_TITLE))
+	{
+		fprintf(stderr, "Failed to enable broadcast in the settings (run elevated on Windows)\n");
+		return 1;
+	}
+
+	// A live ring keeps the broadcast thread inside its read loop, the case UnInit used to time out on
+	CSyntheticWriter writer;
+	std::atomic<bool> stop(false);
+	std::thread publisher;
+	if (!idle)
+	{
+		if (!writer.Open())
+		{
+			fprintf(stderr, "Failed to create the broadcast shared memory and event\n");
+			return 1;
+		}
+		publisher = std::thread([&]()
+		{
+			CHROMA_BROADCAST_EFFECT effect;
+			memset(&effect, 0, sizeof(effect));
+			for (DWORD seq = 0; !stop.load(std::memory_order_relaxed); seq++)
+			{
+				effect.CL1 = seq;
+				writer.Publish(effect);
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			}
+		});
+	}
+
+	std::vector<unsigned long long> initTimes, uninitTimes;
+	initTimes.reserve(iterations);
+	uninitTimes.reserve(iterations);
+	unsigned int failures = 0;
+
+	unsigned long long start = BenchNow();
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		unsigned long long t0 = BenchNow();
+		RZRESULT result = api.InitEx(BENCH_APP_INDEX, BENCH_APP_TITLE);
+		unsigned long long t1 = BenchNow();
+		if (result != RZRESULT_SUCCESS)
+			failures++;
+		api.RegisterEventNotification(BenchCallback);
+
+		unsigned long long t2 = BenchNow();
+		api.UnInit();
+		unsigned long long t3 = BenchNow();
+
+		initTimes.push_back(t1 - t0);
+		uninitTimes.push_back(t3 - t2);
+	}
+	double wall = (BenchNow() - start) / 1e9;
+
+	stop.store(true);
+	if (publisher.joinable())
+		publisher.join();
+	writer.Close();
+
+	nlohmann::json init = Summary(initTimes);
+	nlohmann::json uninit = Summary(uninitTimes);
+	printf("%u iterations in %.2f s, %u InitEx failures\n", iterations, wall, failures);
+	printf("%-8s %9s %9s %9s %9s\n", "call", "p50_us", "p99_us", "p99.9_us", "max_us");
+	printf("%-8s %9.1f %9.1f %9.1f %9.1f\n", "InitEx", init["p50"].get<double>(), init["p99"].get<double>(), init["p99_9"].get<double>(), init["max"].get<double>());
+	printf("%-8s %9.1f %9.1f %9.1f %9.1f\n", "UnInit", uninit["p50"].get<double>(), uninit["p99"].get<double>(), uninit["p99_9"].get<double>(), uninit["max"].get<double>());
+
+	nlohmann::json report = {
+		{"benchmark", "init_uninit"},
+		{"iterations", iterations},
+		{"idle", idle},
+		{"seconds", wall},
+		{"init_failures", failures},
+		{"init_us", init},
+		{"uninit_us", uninit},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+//! \file InterpolateBench.cpp
+//! \brief Frames the interpolation stage generates per second on one core, for each curve, sampled as linear light
+//! floats and converted back to RZCOLOR. Effects arrive at 30 Hz and the output clock ticks at 240 Hz, so most
+//! frames are blends. Also checks that a color survives the trip through linear light unchanged.
+//!
+//! Usage: interpolate-bench [-n frames] [-r output_hz] [-i input_hz] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/Interpolator.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const char* CurveName(INTERPOLATION_CURVE curve)
+{
+	switch (curve)
+	{
+	case INTERPOLATION_STEP:
+		return "step";
+	case INTERPOLATION_LINEAR:
+		return "linear";
+	case INTERPOLATION_EASE_OUT:
+		return "ease_out";
+	default:
+		return "ease_in_out";
+	}
+}
+
+//! Every 8-bit value of every channel must come back from linear light as it went in.
+static bool CheckRoundTrip()
+{
+	for (DWORD v = 0; v < 256; v++)
+	{
+		CHROMA_BROADCAST_EFFECT effect = { v, v << 8, v << 16, v << 24, v | (v << 8) | (v << 16), FALSE };
+		RZLinearEffect linear;
+		CHROMA_BROADCAST_EFFECT back;
+		CEffectInterpolator::ToLinear(effect, linear);
+		CEffectInterpolator::FromLinear(linear, back);
+		if (memcmp(&effect, &back, sizeof(effect)))
+		{
+			fprintf(stderr, "%lu does not survive linear light\n", (unsigned long)v);
+			return false;
+		}
+	}
+	return true;
+}
+
+static CHROMA_BROADCAST_EFFECT InputEffect(unsigned long i)
+{
+	DWORD level = (DWORD)(i * 37 % 256);
+	CHROMA_BROADCAST_EFFECT effect = { level, level << 8, level << 16, (255 - level) * 0x010101, 0xFF000000 | (i & 1 ? 0xFFFFFF : 0), FALSE };
+	return effect;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "interpolate-bench.json";
+	unsigned long frames = 4000000;
+	DWORD outputHz = 240;
+	DWORD inputHz = 30;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			frames = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			outputHz = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			inputHz = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n frames] [-r output_hz] [-i input_hz] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!outputHz || !inputHz)
+	{
+		fprintf(stderr, "Rates must not be 0\n");
+		return 1;
+	}
+
+	bool roundTrip = CheckRoundTrip();
+	printf("%lu frames at %lu Hz from effects at %lu Hz, round trip %s\n", frames, (unsigned long)outputHz, (unsigned long)inputHz, roundTrip ? "exact" : "FAILED");
+	printf("%12s %8s %14s %10s\n", "curve", "output", "frames_per_s", "ns_frame");
+
+	const INTERPOLATION_CURVE curves[] = { INTERPOLATION_STEP, INTERPOLATION_LINEAR, INTERPOLATION_EASE_OUT, INTERPOLATION_EASE_IN_OUT };
+	const unsigned long long inputPeriod = 1000000000ULL / inputHz;
+	nlohmann::json runs = nlohmann::json::array();
+	volatile float sink = 0;
+
+	for (INTERPOLATION_CURVE curve : curves)
+	{
+		for (int rgb = 0; rgb < 2; rgb++)
+		{
+			CEffectInterpolator interpolator;
+			interpolator.SetCurve(curve);
+			CFrameClock clock;
+			clock.Start(outputHz, 0);
+
+			unsigned long pushed = 0;
+			unsigned long long skipped = 0;
+			RZLinearEffect linear;
+			CHROMA_BROADCAST_EFFECT effect;
+			unsigned long long cpu0 = ThreadCpuTime();
+			for (unsigned long i = 0; i < frames; i++)
+			{
+				unsigned long long tick = clock.Next(0, skipped);
+				while ((unsigned long long)pushed * inputPeriod <= tick)
+				{
+					interpolator.Push(InputEffect(pushed), (unsigned long long)pushed * inputPeriod);
+					pushed++;
+				}
+				if (rgb)
+				{
+					interpolator.Render(tick, effect);
+					sink = sink + (float)(effect.CL3 & 0xFF);
+				}
+				else
+				{
+					interpolator.Render(tick, linear);
+					sink = sink + linear.B[2];
+				}
+			}
+			unsigned long long cpu1 = ThreadCpuTime();
+
+			double seconds = (cpu1 - cpu0) / 1e9;
+			double rate = seconds > 0 ? frames / seconds : 0.0;
+			const char* format = rgb ? "rzcolor" : "linear";
+			printf("%12s %8s %14.0f %10.1f\n", CurveName(curve), format, rate, frames ? (cpu1 - cpu0) / (double)frames : 0.0);
+			runs.push_back({
+				{"curve", CurveName(curve)},
+				{"output", format},
+				{"frames_per_second_per_core", rate},
+				{"ns_per_frame", frames ? (cpu1 - cpu0) / (double)frames : 0.0},
+			});
+		}
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "interpolate"},
+		{"frames", frames},
+		{"output_hz", outputHz},
+		{"input_hz", inputHz},
+		{"round_trip_exact", roundTrip},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return roundTrip ? 0 : 1;
+}
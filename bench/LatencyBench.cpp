@@ -0,0 +1,218 @@
+//! \file LatencyBench.cpp
+//! \brief Writer to callback latency and CPU cost of the broadcast reader across publish rates.
+//!
+//! Usage: latency-bench [-l library] [-d seconds_per_rate] [-r rate_hz]... [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <RzErrors.h>
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+#include "SyntheticWriter.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const int BENCH_APP_INDEX = 4242;
+static const char BENCH_APP_TITLE[] = "ChromaBroadcastBench";
+
+// Frames carry their sequence number in CL1 and the run id in CL2
+static const DWORD MAX_FRAMES = 0x1000000;
+
+static std::unique_ptr<std::atomic<unsigned long long>[]> SendTimes;
+static std::unique_ptr<unsigned long long[]> Latencies;
+static std::atomic<size_t> LatencyCount(0);
+static std::atomic<DWORD> CurrentRun(0);
+static std::atomic<bool> Live(false);
+
+static RZRESULT BenchCallback(CHROMA_BROADCAST_TYPE type, PRZPARAM pData)
+{
+	unsigned long long now = BenchNow();
+	if (type == BROADCAST_STATUS)
+	{
+		Live.store((CHROMA_BROADCAST_STATUS)(size_t)pData == LIVE);
+		return RZRESULT_SUCCESS;
+	}
+
+	const CHROMA_BROADCAST_EFFECT* effect = (const CHROMA_BROADCAST_EFFECT*)pData;
+	if (effect->CL2 != CurrentRun.load(std::memory_order_relaxed))
+		return RZRESULT_SUCCESS;
+
+	DWORD seq = effect->CL1 & (MAX_FRAMES - 1);
+	unsigned long long sent = SendTimes[seq].load(std::memory_order_acquire);
+	size_t n = LatencyCount.load(std::memory_order_relaxed);
+	if (sent && n < MAX_FRAMES)
+	{
+		Latencies[n] = now - sent;
+		LatencyCount.store(n + 1, std::memory_order_release);
+	}
+	return RZRESULT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	const char* library = nullptr;
+	const char* output = "latency-bench.json";
+	double seconds = 5.0;
+	std::vector<unsigned int> rates;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			library = argv[++i];
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rates.push_back((unsigned int)strtoul(argv[++i], NULL, 10));
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-l library] [-d seconds_per_rate] [-r rate_hz]... [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (rates.empty())
+		rates = { 10, 60, 240, 1000, 2500, 10000 };
+
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library))
+	{
+		fprintf(stderr, "Failed to load the Chroma Broadcast library\n");
+		return 1;
+	}
+
+	if (!PrepareSettings(BENCH_APP_TITLE))
+	{
+		fprintf(stderr, "Failed to enable broadcast in the settings (run elevated on Windows)\n");
+		return 1;
+	}
+
+	CSyntheticWriter writer;
+	if (!writer.Open())
+	{
+		fprintf(stderr, "Failed to create the broadcast shared memory and event\n");
+		return 1;
+	}
+
+	SendTimes.reset(new std::atomic<unsigned long long>[MAX_FRAMES]);
+	Latencies.reset(new unsigned long long[MAX_FRAMES]);
+
+	RZRESULT result = api.InitEx(BENCH_APP_INDEX, BENCH_APP_TITLE);
+	if (result != RZRESULT_SUCCESS)
+	{
+		fprintf(stderr, "InitEx failed with %ld\n", (long)result);
+		return 1;
+	}
+	api.RegisterEventNotification(BenchCallback);
+
+	// Warm up until the reader passed its health check and reported LIVE
+	CHROMA_BROADCAST_EFFECT effect;
+	memset(&effect, 0, sizeof(effect));
+	for (int i = 0; i < 100 && !Live.load(); i++)
+	{
+		effect.CL1 = i;
+		writer.Publish(effect);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	if (!Live.load())
+	{
+		fprintf(stderr, "The reader never went LIVE, check the broadcast settings\n");
+		api.UnInit();
+		return 1;
+	}
+
+	nlohmann::json results = nlohmann::json::array();
+	printf("%8s %9s %9s %9s %9s %9s %9s %9s %8s\n", "rate_hz", "published", "delivered", "p50_us", "p99_us", "p99.9_us", "max_us", "cpu_%", "reader_%");
+
+	DWORD run = 0;
+	for (unsigned int rate : rates)
+	{
+		if (!rate)
+			continue;
+
+		unsigned long long frames = (unsigned long long)(rate * seconds);
+		if (frames > MAX_FRAMES - 1)
+			frames = MAX_FRAMES - 1;
+
+		CurrentRun.store(++run);
+		for (DWORD i = 0; i < MAX_FRAMES; i++)
+			SendTimes[i].store(0, std::memory_order_relaxed);
+		LatencyCount.store(0);
+
+		unsigned long long period = 1000000000ULL / rate;
+		unsigned long long start = BenchNow();
+		unsigned long long processCpu = ProcessCpuTime();
+		unsigned long long writerCpu = ThreadCpuTime();
+
+		effect.CL2 = run;
+		for (DWORD seq = 1; seq <= frames; seq++)
+		{
+			PaceUntil(start + seq * period);
+			effect.CL1 = seq;
+			effect.CL3 = seq * 2654435761u;
+			SendTimes[seq].store(BenchNow(), std::memory_order_release);
+			writer.Publish(effect);
+		}
+
+		// Let the reader drain the last frame
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		unsigned long long wall = BenchNow() - start;
+		unsigned long long cpu = ProcessCpuTime() - processCpu;
+		unsigned long long writerUsed = ThreadCpuTime() - writerCpu;
+		CurrentRun.store(0);
+
+		size_t count = LatencyCount.load(std::memory_order_acquire);
+		std::vector<unsigned long long> samples(Latencies.get(), Latencies.get() + count);
+		double p50 = Percentile(samples, 0.50) / 1000.0;
+		double p99 = Percentile(samples, 0.99) / 1000.0;
+		double p999 = Percentile(samples, 0.999) / 1000.0;
+		double max = samples.empty() ? 0.0 : samples.back() / 1000.0;
+		double cpuPercent = 100.0 * cpu / wall;
+		double readerPercent = 100.0 * (cpu > writerUsed ? cpu - writerUsed : 0) / wall;
+
+		printf("%8u %9llu %9zu %9.1f %9.1f %9.1f %9.1f %9.1f %8.1f\n", rate, frames, count, p50, p99, p999, max, cpuPercent, readerPercent);
+		fflush(stdout);
+
+		results.push_back({
+			{"rate_hz", rate},
+			{"published", frames},
+			{"delivered", count},
+			{"latency_us", { {"p50", p50}, {"p99", p99}, {"p99_9", p999}, {"max", max} }},
+			{"cpu_percent", cpuPercent},
+			{"reader_cpu_percent", readerPercent},
+		});
+	}
+
+	CHROMA_BROADCAST_METRICS metrics;
+	api.GetMetrics(&metrics);
+	api.UnRegisterEventNotification();
+	api.UnInit();
+	writer.Close();
+
+	nlohmann::json report = {
+		{"benchmark", "latency"},
+		{"seconds_per_rate", seconds},
+		{"results", results},
+		{"metrics", {
+			{"frames_read", metrics.FramesRead},
+			{"frames_delivered", metrics.FramesDelivered},
+			{"frames_deduped", metrics.FramesDeduped},
+			{"frames_dropped", metrics.FramesDropped},
+			{"health_checks", metrics.HealthChecks},
+		}},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,217 @@
+//! \file LedOutputBench.cpp
+//! \brief Frames per second one core takes through the 16-bit LED path, zone map, correction and temporal dithering
+//! to GRB bytes, for each supported instruction set, and the share of a core it needs at the refresh rate. Checks
+//! every level writes the same bytes as the scalar kernels frame after frame, that a frame allocates nothing, and
+//! how close the average of the dithered levels comes to low duties, against rounding them.
+//!
+//! Usage: led-output-bench [-n leds] [-b bits] [-r refresh_hz] [-f frames] [-o results.json]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "../src/LedOutput.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static std::atomic<unsigned long long> Allocations(0);
+
+void* operator new(size_t size)
+{
+	Allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+//! Strips of 144 LEDs with gradients through all five colors, every third one reversed, and an output with warm
+//! white balance, dimmed and current limited.
+static bool Setup(CLedOutput& output, size_t leds, int bits)
+{
+	const size_t STRIP = 144;
+	const int forward[] = { 0, 1, 2, 3, 4 };
+	const int reverse[] = { 4, 3, 2, 1, 0 };
+	CZoneMap& map = output.GetMap();
+	map.Reset(leds);
+	for (size_t first = 0, strip = 0; first < leds; first += STRIP, strip++)
+		map.AddGradient(first, leds - first < STRIP ? leds - first : STRIP, strip % 3 == 2 ? reverse : forward, 5);
+
+	RZCorrection config = { 1.0f, { 1.0f, 0.85f, 0.7f }, 0.8f, 0.6f };
+	output.GetCorrection().Configure(config);
+	return output.Reset(bits);
+}
+
+static CHROMA_BROADCAST_EFFECT InputEffect(unsigned long i)
+{
+	DWORD level = (DWORD)(i * 37 % 256);
+	CHROMA_BROADCAST_EFFECT effect = { level, level << 8, level << 16, (255 - level) * 0x010101, 0x00FFFFFF ^ (level * 0x010101), FALSE };
+	return effect;
+}
+
+//! Largest difference, in levels, between the average level over frames and the duty of LEDs held at duties 0 to
+//! 1023, the dark end where 8-bit steps band.
+static double MeanError(int bits, bool dither, unsigned long frames)
+{
+	const size_t leds = 1024;
+	std::vector<WORD> duties(3 * leds), levels(3 * leds);
+	std::vector<double> sums(leds, 0.0);
+	for (size_t i = 0; i < leds; i++)
+		duties[i] = duties[leds + i] = duties[2 * leds + i] = (WORD)i;
+
+	CTemporalDither stage;
+	stage.Reset(leds, bits);
+	stage.SetEnabled(dither);
+	RZLedPlanes16 in = { duties.data(), duties.data() + leds, duties.data() + 2 * leds };
+	RZLedPlanes16 out = { levels.data(), levels.data() + leds, levels.data() + 2 * leds };
+	for (unsigned long f = 0; f < frames; f++)
+	{
+		stage.Apply(in, out);
+		for (size_t i = 0; i < leds; i++)
+			sums[i] += levels[i];
+	}
+
+	double worst = 0;
+	for (size_t i = 0; i < leds; i++)
+	{
+		double ideal = i * ((1 << bits) - 1) / 65535.0;
+		double error = fabs(sums[i] / frames - ideal);
+		if (error > worst)
+			worst = error;
+	}
+	return worst;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "led-output-bench.json";
+	size_t leds = 10000;
+	int bits = 8;
+	DWORD refreshHz = 240;
+	unsigned long frames = 20000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			leds = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			bits = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			refreshHz = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			frames = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n leds] [-b bits] [-r refresh_hz] [-f frames] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (bits < 1 || bits > 8)
+	{
+		fprintf(stderr, "Bits must be 1 to 8 for byte output\n");
+		return 1;
+	}
+
+	double dithered = MeanError(bits, true, 4096);
+	double rounded = MeanError(bits, false, 4096);
+	printf("%zu LEDs to %d bits at %lu Hz, mean level error at duties 0 to 1023: dithered %.4f, rounded %.4f\n", leds, bits,
+		(unsigned long)refreshHz, dithered, rounded);
+	printf("%7s %12s %10s %10s %9s %6s %11s\n", "level", "frames_per_s", "us_frame", "us_dither", "core_use", "output", "allocations");
+
+	std::vector<BYTE> expected(leds * 3), bytes(leds * 3);
+	nlohmann::json runs = nlohmann::json::array();
+	bool failed = false;
+	for (int level = SIMD_SCALAR; level < SIMD_LEVEL_COUNT; level++)
+	{
+		if (!CSimd::IsSupported((SIMD_LEVEL)level))
+			continue;
+
+		CLedOutput scalar(SIMD_SCALAR), stage((SIMD_LEVEL)level);
+		if (!Setup(scalar, leds, bits) || !Setup(stage, leds, bits))
+			return 1;
+
+		// The error accumulators carry over, so every frame of the sequence has to match
+		bool same = true;
+		for (unsigned long i = 0; i < 256; i++)
+		{
+			scalar.Render(InputEffect(i), expected.data(), true);
+			stage.Render(InputEffect(i), bytes.data(), true);
+			same = same && bytes == expected;
+		}
+		if (!same)
+			failed = true;
+
+		unsigned long long allocations = Allocations;
+		unsigned long long cpu0 = ThreadCpuTime();
+		for (unsigned long i = 0; i < frames; i++)
+			stage.Render(InputEffect(i), bytes.data(), true);
+		unsigned long long cpu1 = ThreadCpuTime();
+		allocations = Allocations - allocations;
+		if (allocations)
+			failed = true;
+
+		// The dithering alone, from constant duties
+		std::vector<WORD> duties(leds * 3, 0x1234);
+		RZLedPlanes16 in = { duties.data(), duties.data() + leds, duties.data() + 2 * leds };
+		CTemporalDither& dither = stage.GetDither();
+		unsigned long long cpu2 = ThreadCpuTime();
+		for (unsigned long i = 0; i < frames; i++)
+			dither.Apply(in, bytes.data(), true);
+		unsigned long long cpu3 = ThreadCpuTime();
+
+		double us = frames ? (cpu1 - cpu0) / 1e3 / frames : 0.0;
+		double usDither = frames ? (cpu3 - cpu2) / 1e3 / frames : 0.0;
+		double rate = us > 0 ? 1e6 / us : 0.0;
+		double coreUse = us * refreshHz / 1e6;
+		printf("%7s %12.0f %10.2f %10.2f %8.2f%% %6s %11llu\n", CSimd::Name((SIMD_LEVEL)level), rate, us, usDither, coreUse * 100,
+			same ? "same" : "DIFF", allocations);
+		runs.push_back({
+			{"level", CSimd::Name((SIMD_LEVEL)level)},
+			{"frames_per_second", rate},
+			{"us_per_frame", us},
+			{"us_per_frame_dither", usDither},
+			{"core_share_at_refresh", coreUse},
+			{"same_output", same},
+			{"allocations", allocations},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "led_output"},
+		{"leds", leds},
+		{"bits", bits},
+		{"refresh_hz", refreshHz},
+		{"frames", frames},
+		{"best_level", CSimd::Name(CSimd::Level())},
+		{"mean_level_error_dithered", dithered},
+		{"mean_level_error_rounded", rounded},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
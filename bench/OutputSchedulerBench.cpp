@@ -0,0 +1,336 @@
+//! \file OutputSchedulerBench.cpp
+//! \brief Writes a 120 Hz stream to simulated outputs of different speeds: a WLED controller over a slow network
+//! taking 12 ms a frame, a DMX interface taking 1 ms and at most 44 frames a second, and two USB devices taking
+//! 0.3 ms. The writes sleep for their cost, as a device blocking on I/O would. Compares writing them one after
+//! another in a fixed order, the slow one first, from a single thread taking the latest frame, with the output
+//! scheduler and its workers. Reports for each output the latency from submission to the end of its write, the
+//! deadline misses, the frames skipped and the cost of a write. Fails on a frame reordered, an allocation in Submit,
+//! or the fast outputs missing more than the limit of their deadlines with the scheduler.
+//!
+//! Usage: output-scheduler-bench [-n frames] [-r rate_hz] [-w workers] [-d deadline_us] [-m max_fast_miss_%] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+#include "../src/OutputScheduler.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Allocations of the calling thread, Submit is checked on the producer alone.
+static thread_local unsigned long long ThreadAllocations = 0;
+
+void* operator new(size_t size)
+{
+	ThreadAllocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+struct RZBenchOutput
+{
+	const char* Name;
+	DWORD Cost;                                 //!< Microseconds a write takes.
+	DWORD MinInterval;                          //!< Microseconds between two frames the output takes.
+	bool Fast;                                  //!< Held to the miss limit.
+};
+
+static const RZBenchOutput OUTPUTS[] =
+{
+	{ "wled", 12000, 0, false },
+	{ "dmx", 1000, 22727, false },
+	{ "usb1", 300, 0, true },
+	{ "usb2", 300, 0, true },
+};
+static const size_t OUTPUT_COUNT = sizeof(OUTPUTS) / sizeof(OUTPUTS[0]);
+
+//! What an output saw in a run. Sized before the run, the writes allocate nothing.
+struct COutputRun
+{
+	const RZBenchOutput* Output = nullptr;
+	const std::vector<unsigned long long>* Submitted = nullptr;
+	std::vector<unsigned long long> Latencies;
+	std::vector<unsigned long long> Costs;
+	DWORD Last = 0;                             //!< Frame written last, plus 1.
+	unsigned long long Written = 0;
+	unsigned long long Reordered = 0;
+	unsigned long long Misses = 0;
+	unsigned long long NextStart = 0;           //!< Serial run only, when the output takes its next frame.
+	unsigned long long Deadline = 0;            //!< Nanoseconds.
+};
+
+//! Writes frame to the simulated output and notes its latency, frames carry their number in CL1.
+static void Write(COutputRun& run, const RZEventData& frame)
+{
+	unsigned long long start = CPlatform::Now();
+	std::this_thread::sleep_for(std::chrono::microseconds(run.Output->Cost));
+	unsigned long long end = CPlatform::Now();
+
+	DWORD i = frame.effect.CL1;
+	if (i + 1 <= run.Last)
+		run.Reordered++;
+	run.Last = i + 1;
+	unsigned long long latency = end - (*run.Submitted)[i];
+	run.Latencies.push_back(latency);
+	run.Costs.push_back(end - start);
+	run.Misses += latency > run.Deadline ? 1 : 0;
+	run.Written++;
+}
+
+static void Written(const RZEventData* frame, CHROMA_BROADCAST_STATUS status, void* user, size_t worker)
+{
+	if (frame)
+		Write(*(COutputRun*)user, *frame);
+}
+
+//! The serial baseline: one thread writes the latest frame to every output in turn.
+struct CSerialWriter
+{
+	CThread Thread;
+	CEvent Wake;
+	CEvent Stop;
+	CLock Lock;
+	RZEventData Frame;
+	bool Pending = false;
+	std::vector<COutputRun>* Runs = nullptr;
+};
+
+static DWORD SerialLoop(void* self)
+{
+	CSerialWriter& writer = *(CSerialWriter*)self;
+	for (;;)
+	{
+		writer.Wake.Reset();
+		writer.Lock.Enter();
+		bool pending = writer.Pending;
+		RZEventData frame = writer.Frame;
+		writer.Pending = false;
+		writer.Lock.Leave();
+		if (!pending)
+		{
+			if (writer.Stop.IsSet())
+				return 0;
+			writer.Wake.Wait(100);
+			continue;
+		}
+		for (COutputRun& run : *writer.Runs)
+		{
+			unsigned long long now = CPlatform::Now();
+			if (now < run.NextStart)
+				continue;
+			run.NextStart = now + run.Output->MinInterval * 1000ULL;
+			Write(run, frame);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "output-scheduler-bench.json";
+	size_t count = 600;
+	double rate = 120;
+	RZOutputConfig config = COutputScheduler::Defaults();
+	DWORD deadline = 8000;
+	double maxMiss = 1.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			config.Workers = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			deadline = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			maxMiss = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n frames] [-r rate_hz] [-w workers] [-d deadline_us] [-m max_fast_miss_%%] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (count < 100 || rate <= 0 || !deadline)
+	{
+		fprintf(stderr, "The bench needs 100 frames or more, a rate and a deadline\n");
+		return 1;
+	}
+
+	const unsigned long long period = (unsigned long long)(1e9 / rate);
+	std::vector<unsigned long long> submitted(count);
+	bool failed = false;
+
+	printf("%zu frames at %.0f Hz, %lu us deadline, %lu workers\n", count, rate, (unsigned long)deadline, (unsigned long)config.Workers);
+	printf("%10s %6s %8s %8s %9s %9s %7s %7s %6s %6s\n", "mode", "output", "written", "skipped", "lat_p50", "lat_p99",
+		"miss_%", "cost_us", "allocs", "check");
+	nlohmann::json runs = nlohmann::json::array();
+
+	for (int scheduled = 0; scheduled < 2; scheduled++)
+	{
+		const char* mode = scheduled ? "scheduled" : "serial";
+		std::vector<COutputRun> outputs(OUTPUT_COUNT);
+		for (size_t o = 0; o < OUTPUT_COUNT; o++)
+		{
+			outputs[o].Output = &OUTPUTS[o];
+			outputs[o].Submitted = &submitted;
+			outputs[o].Latencies.reserve(count);
+			outputs[o].Costs.reserve(count);
+			outputs[o].Deadline = deadline * 1000ULL;
+		}
+
+		COutputScheduler scheduler;
+		CSerialWriter serial;
+		int sinks[OUTPUT_COUNT];
+		std::string error;
+		if (scheduled)
+		{
+			if (!scheduler.Open(config, error))
+			{
+				fprintf(stderr, "%s\n", error.c_str());
+				return 1;
+			}
+			for (size_t o = 0; o < OUTPUT_COUNT; o++)
+			{
+				RZOutputSinkConfig sink;
+				sink.Write = Written;
+				sink.User = &outputs[o];
+				sink.Deadline = deadline;
+				sink.MinInterval = OUTPUTS[o].MinInterval;
+				sinks[o] = scheduler.Add(sink);
+			}
+		}
+		else
+		{
+			serial.Runs = &outputs;
+			if (!serial.Thread.Start(SerialLoop, &serial))
+			{
+				fprintf(stderr, "Failed to start the serial writer\n");
+				return 1;
+			}
+		}
+
+		// Allocations are counted on this thread only, around the hand off of each frame
+		unsigned long long allocations = 0;
+		RZEventData frame;
+		memset(&frame, 0, sizeof(frame));
+		unsigned long long next = BenchNow();
+		for (size_t i = 0; i < count; i++)
+		{
+			PaceUntil(next);
+			next += period;
+			frame.effect.CL1 = (RZCOLOR)i;
+			frame.effect.CL2 = (RZCOLOR)(i * 3) & 0xFFFFFF;
+			unsigned long long before = ThreadAllocations;
+			unsigned long long now = CPlatform::Now();
+			submitted[i] = now;
+			if (scheduled)
+			{
+				for (size_t o = 0; o < OUTPUT_COUNT; o++)
+					scheduler.Submit(sinks[o], frame, now);
+			}
+			else
+			{
+				serial.Lock.Enter();
+				serial.Frame = frame;
+				serial.Pending = true;
+				serial.Lock.Leave();
+				serial.Wake.Set();
+			}
+			allocations += ThreadAllocations - before;
+		}
+
+		// The frames still queued are written before the outputs are looked at
+		PaceUntil(next + 50000000ULL);
+		RZOutputSinkStats stats[OUTPUT_COUNT];
+		memset(stats, 0, sizeof(stats));
+		if (scheduled)
+		{
+			for (size_t o = 0; o < OUTPUT_COUNT; o++)
+			{
+				scheduler.GetStats(sinks[o], stats[o]);
+				scheduler.Remove(sinks[o]);
+			}
+			scheduler.Close();
+		}
+		else
+		{
+			serial.Stop.Set();
+			serial.Wake.Set();
+			serial.Thread.Join(INFINITE);
+		}
+
+		for (size_t o = 0; o < OUTPUT_COUNT; o++)
+		{
+			COutputRun& run = outputs[o];
+			double missRate = run.Written ? 100.0 * run.Misses / run.Written : 100.0;
+			double lat50 = Percentile(run.Latencies, 0.50) / 1e3, lat99 = Percentile(run.Latencies, 0.99) / 1e3;
+			double cost = Percentile(run.Costs, 0.50) / 1e3;
+			unsigned long long skipped = count - run.Written;
+			bool ok = !run.Reordered && !allocations && run.Written;
+			if (scheduled && OUTPUTS[o].Fast)
+				ok = ok && missRate <= maxMiss;
+			if (scheduled)
+				ok = ok && stats[o].Written == run.Written;
+			failed = failed || !ok;
+
+			printf("%10s %6s %8llu %8llu %9.1f %9.1f %7.1f %7.1f %6llu %6s\n", mode, OUTPUTS[o].Name, run.Written, skipped,
+				lat50, lat99, missRate, cost, allocations, ok ? "ok" : "BAD");
+			runs.push_back({
+				{"mode", mode},
+				{"output", OUTPUTS[o].Name},
+				{"write_cost_us", OUTPUTS[o].Cost},
+				{"min_interval_us", OUTPUTS[o].MinInterval},
+				{"written", run.Written},
+				{"skipped", skipped},
+				{"latency_p50_us", lat50},
+				{"latency_p99_us", lat99},
+				{"deadline_misses", run.Misses},
+				{"deadline_miss_percent", missRate},
+				{"measured_cost_p50_us", cost},
+				{"scheduler_cost_us", stats[o].Cost / 1e3},
+				{"reordered", run.Reordered},
+				{"submit_allocations", allocations},
+				{"ok", ok},
+			});
+		}
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "output_scheduler"},
+		{"frames", count},
+		{"rate_hz", rate},
+		{"workers", config.Workers},
+		{"deadline_us", deadline},
+		{"max_fast_miss_percent", maxMiss},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
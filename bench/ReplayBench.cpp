@@ -0,0 +1,201 @@
+//! \file ReplayBench.cpp
+//! \brief Throughput of the full filter and dispatch pipeline fed by the replay source, in captured frames per
+//! second including the filtered ones, and pacing accuracy of scaled replays. Writes a synthetic 1 kHz capture,
+//! replays it through the library at each speed and checks every run delivers the same frames in the same order.
+//!
+//! Usage: replay-bench [-l library] [-n frames] [-s speed]... [-o results.json]
+//!   -s  replay speed, 0 replays as fast as possible. Defaults to 0 and 100.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <RzErrors.h>
+#include "../src/Capture.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const int BENCH_APP_INDEX = 4244;
+static const RZID BENCH_OTHER_APP = 4245;
+static const char BENCH_APP_TITLE[] = "ChromaBroadcastReplayBench";
+static const char BENCH_CAPTURE[] = "replay-bench.capture";
+
+//! FNV-1a over the delivered effects, equal for two runs that delivered the same frames in order.
+static unsigned long long Hash(unsigned long long hash, const CHROMA_BROADCAST_EFFECT& effect)
+{
+	const unsigned char* bytes = (const unsigned char*)&effect;
+	for (size_t i = 0; i < sizeof(effect); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static std::atomic<unsigned long> Delivered(0);
+static std::atomic<bool> Ended(false);
+static unsigned long long DeliveredHash = 0;
+
+static RZRESULT BenchCallback(CHROMA_BROADCAST_TYPE type, PRZPARAM pData)
+{
+	if (type == BROADCAST_EFFECT)
+	{
+		DeliveredHash = Hash(DeliveredHash, *(const CHROMA_BROADCAST_EFFECT*)pData);
+		Delivered.fetch_add(1, std::memory_order_release);
+	}
+	else if ((CHROMA_BROADCAST_STATUS)(size_t)pData == NOT_LIVE)
+		Ended.store(true, std::memory_order_release);
+	return RZRESULT_SUCCESS;
+}
+
+//! Writes frames recorded 1 ms apart: a slow color cycle, every tenth frame addressed to the bench app and
+//! every tenth to an app nobody serves. Returns the hash of the frames the bench app should receive.
+static bool WriteCapture(unsigned long frames, unsigned long& expected, unsigned long long& expectedHash)
+{
+	CCaptureWriter writer;
+	if (!writer.Open(BENCH_CAPTURE))
+		return false;
+
+	ULONGLONG start = CPlatform::Now();
+	writer.SetStatus(LIVE, start);
+	expected = 0;
+	expectedHash = 14695981039346656037ULL;
+
+	RZEventData frame;
+	memset(&frame, 0, sizeof(frame));
+	for (unsigned long i = 0; i < frames; i++)
+	{
+		DWORD phase = (DWORD)(i % 512);
+		DWORD level = phase < 256 ? phase : 511 - phase;
+		frame.effect.CL1 = level;
+		frame.effect.CL2 = level << 8;
+		frame.effect.CL3 = (255 - level) << 16;
+		frame.effect.CL4 = (DWORD)i;
+		frame.effect.CL5 = i % 100 < 50 ? 0xFFFFFF : 0;
+		frame.index = i % 10 == 3 ? BENCH_APP_INDEX : i % 10 == 7 ? BENCH_OTHER_APP : 0;
+		frame.effect.IsAppSpecific = frame.index ? 1 : 0;
+		frame.TickCount = (DWORD)i;
+
+		writer.AddFrame(frame, start + i * 1000000ULL);
+		writer.FlushIfDue(start + i * 1000000ULL);
+		if (frame.index != BENCH_OTHER_APP)
+		{
+			expected++;
+			expectedHash = Hash(expectedHash, frame.effect);
+		}
+	}
+	writer.Close();
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* library = nullptr;
+	const char* output = "replay-bench.json";
+	unsigned long frames = 200000;
+	std::vector<double> speeds;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			library = argv[++i];
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			frames = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			speeds.push_back(atof(argv[++i]));
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-l library] [-n frames] [-s speed]... [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (speeds.empty())
+		speeds = { 0.0, 100.0 };
+
+	CChromaBroadcastLibrary api;
+	if (!api.Load(library))
+	{
+		fprintf(stderr, "Failed to load the Chroma Broadcast library\n");
+		return 1;
+	}
+	if (!PrepareSettings(BENCH_APP_TITLE))
+	{
+		fprintf(stderr, "Failed to enable broadcast in the settings (run elevated on Windows)\n");
+		return 1;
+	}
+
+	unsigned long expected = 0;
+	unsigned long long expectedHash = 0;
+	if (!WriteCapture(frames, expected, expectedHash))
+	{
+		fprintf(stderr, "Failed to write %s\n", BENCH_CAPTURE);
+		return 1;
+	}
+	SetBenchEnvironment("RZBROADCAST_REPLAY", BENCH_CAPTURE);
+
+	printf("%lu frames recorded at 1 kHz, %lu for the bench app\n", frames, expected);
+	printf("%8s %10s %9s %12s %10s %10s %7s\n", "speed", "delivered", "seconds", "frames_per_s", "expected_s", "cpu_%", "order");
+
+	nlohmann::json runs = nlohmann::json::array();
+	bool failed = false;
+	for (double speed : speeds)
+	{
+		SetBenchEnvironment("RZBROADCAST_REPLAY_SPEED", std::to_string(speed).c_str());
+		Delivered.store(0);
+		Ended.store(false);
+		DeliveredHash = 14695981039346656037ULL;
+
+		unsigned long long cpu0 = ProcessCpuTime();
+		unsigned long long t0 = BenchNow();
+		if (api.InitEx(BENCH_APP_INDEX, BENCH_APP_TITLE) != RZRESULT_SUCCESS)
+		{
+			fprintf(stderr, "InitEx failed, is %s readable?\n", BENCH_CAPTURE);
+			return 1;
+		}
+		api.RegisterEventNotification(BenchCallback);
+		while (!Ended.load(std::memory_order_acquire))
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		unsigned long long t1 = BenchNow();
+		unsigned long long cpu1 = ProcessCpuTime();
+		api.UnInit();
+
+		unsigned long delivered = Delivered.load(std::memory_order_acquire);
+		bool ordered = delivered == expected && DeliveredHash == expectedHash;
+		double seconds = (t1 - t0) / 1e9;
+		double expectedSeconds = speed > 0 ? frames / 1000.0 / speed : 0.0;
+		double cpu = seconds > 0 ? 100.0 * (cpu1 - cpu0) / (t1 - t0) : 0.0;
+		printf("%8.1f %10lu %9.3f %12.0f %10.3f %10.1f %7s\n", speed, delivered, seconds, frames / seconds, expectedSeconds, cpu, ordered ? "same" : "DIFF");
+		if (!ordered)
+			failed = true;
+
+		runs.push_back({
+			{"speed", speed},
+			{"delivered", delivered},
+			{"seconds", seconds},
+			{"frames_per_second", frames / seconds},
+			{"expected_seconds", expectedSeconds},
+			{"cpu_percent", cpu},
+			{"same_frames", ordered},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "replay"},
+		{"frames", frames},
+		{"expected_deliveries", expected},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
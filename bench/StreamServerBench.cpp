@@ -0,0 +1,559 @@
+//! \file StreamServerBench.cpp
+//! \brief Streams frames through CStreamServer to a thousand clients on the loopback interface: raw TCP and
+//! WebSocket, binary, JSON and delta encoded, most limited to 30 frames a second, a tenth taking every frame and a few that never
+//! read. Each client checks the status and every frame it receives, clients taking every frame check none is
+//! missing, limited clients check their rate and that they end on the last frame published. Fails on a wrong or
+//! missing frame, a rate exceeded, a client disconnected that kept up, or a client that never read still connected.
+//! Reports the messages per second, the latency from Publish to the clients taking every frame and the CPU of the
+//! whole process.
+//!
+//! Usage: stream-server-bench [-c clients] [-r rate_hz] [-d seconds] [-o results.json]
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "../src/StreamServer.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+#ifdef _WIN32
+typedef SOCKET BENCH_SOCKET;
+typedef WSAPOLLFD BENCH_POLLFD;
+#define BenchPoll WSAPoll
+#define CloseSocket closesocket
+#else
+typedef int BENCH_SOCKET;
+typedef pollfd BENCH_POLLFD;
+#define BenchPoll poll
+#define CloseSocket close
+#endif
+
+using namespace RzChromaBroadcastAPI;
+
+static const DWORD BENCH_APP_INDEX = 4244;
+static const DWORD LIMITED_RATE = 30;
+//! Bytes the server lets a client fall behind, small so the clients that never read are found within a run.
+static const DWORD BENCH_MAX_BUFFERED = 16 * 1024;
+static const int SLOW_RECEIVE_BUFFER = 4096;
+//! How long the clients read after the last frame.
+static const unsigned long long DRAIN_TIME = 500000000ULL;
+//! RFC 6455 sample key and the accept it has to get.
+static const char WS_KEY[] = "dGhlIHNhbXBsZSBub25jZQ==";
+static const char WS_ACCEPT[] = "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+struct RZBenchClient
+{
+	BENCH_SOCKET Socket;
+	bool WebSocket;
+	STREAM_FORMAT Format;
+	CEffectDecoder Delta;
+	DWORD Rate;                             //!< 0 for every frame.
+	bool Slow;                              //!< Never reads.
+	bool Upgraded;
+	bool Closed;
+	std::vector<BYTE> In;
+	unsigned long long Frames;              //!< Frames received while publishing.
+	unsigned long long Statuses;
+	unsigned long long Bad;
+	bool HasLast;
+	DWORD Last;
+};
+
+struct RZPublisher
+{
+	CStreamServer* Server;
+	DWORD Rate;
+	DWORD Frames;
+	std::atomic<DWORD> Published;
+	std::atomic<bool> Done;
+};
+
+static const char* Kind(const RZBenchClient& client)
+{
+	static const char* const names[2][3] = {
+		{ "tcp_binary", "tcp_json", "tcp_delta" },
+		{ "websocket_binary", "websocket_json", "websocket_delta" },
+	};
+	return names[client.WebSocket ? 1 : 0][client.Format];
+}
+
+//! Publishes Frames frames at Rate, the sequence number in CL1 and the time of Publish in CL2 and CL3.
+static DWORD Publish(void* parameter)
+{
+	RZPublisher& publisher = *(RZPublisher*)parameter;
+	unsigned long long start = BenchNow(), period = 1000000000ULL / publisher.Rate;
+	for (DWORD seq = 0; seq < publisher.Frames; seq++)
+	{
+		// Sleeps rather than spins, the clients and the server share the cores with it
+		unsigned long long deadline = start + seq * period, now = BenchNow();
+		if (deadline > now)
+			std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+
+		RZEventData frame;
+		memset(&frame, 0, sizeof(frame));
+		unsigned long long stamp = BenchNow();
+		frame.index = BENCH_APP_INDEX;
+		frame.effect.CL1 = seq;
+		frame.effect.CL2 = (DWORD)stamp;
+		frame.effect.CL3 = (DWORD)(stamp >> 32);
+		frame.effect.CL4 = seq * 7;
+		frame.effect.CL5 = ~seq;
+		frame.effect.IsAppSpecific = seq & 1;
+		publisher.Server->Publish(frame);
+		publisher.Published = seq + 1;
+	}
+	publisher.Done = true;
+	return 0;
+}
+
+static DWORD Get32(const BYTE* p)
+{
+	return (DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+static void Frame(RZBenchClient& client, DWORD number, DWORD app, const DWORD* colors, bool appSpecific, bool counting,
+	std::vector<unsigned long long>& latencies, unsigned long long now)
+{
+	DWORD seq = colors[0];
+	bool ok = number == seq && app == BENCH_APP_INDEX && colors[3] == seq * 7 && colors[4] == ~seq && appSpecific == ((seq & 1) != 0);
+	if (client.HasLast)
+		ok = ok && (client.Rate ? seq > client.Last : seq == client.Last + 1);
+	if (!ok)
+		client.Bad++;
+	client.HasLast = true;
+	client.Last = seq;
+	if (counting)
+		client.Frames++;
+
+	// Limited clients hold frames back on purpose
+	unsigned long long stamp = (unsigned long long)colors[2] << 32 | colors[1];
+	if (!client.Rate && latencies.size() < latencies.capacity() && now > stamp)
+		latencies.push_back(now - stamp);
+}
+
+//! Handles one message, binary, JSON or delta encoded.
+static void Message(RZBenchClient& client, const BYTE* data, size_t size, bool counting, std::vector<unsigned long long>& latencies,
+	unsigned long long now)
+{
+	if (client.Format != STREAM_FORMAT_JSON)
+	{
+		if (size == 2 + STREAM_STATUS_PAYLOAD && data[0] == STREAM_MESSAGE_STATUS && data[1] == STREAM_STATUS_PAYLOAD)
+		{
+			client.Statuses++;
+			if (data[2] != LIVE)
+				client.Bad++;
+			return;
+		}
+		if (client.Format == STREAM_FORMAT_DELTA)
+		{
+			// Over TCP nothing is lost, every delta has to decode
+			RZEventData frame;
+			size_t used = 0;
+			if (size < 2 || data[0] != STREAM_MESSAGE_DELTA || data[1] != size - 2 ||
+				client.Delta.Decode(data + 2, size - 2, frame, &used) != EFFECT_DECODE_FRAME || used != size - 2)
+			{
+				client.Bad++;
+				return;
+			}
+			// Deltas carry no frame number, the sequence number in CL1 stands in for it
+			DWORD colors[5] = { frame.effect.CL1, frame.effect.CL2, frame.effect.CL3, frame.effect.CL4, frame.effect.CL5 };
+			Frame(client, colors[0], frame.index, colors, frame.effect.IsAppSpecific != 0, counting, latencies, now);
+			return;
+		}
+		if (size != 2 + STREAM_FRAME_PAYLOAD || data[0] != STREAM_MESSAGE_FRAME || data[1] != STREAM_FRAME_PAYLOAD)
+		{
+			client.Bad++;
+			return;
+		}
+		DWORD colors[5];
+		for (int i = 0; i < 5; i++)
+			colors[i] = Get32(data + 10 + i * 4);
+		Frame(client, Get32(data + 2), Get32(data + 6), colors, data[30] != 0, counting, latencies, now);
+		return;
+	}
+
+	nlohmann::json message = nlohmann::json::parse(data, data + size, nullptr, false);
+	if (!message.is_object() || !message.contains("type"))
+	{
+		client.Bad++;
+		return;
+	}
+	if (message["type"] == "status")
+	{
+		client.Statuses++;
+		if (message.value("status", "") != "LIVE")
+			client.Bad++;
+		return;
+	}
+	const nlohmann::json& list = message["colors"];
+	if (message["type"] != "frame" || !list.is_array() || list.size() != 5)
+	{
+		client.Bad++;
+		return;
+	}
+	DWORD colors[5];
+	for (int i = 0; i < 5; i++)
+		colors[i] = list[i].get<DWORD>();
+	Frame(client, message.value("frame", 0u), message.value("app", 0u), colors, message.value("app_specific", false), counting, latencies, now);
+}
+
+//! Splits what a client received into messages.
+static void Parse(RZBenchClient& client, bool counting, std::vector<unsigned long long>& latencies, unsigned long long now)
+{
+	std::vector<BYTE>& in = client.In;
+	size_t at = 0;
+	if (client.WebSocket && !client.Upgraded)
+	{
+		static const char end[] = "\r\n\r\n";
+		auto found = std::search(in.begin(), in.end(), end, end + 4);
+		if (found == in.end())
+			return;
+		std::string response(in.begin(), found);
+		if (response.compare(0, 12, "HTTP/1.1 101") || response.find(WS_ACCEPT) == std::string::npos)
+			client.Bad++;
+		client.Upgraded = true;
+		at = found + 4 - in.begin();
+	}
+
+	for (;;)
+	{
+		size_t left = in.size() - at;
+		const BYTE* p = in.data() + at;
+		if (client.WebSocket)
+		{
+			if (left < 2)
+				break;
+			size_t length = p[1] & 0x7F, header = 2;
+			if (length == 126)
+			{
+				if (left < 4)
+					break;
+				length = (size_t)p[2] << 8 | p[3];
+				header = 4;
+			}
+			if (left < header + length)
+				break;
+			BYTE opcode = p[0] & 0x0F;
+			if ((p[1] & 0x80) || length == 127 || opcode != (client.Format == STREAM_FORMAT_JSON ? 0x1 : 0x2))
+				client.Bad++;
+			Message(client, p + header, length, counting, latencies, now);
+			at += header + length;
+		}
+		else if (client.Format == STREAM_FORMAT_JSON)
+		{
+			const BYTE* newline = (const BYTE*)memchr(p, '\n', left);
+			if (!newline)
+				break;
+			Message(client, p, newline - p, counting, latencies, now);
+			at += newline - p + 1;
+		}
+		else
+		{
+			if (left < 2 || left < 2 + (size_t)p[1])
+				break;
+			Message(client, p, 2 + p[1], counting, latencies, now);
+			at += 2 + p[1];
+		}
+	}
+	in.erase(in.begin(), in.begin() + at);
+}
+
+static bool Connect(RZBenchClient& client, WORD port)
+{
+	client.Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (client.Socket == (BENCH_SOCKET)-1)
+		return false;
+	if (client.Slow)
+		setsockopt(client.Socket, SOL_SOCKET, SO_RCVBUF, (const char*)&SLOW_RECEIVE_BUFFER, sizeof(SLOW_RECEIVE_BUFFER));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(0x7F000001);
+	address.sin_port = htons(port);
+	if (connect(client.Socket, (sockaddr*)&address, sizeof(address)))
+		return false;
+
+	static const char* const formats[] = { "binary", "json", "delta" };
+	std::string options = std::string("format=") + formats[client.Format] + "&rate=" + std::to_string(client.Rate);
+	std::string request = client.WebSocket ?
+		"GET /stream?" + options + " HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " +
+			WS_KEY + "\r\nSec-WebSocket-Version: 13\r\n\r\n" :
+		options + "\n";
+	if (send(client.Socket, request.data(), (int)request.size(), 0) != (int)request.size())
+		return false;
+
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	ioctlsocket(client.Socket, FIONBIO, &nonBlocking);
+#else
+	fcntl(client.Socket, F_SETFL, fcntl(client.Socket, F_GETFL) | O_NONBLOCK);
+#endif
+	return true;
+}
+
+//! Reads whatever the clients that read have received.
+static void Read(std::vector<RZBenchClient>& clients, std::vector<BENCH_POLLFD>& fds, std::vector<size_t>& owners, bool counting,
+	std::vector<unsigned long long>& latencies, int timeout)
+{
+	static BYTE buffer[64 * 1024];
+	if (BenchPoll(fds.data(), (unsigned long)fds.size(), timeout) <= 0)
+		return;
+	unsigned long long now = BenchNow();
+	for (size_t i = 0; i < fds.size(); i++)
+	{
+		if (!fds[i].revents)
+			continue;
+		RZBenchClient& client = clients[owners[i]];
+		for (;;)
+		{
+			int received = recv(client.Socket, (char*)buffer, sizeof(buffer), 0);
+			if (received > 0)
+			{
+				client.In.insert(client.In.end(), buffer, buffer + received);
+				if (received < (int)sizeof(buffer))
+					break;
+				continue;
+			}
+#ifdef _WIN32
+			bool wouldBlock = received < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+			bool wouldBlock = received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+#endif
+			if (!wouldBlock)
+			{
+				client.Closed = true;
+				fds[i].events = 0;
+			}
+			break;
+		}
+		Parse(client, counting, latencies, now);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "stream-server-bench.json";
+	size_t count = 1000;
+	DWORD rate = 240;
+	double seconds = 5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rate = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-c clients] [-r rate_hz] [-d seconds] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!rate || seconds <= 0)
+	{
+		fprintf(stderr, "The rate and the duration have to be above 0\n");
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#else
+	// Two descriptors a client, the server's and its own
+	rlimit limit;
+	if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < count * 2 + 64)
+	{
+		limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > count * 2 + 64 ? count * 2 + 64 : limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+#endif
+
+	CStreamServer server;
+	RZStreamConfig config = CStreamServer::Defaults();
+	config.MaxClients = (DWORD)count + 16;
+	config.MaxFps = 0;
+	config.MaxBuffered = BENCH_MAX_BUFFERED;
+	std::string error;
+	if (!server.Open(config, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	server.SetStatus(LIVE);
+
+	// A tenth takes every frame, every hundredth never reads, the rest are limited, the kinds mixed in each
+	std::vector<RZBenchClient> clients(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		RZBenchClient& client = clients[i];
+		client.Slow = i % 100 == 99;
+		client.Rate = client.Slow || i % 10 == 0 ? 0 : LIMITED_RATE;
+		size_t kind = client.Slow ? 1 : client.Rate ? i % 6 : (i / 10) % 6;
+		client.Format = (STREAM_FORMAT)(kind % 3);
+		client.WebSocket = kind >= 3;
+		if (!Connect(client, server.Port()))
+		{
+			fprintf(stderr, "Client %zu failed to connect\n", i);
+			return 1;
+		}
+	}
+
+	std::vector<BENCH_POLLFD> fds;
+	std::vector<size_t> owners;
+	size_t slow = 0, limited = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (clients[i].Slow)
+		{
+			slow++;
+			continue;
+		}
+		limited += clients[i].Rate ? 1 : 0;
+		BENCH_POLLFD fd;
+		memset(&fd, 0, sizeof(fd));
+		fd.fd = clients[i].Socket;
+		fd.events = POLLIN;
+		fds.push_back(fd);
+		owners.push_back(i);
+	}
+	size_t unlimited = fds.size() - limited;
+
+	// Every client gets the status before the first frame
+	std::vector<unsigned long long> latencies;
+	unsigned long long wait = BenchNow();
+	for (;;)
+	{
+		size_t ready = 0;
+		for (size_t i : owners)
+			ready += clients[i].Statuses ? 1 : 0;
+		if (ready == owners.size() || BenchNow() - wait > 5000000000ULL)
+			break;
+		Read(clients, fds, owners, false, latencies, 10);
+	}
+
+	RZPublisher publisher;
+	publisher.Server = &server;
+	publisher.Rate = rate;
+	publisher.Frames = (DWORD)(seconds * rate);
+	publisher.Published = 0;
+	publisher.Done = false;
+	latencies.reserve(unlimited * publisher.Frames);
+
+	CThread thread;
+	unsigned long long start = BenchNow(), cpu0 = ProcessCpuTime();
+	thread.Start(Publish, &publisher);
+	while (!publisher.Done)
+		Read(clients, fds, owners, true, latencies, 10);
+	unsigned long long end = BenchNow(), cpu1 = ProcessCpuTime();
+	thread.Join(INFINITE);
+	while (BenchNow() - end < DRAIN_TIME)
+		Read(clients, fds, owners, true, latencies, 10);
+
+	RZStreamStats stats;
+	server.GetStats(stats);
+	double elapsed = (end - start) / 1e9;
+	DWORD lastFrame = publisher.Frames - 1;
+	unsigned long long messages = 0, bad = 0, statuses = 0, closed = 0, missing = 0, fast = 0, stale = 0;
+	double limitedFps = 0;
+	for (size_t i : owners)
+	{
+		const RZBenchClient& client = clients[i];
+		messages += client.Frames + client.Statuses;
+		bad += client.Bad;
+		statuses += client.Statuses == 1 ? 0 : 1;
+		closed += client.Closed ? 1 : 0;
+		if (!client.HasLast || client.Last != lastFrame)
+			stale++;
+		if (!client.Rate && client.Frames != publisher.Frames)
+			missing++;
+		if (client.Rate)
+		{
+			double fps = client.Frames / elapsed;
+			limitedFps = fps > limitedFps ? fps : limitedFps;
+			// The frame waiting when publishing stops arrives after it
+			if (client.Frames > client.Rate * elapsed + 2)
+				fast++;
+		}
+	}
+	unsigned long long p50 = Percentile(latencies, 0.50), p99 = Percentile(latencies, 0.99);
+	unsigned long long worst = latencies.empty() ? 0 : latencies.back();
+	double cpu = elapsed > 0 ? (cpu1 - cpu0) / 1e9 / elapsed * 100 : 0.0;
+	double messageRate = elapsed > 0 ? messages / elapsed : 0.0;
+	bool ok = !bad && !statuses && !closed && !missing && !fast && !stale && stats.SlowDisconnects == slow && !stats.Rejected;
+
+	printf("%zu clients: %zu every frame, %zu at %lu fps, %zu never reading; %lu frames at %lu Hz\n", count, unlimited, limited,
+		(unsigned long)LIMITED_RATE, slow, (unsigned long)publisher.Frames, (unsigned long)rate);
+	printf("%10s %10s %8s %8s %8s %9s %6s %6s %6s %6s %6s %6s\n", "msgs_s", "MB_s", "p50_us", "p99_us", "max_us", "lim_fps", "cpu%",
+		"slow", "bad", "missed", "stale", "check");
+	printf("%10.0f %10.2f %8.1f %8.1f %8.1f %9.1f %6.1f %3llu/%-2zu %6llu %6llu %6llu %6s\n", messageRate, stats.Bytes / elapsed / 1e6,
+		p50 / 1e3, p99 / 1e3, worst / 1e3, limitedFps, cpu, stats.SlowDisconnects, slow, bad, missing, stale, ok ? "ok" : "BAD");
+	if (closed || stats.Rejected)
+		printf("%llu clients disconnected, %llu rejected\n", closed, stats.Rejected);
+
+	nlohmann::json kinds = nlohmann::json::object();
+	for (const RZBenchClient& client : clients)
+	{
+		std::string kind = std::string(Kind(client)) + (client.Slow ? "_slow" : client.Rate ? "_limited" : "");
+		kinds[kind] = kinds.value(kind, 0) + 1;
+	}
+	nlohmann::json report = {
+		{"benchmark", "stream_server"},
+		{"clients", count},
+		{"client_kinds", kinds},
+		{"rate_hz", rate},
+		{"frames", publisher.Frames},
+		{"seconds", elapsed},
+		{"messages_per_second", messageRate},
+		{"bytes_per_second", stats.Bytes / elapsed},
+		{"latency_p50_us", p50 / 1e3},
+		{"latency_p99_us", p99 / 1e3},
+		{"latency_max_us", worst / 1e3},
+		{"cpu_percent", cpu},
+		{"limited_rate", LIMITED_RATE},
+		{"limited_max_fps", limitedFps},
+		{"server_messages", stats.Messages},
+		{"server_skipped", stats.Skipped},
+		{"server_dropped", stats.Dropped},
+		{"slow_clients", slow},
+		{"slow_disconnects", stats.SlowDisconnects},
+		{"bad_messages", bad},
+		{"clients_missing_frames", missing},
+		{"clients_over_rate", fast},
+		{"clients_stale", stale},
+		{"clients_disconnected", closed},
+		{"passed", ok},
+	};
+
+	for (RZBenchClient& client : clients)
+		CloseSocket(client.Socket);
+	server.Close();
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return ok ? 0 : 1;
+}
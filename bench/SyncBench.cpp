@@ -0,0 +1,288 @@
+//! \file SyncBench.cpp
+//! \brief Leads synchronized playout on the loopback interface to several followers, each on a thread of its own
+//! with a clock shifted by seconds and running up to a few hundred ppm fast or slow, as machines of their own would.
+//! Every follower notes when it played each frame on the real clock: the spread of those times across followers is
+//! the skew between nodes, their distance to the presentation time the error of the clock estimates. Fails on a
+//! frame missing, wrong, late or not LIVE, or a p99 skew above the limit.
+//!
+//! Usage: sync-bench [-f followers] [-r rate_hz] [-d seconds] [-i poll_ms] [-s max_p99_skew_us] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../src/SyncPlayout.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Exchanges a follower needs before the frames start.
+static const size_t READY_SAMPLES = 8;
+
+struct CFollowerRun
+{
+	CSyncFollower Sync;
+	CThread Thread;
+	CEvent Stop;
+	long long ClockOffset = 0;
+	int ClockDrift = 0;
+	std::vector<unsigned long long> Played;     //!< Real time each frame was played, 0 for never.
+	unsigned long Wrong = 0;                    //!< Frames played twice, out of range, with other colors or not LIVE.
+	RZSyncFollowerStats Stats = {};
+};
+
+//! Frame i carries its number in CL1 and colors derived from it in the others.
+static void MakeFrame(DWORD i, RZEventData& frame)
+{
+	memset(&frame, 0, sizeof(frame));
+	frame.index = 4244;
+	frame.effect.CL1 = i;
+	frame.effect.CL2 = (i * 3) & 0xFFFFFF;
+	frame.effect.CL3 = 0x00FF00;
+	frame.effect.CL4 = (i / 16) * 0x010101 & 0xFFFFFF;
+	frame.effect.CL5 = 0x202020;
+}
+
+static void Played(const RZEventData* frame, CHROMA_BROADCAST_STATUS status, void* user)
+{
+	CFollowerRun* run = (CFollowerRun*)user;
+	if (!frame)
+		return;
+	unsigned long long now = CPlatform::Now();
+	RZEventData expected;
+	MakeFrame(frame->effect.CL1, expected);
+	DWORD i = frame->effect.CL1;
+	if (i >= run->Played.size() || run->Played[i] || status != LIVE || frame->index != expected.index
+		|| memcmp(&frame->effect, &expected.effect, sizeof(expected.effect)))
+	{
+		run->Wrong++;
+		return;
+	}
+	run->Played[i] = now;
+}
+
+static DWORD FollowerThread(void* parameter)
+{
+	CFollowerRun* run = (CFollowerRun*)parameter;
+	run->Sync.Run(run->Stop, Played, run);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "sync-bench.json";
+	int followers = 4;
+	double rate = 100.0;
+	double seconds = 10.0;
+	DWORD poll = 250;
+	double maxSkew = 2000.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			followers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			poll = (DWORD)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			maxSkew = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-f followers] [-r rate_hz] [-d seconds] [-i poll_ms] [-s max_p99_skew_us] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (followers < 2 || rate <= 0 || seconds <= 0 || !poll)
+	{
+		fprintf(stderr, "The bench needs 2 followers or more, and a positive rate, duration and poll interval\n");
+		return 1;
+	}
+
+	DWORD loopback = 0;
+	CUdpSocket::ParseAddress("127.0.0.1", loopback);
+	RZSyncLeaderConfig leaderConfig = CSyncLeader::Defaults();
+	leaderConfig.Address = loopback;
+	leaderConfig.Port = 0;
+	CSyncLeader leader;
+	std::string error;
+	if (!leader.Open(leaderConfig, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	// Follower k is k * 3.7 s ahead, and every other one runs slow
+	DWORD frames = (DWORD)(seconds * rate);
+	std::vector<CFollowerRun> runs(followers);
+	bool failed = false;
+	for (int k = 0; k < followers && !failed; k++)
+	{
+		CFollowerRun& run = runs[k];
+		run.ClockOffset = k * 3700000000LL;
+		run.ClockDrift = (k % 2 ? 1 : -1) * 60 * k;
+		run.Played.assign(frames, 0);
+		RZSyncFollowerConfig config = CSyncFollower::Defaults(loopback);
+		config.Leader.Port = leader.Port();
+		config.PollInterval = poll;
+		config.ClockOffset = run.ClockOffset;
+		config.ClockDrift = run.ClockDrift;
+		if (!run.Sync.Open(config, error) || !run.Thread.Start(FollowerThread, &run))
+		{
+			fprintf(stderr, "follower %d: %s\n", k, error.c_str());
+			failed = true;
+		}
+	}
+
+	// Frames only start once every follower has a first estimate of the leader's clock
+	unsigned long long deadline = CPlatform::Now() + 5000000000ULL;
+	for (int k = 0; k < followers && !failed; k++)
+	{
+		for (;;)
+		{
+			runs[k].Sync.GetStats(runs[k].Stats);
+			if (runs[k].Stats.Samples >= READY_SAMPLES)
+				break;
+			if (CPlatform::Now() > deadline)
+			{
+				fprintf(stderr, "follower %d got no time from the leader\n", k);
+				failed = true;
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	std::vector<unsigned long long> presentations(frames, 0);
+	if (!failed)
+	{
+		leader.SetStatus(LIVE);
+		unsigned long long period = (unsigned long long)(1e9 / rate);
+		unsigned long long start = CPlatform::Now();
+		RZEventData frame;
+		for (DWORD i = 0; i < frames; i++)
+		{
+			MakeFrame(i, frame);
+			presentations[i] = leader.Publish(frame);
+			PaceUntil(start + (i + 1) * period);
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(leaderConfig.Delay + 200000));
+	}
+
+	for (CFollowerRun& run : runs)
+	{
+		run.Stop.Set();
+		run.Sync.Wake();
+		run.Thread.Join(INFINITE);
+		run.Sync.GetStats(run.Stats);
+		run.Sync.Close();
+	}
+	RZSyncLeaderStats leaderStats;
+	leader.GetStats(leaderStats);
+	leader.Close();
+
+	// Skew: latest minus earliest play of a frame across the followers; error: play minus presentation time
+	std::vector<unsigned long long> skews, errors;
+	unsigned long long missing = 0, wrong = 0, late = 0;
+	long long errorSum = 0;
+	for (DWORD i = 0; i < frames && !failed; i++)
+	{
+		unsigned long long first = 0, last = 0;
+		int played = 0;
+		for (CFollowerRun& run : runs)
+		{
+			unsigned long long at = run.Played[i];
+			if (!at)
+			{
+				missing++;
+				continue;
+			}
+			first = played ? std::min(first, at) : at;
+			last = played ? std::max(last, at) : at;
+			played++;
+			long long error = (long long)(at - presentations[i]);
+			errorSum += error;
+			errors.push_back((unsigned long long)(error < 0 ? -error : error));
+		}
+		if (played > 1)
+			skews.push_back(last - first);
+	}
+	nlohmann::json followerResults = nlohmann::json::array();
+	printf("%d followers, %lu frames at %.0f Hz, %lu ms of delay, a time request every %lu ms\n", followers, (unsigned long)frames,
+		rate, (unsigned long)(leaderConfig.Delay / 1000), (unsigned long)poll);
+	printf("%8s %12s %9s %9s %9s %8s %7s %6s %6s %6s\n", "follower", "offset_s", "drift", "est_ppm", "rtt_us", "played", "wrong",
+		"late", "lost", "unsync");
+	for (int k = 0; k < followers; k++)
+	{
+		CFollowerRun& run = runs[k];
+		wrong += run.Wrong;
+		late += run.Stats.Late;
+		// The estimate is of the leader's clock against the follower's, the opposite sign of the drift simulated
+		printf("%8d %12.1f %9d %9.1f %9.1f %8llu %7lu %6llu %6llu %6llu\n", k, run.ClockOffset / 1e9, run.ClockDrift, run.Stats.Drift,
+			run.Stats.RoundTrip / 1e3, run.Stats.Frames, run.Wrong, run.Stats.Late, run.Stats.Lost, run.Stats.Unsynced);
+		followerResults.push_back({
+			{"clock_offset_ns", run.ClockOffset},
+			{"clock_drift_ppm", run.ClockDrift},
+			{"estimated_drift_ppm", run.Stats.Drift},
+			{"round_trip_ns", run.Stats.RoundTrip},
+			{"samples", run.Stats.Samples},
+			{"frames_played", run.Stats.Frames},
+			{"wrong", run.Wrong},
+			{"late", run.Stats.Late},
+			{"lost", run.Stats.Lost},
+			{"unsynced", run.Stats.Unsynced},
+			{"requests", run.Stats.Requests},
+			{"replies", run.Stats.Replies},
+		});
+	}
+
+	double meanError = errors.empty() ? 0.0 : (double)errorSum / errors.size();
+	unsigned long long skew50 = Percentile(skews, 0.50), skew99 = Percentile(skews, 0.99), skewMax = skews.empty() ? 0 : skews.back();
+	unsigned long long error50 = Percentile(errors, 0.50), error99 = Percentile(errors, 0.99), errorMax = errors.empty() ? 0 : errors.back();
+	failed = failed || missing || wrong || late || skews.empty() || skew99 > maxSkew * 1000.0;
+	printf("skew   p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", skew50 / 1e3, skew99 / 1e3, skewMax / 1e3);
+	printf("error  p50 %8.1f us  p99 %8.1f us  max %8.1f us  mean %+8.1f us\n", error50 / 1e3, error99 / 1e3, errorMax / 1e3, meanError / 1e3);
+	printf("leader %llu frames, %llu datagrams, %llu failed, %llu requests; %llu missing, %llu wrong\n", leaderStats.Frames,
+		leaderStats.Datagrams, leaderStats.Failed, leaderStats.Requests, missing, wrong);
+	printf("%s\n", failed ? "FAILED" : "OK");
+
+	nlohmann::json report = {
+		{"benchmark", "sync_playout"},
+		{"followers", followers},
+		{"frames", frames},
+		{"rate_hz", rate},
+		{"delay_us", leaderConfig.Delay},
+		{"poll_interval_ms", poll},
+		{"skew_p50_ns", skew50},
+		{"skew_p99_ns", skew99},
+		{"skew_max_ns", skewMax},
+		{"max_p99_skew_ns", maxSkew * 1000.0},
+		{"error_p50_ns", error50},
+		{"error_p99_ns", error99},
+		{"error_max_ns", errorMax},
+		{"error_mean_ns", meanError},
+		{"missing", missing},
+		{"wrong", wrong},
+		{"late", late},
+		{"leader_datagrams", leaderStats.Datagrams},
+		{"leader_failed", leaderStats.Failed},
+		{"runs", followerResults},
+		{"ok", !failed},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#include <string.h>
+#include "SyntheticWriter.h"
+
+using namespace RzChromaBroadcastAPI;
+
+CSyntheticWriter::CSyntheticWriter() : Shared(nullptr)
+{
+}
+
+CSyntheticWriter::~CSyntheticWriter()
+{
+	Close();
+}
+
+bool CSyntheticWriter::Open()
+{
+	if (!SharedMemory.Open(RZBROADCAST_SHARED_MEMORY, sizeof(RZEventSharedMemoryData), SHARED_MEMORY_OPEN_OR_CREATE)
+		|| !Event.Open(RZBROADCAST_EVENT)
+		|| !Synapse3Mutex.Create(RZSYNAPSE3_MUTEX))
+	{
+		Close();
+		return false;
+	}
+	Shared = (RZEventSharedMemoryData*)SharedMemory.Data();
+	memset(Shared, 0, sizeof(RZEventSharedMemoryData));
+	return true;
+}
+
+void CSyntheticWriter::Close()
+{
+	Synapse3Mutex.Close();
+	Event.Close();
+	SharedMemory.Close();
+	Shared = nullptr;
+}
+
+void CSyntheticWriter::Publish(const CHROMA_BROADCAST_EFFECT& effect, RZID index)
+{
+	const DWORD slots = sizeof(RZEventSharedMemoryData::events) / sizeof(RZEventSharedMemoryData::events[0]);
+	DWORD idx = Shared->idx % slots;
+
+	RZEventData& event = Shared->events[idx];
+	event.index = index;
+	event.effect = effect;
+	event.TickCount = TickCount();
+
+	// Publish the slot before moving the index past it
+	std::atomic_thread_fence(std::memory_order_release);
+	Shared->idx = (idx + 1) % slots;
+
+	Event.Set();
+}
+
+DWORD CSyntheticWriter::TickCount()
+{
+	return CPlatform::TickCount();
+}
@@ -0,0 +1,35 @@
+//! \file SyntheticWriter.h
+//! \brief Plays the Synapse side of the broadcast: owns the shared memory ring, the data event and the Synapse mutex.
+
+#ifndef _SYNTHETICWRITER_H_
+#define _SYNTHETICWRITER_H_
+
+#pragma once
+
+#include "../src/BroadcastProtocol.h"
+#include "../src/Platform.h"
+
+class CSyntheticWriter
+{
+public:
+	CSyntheticWriter();
+	~CSyntheticWriter();
+
+	//! Creates (or opens) the ring, the event and the mutex that tells readers Synapse is online.
+	bool Open();
+	void Close();
+
+	//! Writes the next ring slot, stamps TickCount and signals the event.
+	void Publish(const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& effect, RZID index = 0);
+
+	//! The writer's TickCount clock: monotonic milliseconds, as GetTickCount().
+	static DWORD TickCount();
+
+private:
+	CSharedMemory SharedMemory;
+	CNamedEvent Event;
+	CNamedMutex Synapse3Mutex;
+	RZEventSharedMemoryData* Shared;
+};
+
+#endif
@@ -0,0 +1,190 @@
+//! \file ZoneMapBench.cpp
+//! \brief Frames per second one core renders from effects onto a 10000 LED installation, for each supported
+//! instruction set: strips with gradients and solid zones and a matrix whose LEDs weigh all five colors. Checks
+//! every level renders the same floats as the scalar kernel and that rendering allocates nothing.
+//!
+//! Usage: zone-map-bench [-n leds] [-f frames] [-o results.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "../src/ZoneMap.h"
+#include "../src/json.hpp"
+#include "BenchUtil.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static std::atomic<unsigned long long> Allocations(0);
+
+void* operator new(size_t size)
+{
+	Allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+//! Strips of 144 LEDs take turns at a gradient through all colors, a solid color and a gradient between two, the
+//! last fifth of the LEDs is a matrix where each LED weighs the five colors by its distance to five anchors.
+static void BuildLayout(CZoneMap& map, size_t leds)
+{
+	const size_t STRIP = 144;
+	size_t matrix = leds / 5;
+	size_t strips = leds - matrix;
+	map.Reset(leds);
+
+	const int all[] = { 0, 1, 2, 3, 4 };
+	size_t first = 0;
+	for (int strip = 0; first < strips; strip++, first += STRIP)
+	{
+		size_t count = strips - first < STRIP ? strips - first : STRIP;
+		int pair[] = { strip % 5, (strip + 1) % 5 };
+		switch (strip % 3)
+		{
+		case 0:
+			map.AddGradient(first, count, all, 5);
+			break;
+		case 1:
+			map.AddSolid(first, count, strip % 5);
+			break;
+		default:
+			map.AddGradient(first, count, pair, 2);
+			break;
+		}
+	}
+
+	const float anchors[5][2] = { { 0.1f, 0.1f }, { 0.9f, 0.1f }, { 0.5f, 0.5f }, { 0.1f, 0.9f }, { 0.9f, 0.9f } };
+	const size_t side = 100;
+	std::vector<float> weights(matrix * 5);
+	for (size_t i = 0; i < matrix; i++)
+	{
+		float x = (float)(i % side) / side, y = (float)(i / side % side) / side, total = 0.0f;
+		for (int k = 0; k < 5; k++)
+		{
+			float dx = x - anchors[k][0], dy = y - anchors[k][1];
+			weights[i * 5 + k] = 1.0f / (0.01f + dx * dx + dy * dy);
+			total += weights[i * 5 + k];
+		}
+		for (int k = 0; k < 5; k++)
+			weights[i * 5 + k] /= total;
+	}
+	map.AddWeights(strips, matrix, weights.data());
+}
+
+static CHROMA_BROADCAST_EFFECT InputEffect(unsigned long i)
+{
+	DWORD level = (DWORD)(i * 37 % 256);
+	CHROMA_BROADCAST_EFFECT effect = { level, level << 8, level << 16, (255 - level) * 0x010101, 0x00FFFFFF ^ (level * 0x010101), FALSE };
+	return effect;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = "zone-map-bench.json";
+	size_t leds = 10000;
+	unsigned long frames = 20000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			leds = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			frames = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-n leds] [-f frames] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<float> expected(leds * 3), planes(leds * 3);
+	RZLedPlanes reference = { expected.data(), expected.data() + leds, expected.data() + 2 * leds };
+	RZLedPlanes out = { planes.data(), planes.data() + leds, planes.data() + 2 * leds };
+
+	printf("%zu LEDs, %lu frames\n", leds, frames);
+	printf("%7s %12s %10s %12s %8s %6s %11s\n", "level", "frames_per_s", "us_frame", "leds_per_s", "speedup", "output", "allocations");
+
+	nlohmann::json runs = nlohmann::json::array();
+	bool failed = false;
+	double scalarRate = 0;
+	for (int level = SIMD_SCALAR; level < SIMD_LEVEL_COUNT; level++)
+	{
+		if (!CSimd::IsSupported((SIMD_LEVEL)level))
+			continue;
+
+		CZoneMap scalar(SIMD_SCALAR), map((SIMD_LEVEL)level);
+		BuildLayout(scalar, leds);
+		BuildLayout(map, leds);
+
+		bool same = true;
+		for (unsigned long i = 0; i < 64; i++)
+		{
+			scalar.Render(InputEffect(i), reference);
+			map.Render(InputEffect(i), out);
+			same = same && planes == expected;
+		}
+		if (!same)
+			failed = true;
+
+		unsigned long long allocations = Allocations;
+		unsigned long long cpu0 = ThreadCpuTime();
+		for (unsigned long i = 0; i < frames; i++)
+			map.Render(InputEffect(i), out);
+		unsigned long long cpu1 = ThreadCpuTime();
+		allocations = Allocations - allocations;
+		if (allocations)
+			failed = true;
+
+		double seconds = (cpu1 - cpu0) / 1e9;
+		double rate = seconds > 0 ? frames / seconds : 0.0;
+		if (level == SIMD_SCALAR)
+			scalarRate = rate;
+		double speedup = scalarRate > 0 ? rate / scalarRate : 0.0;
+		double us = frames ? (cpu1 - cpu0) / 1e3 / frames : 0.0;
+		printf("%7s %12.0f %10.2f %12.0f %7.2fx %6s %11llu\n", CSimd::Name((SIMD_LEVEL)level), rate, us, rate * leds, speedup,
+			same ? "same" : "DIFF", allocations);
+		runs.push_back({
+			{"level", CSimd::Name((SIMD_LEVEL)level)},
+			{"frames_per_second", rate},
+			{"us_per_frame", us},
+			{"leds_per_second", rate * leds},
+			{"speedup", speedup},
+			{"same_output", same},
+			{"allocations", allocations},
+		});
+	}
+
+	nlohmann::json report = {
+		{"benchmark", "zone_map"},
+		{"leds", leds},
+		{"frames", frames},
+		{"best_level", CSimd::Name(CSimd::Level())},
+		{"runs", runs},
+	};
+
+	FILE* f = fopen(output, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+	fprintf(f, "%s\n", report.dump(2).c_str());
+	fclose(f);
+	return failed ? 1 : 0;
+}
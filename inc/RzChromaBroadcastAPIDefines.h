@@ -6,7 +6,9 @@
 
 #pragma once
 
-#ifndef GUID_DEFINED
+#ifndef _WIN32
+#include "RzPosixTypes.h"
+#elif !defined(GUID_DEFINED)
 #include <Guiddef.h>
 #endif
 
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#ifndef _WIN32
+#include "RzPosixTypes.h"
+#endif
+
 typedef LONG            RZRESULT;           //!< Return result.
 typedef LONG            RZSTATUS;           //!< Status
 typedef GUID            RZEFFECTID;         //!< Effect Id.
@@ -16,6 +20,7 @@ typedef size_t          RZSIZE;             //!< Size.
 typedef void*           PRZPARAM;           //!< Context sensitive pointer.
 typedef DWORD           RZID;               //!< Generic data type for Identifier.
 typedef DWORD           RZCOLOR;            //!< Color data. 1st byte = Red; 2nd byte = Green; 3rd byte = Blue; 4th byte = Alpha (if applicable)
+typedef struct RZBroadcastContext* RZBROADCASTCONTEXT;  //!< Handle of an app identity created with CreateContext.
 
 namespace RzChromaBroadcastAPI
 {
@@ -44,6 +49,61 @@ namespace RzChromaBroadcastAPI
 #pragma pack(pop)
 
 	typedef RZRESULT(*RZEVENTNOTIFICATIONCALLBACK)(CHROMA_BROADCAST_TYPE type, PRZPARAM pData);
+
+	//! Notification callback of a context. user is the pointer given to RegisterContextNotification.
+	typedef RZRESULT(*RZCONTEXTNOTIFICATIONCALLBACK)(RZBROADCASTCONTEXT context, CHROMA_BROADCAST_TYPE type, PRZPARAM pData, void* user);
+
+	//! Number of buckets in each CHROMA_BROADCAST_METRICS histogram.
+	//! Bucket 0 counts samples below 1 microsecond, bucket i counts samples in [2^(i-1), 2^i) microseconds.
+	//! The last bucket also holds everything above its lower bound.
+	const int CHROMA_BROADCAST_METRICS_BUCKETS = 32;
+
+	//! Snapshot of the pipeline counters returned by GetMetrics().
+	struct CHROMA_BROADCAST_METRICS
+	{
+		ULONGLONG FramesRead;           //!< Ring slots read by the broadcast thread.
+		ULONGLONG FramesDelivered;      //!< Effects passed to the notification callback.
+		ULONGLONG FramesDeduped;        //!< Reads skipped because the writer had not published a new frame.
+		ULONGLONG FramesDropped;        //!< Frames overwritten by the writer before they could be read.
+		ULONGLONG FramesFiltered;       //!< App specific frames addressed to another application.
+		ULONGLONG HealthChecks;         //!< Synapse mutex, registry and service checks run.
+		ULONGLONG StatusTransitions;    //!< LIVE / NOT_LIVE changes reported to the callback.
+		ULONGLONG CallbackTime[CHROMA_BROADCAST_METRICS_BUCKETS];   //!< Callback execution time histogram.
+		ULONGLONG Latency[CHROMA_BROADCAST_METRICS_BUCKETS];        //!< Writer to delivery latency histogram, millisecond resolution (TickCount).
+	};
+
+	//! State of the frame pacer returned by GetPacing(), enabled by RZBROADCAST_PACING. Times in microseconds.
+	struct CHROMA_BROADCAST_PACING
+	{
+		BOOL Enabled;
+		DWORD Delay;                    //!< Current delay of a frame that arrived on time.
+		DWORD MinDelay;
+		DWORD MaxDelay;
+		DWORD Interval;                 //!< Cadence the frames are delivered at.
+		DWORD Jitter;                   //!< 99th percentile of how late frames arrived against the cadence.
+		DWORD Buffered;                 //!< Frames waiting for their slot.
+		ULONGLONG FramesPaced;          //!< Frames delivered through the pacer.
+		ULONGLONG Underruns;            //!< Frames that arrived after their slot.
+		ULONGLONG Overflows;            //!< Frames dropped for a full pacer.
+		ULONGLONG Resets;               //!< Pauses of the stream after which the cadence started over.
+		ULONGLONG RateChanges;          //!< Changes of the rate the frames arrive at.
+	};
+
+	//! Output of a context returned by GetOutputStats(), its callback is written by the output workers
+	//! RZBROADCAST_OUTPUT enables. Times in microseconds.
+	struct CHROMA_BROADCAST_OUTPUT_STATS
+	{
+		BOOL Scheduled;                 //!< The output workers call the context back, not the reader.
+		DWORD Deadline;                 //!< Time a frame must be written in once it arrived.
+		DWORD Cost;                     //!< Time the callback has been taking, a moving average.
+		DWORD MaxCost;
+		DWORD Queued;                   //!< Frames and status changes waiting for a worker.
+		ULONGLONG Submitted;
+		ULONGLONG Written;
+		ULONGLONG Skipped;              //!< Frames replaced by a newer one before the callback took them.
+		ULONGLONG DeadlineMisses;       //!< Frames written after their deadline.
+		ULONGLONG Statuses;             //!< Status changes written.
+	};
 }
 
 #endif
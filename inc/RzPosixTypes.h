@@ -0,0 +1,45 @@
+//! \file RzPosixTypes.h
+//! \brief Windows base types used by the SDK headers, for non Windows builds.
+
+#ifndef _RZPOSIXTYPES_H_
+#define _RZPOSIXTYPES_H_
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t             LONG;
+typedef uint32_t            DWORD;
+typedef uint16_t            WORD;
+typedef uint8_t             BYTE;
+typedef int                 BOOL;
+typedef unsigned long long  ULONGLONG;
+typedef void*               HANDLE;
+
+#ifndef TRUE
+#define TRUE                1
+#endif
+#ifndef FALSE
+#define FALSE               0
+#endif
+#ifndef MAXDWORD
+#define MAXDWORD            0xffffffffu
+#endif
+
+#ifndef GUID_DEFINED
+#define GUID_DEFINED
+typedef struct _GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t  Data4[8];
+} GUID;
+#endif
+
+#endif
+
+#endif
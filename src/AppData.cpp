@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include "json.hpp"
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+#include "AppData.h"
+
+std::string CAppData::GuidToString(const GUID& guid)
+{
+	char text[40];
+	snprintf(text, sizeof(text), "{%08lX-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+		(unsigned long)guid.Data1, guid.Data2, guid.Data3,
+		guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+		guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+	return text;
+}
+
+bool CAppData::Find(const std::string& dataPath, const GUID& app, RZAppRecord& record)
+{
+	FILE* f = fopen(CPlatform::PathJoin(dataPath, "broadcast.dat").c_str(), "rb");
+	if (!f)
+		return false;
+
+	DWORD len = 0;
+	if (fread(&len, 1, sizeof(len), f) != sizeof(len) || len > 0x1000000)
+	{
+		fclose(f);
+		return false;
+	}
+
+	std::unique_ptr<char[]> data(new char[len + 1]);
+	size_t read = fread(data.get(), 1, len, f);
+	fclose(f);
+	data[read] = 0;
+
+	const size_t keyLen = sizeof(RZBROADCAST_DAT_KEY) - 1;
+	for (size_t i = 0; i < read; i++)
+		data[i] ^= RZBROADCAST_DAT_KEY[i % keyLen];
+
+	nlohmann::json jsn = nlohmann::json::parse(data.get(), nullptr, false);
+	if (jsn.is_discarded() || !jsn.contains("app"))
+		return false;
+
+	std::string guidStr = GuidToString(app);
+	for (const auto &entry : jsn["app"])
+	{
+		if (guidStr != entry["guid"])
+			continue;
+
+		int Status = strtol(entry["status"].get<std::string>().c_str(), NULL, 10);
+		if (Status != 1 && Status != 2)
+			continue;
+
+		record.Status = Status;
+		record.Index = strtol(entry["index"].get<std::string>().c_str(), NULL, 10);
+		record.Title = entry["title"].get<std::string>();
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,33 @@
+//! \file AppData.h
+//! \brief Registered application list (broadcast.dat) written by Synapse.
+
+#ifndef _APPDATA_H_
+#define _APPDATA_H_
+
+#pragma once
+
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <RzChromaBroadcastAPITypes.h>
+
+struct RZAppRecord
+{
+	int Index;
+	std::string Title;
+	int Status;          //!< 1 released app, 2 test app.
+};
+
+class CAppData
+{
+public:
+	//! Registry format of a GUID: "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}".
+	static std::string GuidToString(const GUID& guid);
+
+	//! Looks the app up in <dataPath>/broadcast.dat. Returns false when the file cannot be read
+	//! or the app is not listed with status 1 or 2.
+	static bool Find(const std::string& dataPath, const GUID& app, RZAppRecord& record);
+};
+
+#endif
@@ -0,0 +1,51 @@
+//! \file BroadcastProtocol.h
+//! \brief Named objects and shared memory layout shared with the Synapse broadcast writer.
+
+#ifndef _BROADCASTPROTOCOL_H_
+#define _BROADCASTPROTOCOL_H_
+
+#pragma once
+
+#include <atomic>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <RzChromaBroadcastAPITypes.h>
+
+// Object names without namespace, the platform layer maps them to Global\ objects or POSIX shm
+const char RZBROADCAST_EVENT[] = "{91A407C5-C2B8-49FB-ABF9-88913B0B6ADD}";
+const char RZBROADCAST_SHARED_MEMORY[] = "{A66DE3D7-B9D1-4980-9A0E-BBB4AA943535}";
+const char RZSYNAPSE3_MUTEX[] = "{08B4F43A-DA51-4120-B388-CE0F8CE6F61A}";
+const char RZSYNAPSE3_NAME[] = "Razer Synapse Service";
+const char RZBROADCAST_APP_NUM_EVENT[] = "{08983A2E-6665-42B2-9492-38D5B1F3340A}";
+const char RZBROADCAST_REG_SUBKEY[] = "Software\\Razer\\ChromaBroadcast";
+const char RZBROADCAST_DAT_KEY[] = "h4cQkm3pL3a5E8u71FyoUc4Ntm34NsU5ukc";
+const char RZBROADCAST_DEV_ENABLE[] = "{E69A5B35-5E42-42A0-8721-9F7279269950}";
+
+#pragma pack(push, 1)
+struct RZEventData
+{
+	RZID index;
+	RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT effect;
+	DWORD Reserved1;
+	DWORD TickCount;
+	DWORD Reserved3;
+};
+
+struct RZEventSharedMemoryData
+{
+	DWORD idx;
+	DWORD Reserved0;
+	RZEventData events[10];
+};
+#pragma pack(pop)
+
+//! POSIX layout of a named event such as RZBROADCAST_EVENT: a manual reset event. Set stores Signaled and bumps Generation,
+//! waiters sleep on Generation with a process shared futex.
+struct RZPosixEvent
+{
+	std::atomic<unsigned int> Signaled;
+	std::atomic<unsigned int> Generation;
+};
+
+#endif
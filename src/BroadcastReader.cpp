@@ -0,0 +1,71 @@
+#include <string.h>
+#include "BroadcastReader.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const DWORD RING_SLOTS = sizeof(RZEventSharedMemoryData::events) / sizeof(RZEventSharedMemoryData::events[0]);
+
+CRingReader::CRingReader()
+{
+	Reset();
+}
+
+void CRingReader::Reset()
+{
+	LastIdx = MAXDWORD;
+	memset(&LastEvent, 0, sizeof(LastEvent));
+}
+
+bool CRingReader::Read(const RZEventSharedMemoryData* shared, CMetricsShard& metrics, RZEventData& frame)
+{
+	DWORD writeIdx = shared->idx % RING_SLOTS;
+	auto idx = writeIdx > 0 ? writeIdx - 1 : RING_SLOTS - 1;
+	memcpy(&frame, &shared->events[idx], sizeof(RZEventData));
+	metrics.Add(METRIC_FRAMES_READ);
+
+	// The writer bumps idx once per frame; an unchanged slot is the frame we already delivered
+	bool newFrame = writeIdx != LastIdx || frame.TickCount != LastEvent.TickCount || memcmp(&frame.effect, &LastEvent.effect, sizeof(frame.effect));
+	if (!newFrame)
+	{
+		metrics.Add(METRIC_FRAMES_DEDUPED);
+		return false;
+	}
+
+	if (LastIdx != MAXDWORD)
+	{
+		DWORD advanced = (writeIdx + RING_SLOTS - LastIdx) % RING_SLOTS;
+		if (advanced > 1)
+			metrics.Add(METRIC_FRAMES_DROPPED, advanced - 1);
+	}
+	LastIdx = writeIdx;
+	LastEvent.effect = frame.effect;
+	LastEvent.TickCount = frame.TickCount;
+	return true;
+}
+
+bool CRingReader::Pending(const RZEventSharedMemoryData* shared) const
+{
+	DWORD writeIdx = shared->idx % RING_SLOTS;
+	auto idx = writeIdx > 0 ? writeIdx - 1 : RING_SLOTS - 1;
+	const RZEventData& frame = shared->events[idx];
+	return writeIdx != LastIdx || frame.TickCount != LastEvent.TickCount || memcmp(&frame.effect, &LastEvent.effect, sizeof(frame.effect));
+}
+
+WAIT_RESULT CRingReader::Wait(const RZEventSharedMemoryData* shared, CNamedEvent& event, DWORD milliseconds, CEvent* cancel)
+{
+	if (cancel && cancel->IsSet())
+		return WAIT_RESULT_CANCELLED;
+	if (Pending(shared))
+		return WAIT_RESULT_SIGNALED;
+
+	WAIT_RESULT wait = event.Wait(milliseconds, cancel);
+	// Reset before the ring is read, a frame it misses sets the event again
+	if (wait == WAIT_RESULT_SIGNALED)
+		event.Reset();
+	return wait;
+}
+
+RZID CRingReader::TargetApp(const RZEventData& frame)
+{
+	return frame.effect.IsAppSpecific == 1 ? frame.index : 0;
+}
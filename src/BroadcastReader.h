@@ -0,0 +1,40 @@
+//! \file BroadcastReader.h
+//! \brief Reads the newest frame of the Synapse ring and decides whether it is new and meant for this app.
+
+#ifndef _BROADCASTREADER_H_
+#define _BROADCASTREADER_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+#include "Metrics.h"
+#include "Platform.h"
+
+class CRingReader
+{
+public:
+	CRingReader();
+
+	void Reset();
+
+	//! Copies the newest slot into frame. Returns true when it is a frame not seen before,
+	//! and counts read, deduped and dropped frames.
+	bool Read(const RZEventSharedMemoryData* shared, CMetricsShard& metrics, RZEventData& frame);
+
+	//! Whether the newest slot holds a frame Read has not returned yet.
+	bool Pending(const RZEventSharedMemoryData* shared) const;
+
+	//! Waits for a frame Read has not returned: returns WAIT_RESULT_SIGNALED at once when the ring holds one,
+	//! otherwise waits for event and resets it when signaled. The writer sets the manual reset event and never
+	//! resets it, left set it would never block again. A frame written after the reset sets it anew.
+	WAIT_RESULT Wait(const RZEventSharedMemoryData* shared, CNamedEvent& event, DWORD milliseconds, CEvent* cancel);
+
+	//! Index of the app an app specific frame targets, 0 for frames delivered to every app.
+	static RZID TargetApp(const RZEventData& frame);
+
+private:
+	DWORD LastIdx;
+	RZEventData LastEvent;
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "Broker.h"
+
+//! Same check as the DLL: broadcast enabled for the app in its settings key.
+static bool IsAppEnabledInSettings(const std::string& title)
+{
+	DWORD Enable = 0;
+	return CSettings::GetDword(std::string(RZBROADCAST_REG_SUBKEY) + "\\" + title + ".exe", "Enable", Enable) && Enable != 0;
+}
+
+//! Formats the name of a client event or broker ring with its process id.
+static std::string ProcessObjectName(const char* format, DWORD pid)
+{
+	char name[128];
+	snprintf(name, sizeof(name), format, (unsigned long)pid);
+	return name;
+}
+
+//------------------------------------------------------------------------------------------------
+// CBrokerServer
+
+CBrokerServer::CBrokerServer() : Page(nullptr)
+{
+	memset(EventOwners, 0, sizeof(EventOwners));
+	memset(AppsVersions, 0, sizeof(AppsVersions));
+}
+
+CBrokerServer::~CBrokerServer()
+{
+	Close();
+}
+
+bool CBrokerServer::Open(DWORD depth)
+{
+	// Left mapped by the clients and by the previous broker, a restarted broker takes the page over
+	if (!Memory.Open(RZBROADCAST_BROKER_SHARED_MEMORY, sizeof(RZBrokerPage), SHARED_MEMORY_OPEN_OR_CREATE, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+
+	RZBrokerPage* page = (RZBrokerPage*)Memory.Data();
+	DWORD owner = page->ProcessId.load(std::memory_order_acquire);
+	if (page->Magic == RZBROADCAST_BROKER_MAGIC && owner && owner != CPlatform::ProcessId() && CPlatform::IsProcessAlive(owner))
+	{
+		Memory.Close();
+		return false;
+	}
+
+	if (page->Magic != RZBROADCAST_BROKER_MAGIC || page->Version != RZBROADCAST_BROKER_VERSION)
+	{
+		page = new (Memory.Data()) RZBrokerPage();
+		page->Version = RZBROADCAST_BROKER_VERSION;
+		std::atomic_thread_fence(std::memory_order_release);
+		page->Magic = RZBROADCAST_BROKER_MAGIC;
+	}
+
+	// Named after this process, clients attaching once ProcessId is set find it
+	if (!Ring.Open(ProcessObjectName(RZBROADCAST_BROKER_RING, CPlatform::ProcessId()).c_str(), depth))
+	{
+		Memory.Close();
+		return false;
+	}
+
+	page->Status.store(0, std::memory_order_relaxed);
+	page->ProcessId.store(CPlatform::ProcessId(), std::memory_order_release);
+	Page = page;
+	CheckClients();
+	return true;
+}
+
+void CBrokerServer::Close()
+{
+	if (!Page)
+		return;
+
+	// Clients waiting on their event notice the broker left and report NOT_LIVE
+	Page->Status.store(0, std::memory_order_relaxed);
+	Page->ProcessId.store(0, std::memory_order_release);
+	WakeClients();
+
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		Events[i].Close();
+		EventOwners[i] = 0;
+		AppsVersions[i] = 0;
+		ClientApps[i].clear();
+	}
+	Apps.clear();
+	Page = nullptr;
+	Memory.Close();
+	Ring.Close();
+}
+
+void CBrokerServer::Publish(const RZEventData& frame, ULONGLONG timestamp)
+{
+	Ring.Publish(frame, timestamp);
+	WakeClients();
+}
+
+void CBrokerServer::SetStatus(DWORD status)
+{
+	if (Page->Status.exchange(status, std::memory_order_acq_rel) != status)
+		WakeClients();
+}
+
+DWORD CBrokerServer::Status() const
+{
+	return Page ? Page->Status.load(std::memory_order_acquire) : 0;
+}
+
+void CBrokerServer::CheckClients()
+{
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		DWORD pid = Page->Clients[i].ProcessId.load(std::memory_order_acquire);
+		if (pid && !CPlatform::IsProcessAlive(pid))
+		{
+			// The client died without detaching
+			Page->Clients[i].AppCount = 0;
+			Page->Clients[i].ProcessId.compare_exchange_strong(pid, 0);
+			pid = 0;
+		}
+		if (EventOwners[i] != pid)
+		{
+			Events[i].Close();
+			EventOwners[i] = 0;
+		}
+	}
+	RefreshApps(true);
+}
+
+bool CBrokerServer::IsAppServed(RZID index)
+{
+	RefreshApps(false);
+	auto app = Apps.find(index);
+	return app != Apps.end() && app->second;
+}
+
+DWORD CBrokerServer::ClientCount() const
+{
+	DWORD count = 0;
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		if (Page->Clients[i].ProcessId.load(std::memory_order_relaxed))
+			count++;
+	}
+	return count;
+}
+
+void CBrokerServer::WakeClients()
+{
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		DWORD pid = Page->Clients[i].ProcessId.load(std::memory_order_acquire);
+		if (!pid)
+			continue;
+
+		// The client creates its event before it claims the slot
+		if (EventOwners[i] != pid)
+		{
+			if (!Events[i].Open(ProcessObjectName(RZBROADCAST_BROKER_CLIENT_EVENT, pid).c_str(), SHARED_MEMORY_OPEN_EXISTING))
+				continue;
+			EventOwners[i] = pid;
+		}
+		Events[i].Set();
+	}
+}
+
+void CBrokerServer::RefreshApps(bool checkSettings)
+{
+	bool changed = false;
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		RZBrokerClient& client = Page->Clients[i];
+		DWORD version = client.AppsVersion.load(std::memory_order_acquire);
+		if (!client.ProcessId.load(std::memory_order_relaxed))
+		{
+			if (!ClientApps[i].empty())
+			{
+				ClientApps[i].clear();
+				changed = true;
+			}
+			continue;
+		}
+		if ((version & 1) || (!checkSettings && version == AppsVersions[i]))
+			continue;
+
+		RZBrokerApp apps[BROKER_MAX_APPS];
+		DWORD count = client.AppCount < BROKER_MAX_APPS ? client.AppCount : BROKER_MAX_APPS;
+		for (DWORD j = 0; j < count; j++)
+		{
+			apps[j].Index = client.Apps[j].Index;
+			memcpy(apps[j].Title, client.Apps[j].Title, sizeof(apps[j].Title));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (client.AppsVersion.load(std::memory_order_relaxed) != version)
+			continue;
+
+		ClientApps[i].clear();
+		for (DWORD j = 0; j < count; j++)
+		{
+			apps[j].Title[sizeof(apps[j].Title) - 1] = 0;
+			bool enabled = IsAppEnabledInSettings(apps[j].Title);
+			client.Apps[j].Enabled.store(enabled ? 1 : 0, std::memory_order_relaxed);
+			ClientApps[i].push_back(std::make_pair(apps[j].Index, enabled));
+		}
+		AppsVersions[i] = version;
+		changed = true;
+	}
+
+	if (!changed)
+		return;
+
+	Apps.clear();
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS; i++)
+	{
+		for (const auto& app : ClientApps[i])
+			Apps[app.first] = Apps[app.first] || app.second;
+	}
+}
+
+//------------------------------------------------------------------------------------------------
+// CBrokerClient
+
+CBrokerClient::CBrokerClient() : Page(nullptr), Slot(nullptr)
+{
+}
+
+CBrokerClient::~CBrokerClient()
+{
+	Detach();
+}
+
+bool CBrokerClient::Attach()
+{
+	Detach();
+
+	if (!Memory.Open(RZBROADCAST_BROKER_SHARED_MEMORY, sizeof(RZBrokerPage), SHARED_MEMORY_OPEN_EXISTING, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+
+	Page = (RZBrokerPage*)Memory.Data();
+	DWORD pid = CPlatform::ProcessId();
+	if (Page->Magic != RZBROADCAST_BROKER_MAGIC || Page->Version != RZBROADCAST_BROKER_VERSION || !IsBrokerAlive()
+		|| !Ring.Open(ProcessObjectName(RZBROADCAST_BROKER_RING, Page->ProcessId.load(std::memory_order_acquire)).c_str())
+		|| !Event.Open(ProcessObjectName(RZBROADCAST_BROKER_CLIENT_EVENT, pid).c_str(), SHARED_MEMORY_CREATE))
+	{
+		Detach();
+		return false;
+	}
+
+	for (DWORD i = 0; i < BROKER_MAX_CLIENTS && !Slot; i++)
+	{
+		RZBrokerClient& client = Page->Clients[i];
+		DWORD expected = 0;
+		if (client.ProcessId.load(std::memory_order_relaxed) == 0 && client.ProcessId.compare_exchange_strong(expected, pid))
+			Slot = &client;
+	}
+	if (!Slot)
+	{
+		Detach();
+		return false;
+	}
+
+	Slot->AppCount = 0;
+	return true;
+}
+
+void CBrokerClient::Detach()
+{
+	if (Slot)
+	{
+		Slot->AppCount = 0;
+		Slot->AppsVersion.fetch_add(2, std::memory_order_release);
+		Slot->ProcessId.store(0, std::memory_order_release);
+		Slot = nullptr;
+	}
+	Event.Close();
+	Ring.Close();
+	Memory.Close();
+	Page = nullptr;
+}
+
+void CBrokerClient::SetApps(const std::vector<std::pair<RZID, std::string>>& apps, const std::vector<bool>& enabled)
+{
+	if (!Slot)
+		return;
+
+	Slot->AppsVersion.fetch_add(1, std::memory_order_acq_rel);
+	std::atomic_thread_fence(std::memory_order_release);
+	DWORD count = 0;
+	for (size_t i = 0; i < apps.size() && count < BROKER_MAX_APPS; i++, count++)
+	{
+		RZBrokerApp& app = Slot->Apps[count];
+		app.Index = apps[i].first;
+		app.Enabled.store(i < enabled.size() && enabled[i] ? 1 : 0, std::memory_order_relaxed);
+		size_t len = apps[i].second.size() < sizeof(app.Title) - 1 ? apps[i].second.size() : sizeof(app.Title) - 1;
+		memcpy(app.Title, apps[i].second.c_str(), len);
+		app.Title[len] = 0;
+	}
+	Slot->AppCount = count;
+	Slot->AppsVersion.fetch_add(1, std::memory_order_release);
+}
+
+bool CBrokerClient::IsAppEnabled(RZID index) const
+{
+	if (!Slot)
+		return false;
+
+	for (DWORD i = 0; i < Slot->AppCount && i < BROKER_MAX_APPS; i++)
+	{
+		if (Slot->Apps[i].Index == index)
+			return Slot->Apps[i].Enabled.load(std::memory_order_relaxed) != 0;
+	}
+	return false;
+}
+
+DWORD CBrokerClient::Status() const
+{
+	if (!Page || !Page->ProcessId.load(std::memory_order_acquire))
+		return 0;
+	return Page->Status.load(std::memory_order_acquire);
+}
+
+bool CBrokerClient::IsBrokerAlive() const
+{
+	DWORD pid = Page ? Page->ProcessId.load(std::memory_order_acquire) : 0;
+	return pid && CPlatform::IsProcessAlive(pid);
+}
+
+WAIT_RESULT CBrokerClient::Wait(DWORD milliseconds, CEvent* cancel)
+{
+	WAIT_RESULT result = Event.Wait(milliseconds, cancel);
+	// Rearm before reading, a frame published after this point sets the event again
+	if (result == WAIT_RESULT_SIGNALED)
+		Event.Reset();
+	return result;
+}
+
+bool CBrokerClient::Read(RZEventData& frame, CMetricsShard& metrics)
+{
+	RZFrameRingEntry entry;
+	ULONGLONG missed = 0;
+	bool read = Ring.Read(entry, missed);
+	if (missed)
+		metrics.Add(METRIC_FRAMES_DROPPED, missed);
+	if (!read)
+		return false;
+
+	metrics.Add(METRIC_FRAMES_READ);
+	frame = entry.Frame;
+	return true;
+}
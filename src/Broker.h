@@ -0,0 +1,107 @@
+//! \file Broker.h
+//! \brief Both ends of the local broker page: the broker republishing the Synapse frames, and the clients reading them.
+
+#ifndef _BROKER_H_
+#define _BROKER_H_
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "BrokerProtocol.h"
+#include "FrameRing.h"
+#include "Metrics.h"
+#include "Platform.h"
+
+//! Broker side: owns the ring and the status, tracks the client slots and wakes the clients.
+class CBrokerServer
+{
+public:
+	CBrokerServer();
+	~CBrokerServer();
+
+	//! Creates a frame ring of depth slots, then maps the broker page and takes it over. Fails
+	//! while another broker is alive.
+	bool Open(DWORD depth = FRAME_RING_DEFAULT_DEPTH);
+	void Close();
+
+	//! Appends a frame ingested at timestamp to the ring and wakes the clients.
+	void Publish(const RZEventData& frame, ULONGLONG timestamp);
+	DWORD RingDepth() const { return Ring.Depth(); }
+
+	//! Publishes the Synapse health as BROKER_STATUS bits, waking the clients when it changed.
+	void SetStatus(DWORD status);
+	DWORD Status() const;
+
+	//! Frees the slots of exited clients and rereads the enable setting of every app they serve.
+	void CheckClients();
+
+	//! True when a client serves the app and broadcast is enabled for it.
+	bool IsAppServed(RZID index);
+
+	DWORD ClientCount() const;
+
+private:
+	CBrokerServer(const CBrokerServer&) = delete;
+	CBrokerServer& operator=(const CBrokerServer&) = delete;
+
+	void WakeClients();
+	//! Copies the apps of the clients that changed them, or of all clients when checkSettings is
+	//! set, and refreshes their Enabled flag from the settings.
+	void RefreshApps(bool checkSettings);
+
+	CSharedMemory Memory;
+	RZBrokerPage* Page;
+	CFrameRingWriter Ring;
+	CNamedEvent Events[BROKER_MAX_CLIENTS];
+	DWORD EventOwners[BROKER_MAX_CLIENTS];      //!< Process each slot's event was opened for.
+	DWORD AppsVersions[BROKER_MAX_CLIENTS];     //!< AppsVersion of each slot when its apps were last copied.
+	std::vector<std::pair<RZID, bool>> ClientApps[BROKER_MAX_CLIENTS];
+	std::unordered_map<RZID, bool> Apps;        //!< App index to enabled, over all clients.
+};
+
+//! Client side, used by the DLL instead of its own reader and monitor when a broker runs.
+class CBrokerClient
+{
+public:
+	CBrokerClient();
+	~CBrokerClient();
+
+	//! Maps the page of a running broker, creates the wake event and claims a client slot.
+	bool Attach();
+	void Detach();
+	bool IsAttached() const { return Slot != nullptr; }
+
+	//! Publishes the apps this process serves. enabled is the client's own reading of the
+	//! settings, kept until the broker checks them.
+	void SetApps(const std::vector<std::pair<RZID, std::string>>& apps, const std::vector<bool>& enabled);
+	bool IsAppEnabled(RZID index) const;
+
+	//! BROKER_STATUS bits, 0 once the broker exited.
+	DWORD Status() const;
+	//! Checks the broker process still exists, for clients that did not hear from it for a while.
+	bool IsBrokerAlive() const;
+
+	//! Waits until the broker publishes or changes status, then rearms the wake event.
+	WAIT_RESULT Wait(DWORD milliseconds, CEvent* cancel);
+
+	//! Copies the oldest frame not read yet. Returns false when there is none. Frames the broker
+	//! overwrote before they could be read are skipped and counted as dropped.
+	bool Read(RZEventData& frame, CMetricsShard& metrics);
+	//! Whether the broker published a frame not read yet, without waiting.
+	bool Pending() const { return Ring.Newest() > Ring.Position(); }
+
+private:
+	CBrokerClient(const CBrokerClient&) = delete;
+	CBrokerClient& operator=(const CBrokerClient&) = delete;
+
+	CSharedMemory Memory;
+	RZBrokerPage* Page;
+	RZBrokerClient* Slot;
+	CNamedEvent Event;
+	CFrameRingReader Ring;
+};
+
+#endif
@@ -0,0 +1,59 @@
+//! \file BrokerProtocol.h
+//! \brief Named objects and shared memory layout of the local broker, which reads the Synapse ring once and
+//! republishes the frames to every client process through a frame ring.
+
+#ifndef _BROKERPROTOCOL_H_
+#define _BROKERPROTOCOL_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+
+const char RZBROADCAST_BROKER_SHARED_MEMORY[] = "{6E1F3A52-9C84-4B07-A3D5-2F8E7C19B640}";
+//! Wake event of a client, formatted with its process id. The client creates it, the broker sets it.
+const char RZBROADCAST_BROKER_CLIENT_EVENT[] = "{6E1F3A52-9C84-4B07-A3D5-2F8E7C19B640}-%lu";
+//! Frame ring of a broker, formatted with its process id, see FrameRing.h.
+const char RZBROADCAST_BROKER_RING[] = "{6E1F3A52-9C84-4B07-A3D5-2F8E7C19B640}-Ring-%lu";
+const DWORD RZBROADCAST_BROKER_MAGIC = 0x4B425A52; // "RZBK"
+const DWORD RZBROADCAST_BROKER_VERSION = 2;
+
+const DWORD BROKER_MAX_CLIENTS = 32;
+const DWORD BROKER_MAX_APPS = 8;
+
+//! Health of the Synapse side as seen by the broker. Clients deliver effects only while all bits are set.
+enum BROKER_STATUS
+{
+	BROKER_STATUS_SYNAPSE_ONLINE = 0x1,     //!< The Synapse mutex exists.
+	BROKER_STATUS_ENABLED = 0x2,            //!< Broadcast is enabled in the settings.
+	BROKER_STATUS_SERVICE_RUNNING = 0x4,    //!< The Synapse service is running.
+	BROKER_STATUS_LIVE = 0x7,
+};
+
+//! An app served by a client. The client writes Index and Title, the broker refreshes Enabled from the settings.
+struct RZBrokerApp
+{
+	RZID Index;
+	std::atomic<DWORD> Enabled;
+	char Title[64];
+};
+
+//! Slot of a client process, claimed by swapping ProcessId from 0.
+struct RZBrokerClient
+{
+	std::atomic<DWORD> ProcessId;
+	//! Odd while the client rewrites Apps, the broker retries its copy when it changes.
+	std::atomic<DWORD> AppsVersion;
+	DWORD AppCount;
+	RZBrokerApp Apps[BROKER_MAX_APPS];
+};
+
+struct RZBrokerPage
+{
+	DWORD Magic;
+	DWORD Version;
+	std::atomic<DWORD> ProcessId;           //!< Broker process, 0 once it exited. Its ring exists while it is set.
+	std::atomic<DWORD> Status;              //!< BROKER_STATUS bits.
+	RZBrokerClient Clients[BROKER_MAX_CLIENTS];
+};
+
+#endif
@@ -0,0 +1,484 @@
+#include <string.h>
+#include <new>
+#include "Capture.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const DWORD CAPTURE_FIELD_COUNT = 7;
+
+//! The delta encoded fields of a frame in CAPTURE_FIELD bit order.
+static void GetFields(const RZEventData& frame, DWORD fields[CAPTURE_FIELD_COUNT])
+{
+	fields[0] = frame.index;
+	fields[1] = frame.effect.CL1;
+	fields[2] = frame.effect.CL2;
+	fields[3] = frame.effect.CL3;
+	fields[4] = frame.effect.CL4;
+	fields[5] = frame.effect.CL5;
+	fields[6] = (DWORD)frame.effect.IsAppSpecific;
+}
+
+static void SetFields(RZEventData& frame, const DWORD fields[CAPTURE_FIELD_COUNT])
+{
+	frame.index = fields[0];
+	frame.effect.CL1 = fields[1];
+	frame.effect.CL2 = fields[2];
+	frame.effect.CL3 = fields[3];
+	frame.effect.CL4 = fields[4];
+	frame.effect.CL5 = fields[5];
+	frame.effect.IsAppSpecific = (BOOL)fields[6];
+}
+
+//------------------------------------------------------------------------------------------------
+// CCaptureWriter
+
+CCaptureWriter::CCaptureWriter() : BatchTime(0), LastTime(0), Status(0), Length(0), Frames(0), Statuses(0)
+{
+	memset(&Previous, 0, sizeof(Previous));
+}
+
+CCaptureWriter::~CCaptureWriter()
+{
+	Close();
+}
+
+bool CCaptureWriter::Open(const char* path, ULONGLONG startTime)
+{
+	Close();
+
+	if (!File.Create(path, CAPTURE_GROW_BYTES))
+		return false;
+
+	RZCaptureHeader* header = new (File.Data()) RZCaptureHeader();
+	header->Magic = RZBROADCAST_CAPTURE_MAGIC;
+	header->Version = RZBROADCAST_CAPTURE_VERSION;
+	header->HeaderSize = sizeof(RZCaptureHeader);
+	header->ProcessId = CPlatform::ProcessId();
+	header->StartTime = startTime ? startTime : CPlatform::Now();
+	header->BlockSize = CAPTURE_BLOCK_BYTES;
+
+	Batch.clear();
+	Batch.reserve(CAPTURE_BATCH_BYTES * 2);
+	Index.clear();
+	BatchTime = 0;
+	LastTime = 0;
+	memset(&Previous, 0, sizeof(Previous));
+	Status = 0;
+	Length = 0;
+	Frames = 0;
+	Statuses = 0;
+	return true;
+}
+
+void CCaptureWriter::Close()
+{
+	if (!IsOpen())
+		return;
+
+	Flush();
+	// A failed flush closed the file already
+	if (IsOpen())
+		File.Close(WriteIndex());
+	Batch.clear();
+	Index.clear();
+}
+
+size_t CCaptureWriter::WriteIndex()
+{
+	size_t end = sizeof(RZCaptureHeader) + Length;
+	size_t offset = (end + 7) & ~(size_t)7;
+	size_t bytes = Index.size() * sizeof(RZCaptureIndexEntry);
+	if (offset + bytes > File.Size() && !File.Resize(offset + bytes))
+		return end;
+
+	BYTE* data = (BYTE*)File.Data();
+	memset(data + end, 0, offset - end);
+	memcpy(data + offset, Index.data(), bytes);
+	RZCaptureHeader* header = (RZCaptureHeader*)data;
+	header->IndexCount = (DWORD)Index.size();
+	header->IndexOffset = offset;
+	return offset + bytes;
+}
+
+void CCaptureWriter::AddVarint(ULONGLONG value)
+{
+	while (value >= 0x80)
+	{
+		Batch.push_back((BYTE)(value | 0x80));
+		value >>= 7;
+	}
+	Batch.push_back((BYTE)value);
+}
+
+void CCaptureWriter::AddTime(BYTE type, ULONGLONG time)
+{
+	const RZCaptureHeader* header = (const RZCaptureHeader*)File.Data();
+	ULONGLONG us = time > header->StartTime ? (time - header->StartTime) / 1000 : 0;
+	// Times never go backwards in the file, even for a record stamped before the previous one
+	if (us < LastTime)
+		us = LastTime;
+
+	if (Batch.empty())
+		BatchTime = time;
+	AddKeyframeIfDue();
+	Batch.push_back(type);
+	AddVarint(us - LastTime);
+	LastTime = us;
+}
+
+void CCaptureWriter::AddKeyframeIfDue()
+{
+	size_t used = (Length + Batch.size()) % CAPTURE_BLOCK_BYTES;
+	if (used != 0 && used + CAPTURE_MAX_RECORD <= CAPTURE_BLOCK_BYTES)
+		return;
+
+	if (used != 0)
+		Batch.insert(Batch.end(), CAPTURE_BLOCK_BYTES - used, (BYTE)CAPTURE_RECORD_PADDING);
+
+	RZCaptureIndexEntry entry = { LastTime, Frames };
+	Index.push_back(entry);
+
+	DWORD fields[CAPTURE_FIELD_COUNT];
+	GetFields(Previous, fields);
+	Batch.push_back(CAPTURE_RECORD_KEYFRAME);
+	AddVarint(LastTime);
+	AddVarint(Frames);
+	Batch.push_back((BYTE)Status);
+	AddVarint(Previous.TickCount);
+	for (DWORD i = 0; i < CAPTURE_FIELD_COUNT; i++)
+		AddVarint(fields[i]);
+}
+
+void CCaptureWriter::AddFrame(const RZEventData& frame, ULONGLONG time)
+{
+	if (!IsOpen())
+		return;
+
+	DWORD fields[CAPTURE_FIELD_COUNT], previous[CAPTURE_FIELD_COUNT];
+	GetFields(frame, fields);
+	GetFields(Previous, previous);
+
+	BYTE changed = 0;
+	for (DWORD i = 0; i < CAPTURE_FIELD_COUNT; i++)
+	{
+		if (fields[i] != previous[i])
+			changed |= (BYTE)(1 << i);
+	}
+
+	AddTime(CAPTURE_RECORD_FRAME | changed, time);
+	AddVarint((DWORD)(frame.TickCount - Previous.TickCount));
+	for (DWORD i = 0; i < CAPTURE_FIELD_COUNT; i++)
+	{
+		if (changed & (1 << i))
+			AddVarint(fields[i] ^ previous[i]);
+	}
+
+	Previous = frame;
+	Frames++;
+}
+
+void CCaptureWriter::SetStatus(CHROMA_BROADCAST_STATUS status, ULONGLONG time)
+{
+	if (!IsOpen() || Status == (int)status)
+		return;
+
+	AddTime(CAPTURE_RECORD_STATUS, time);
+	Batch.push_back((BYTE)status);
+	Status = (int)status;
+	Statuses++;
+}
+
+bool CCaptureWriter::FlushIfDue(ULONGLONG now)
+{
+	if (Batch.size() >= CAPTURE_BATCH_BYTES || (!Batch.empty() && now - BatchTime >= CAPTURE_BATCH_AGE))
+		return Flush();
+	return true;
+}
+
+bool CCaptureWriter::Flush()
+{
+	if (!IsOpen())
+		return false;
+	if (Batch.empty())
+		return true;
+
+	size_t needed = sizeof(RZCaptureHeader) + Length + Batch.size();
+	if (needed > File.Size())
+	{
+		size_t size = File.Size() * 2;
+		if (size < needed)
+			size = (needed + CAPTURE_GROW_BYTES - 1) / CAPTURE_GROW_BYTES * CAPTURE_GROW_BYTES;
+		if (!File.Resize(size))
+		{
+			// What was flushed before stays readable
+			File.Close(sizeof(RZCaptureHeader) + Length);
+			Batch.clear();
+			return false;
+		}
+	}
+
+	BYTE* data = (BYTE*)File.Data();
+	memcpy(data + sizeof(RZCaptureHeader) + Length, Batch.data(), Batch.size());
+	Length += Batch.size();
+	Batch.clear();
+
+	RZCaptureHeader* header = (RZCaptureHeader*)data;
+	header->Frames = Frames;
+	header->Statuses = Statuses;
+	header->Length.store(Length, std::memory_order_release);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CCaptureReader
+
+CCaptureReader::CCaptureReader() : Index(nullptr), BlockSize(0), Offset(0), End(0), LastTime(0), Frames(0), LastStatus(0)
+{
+	memset(&Previous, 0, sizeof(Previous));
+}
+
+CCaptureReader::~CCaptureReader()
+{
+	Close();
+}
+
+bool CCaptureReader::Open(const char* path)
+{
+	Close();
+
+	if (!File.OpenReadOnly(path))
+		return false;
+
+	const RZCaptureHeader* header = Header();
+	if (File.Size() < sizeof(RZCaptureHeader) || header->Magic != RZBROADCAST_CAPTURE_MAGIC
+		|| (header->Version != RZBROADCAST_CAPTURE_VERSION && header->Version != RZBROADCAST_CAPTURE_VERSION_LINEAR)
+		|| header->HeaderSize < sizeof(RZCaptureHeader) || header->HeaderSize > File.Size()
+		|| (header->Version == RZBROADCAST_CAPTURE_VERSION && header->BlockSize < CAPTURE_MAX_RECORD * 2))
+	{
+		Close();
+		return false;
+	}
+
+	// A capture still being recorded, or cut short, ends at the last batch flushed
+	ULONGLONG length = header->Length.load(std::memory_order_acquire);
+	End = header->HeaderSize + (size_t)length;
+	if (End > File.Size() || End < header->HeaderSize)
+		End = File.Size();
+
+	if (header->Version == RZBROADCAST_CAPTURE_VERSION)
+	{
+		BlockSize = header->BlockSize;
+		ULONGLONG offset = header->IndexOffset;
+		size_t bytes = Blocks() * sizeof(RZCaptureIndexEntry);
+		if (offset >= End && offset % 8 == 0 && header->IndexCount == Blocks() && offset + bytes <= File.Size())
+			Index = (const RZCaptureIndexEntry*)((const BYTE*)File.Data() + offset);
+	}
+	Rewind();
+	return true;
+}
+
+void CCaptureReader::Close()
+{
+	File.Close();
+	Index = nullptr;
+	BlockSize = 0;
+	Offset = 0;
+	End = 0;
+}
+
+void CCaptureReader::Rewind()
+{
+	Offset = Header() ? Header()->HeaderSize : 0;
+	LastTime = 0;
+	memset(&Previous, 0, sizeof(Previous));
+	Frames = 0;
+	LastStatus = 0;
+}
+
+size_t CCaptureReader::Blocks() const
+{
+	if (!BlockSize)
+		return 0;
+	return (End - Header()->HeaderSize + BlockSize - 1) / BlockSize;
+}
+
+bool CCaptureReader::ReadVarint(size_t& offset, ULONGLONG& value) const
+{
+	const BYTE* data = (const BYTE*)File.Data();
+	value = 0;
+	for (unsigned int shift = 0; shift < 64 && offset < End; shift += 7)
+	{
+		BYTE byte = data[offset++];
+		value |= (ULONGLONG)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool CCaptureReader::ReadKeyframe()
+{
+	const BYTE* data = (const BYTE*)File.Data();
+	ULONGLONG time = 0, frames = 0, ticks = 0;
+	if (!ReadVarint(Offset, time) || !ReadVarint(Offset, frames) || Offset >= End)
+		return false;
+	BYTE status = data[Offset++];
+	if (!ReadVarint(Offset, ticks))
+		return false;
+
+	DWORD fields[CAPTURE_FIELD_COUNT];
+	for (DWORD i = 0; i < CAPTURE_FIELD_COUNT; i++)
+	{
+		ULONGLONG value = 0;
+		if (!ReadVarint(Offset, value))
+			return false;
+		fields[i] = (DWORD)value;
+	}
+
+	memset(&Previous, 0, sizeof(Previous));
+	SetFields(Previous, fields);
+	Previous.TickCount = (DWORD)ticks;
+	LastTime = time;
+	Frames = frames;
+	LastStatus = status;
+	return true;
+}
+
+bool CCaptureReader::BlockTime(size_t block, ULONGLONG& time) const
+{
+	if (Index)
+	{
+		time = Index[block].Time;
+		return true;
+	}
+
+	size_t offset = Header()->HeaderSize + block * BlockSize;
+	if (offset >= End || ((const BYTE*)File.Data())[offset] != CAPTURE_RECORD_KEYFRAME)
+		return false;
+	offset++;
+	return ReadVarint(offset, time);
+}
+
+bool CCaptureReader::Seek(ULONGLONG time)
+{
+	Rewind();
+
+	// The last block whose keyframe is earlier than time, records at time may end the block before
+	size_t blocks = Blocks();
+	if (blocks > 1)
+	{
+		size_t low = 0, high = blocks - 1;
+		while (low < high)
+		{
+			size_t middle = low + (high - low + 1) / 2;
+			ULONGLONG start = 0;
+			if (!BlockTime(middle, start))
+				return false;
+			if (start < time)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+		Offset = Header()->HeaderSize + low * BlockSize;
+	}
+	// Take the block's state from its keyframe now, the first record may already be the one sought
+	if (BlockSize && Offset < End && ((const BYTE*)File.Data())[Offset] == CAPTURE_RECORD_KEYFRAME)
+	{
+		Offset++;
+		if (!ReadKeyframe())
+			return false;
+	}
+
+	for (;;)
+	{
+		size_t offset = Offset;
+		ULONGLONG lastTime = LastTime;
+		RZEventData previous = Previous;
+		ULONGLONG frames = Frames;
+		int status = LastStatus;
+
+		RZCaptureRecord record;
+		if (!Next(record))
+			return false;
+		if (record.Time >= time)
+		{
+			Offset = offset;
+			LastTime = lastTime;
+			Previous = previous;
+			Frames = frames;
+			LastStatus = status;
+			return true;
+		}
+	}
+}
+
+bool CCaptureReader::Next(RZCaptureRecord& record)
+{
+	const BYTE* data = (const BYTE*)File.Data();
+	BYTE type = 0;
+	for (;;)
+	{
+		if (Offset >= End)
+			return false;
+		type = data[Offset++];
+		if (type == CAPTURE_RECORD_PADDING && BlockSize)
+		{
+			size_t header = Header()->HeaderSize;
+			Offset = header + ((Offset - header) / BlockSize + 1) * BlockSize;
+			continue;
+		}
+		if (type == CAPTURE_RECORD_KEYFRAME && BlockSize)
+		{
+			if (!ReadKeyframe())
+				return false;
+			continue;
+		}
+		break;
+	}
+
+	ULONGLONG delta = 0;
+	if (!ReadVarint(Offset, delta))
+		return false;
+	LastTime += delta;
+	record.Time = LastTime;
+
+	if (type == CAPTURE_RECORD_STATUS)
+	{
+		if (Offset >= End)
+			return false;
+		record.Type = CAPTURE_RECORD_STATUS;
+		record.Status = (CHROMA_BROADCAST_STATUS)data[Offset++];
+		record.Frame = Previous;
+		LastStatus = record.Status;
+		return true;
+	}
+	if (!(type & CAPTURE_RECORD_FRAME))
+		return false;
+
+	ULONGLONG ticks = 0;
+	if (!ReadVarint(Offset, ticks))
+		return false;
+
+	DWORD fields[CAPTURE_FIELD_COUNT];
+	GetFields(Previous, fields);
+	for (DWORD i = 0; i < CAPTURE_FIELD_COUNT; i++)
+	{
+		ULONGLONG value = 0;
+		if (!(type & (1 << i)))
+			continue;
+		if (!ReadVarint(Offset, value))
+			return false;
+		fields[i] ^= (DWORD)value;
+	}
+
+	RZEventData frame = Previous;
+	SetFields(frame, fields);
+	frame.TickCount = Previous.TickCount + (DWORD)ticks;
+	Previous = frame;
+	Frames++;
+
+	record.Type = CAPTURE_RECORD_FRAME;
+	record.Frame = frame;
+	record.Status = (CHROMA_BROADCAST_STATUS)0;
+	return true;
+}
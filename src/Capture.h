@@ -0,0 +1,186 @@
+//! \file Capture.h
+//! \brief Binary capture of the broadcast stream: every frame the workers received and every status transition,
+//! delta encoded against the previous frame and appended in batches to a memory mapped file.
+//!
+//! After the header, a capture is a sequence of records. Each starts with a type byte and the microseconds
+//! since the previous record as a LEB128 varint. A status record is followed by the status byte. A frame
+//! record carries CAPTURE_FIELD bits in the low bits of its type byte, then the TickCount delta and the
+//! changed fields, each as a varint of its XOR with the previous frame's value.
+//!
+//! Records are grouped in blocks of CAPTURE_BLOCK_BYTES and never straddle two. Every block starts with a
+//! keyframe that holds the whole decoder state, so decoding can start at any block, and ends with zero
+//! padding. Close appends an index with the keyframe time of each block, which lets a reader find the block
+//! holding a time with a binary search over the index, or over the keyframes of a capture cut short.
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+const DWORD RZBROADCAST_CAPTURE_MAGIC = 0x50435A52; // "RZCP"
+const DWORD RZBROADCAST_CAPTURE_VERSION = 2;
+//! Version 1 captures have neither blocks nor an index, they are still read from the start.
+const DWORD RZBROADCAST_CAPTURE_VERSION_LINEAR = 1;
+
+//! Pending bytes that make the recorder copy its batch to the file.
+const size_t CAPTURE_BATCH_BYTES = 16384;
+//! Longest a record waits in the batch, in nanoseconds.
+const unsigned long long CAPTURE_BATCH_AGE = 1000000000ULL;
+//! The file grows in steps of this many bytes.
+const size_t CAPTURE_GROW_BYTES = 1 << 20;
+//! Bytes of records per block, each block costs one keyframe and one index entry.
+const size_t CAPTURE_BLOCK_BYTES = 1 << 14;
+//! Longest encoded record, a block with less room left is padded.
+const size_t CAPTURE_MAX_RECORD = 80;
+
+enum CAPTURE_RECORD : unsigned char
+{
+	CAPTURE_RECORD_PADDING = 0x00,          //!< The rest of the block is padding.
+	CAPTURE_RECORD_STATUS = 0x01,
+	CAPTURE_RECORD_KEYFRAME = 0x02,         //!< Absolute time, frame count, status, TickCount and all fields.
+	CAPTURE_RECORD_FRAME = 0x80,            //!< The low 7 bits are CAPTURE_FIELD flags.
+};
+
+//! Frame fields that differ from the previous frame. TickCount is always present.
+enum CAPTURE_FIELD : unsigned char
+{
+	CAPTURE_FIELD_INDEX = 0x01,
+	CAPTURE_FIELD_CL1 = 0x02,               //!< CL1 to CL5 are consecutive bits.
+	CAPTURE_FIELD_APP_SPECIFIC = 0x40,
+};
+
+struct RZCaptureHeader
+{
+	DWORD Magic;
+	DWORD Version;
+	DWORD HeaderSize;
+	DWORD ProcessId;                        //!< Process that recorded the capture.
+	ULONGLONG StartTime;                    //!< CPlatform::Now() the record times count from.
+	std::atomic<ULONGLONG> Length;          //!< Bytes of records after the header, readers stop there.
+	ULONGLONG Frames;
+	ULONGLONG Statuses;
+	ULONGLONG IndexOffset;                  //!< File offset of the block index, 0 until Close writes it.
+	DWORD IndexCount;
+	DWORD BlockSize;                        //!< CAPTURE_BLOCK_BYTES, 0 in version 1.
+};
+
+static_assert(sizeof(RZCaptureHeader) == 64, "the capture header is part of the file format");
+
+//! Keyframe of a block, the index holds one per block in file order.
+struct RZCaptureIndexEntry
+{
+	ULONGLONG Time;                         //!< Microseconds of the last record before the block.
+	ULONGLONG Frames;                       //!< Frames recorded before the block.
+};
+
+//! A decoded record.
+struct RZCaptureRecord
+{
+	CAPTURE_RECORD Type;
+	ULONGLONG Time;                         //!< Microseconds since the start of the capture.
+	RZEventData Frame;                      //!< The frame, or the last one before a status record.
+	RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS Status;
+};
+
+//! Records frames and status transitions. Adding a record only encodes it into a batch in memory,
+//! the batch reaches the file in Flush, which the worker calls once the frame was delivered.
+class CCaptureWriter
+{
+public:
+	CCaptureWriter();
+	~CCaptureWriter();
+
+	//! Creates or truncates the capture file. Record times count from startTime, CPlatform::Now() when 0.
+	bool Open(const char* path, ULONGLONG startTime = 0);
+	//! Flushes, appends the block index and trims the file.
+	void Close();
+	bool IsOpen() const { return File.Data() != nullptr; }
+
+	//! time is CPlatform::Now() when the frame was received.
+	void AddFrame(const RZEventData& frame, ULONGLONG time);
+	//! Records the status when it differs from the last one recorded.
+	void SetStatus(RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status, ULONGLONG time);
+
+	//! Flushes once the batch is CAPTURE_BATCH_BYTES or CAPTURE_BATCH_AGE old.
+	bool FlushIfDue(ULONGLONG now);
+	//! Copies the batch to the file. Fails and closes the capture when the file cannot grow.
+	bool Flush();
+
+private:
+	CCaptureWriter(const CCaptureWriter&) = delete;
+	CCaptureWriter& operator=(const CCaptureWriter&) = delete;
+
+	void AddTime(BYTE type, ULONGLONG time);
+	void AddKeyframeIfDue();
+	void AddVarint(ULONGLONG value);
+	size_t WriteIndex();
+
+	CMappedFile File;
+	std::vector<BYTE> Batch;
+	std::vector<RZCaptureIndexEntry> Index;
+	ULONGLONG BatchTime;                    //!< Now() of the oldest record in the batch.
+	ULONGLONG LastTime;                     //!< Microseconds of the last record.
+	RZEventData Previous;
+	int Status;                             //!< Last status recorded, 0 before the first.
+	size_t Length;
+	ULONGLONG Frames;
+	ULONGLONG Statuses;
+};
+
+//! Decodes a capture, written or still being written. The file is only mapped, pages are read as records
+//! are decoded, so captures larger than memory can be read and seeked.
+class CCaptureReader
+{
+public:
+	CCaptureReader();
+	~CCaptureReader();
+
+	bool Open(const char* path);
+	void Close();
+
+	const RZCaptureHeader* Header() const { return (const RZCaptureHeader*)File.Data(); }
+
+	//! Decodes the next record. Returns false at the end of the capture or at a corrupt record.
+	bool Next(RZCaptureRecord& record);
+	//! Back to the first record.
+	void Rewind();
+	//! Continues with the first record at or after time, in microseconds since the start. Decodes at most one
+	//! block past a binary search over the blocks. Returns false when no record is that late.
+	bool Seek(ULONGLONG time);
+
+	//! Time of the last record decoded, so Seek(~0ULL) leaves the duration of the capture here.
+	ULONGLONG Time() const { return LastTime; }
+	//! Frames decoded before the next record, counted from the start of the capture.
+	ULONGLONG FrameNumber() const { return Frames; }
+	//! Status in effect before the next record, 0 before the first status record.
+	int Status() const { return LastStatus; }
+	//! Number of blocks, 0 for a version 1 capture.
+	size_t Blocks() const;
+	//! True when Close wrote the index, a capture cut short is seeked through its keyframes.
+	bool HasIndex() const { return Index != nullptr; }
+
+private:
+	CCaptureReader(const CCaptureReader&) = delete;
+	CCaptureReader& operator=(const CCaptureReader&) = delete;
+
+	bool ReadVarint(size_t& offset, ULONGLONG& value) const;
+	bool ReadKeyframe();
+	bool BlockTime(size_t block, ULONGLONG& time) const;
+
+	CMappedFile File;
+	const RZCaptureIndexEntry* Index;
+	size_t BlockSize;
+	size_t Offset;
+	size_t End;
+	ULONGLONG LastTime;
+	RZEventData Previous;
+	ULONGLONG Frames;
+	int LastStatus;
+};
+
+#endif
@@ -1,640 +1,1097 @@
-#include <Windows.h>
-#include <time.h>
 #include <stdio.h>
-#include <shlwapi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <RzErrors.h>
-#include <RzChromaBroadcastAPITypes.h>
-#include "json.hpp"
+#include "AppData.h"
+#include "BroadcastProtocol.h"
+#include "BroadcastReader.h"
+#include "Broker.h"
+#include "Capture.h"
+#include "FramePacer.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "OutputScheduler.h"
+#include "Platform.h"
+#include "SyncPlayout.h"
+#include "Trace.h"
 
 using namespace RzChromaBroadcastAPI;
 
-const wchar_t RZBROADCAST_EVENT[] = L"Global\\{91A407C5-C2B8-49FB-ABF9-88913B0B6ADD}";
-const wchar_t RZBROADCAST_SHARED_MEMORY[] = L"Global\\{A66DE3D7-B9D1-4980-9A0E-BBB4AA943535}";
-const wchar_t RZSYNAPSE3_MUTEX[] = L"Global\\{08B4F43A-DA51-4120-B388-CE0F8CE6F61A}";
-const wchar_t RZSYNAPSE3_NAME[] = L"Razer Synapse Service";
-const wchar_t RZBROADCAST_APP_NUM_EVENT[] = L"Global\\{08983A2E-6665-42B2-9492-38D5B1F3340A}";
-const char RZBROADCAST_REG_SUBKEY[] = "Software\\Razer\\ChromaBroadcast";
-const char RZBROADCAST_DAT_KEY[] = "h4cQkm3pL3a5E8u71FyoUc4Ntm34NsU5ukc";
-const char RZBROADCAST_DEV_ENABLE[] = "{E69A5B35-5E42-42A0-8721-9F7279269950}";
-
-#define RZLOGLEVEL_FATAL 0
-#define RZLOGLEVEL_ERROR 1
-#define RZLOGLEVEL_WARN 2
-#define RZLOGLEVEL_INFO 3
-#define RZLOGLEVEL_DEBUG 4
-
-#define BROADCAST_SUCCESS 0
-#define CHROMA_DEVICE_NOT_FOUND 1
-#define SYNAPSE3_NOT_INSTALLED 2
-#define SYNAPSE3_NOT_RUNNING 3
-#define SYNAPSE3_NOT_ONLINE 4
-#define BROADCAST_DISABLED 5
-#define BROADCAST_APP_DISABLED 6
-#define BROADCAST_MODULE_NOT_FOUND 7
-#define BROADCAST_DATA_NULL 8
-#define BROADCAST_DATA_INIT_SUCCESS 9
-
-#pragma pack(push, 1)
-struct RZEventData
-{
-	RZID index;
-	CHROMA_BROADCAST_EFFECT effect;
-	DWORD Reserved1;
-	DWORD TickCount;
-	DWORD Reserved3;
-};
+static_assert(METRICS_SHARD_COUNT - METRICS_SHARD_OUTPUT == OUTPUT_MAX_WORKERS, "A metrics shard for each output worker");
 
-struct RZEventSharedMemoryData
-{
-	DWORD idx;
-	DWORD Reserved0;
-	RZEventData events[10];
-};
-#pragma pack(pop)
+//! Milliseconds an output worker has to write a frame to a callback by default, a frame at 60 Hz.
+static const double OUTPUT_DEFAULT_DEADLINE = 16;
 
-struct RZEventSharedMemory
+//! Nanoseconds a paced worker sleeps at a time through the last stretch before a slot, a fifth of a frame at 1 kHz.
+static const unsigned long long PACING_SLICE = 200000;
+
+//! One app identity served by the process, the handle returned by CreateContext.
+//! Init and InitEx create the default context.
+struct RZBroadcastContext
 {
-	HANDLE file;
-	RZEventSharedMemoryData* mem;
+	int Index;
+	std::string Title;
+	RZEVENTNOTIFICATIONCALLBACK NotificationCallback = nullptr;    //!< Set by RegisterEventNotification.
+	RZCONTEXTNOTIFICATIONCALLBACK ContextCallback = nullptr;       //!< Set by RegisterContextNotification.
+	void* User = nullptr;
+	bool AppEnabled = false;    //!< Broadcast enabled for this app, refreshed by the health checks.
+	bool Running = false;       //!< LIVE was reported to the callback.
+	bool Retired = false;       //!< Destroyed from a callback, freed once the worker is done with it.
+	int Sink = -1;              //!< Its sink when the output workers write the callbacks.
+
+	RZBroadcastContext(int index, const std::string& title) : Index(index), Title(title) {}
+
+	bool HasCallback() const { return NotificationCallback || ContextCallback; }
 };
 
-FILE* logFile = nullptr;
-
-void Log(unsigned char loglevel, const char *filename, int fileline, const char *format, ...)
+//! Process wide reader and supervisor shared by every context: one broadcast thread reads the
+//! ring and routes each frame, one monitor thread watches the Synapse service.
+class CChromaBroadcastAPI
 {
-	if (!logFile)
-		return;
+public:
+	static bool IsInitialized;
+	static RZBroadcastContext* DefaultContext;
 
-	if (loglevel > RZLOGLEVEL_DEBUG)
-		loglevel = RZLOGLEVEL_DEBUG;
+private:
+	static CEvent UninitEvent;
+	static CThread BroadcastDataThread;
+	static CThread MonitorOnlineThread;
+	static CNamedEvent BroadcastEventData;
+	//! Attached while a broker process serves the frames, the workers are then replaced by Thread_BrokerData.
+	static CBrokerClient Broker;
+	//! Open while recording, fed by the workers with Critical held.
+	static CCaptureWriter Recorder;
+	//! Open in replay mode, read by Thread_ReplayData only.
+	static CCaptureReader Replay;
+	static double ReplaySpeed;
+	//! Open in sync mode, run by Thread_SyncData only.
+	static CSyncFollower Sync;
+	//! Set by RZBROADCAST_PACING when the workers start, Pacer is then fed by Thread_BroadcastData or
+	//! Thread_BrokerData only.
+	static bool Pacing;
+	static RZFramePacerConfig PacingConfig;
+	static CFramePacer Pacer;
+	//! Open when RZBROADCAST_OUTPUT hands the callbacks to output workers, a sink for each context.
+	static COutputScheduler Output;
+	static DWORD OutputDeadline;
+	//! Guards the callbacks of the contexts for the output workers, taken inside Critical by those changing them.
+	static CLock CallbackLock;
+	//! Guards the contexts and their callbacks, held by the workers while they notify.
+	static CLock Critical;
+	//! Serializes starting and stopping the workers. Never taken by the workers themselves.
+	static CLock Lifecycle;
+	static bool ThreadsRunning;
+	static std::vector<RZBroadcastContext*> Contexts;
+	//! App index to context, for frames addressed to a single app.
+	static std::unordered_map<RZID, RZBroadcastContext*> Routes;
+	static std::vector<RZBroadcastContext*> Dispatching;
+	static std::vector<RZBroadcastContext*> Retired;
+	static bool Synapse3NotOnline;
+	static RZSTATUS LogStatus;
 
-	va_list ArgList;
-	va_start(ArgList, format);
+	static bool CheckIsChromaBroadcastEnabled()
+	{
+		DWORD Enable = 0;
+		return CSettings::GetDword(RZBROADCAST_REG_SUBKEY, "Enable", Enable) && Enable != 0;
+	}
 
-	char line[260];
-	vsprintf(line, format, ArgList);
+	static bool CheckIsChromaBroadcastForAppEnabled(const std::string& title)
+	{
+		DWORD Enable = 0;
+		return CSettings::GetDword(std::string(RZBROADCAST_REG_SUBKEY) + "\\" + title + ".exe", "Enable", Enable) && Enable != 0;
+	}
 
-	const char* levels[] = { "Fatal", "Error", "Warn", "Info", "Debug" };
+	static RZRESULT Notify(CMetricsShard& metrics, RZBroadcastContext& context, CHROMA_BROADCAST_TYPE type, PRZPARAM pData)
+	{
+		CTraceSpan span(TRACE_CALLBACK);
+		unsigned long long start = CBroadcastMetrics::Now();
+		RZRESULT result = context.ContextCallback
+			? context.ContextCallback(&context, type, pData, context.User)
+			: context.NotificationCallback(type, pData);
+		metrics.AddCallbackTime(CBroadcastMetrics::Now() - start);
+		return result;
+	}
 
-	char time[100];
-	GetDateFormatA(LOCALE_USER_DEFAULT, 0, NULL, "yyyy'-'MM'-'dd HH':'mm", time, sizeof(time));
+	//! Milliseconds on the monotonic clock, for the health check intervals.
+	static unsigned long long Milliseconds()
+	{
+		return CPlatform::Now() / 1000000ULL;
+	}
 
-	fprintf(logFile, "[%s][%s][%s:%d]%s\n", time, levels[loglevel], filename, fileline, line);
+	static bool IsWorkerThread()
+	{
+		return BroadcastDataThread.IsCurrent() || MonitorOnlineThread.IsCurrent() || Output.IsWorker();
+	}
 
-	va_end(ArgList);
-}
+	//! Writes a frame or a status change to the callback of a context, on output worker worker.
+	//! Runs without Critical, so the callbacks of different contexts run side by side.
+	static void NotifyOutput(const RZEventData* frame, CHROMA_BROADCAST_STATUS status, void* user, size_t worker)
+	{
+		RZBroadcastContext& context = *(RZBroadcastContext*)user;
+		CMetricsShard& metrics = CBroadcastMetrics::Shard((METRICS_SHARD)(METRICS_SHARD_OUTPUT + worker));
+
+		// UnRegister waits for this write once it cleared the callbacks, so the copy is safe to call
+		CallbackLock.Enter();
+		RZEVENTNOTIFICATIONCALLBACK notification = context.NotificationCallback;
+		RZCONTEXTNOTIFICATIONCALLBACK callback = context.ContextCallback;
+		void* callbackUser = context.User;
+		CallbackLock.Leave();
+		if (!notification && !callback)
+			return;
+
+		CHROMA_BROADCAST_TYPE type = frame ? BROADCAST_EFFECT : BROADCAST_STATUS;
+		PRZPARAM data = frame ? (PRZPARAM)&frame->effect : (PRZPARAM)status;
+		CTraceSpan span(TRACE_CALLBACK);
+		unsigned long long start = CBroadcastMetrics::Now();
+		if (callback)
+			callback(&context, type, data, callbackUser);
+		else
+			notification(type, data);
+		metrics.AddCallbackTime(CBroadcastMetrics::Now() - start);
+		if (frame)
+		{
+			metrics.Add(METRIC_FRAMES_DELIVERED);
+			metrics.AddLatency((unsigned long long)(CPlatform::TickCount() - frame->TickCount) * 1000);
+		}
+	}
 
-RZSTATUS lastLogStatus = BROADCAST_SUCCESS;
-void SetBroadcastLog(RZSTATUS value)
-{
-	if (lastLogStatus == value)
-		return;
+	//! Gives context a sink of the output workers, or leaves its callbacks to the reader when
+	//! they are off or every sink is taken. Called with Critical held.
+	static void AddSink(RZBroadcastContext& context)
+	{
+		context.Sink = -1;
+		if (!Output.IsOpen())
+			return;
+
+		RZOutputSinkConfig config;
+		config.Write = NotifyOutput;
+		config.User = &context;
+		config.Deadline = OutputDeadline;
+		config.MinInterval = 0;
+		context.Sink = Output.Add(config);
+		if (context.Sink < 0)
+			Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s no output sink left for app %d, the reader calls it back", __FUNCTION__, context.Index);
+	}
 
-	switch (value)
+	//! Reports a change of the status to context, through its sink when it has one.
+	static void NotifyStatus(CMetricsShard& metrics, RZBroadcastContext& context, CHROMA_BROADCAST_STATUS status)
 	{
-	case BROADCAST_SUCCESS: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_SUCCESS", __FUNCTION__); break;
-	case CHROMA_DEVICE_NOT_FOUND: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status CHROMA_DEVICE_NOT_FOUND", __FUNCTION__); break;
-	case SYNAPSE3_NOT_INSTALLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_INSTALLED", __FUNCTION__); break;
-	case SYNAPSE3_NOT_RUNNING: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_RUNNING", __FUNCTION__); break;
-	case SYNAPSE3_NOT_ONLINE: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_ONLINE", __FUNCTION__); break;
-	case BROADCAST_DISABLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DISABLED", __FUNCTION__); break;
-	case BROADCAST_APP_DISABLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_APP_DISABLED", __FUNCTION__); break;
-	case BROADCAST_MODULE_NOT_FOUND: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_MODULE_NOT_FOUND", __FUNCTION__); break;
-	case BROADCAST_DATA_NULL: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DATA_NULL", "SetBroadcastLog"); break;
-	case BROADCAST_DATA_INIT_SUCCESS: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DATA_INIT_SUCCESS", __FUNCTION__); break;
+		if (context.Sink >= 0)
+			Output.SubmitStatus(context.Sink, status, CPlatform::Now());
+		else
+			Notify(metrics, context, BROADCAST_STATUS, (PRZPARAM) status);
 	}
 
-	lastLogStatus = value;
-}
+	//! Copies the contexts to notify, a callback may create or destroy contexts while the worker
+	//! walks the list. Called with Critical held.
+	static const std::vector<RZBroadcastContext*>& BeginDispatch()
+	{
+		Dispatching.assign(Contexts.begin(), Contexts.end());
+		return Dispatching;
+	}
 
-class CChromaBroadcastAPI
-{
-public:
-	static bool IsInitialized;
+	//! Frees the contexts destroyed from a callback. Called with Critical held, or once the
+	//! workers are joined.
+	static void ReleaseRetired()
+	{
+		for (RZBroadcastContext* context : Retired)
+			delete context;
+		Retired.clear();
+	}
 
-private:
-	static RZEVENTNOTIFICATIONCALLBACK NotificationCallback;
-	static HANDLE UninitEvent;
-	static HANDLE BroadcastDataThreadHandle;
-	static HANDLE MonitorOnlineThreadHandle;
-	static HANDLE BroadcastEventData;
-	static int Index;
-	static std::string Title;
-	static CRITICAL_SECTION Critical;
-	static bool Synapse3NotOnline;
-	static bool Running;
-	static RZSTATUS LogStatus;
+	static bool AnyContext(bool RZBroadcastContext::*flag)
+	{
+		for (RZBroadcastContext* context : Contexts)
+		{
+			if (context->*flag)
+				return true;
+		}
+		return false;
+	}
 
-	static void OpenEventSharedMemory(RZEventSharedMemory& esm)
+	//! Delivers a frame to the contexts it is for, app specific frames only to the context
+	//! registered for their index. Without a frame only the LIVE status is updated. Called by the
+	//! workers with Critical held.
+	static void Dispatch(CMetricsShard& metrics, RZEventData* frame, bool healthy)
 	{
-		esm.file = 0;
-		esm.mem = 0;
-		esm.file = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, RZBROADCAST_SHARED_MEMORY);
-		if (esm.file)
+		// A recording stamps the frame on arrival and encodes it once it was delivered
+		ULONGLONG received = Recorder.IsOpen() ? CPlatform::Now() : 0;
+		const RZEventData* captured = frame;
+
+		CTraceSpan filterSpan(TRACE_FILTER);
+		RZBroadcastContext* target = nullptr;
+		RZID app = frame ? CRingReader::TargetApp(*frame) : 0;
+		if (app)
 		{
-			esm.mem = (RZEventSharedMemoryData*)MapViewOfFile(esm.file, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(RZEventSharedMemoryData));
+			auto route = Routes.find(app);
+			if (route != Routes.end())
+				target = route->second;
+			else
+			{
+				frame = nullptr;
+				metrics.Add(METRIC_FRAMES_FILTERED);
+			}
 		}
-		else
+		filterSpan.End();
+
+		for (RZBroadcastContext* context : BeginDispatch())
 		{
-			esm.file = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(RZEventSharedMemoryData), RZBROADCAST_SHARED_MEMORY);
-			if (esm.file)
+			if (context->Retired || !context->HasCallback())
+				continue;
+
+			if (healthy && context->AppEnabled)
 			{
-				esm.mem = (RZEventSharedMemoryData*)MapViewOfFile(esm.file, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(RZEventSharedMemoryData));
-				if (esm.mem)
-					memset(esm.mem, 0, sizeof(RZEventSharedMemoryData));
+				if (frame && (!target || target == context))
+				{
+					if (context->Sink >= 0)
+						Output.Submit(context->Sink, *frame, CPlatform::Now());
+					else
+					{
+						Notify(metrics, *context, BROADCAST_EFFECT, &frame->effect);
+						metrics.Add(METRIC_FRAMES_DELIVERED);
+						metrics.AddLatency((unsigned long long)(CPlatform::TickCount() - frame->TickCount) * 1000);
+					}
+					if (!context->Running && !context->Retired)
+					{
+						NotifyStatus(metrics, *context, LIVE);
+						metrics.Add(METRIC_STATUS_TRANSITIONS);
+						context->Running = true;
+					}
+					SetBroadcastLog(BROADCAST_SUCCESS);
+				}
+			}
+			else if (context->Running)
+			{
+				NotifyStatus(metrics, *context, NOT_LIVE);
+				metrics.Add(METRIC_STATUS_TRANSITIONS);
+				context->Running = false;
 			}
 		}
+
+		if (received)
+			Record(captured, healthy, received);
 	}
 
-	static bool CheckIsChromaBroadcastEnabled()
+	//! Adds a received frame and the stream status to the recording, and writes the batch out when
+	//! it is due. Called with Critical held.
+	static void Record(const RZEventData* frame, bool healthy, ULONGLONG received)
 	{
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RZBROADCAST_REG_SUBKEY, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
-			return false;
+		if (!Recorder.IsOpen())
+			return;
+
+		Recorder.SetStatus(healthy ? LIVE : NOT_LIVE, received);
+		if (frame)
+			Recorder.AddFrame(*frame, received);
+		if (!Recorder.FlushIfDue(CPlatform::Now()))
+			Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s the capture file could not grow, recording stopped", __FUNCTION__);
+	}
 
-		DWORD Enable = 0;
-		DWORD EnableLen = sizeof(Enable);
-		if (RegQueryValueExA(phkResult, "Enable", 0, 0, (LPBYTE)&Enable, &EnableLen))
+	//! Milliseconds the worker can wait for the next frame before the pacer has one due. Within 2 ms
+	//! of the slot, a wait would land on the tick: it sleeps through the stretch instead, in slices
+	//! short enough to see a frame pending, and returns 0 once the slot came or a frame did. Called by
+	//! the worker feeding the pacer without Critical, which it then takes once, and the callers of the
+	//! API never wait on the stretch.
+	template <typename TPending>
+	static DWORD PacingTimeout(TPending pending)
+	{
+		unsigned long long due = Pacing ? Pacer.NextDue() : 0;
+		if (!due)
+			return INFINITE;
+		for (;;)
 		{
-			RegCloseKey(phkResult);
-			return false;
+			unsigned long long now = CPlatform::Now();
+			if (due <= now || pending())
+				return 0;
+			if (due > now + 2000000ULL)
+				return (DWORD)((due - now) / 1000000ULL) - 1;
+			CPlatform::SleepUntil(std::min(due, now + PACING_SLICE));
 		}
-		RegCloseKey(phkResult);
-
-		return Enable != 0;
 	}
 
-	static bool CheckIsChromaBroadcastForAppEnabled()
+	//! Queues frame in the pacer and delivers the frames whose slot came, or only the status when
+	//! none did. Called by the workers with Critical held.
+	static void DispatchPaced(CMetricsShard& metrics, RZEventData* frame, bool healthy)
 	{
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, (std::string(RZBROADCAST_REG_SUBKEY) + "\\" + Title + ".exe").c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
-			return false;
+		unsigned long long now = CPlatform::Now();
+		if (frame)
+			Pacer.Push(*frame, now);
 
-		DWORD Enable = 0;
-		DWORD EnableLen = sizeof(Enable);
-		if (RegQueryValueExA(phkResult, "Enable", 0, 0, (LPBYTE)&Enable, &EnableLen))
+		bool delivered = false;
+		RZEventData paced;
+		while (Pacer.Pop(now, paced))
 		{
-			RegCloseKey(phkResult);
-			return false;
+			Dispatch(metrics, &paced, healthy);
+			delivered = true;
 		}
-		RegCloseKey(phkResult);
-
-		return Enable != 0;
+		if (!delivered)
+			Dispatch(metrics, nullptr, healthy);
 	}
 
-	static DWORD WINAPI Thread_BroadcastData(LPVOID lpThreadParameter)
+	static DWORD Thread_BroadcastData(void* lpThreadParameter)
 	{
-		static __time64_t lastTime;
-		RZEventSharedMemory shared;
-		OpenEventSharedMemory(shared);
-
-		HANDLE Handles[] = { BroadcastEventData, UninitEvent };
-		if (!WaitForMultipleObjects(2, Handles, 0, INFINITE))
+		CBroadcastTrace::SetThreadName("BroadcastData");
+		// The ring of Synapse lives in the Global namespace only, without it the reader has nothing to wait for
+		CSharedMemory shared;
+		if (!shared.Open(RZBROADCAST_SHARED_MEMORY, sizeof(RZEventSharedMemoryData), SHARED_MEMORY_OPEN_OR_CREATE))
+			Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s cannot open the Synapse broadcast memory, no frames will be read", __FUNCTION__);
+		const RZEventSharedMemoryData* ring = (const RZEventSharedMemoryData*)shared.Data();
+
+		CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_BROADCAST);
+		CRingReader reader;
+
+		unsigned long long lastTime = 0;
+		bool needSynapse3Check = true;
+		bool OpenSynapse3MutexSuccess = false;
+		bool DeviceFound = false;
+		bool IsChromaBroadcastEnabled = false;
+		while (ring)
 		{
-			bool needSynapse3Check = false;
-			bool OpenSynapse3MutexSuccess = false;
-			bool DeviceFound = false;
-			bool IsChromaBroadcastEnabled = false;
-			bool IsChromaBroadcastForAppEnabled = false;
-			while (TryEnterCriticalSection(&Critical))
-			{
-				auto idx = shared.mem->idx;
-				idx = idx > 0 ? idx - 1 : (sizeof(RZEventSharedMemoryData::events) / sizeof(RZEventSharedMemoryData::events[0])) - 1;
-				RZEventData* event = &shared.mem->events[idx];
+			// UnInit cancels the wait itself, so the thread never needs a timeout to notice it, only
+			// to deliver the frames the pacer holds and to run the health checks while Synapse is silent.
+			// Another process reading the ring resets the event too, the cap bounds a wake it took.
+			CTraceSpan waitSpan(TRACE_WAIT);
+			WAIT_RESULT wait = reader.Wait(ring, BroadcastEventData, std::min<DWORD>(PacingTimeout([&]() { return reader.Pending(ring); }), 500), &UninitEvent);
+			waitSpan.End();
+			if (wait == WAIT_RESULT_CANCELLED || wait == WAIT_RESULT_FAILED)
+				break;
 
-				CHROMA_BROADCAST_EFFECT effect;
-				memcpy(&effect, &event->effect, sizeof(CHROMA_BROADCAST_EFFECT));
+			Critical.Enter();
 
-				if (!needSynapse3Check)
+			CTraceSpan snapshotSpan(TRACE_SNAPSHOT);
+			RZEventData frame;
+			bool newFrame = wait == WAIT_RESULT_SIGNALED && reader.Read(ring, metrics, frame);
+			snapshotSpan.End();
+
+			if (!needSynapse3Check)
+			{
+				unsigned long long diff = Milliseconds() - lastTime;
+				if (!AnyContext(&RZBroadcastContext::Running))
 				{
-					__time64_t Time;
-					double diff = _difftime64(_time64(&Time), lastTime);
-					if (!Running)
-					{
-						if (diff > 0.5)
-							needSynapse3Check = true;
-					}
-					if (diff > 2.0)
-					{
+					if (diff > 500)
 						needSynapse3Check = true;
-					}
 				}
-
-				bool sendEvent = true;
-				if (effect.IsAppSpecific == 1 && event->index)
+				if (diff > 2000)
 				{
-					if (Index != event->index)
-						sendEvent = false;
+					needSynapse3Check = true;
 				}
+			}
 
-				if (needSynapse3Check)
-				{
-					OpenSynapse3MutexSuccess = false;
-					DeviceFound = true;
-					HANDLE Synapse3Mutex = OpenMutexW(MUTEX_ALL_ACCESS, FALSE, RZSYNAPSE3_MUTEX);
-					if (Synapse3Mutex)
-					{
-						ReleaseMutex(Synapse3Mutex);
-						CloseHandle(Synapse3Mutex);
-						OpenSynapse3MutexSuccess = true;
-					}
-					IsChromaBroadcastEnabled = CheckIsChromaBroadcastEnabled();
-					IsChromaBroadcastForAppEnabled = CheckIsChromaBroadcastForAppEnabled();
-					_time64(&lastTime);
-					needSynapse3Check = 0;
-				}
+			if (needSynapse3Check)
+			{
+				CTraceSpan healthSpan(TRACE_HEALTH_CHECK);
+				DeviceFound = true;
+				OpenSynapse3MutexSuccess = CNamedMutex::Exists(RZSYNAPSE3_MUTEX);
+				IsChromaBroadcastEnabled = CheckIsChromaBroadcastEnabled();
+				for (RZBroadcastContext* context : Contexts)
+					context->AppEnabled = CheckIsChromaBroadcastForAppEnabled(context->Title);
+				lastTime = Milliseconds();
+				needSynapse3Check = false;
+				metrics.Add(METRIC_HEALTH_CHECKS);
+			}
 
-				if (!DeviceFound)
-				{
-					SetBroadcastLog(CHROMA_DEVICE_NOT_FOUND);
-				}
-				else if (OpenSynapse3MutexSuccess)
+			if (!DeviceFound)
+			{
+				SetBroadcastLog(CHROMA_DEVICE_NOT_FOUND);
+			}
+			else if (OpenSynapse3MutexSuccess)
+			{
+				if (!IsChromaBroadcastEnabled)
 				{
-					if (!IsChromaBroadcastEnabled)
-					{
-						SetBroadcastLog(BROADCAST_DISABLED);
-					}
-					else if (!IsChromaBroadcastForAppEnabled)
-					{
-						SetBroadcastLog(BROADCAST_APP_DISABLED);
-					}
+					SetBroadcastLog(BROADCAST_DISABLED);
 				}
-				else if (Synapse3NotOnline == true)
+				else if (!AnyContext(&RZBroadcastContext::AppEnabled))
 				{
-					SetBroadcastLog(SYNAPSE3_NOT_ONLINE);
+					SetBroadcastLog(BROADCAST_APP_DISABLED);
 				}
+			}
+			else if (Synapse3NotOnline == true)
+			{
+				SetBroadcastLog(SYNAPSE3_NOT_ONLINE);
+			}
 
-				if (NotificationCallback)
-				{
-					if (OpenSynapse3MutexSuccess && DeviceFound && IsChromaBroadcastEnabled && IsChromaBroadcastForAppEnabled)
-					{
-						if (sendEvent)
-						{
-							NotificationCallback(BROADCAST_EFFECT, &effect);
-							if (!Running)
-							{
-								NotificationCallback(BROADCAST_STATUS, (PRZPARAM) LIVE);
-								Running = true;
-							}
-							SetBroadcastLog(BROADCAST_SUCCESS);
-						}
-					}
-					else if (Running)
-					{
-						NotificationCallback(BROADCAST_STATUS, (PRZPARAM) NOT_LIVE);
-						Running = false;
-					}
-				}
+			bool healthy = OpenSynapse3MutexSuccess && DeviceFound && IsChromaBroadcastEnabled;
+			if (Pacing)
+				DispatchPaced(metrics, newFrame ? &frame : nullptr, healthy);
+			else
+				Dispatch(metrics, newFrame ? &frame : nullptr, healthy);
 
-				LeaveCriticalSection(&Critical);
-			}
+			ReleaseRetired();
+			Critical.Leave();
 		}
 
-		if (shared.mem)
-			UnmapViewOfFile(shared.mem);
-		if (shared.file)
-			CloseHandle(shared.file);
 		return 0;
 	}
 
-	static DWORD WINAPI Thread_MonitorOnline(LPVOID lpThreadParameter)
+	//! Broker mode: the broker process reads the Synapse ring and runs the health checks, this
+	//! thread only routes the frames it republishes.
+	static DWORD Thread_BrokerData(void* lpThreadParameter)
 	{
-		static __time64_t lastTime;
-		
-		__time64_t Time;
-		if (WaitForSingleObject(UninitEvent, 1000))
+		CBroadcastTrace::SetThreadName("BrokerData");
+		CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_BROADCAST);
+
+		bool brokerAlive = true;
+		for (;;)
 		{
-			do
+			CTraceSpan waitSpan(TRACE_WAIT);
+			WAIT_RESULT wait = Broker.Wait(std::min<DWORD>(PacingTimeout([]() { return Broker.Pending(); }), 1000), &UninitEvent);
+			waitSpan.End();
+			if (wait == WAIT_RESULT_CANCELLED || wait == WAIT_RESULT_FAILED)
+				break;
+			// A broker that exits clears its page and wakes the clients, one that crashed only goes quiet
+			brokerAlive = wait == WAIT_RESULT_SIGNALED || Broker.IsBrokerAlive();
+
+			Critical.Enter();
+
+			DWORD status = brokerAlive ? Broker.Status() : 0;
+			for (RZBroadcastContext* context : Contexts)
+				context->AppEnabled = Broker.IsAppEnabled((RZID)context->Index);
+
+			if (!(status & BROKER_STATUS_SERVICE_RUNNING))
+				SetBroadcastLog(SYNAPSE3_NOT_RUNNING);
+			else if (!(status & BROKER_STATUS_SYNAPSE_ONLINE))
+				SetBroadcastLog(SYNAPSE3_NOT_ONLINE);
+			else if (!(status & BROKER_STATUS_ENABLED))
+				SetBroadcastLog(BROADCAST_DISABLED);
+			else if (!AnyContext(&RZBroadcastContext::AppEnabled))
+				SetBroadcastLog(BROADCAST_APP_DISABLED);
+
+			bool healthy = (status & BROKER_STATUS_LIVE) == BROKER_STATUS_LIVE;
+			bool delivered = false;
+			RZEventData frame;
+			while (Broker.Read(frame, metrics))
 			{
-				if (_difftime64(_time64(&Time), lastTime) > 3.0)
-				{
-					_time64(&lastTime);
-
-					SC_HANDLE hSCObject = OpenSCManagerW(NULL, NULL, SC_MANAGER_ENUMERATE_SERVICE);
-					if (hSCObject)
-					{
-						bool state4 = false;
-						SC_HANDLE service = OpenServiceW(hSCObject, RZSYNAPSE3_NAME, SC_MANAGER_ENUMERATE_SERVICE);
-						if (service)
-						{
-							DWORD pcbBytesNeeded = 0;
-							SERVICE_STATUS_PROCESS status;
-							memset(&status, 0, sizeof(SERVICE_STATUS_PROCESS));
-							if (QueryServiceStatusEx(service, SC_STATUS_PROCESS_INFO, (LPBYTE)&status, sizeof(SERVICE_STATUS_PROCESS), &pcbBytesNeeded) && status.dwCurrentState == SERVICE_RUNNING)
-								state4 = true;
-							CloseServiceHandle(service);
-						}
-						CloseServiceHandle(hSCObject);
-
-						if (state4)
-						{
-							Synapse3NotOnline = true;
-							HANDLE Synapse3Mutex = OpenMutexW(MUTEX_ALL_ACCESS, FALSE, RZSYNAPSE3_MUTEX);
-							if (!Synapse3Mutex)
-							{
-								SetBroadcastLog(SYNAPSE3_NOT_ONLINE);
-							}
-							ReleaseMutex(Synapse3Mutex);
-							CloseHandle(Synapse3Mutex);
-							continue;
-						}
-					}
-					
-					Synapse3NotOnline = false;
-					SetBroadcastLog(SYNAPSE3_NOT_RUNNING);
+				if (Pacing)
+					DispatchPaced(metrics, &frame, healthy);
+				else
+					Dispatch(metrics, &frame, healthy);
+				delivered = true;
+			}
+			if (!delivered && Pacing)
+				DispatchPaced(metrics, nullptr, healthy);
+			else if (!delivered)
+				Dispatch(metrics, nullptr, healthy);
 
-					if (NotificationCallback)
-					{
-						NotificationCallback(BROADCAST_STATUS, (PRZPARAM) NOT_LIVE);
-						Running = false;
-					}
-				}
-			} while (WaitForSingleObject(UninitEvent, 1000));
+			ReleaseRetired();
+			Critical.Leave();
 		}
 		return 0;
 	}
 
-	static void RegisterApp()
+	//! Sleeps until deadline on the monotonic clock, yielding through the last milliseconds so
+	//! replays of kHz captures keep their spacing. Returns false once UnInit cancels the wait.
+	static bool WaitUntil(ULONGLONG deadline)
 	{
-		std::string regKey = std::string(RZBROADCAST_REG_SUBKEY) + "\\" + Title + ".exe";
+		for (;;)
+		{
+			ULONGLONG now = CPlatform::Now();
+			if (now >= deadline)
+				return true;
+			if (deadline - now > 2000000ULL)
+			{
+				if (UninitEvent.Wait((DWORD)((deadline - now) / 1000000ULL) - 1))
+					return false;
+			}
+			else if (UninitEvent.IsSet())
+				return false;
+			else
+				std::this_thread::yield();
+		}
+	}
 
-		HKEY phkResult;
-		bool NewReg = true;
-		if (!RegOpenKeyExA(HKEY_LOCAL_MACHINE, regKey.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+	//! Replay mode: feeds the records of a capture through the same filter and dispatch as the
+	//! live readers, ReplaySpeed times as fast as they were recorded, or as fast as possible when
+	//! it is 0. Starts once a callback is registered, and the stream goes NOT_LIVE at the end of
+	//! the capture.
+	static DWORD Thread_ReplayData(void* lpThreadParameter)
+	{
+		CBroadcastTrace::SetThreadName("ReplayData");
+		CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_BROADCAST);
+
+		// Init returns before the client registers its callback, the replay waits for it so every
+		// run delivers the whole capture
+		for (;;)
 		{
-			NewReg = false;
-			RegCloseKey(phkResult);
+			Critical.Enter();
+			bool listening = false;
+			for (RZBroadcastContext* context : Contexts)
+				listening = listening || context->HasCallback();
+			Critical.Leave();
+			if (listening)
+				break;
+			if (UninitEvent.Wait(1))
+				return 0;
 		}
 
-		HKEY hKey;
-		if (!RegCreateKeyExA(HKEY_LOCAL_MACHINE, regKey.c_str(), 0, 0, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, 0, &hKey, 0))
+		ULONGLONG start = CPlatform::Now();
+		bool healthy = false;
+		RZCaptureRecord record;
+		while (!UninitEvent.IsSet() && Replay.Next(record))
 		{
-			RegSetValueExA(hKey, "Title", 0, REG_SZ, (LPBYTE)Title.c_str(), Title.size());
-			char path[260];
-			GetModuleFileNameA(0, path, sizeof(path));
-			RegSetValueExA(hKey, "Path", 0, REG_SZ, (LPBYTE)path, strlen(path));
-			if (NewReg)
+			if (ReplaySpeed > 0 && !WaitUntil(start + (ULONGLONG)(record.Time * 1000.0 / ReplaySpeed)))
+				break;
+
+			Critical.Enter();
+			if (record.Type == CAPTURE_RECORD_STATUS)
 			{
-				DWORD one = 1;
-				RegSetValueExW(hKey, L"Enable", 0, REG_DWORD, (LPBYTE)&one, sizeof(one));
+				healthy = record.Status == LIVE;
+				Dispatch(metrics, nullptr, healthy);
 			}
-			RegSetValueExW(hKey, L"Index", 0, REG_DWORD, (LPBYTE)&Index, sizeof(Index));
-			RegCloseKey(hKey);
+			else
+			{
+				// Latency is measured from the replay, the recorded TickCount is from another session
+				record.Frame.TickCount = CPlatform::TickCount();
+				metrics.Add(METRIC_FRAMES_READ);
+				Dispatch(metrics, &record.Frame, healthy);
+			}
+			ReleaseRetired();
+			Critical.Leave();
+		}
+
+		if (!UninitEvent.IsSet())
+		{
+			Critical.Enter();
+			Dispatch(metrics, nullptr, false);
+			ReleaseRetired();
+			Critical.Leave();
+			UninitEvent.Wait(INFINITE);
 		}
+		return 0;
 	}
 
-	static int VerifyAppId(RZAPPID app)
+	//! Plays a frame of the sync leader, called by Sync.Run at its presentation time.
+	static void SyncPlayout(const RZEventData* frame, CHROMA_BROADCAST_STATUS status, void* user)
 	{
-		int ret = -1;
+		CMetricsShard& metrics = *(CMetricsShard*)user;
+		Critical.Enter();
+		if (frame)
+		{
+			// Latency is measured from the presentation time, the delay before it is on purpose
+			RZEventData played = *frame;
+			played.TickCount = CPlatform::TickCount();
+			metrics.Add(METRIC_FRAMES_READ);
+			Dispatch(metrics, &played, status == LIVE);
+		}
+		else
+			Dispatch(metrics, nullptr, status == LIVE);
+		ReleaseRetired();
+		Critical.Leave();
+	}
 
-		std::wstring guidWStr;
-		guidWStr.resize(40);
-		StringFromGUID2(app, guidWStr.data(), 39);
-		guidWStr.resize(lstrlen(guidWStr.c_str()));
-		std::string guidStr(guidWStr.begin(), guidWStr.end());
+	//! Sync mode: plays the frames of a sync leader, chroma-broker -y on this or another machine,
+	//! at the presentation time it gave them, in step with every other follower.
+	static DWORD Thread_SyncData(void* lpThreadParameter)
+	{
+		CBroadcastTrace::SetThreadName("SyncData");
+		CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_BROADCAST);
+		Sync.Run(UninitEvent, SyncPlayout, &metrics);
+		return 0;
+	}
 
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RZBROADCAST_REG_SUBKEY, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
-			return -1;
+	//! Publishes the apps of the contexts to the broker. Called with Critical held.
+	static void UpdateBrokerApps()
+	{
+		if (!Broker.IsAttached())
+			return;
 
-		std::string DataPath;
-		DataPath.resize(260);
-		DWORD DataPathLen = 260;
-		if (RegQueryValueExA(phkResult, "DataPath", 0, 0, (LPBYTE)DataPath.data(), &DataPathLen))
+		std::vector<std::pair<RZID, std::string>> apps;
+		std::vector<bool> enabled;
+		for (RZBroadcastContext* context : Contexts)
 		{
-			RegCloseKey(phkResult);
-			return -1;
+			apps.push_back(std::make_pair((RZID)context->Index, context->Title));
+			enabled.push_back(context->AppEnabled);
 		}
-		DataPath.resize(strlen(DataPath.c_str()));
-		RegCloseKey(phkResult);
+		Broker.SetApps(apps, enabled);
+	}
 
-		FILE* f = fopen((DataPath + "\\broadcast.dat").c_str(), "rb");
-		if (!f)
-			return -1;
+	//! Returns true once UnInit signalled the thread to exit.
+	static bool TracedWait(CEvent& event, DWORD milliseconds)
+	{
+		CTraceSpan span(TRACE_WAIT);
+		return event.Wait(milliseconds);
+	}
 
-		DWORD len;
-		fread(&len, 1, sizeof(len), f);
-		char *data = new char[len+1];
-		fread(data, 1, len, f);
-		fclose(f);
-		data[len] = 0;
+	static DWORD Thread_MonitorOnline(void* lpThreadParameter)
+	{
+		unsigned long long lastTime = 0;
+		CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_MONITOR);
+		CBroadcastTrace::SetThreadName("MonitorOnline");
 
-		for (DWORD i = 0; i < len; i++)
-			data[i] ^= RZBROADCAST_DAT_KEY[i % strlen(RZBROADCAST_DAT_KEY)];
+		while (!TracedWait(UninitEvent, 1000))
+		{
+			if (lastTime && Milliseconds() - lastTime <= 3000)
+				continue;
 
-		nlohmann::json jsn = nlohmann::json::parse(data);
+			CTraceSpan pollSpan(TRACE_SERVICE_POLL);
+			lastTime = Milliseconds();
+			metrics.Add(METRIC_HEALTH_CHECKS);
 
-		for (const auto &app : jsn["app"])
-		{
-			if (guidStr == app["guid"])
+			if (CPlatform::IsServiceRunning(RZSYNAPSE3_NAME))
 			{
-				int Status = strtol(app["status"].get<std::string>().c_str(), NULL, 10);
-				if (Status != 1 && Status != 2)
-					continue;
-
-				Index = strtol(app["index"].get<std::string>().c_str(), NULL, 10);
-				Title = app["title"].get<std::string>();
+				Synapse3NotOnline = true;
+				if (!CNamedMutex::Exists(RZSYNAPSE3_MUTEX))
+				{
+					SetBroadcastLog(SYNAPSE3_NOT_ONLINE);
+				}
+				continue;
+			}
 
-				RegisterApp();
+			Synapse3NotOnline = false;
+			SetBroadcastLog(SYNAPSE3_NOT_RUNNING);
 
-				ret = Status == 2 ? (PathFileExistsA((DataPath + "\\" + RZBROADCAST_DEV_ENABLE).c_str()) ? 2 : 3) : 1;
-				break;
+			Critical.Enter();
+			for (RZBroadcastContext* context : BeginDispatch())
+			{
+				if (context->Retired || !context->HasCallback())
+					continue;
+				NotifyStatus(metrics, *context, NOT_LIVE);
+				if (context->Running)
+					metrics.Add(METRIC_STATUS_TRANSITIONS);
+				context->Running = false;
 			}
+			ReleaseRetired();
+			Critical.Leave();
 		}
-
-		delete[]data;
-		return ret;
+		return 0;
 	}
 
-public:
-	static RZRESULT Init(RZAPPID app)
+	static void RegisterApp(int index, const std::string& title)
 	{
-		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
+		std::string regKey = std::string(RZBROADCAST_REG_SUBKEY) + "\\" + title + ".exe";
 
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RZBROADCAST_REG_SUBKEY, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+		bool NewReg = false;
+		if (CSettings::CreateKey(regKey, &NewReg))
 		{
-			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Broadcast Module Not Installed", __FUNCTION__, RZRESULT_NOT_FOUND);
-			return RZRESULT_NOT_FOUND;
+			CSettings::SetString(regKey, "Title", title);
+			CSettings::SetString(regKey, "Path", CPlatform::ExecutablePath());
+			if (NewReg)
+				CSettings::SetDword(regKey, "Enable", 1);
+			CSettings::SetDword(regKey, "Index", (DWORD)index);
 		}
-		RegCloseKey(phkResult);
+	}
 
-		RZRESULT res = VerifyAppId(app);
-		if (!res)
+	static int VerifyAppId(RZAPPID app, int& index, std::string& title)
+	{
+		std::string DataPath;
+		if (!CSettings::GetString(RZBROADCAST_REG_SUBKEY, "DataPath", DataPath))
+			return -1;
+
+		RZAppRecord record;
+		if (!CAppData::Find(DataPath, app, record))
+			return -1;
+
+		index = record.Index;
+		title = record.Title;
+
+		RegisterApp(index, title);
+
+		if (record.Status == 2)
+			return CPlatform::FileExists(CPlatform::PathJoin(DataPath, RZBROADCAST_DEV_ENABLE)) ? 2 : 3;
+		return 1;
+	}
+
+	//! Starts the shared workers for the first context. Called with Lifecycle held.
+	static RZRESULT StartThreads(const std::string& title)
+	{
+		// Workers stopped from one of their own callbacks could not join themselves
+		BroadcastDataThread.Join(INFINITE);
+		MonitorOnlineThread.Join(INFINITE);
+		Output.Close();
+		ReleaseRetired();
+		Broker.Detach();
+
+		CBroadcastMetrics::SetTitle(title);
+		UninitEvent.Reset();
+
+		// RZBROADCAST_OUTPUT=<workers>[:<deadline_ms>] calls the contexts back from a pool of output
+		// workers, earliest deadline first, so a slow callback no longer holds back the others
+		std::string output = CPlatform::EnvironmentVariable("RZBROADCAST_OUTPUT");
+		if (!output.empty())
 		{
-			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Unknown AppId", __FUNCTION__, RZRESULT_UNKNOWN_APPID);
-			return RZRESULT_UNKNOWN_APPID;
+			char* end = nullptr;
+			RZOutputConfig config = COutputScheduler::Defaults();
+			config.Workers = (DWORD)strtoul(output.c_str(), &end, 10);
+			double deadline = *end == ':' ? strtod(end + 1, &end) : OUTPUT_DEFAULT_DEADLINE;
+			std::string error = "expected <workers>[:<deadline_ms>]";
+			if (*end || deadline <= 0 || deadline > 1000 || !Output.Open(config, error))
+				Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s ignores RZBROADCAST_OUTPUT=%s, %s", __FUNCTION__, output.c_str(), error.c_str());
+			else
+				OutputDeadline = (DWORD)(deadline * 1000);
 		}
+		Critical.Enter();
+		for (RZBroadcastContext* context : Contexts)
+			AddSink(*context);
+		Critical.Leave();
 
-		switch (res)
+		RZRESULT res = RZRESULT_SUCCESS;
+		// RZBROADCAST_REPLAY=<capture> plays a recording instead of Synapse, RZBROADCAST_REPLAY_SPEED
+		// scales its pacing, 0 plays it as fast as possible
+		std::string replayPath = CPlatform::EnvironmentVariable("RZBROADCAST_REPLAY");
+		if (!replayPath.empty())
 		{
-		case -1: Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Invalid AppId", __FUNCTION__, RZRESULT_ACCESS_DENIED); return RZRESULT_ACCESS_DENIED;
-		case 3: Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Setup required for Test AppId", __FUNCTION__, RZRESULT_RESOURCE_DISABLED); return RZRESULT_RESOURCE_DISABLED;
-		case 2: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s Test AppId %d verified!", __FUNCTION__, Index); break;
-		case 1: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s AppId %d verified!", __FUNCTION__, Index); break;
+			if (!Replay.Open(replayPath.c_str()))
+			{
+				res = RZRESULT_FAILED;
+				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to open capture %s", __FUNCTION__, res, replayPath.c_str());
+				return res;
+			}
+			std::string speed = CPlatform::EnvironmentVariable("RZBROADCAST_REPLAY_SPEED");
+			ReplaySpeed = speed.empty() ? 1.0 : atof(speed.c_str());
+
+			CTraceSpan threadsSpan(TRACE_START_THREADS);
+			if (!BroadcastDataThread.Start(Thread_ReplayData))
+			{
+				res = RZRESULT_FAILED;
+				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Replay Data thread", __FUNCTION__, res);
+			}
+			return res;
 		}
 
-		HANDLE AppNumEvent = OpenEventW(EVENT_ALL_ACCESS, FALSE, RZBROADCAST_APP_NUM_EVENT);
-		if (AppNumEvent)
+		// RZBROADCAST_SYNC=<ip>[:port] follows a sync leader instead of the local Synapse
+		std::string syncLeader = CPlatform::EnvironmentVariable("RZBROADCAST_SYNC");
+		if (!syncLeader.empty())
 		{
-			PulseEvent(AppNumEvent);
-			CloseHandle(AppNumEvent);
+			RZNetAddress leader;
+			std::string error;
+			if (!CSyncFollower::ParseLeader(syncLeader, leader))
+				error = "Invalid sync leader " + syncLeader;
+			else
+			{
+				RZSyncFollowerConfig config = CSyncFollower::Defaults(leader.Ip);
+				config.Leader = leader;
+				Sync.Open(config, error);
+			}
+			if (!Sync.IsOpen())
+			{
+				res = RZRESULT_FAILED;
+				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | %s", __FUNCTION__, res, error.c_str());
+				return res;
+			}
+
+			CTraceSpan threadsSpan(TRACE_START_THREADS);
+			if (!BroadcastDataThread.Start(Thread_SyncData))
+			{
+				res = RZRESULT_FAILED;
+				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Sync Data thread", __FUNCTION__, res);
+			}
+			return res;
 		}
 
-		BroadcastEventData = CreateEventW(NULL, TRUE, FALSE, RZBROADCAST_EVENT);
-		if (!BroadcastEventData)
+		// RZBROADCAST_PACING=<min_ms>[-<max_ms>] delivers the frames of the Synapse ring or the broker
+		// at a steady cadence, holding each at least min_ms and adapting up to max_ms to the jitter
+		Pacing = false;
+		std::string pacing = CPlatform::EnvironmentVariable("RZBROADCAST_PACING");
+		if (!pacing.empty())
 		{
-			res = GetLastError();
-			if (res)
-				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Event Data", __FUNCTION__, res);
+			char* end = nullptr;
+			double minimum = strtod(pacing.c_str(), &end);
+			double maximum = *end == '-' ? strtod(end + 1, &end) : 0;
+			PacingConfig = CFramePacer::Defaults();
+			if (*end || minimum <= 0 || maximum < 0 || minimum > 1000 || maximum > 1000)
+				Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s ignores RZBROADCAST_PACING=%s, expected <min_ms>[-<max_ms>]", __FUNCTION__, pacing.c_str());
+			else
+			{
+				PacingConfig.MinDelay = (DWORD)(minimum * 1000);
+				PacingConfig.MaxDelay = std::max(maximum ? (DWORD)(maximum * 1000) : PacingConfig.MaxDelay, PacingConfig.MinDelay);
+				Pacer.Configure(PacingConfig);
+				Pacing = true;
+			}
 		}
 
-		InitializeCriticalSection(&Critical);
-
-		if (BroadcastEventData)
+		// A running broker already reads the ring and watches Synapse, RZBROADCAST_BROKER=0 opts out
+		if (CPlatform::EnvironmentVariable("RZBROADCAST_BROKER") != "0" && Broker.Attach())
 		{
-			if (!BroadcastDataThreadHandle || BroadcastDataThreadHandle == INVALID_HANDLE_VALUE)
+			Critical.Enter();
+			UpdateBrokerApps();
+			Critical.Leave();
+
+			CTraceSpan threadsSpan(TRACE_START_THREADS);
+			if (!BroadcastDataThread.Start(Thread_BrokerData))
 			{
-				BroadcastDataThreadHandle = CreateThread(NULL, 0, Thread_BroadcastData, NULL, 0, NULL);
-				if (!BroadcastDataThreadHandle)
-				{
-					res = GetLastError();
-					if (res)
-						Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Data thread", __FUNCTION__, res);
-				}
-				if (!MonitorOnlineThreadHandle || MonitorOnlineThreadHandle == INVALID_HANDLE_VALUE)
-				{
-					MonitorOnlineThreadHandle = CreateThread(NULL, 0, Thread_MonitorOnline, NULL, 0, NULL);
-					if (!MonitorOnlineThreadHandle)
-					{
-						res = GetLastError();
-						if (res)
-							Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Monitor Online thread", __FUNCTION__, res);
-					}
-				}
+				res = RZRESULT_FAILED;
+				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broker Data thread", __FUNCTION__, res);
 			}
-			if (BroadcastEventData && BroadcastDataThreadHandle)
+			return res;
+		}
+
+		if (!BroadcastEventData.IsOpen() && !BroadcastEventData.Open(RZBROADCAST_EVENT))
+		{
+			res = RZRESULT_FAILED;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Event Data", __FUNCTION__, res);
+			return res;
+		}
+
+		CTraceSpan threadsSpan(TRACE_START_THREADS);
+		if (!BroadcastDataThread.Start(Thread_BroadcastData))
+		{
+			res = RZRESULT_FAILED;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Data thread", __FUNCTION__, res);
+		}
+		if (!MonitorOnlineThread.Start(Thread_MonitorOnline))
+		{
+			res = RZRESULT_FAILED;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Monitor Online thread", __FUNCTION__, res);
+		}
+		return res;
+	}
+
+	//! Stops the shared workers once the last context is gone. From a callback the workers are
+	//! only signalled, the next StartThreads joins them.
+	static void StopThreads(bool worker)
+	{
+		// Both workers wait on UninitEvent, so they return as soon as it is set. The joins only
+		// wait longer while a callback is still running.
+		UninitEvent.Set();
+		Sync.Wake();
+		Output.Stop();
+
+		if (!worker)
+		{
+			BroadcastDataThread.Join(INFINITE);
+			MonitorOnlineThread.Join(INFINITE);
+			Output.Close();
+			ReleaseRetired();
+			BroadcastEventData.Close();
+			Broker.Detach();
+			Replay.Close();
+			Sync.Close();
+		}
+
+		// Idle captures stay complete on disk until the next frame
+		Critical.Enter();
+		Recorder.Flush();
+		Critical.Leave();
+
+		if (CBroadcastTrace::IsEnabled() && !TracePath.empty())
+		{
+			if (!CBroadcastTrace::Dump(TracePath.c_str()))
+				Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s failed to write trace %s", __FUNCTION__, TracePath.c_str());
+		}
+	}
+
+	//! Adds a context for an app already registered in the settings and starts the workers for
+	//! the first one.
+	static RZRESULT AddContext(int index, const std::string& title, RZBroadcastContext*& context)
+	{
+		RZBroadcastContext* created = new RZBroadcastContext(index, title);
+		created->AppEnabled = CheckIsChromaBroadcastForAppEnabled(title);
+
+		bool worker = IsWorkerThread();
+		if (!worker)
+			Lifecycle.Enter();
+
+		RZRESULT res = RZRESULT_SUCCESS;
+		Critical.Enter();
+		if (Routes.count((RZID)index))
+		{
+			res = RZRESULT_ALREADY_INITIALIZED;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | A context already exists for app %d", __FUNCTION__, res, index);
+		}
+		else if (worker && !ThreadsRunning)
+		{
+			res = RZRESULT_NOT_VALID_STATE;
+		}
+		else if (Broker.IsAttached() && Contexts.size() >= BROKER_MAX_APPS)
+		{
+			// The broker only knows the apps its slot of this process holds, it would filter the others out
+			res = RZRESULT_NO_MORE_ITEMS;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | The broker serves %lu apps a process, app %d is one too many", __FUNCTION__, res, (unsigned long)BROKER_MAX_APPS, index);
+		}
+		else
+		{
+			Contexts.push_back(created);
+			Routes[(RZID)index] = created;
+			AddSink(*created);
+			UpdateBrokerApps();
+		}
+		bool start = res == RZRESULT_SUCCESS && !ThreadsRunning;
+		if (start)
+			ThreadsRunning = true;
+		Critical.Leave();
+
+		if (start)
+		{
+			res = StartThreads(title);
+			if (res != RZRESULT_SUCCESS)
 			{
-				if (MonitorOnlineThreadHandle)
-					res = 0;
+				Critical.Enter();
+				Contexts.clear();
+				Routes.clear();
+				ThreadsRunning = false;
+				UpdateBrokerApps();
+				Critical.Leave();
+				StopThreads(false);
 			}
 		}
 
-		UninitEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
+		if (!worker)
+			Lifecycle.Leave();
+
+		if (res != RZRESULT_SUCCESS)
+		{
+			delete created;
+			return res;
+		}
+
+		CNamedEvent::Pulse(RZBROADCAST_APP_NUM_EVENT);
+		context = created;
 		return res;
 	}
 
-	static RZRESULT InitEx(int index, std::string title)
+	//! Returns false for handles that are not live contexts. Called with Critical held.
+	static bool IsContext(RZBroadcastContext* context)
 	{
-		Index = index;
-		Title = title;
-
-		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
+		return context && std::find(Contexts.begin(), Contexts.end(), context) != Contexts.end();
+	}
 
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RZBROADCAST_REG_SUBKEY, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+public:
+	static RZRESULT Verify(RZAPPID app, int& index, std::string& title)
+	{
+		if (!CSettings::KeyExists(RZBROADCAST_REG_SUBKEY))
 		{
 			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Broadcast Module Not Installed", __FUNCTION__, RZRESULT_NOT_FOUND);
 			return RZRESULT_NOT_FOUND;
 		}
-		RegCloseKey(phkResult);
-
-		RegisterApp();
 
-		HANDLE AppNumEvent = OpenEventW(EVENT_ALL_ACCESS, FALSE, RZBROADCAST_APP_NUM_EVENT);
-		if (AppNumEvent)
+		CTraceSpan verifySpan(TRACE_VERIFY_APP);
+		RZRESULT res = VerifyAppId(app, index, title);
+		verifySpan.End();
+		if (!res)
 		{
-			PulseEvent(AppNumEvent);
-			CloseHandle(AppNumEvent);
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Unknown AppId", __FUNCTION__, RZRESULT_UNKNOWN_APPID);
+			return RZRESULT_UNKNOWN_APPID;
 		}
 
-		RZRESULT res = RZRESULT_SUCCESS;
-		BroadcastEventData = CreateEventW(NULL, TRUE, FALSE, RZBROADCAST_EVENT);
-		if (!BroadcastEventData)
+		switch (res)
 		{
-			res = GetLastError();
-			if (res)
-				Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Event Data", __FUNCTION__, res);
+		case -1: Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Invalid AppId", __FUNCTION__, RZRESULT_ACCESS_DENIED); return RZRESULT_ACCESS_DENIED;
+		case 3: Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Setup required for Test AppId", __FUNCTION__, RZRESULT_RESOURCE_DISABLED); return RZRESULT_RESOURCE_DISABLED;
+		case 2: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s Test AppId %d verified!", __FUNCTION__, index); break;
+		case 1: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s AppId %d verified!", __FUNCTION__, index); break;
 		}
+		return RZRESULT_SUCCESS;
+	}
+
+	static RZRESULT CreateContext(RZAPPID app, RZBroadcastContext*& context)
+	{
+		CTraceSpan initSpan(TRACE_INIT);
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
 
-		InitializeCriticalSection(&Critical);
+		int index = 0;
+		std::string title;
+		RZRESULT res = Verify(app, index, title);
+		if (res == RZRESULT_SUCCESS)
+			res = AddContext(index, title, context);
 
-		if (BroadcastEventData)
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
+		return res;
+	}
+
+	static RZRESULT CreateContext(int index, const std::string& title, RZBroadcastContext*& context)
+	{
+		CTraceSpan initSpan(TRACE_INIT);
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
+
+		if (!CSettings::KeyExists(RZBROADCAST_REG_SUBKEY))
 		{
-			if (!BroadcastDataThreadHandle || BroadcastDataThreadHandle == INVALID_HANDLE_VALUE)
-			{
-				BroadcastDataThreadHandle = CreateThread(NULL, 0, Thread_BroadcastData, NULL, 0, NULL);
-				if (!BroadcastDataThreadHandle)
-				{
-					res = GetLastError();
-					if (res)
-						Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Broadcast Data thread", __FUNCTION__, res);
-				}
-				if (!MonitorOnlineThreadHandle || MonitorOnlineThreadHandle == INVALID_HANDLE_VALUE)
-				{
-					MonitorOnlineThreadHandle = CreateThread(NULL, 0, Thread_MonitorOnline, NULL, 0, NULL);
-					if (!MonitorOnlineThreadHandle)
-					{
-						res = GetLastError();
-						if (res)
-							Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create Monitor Online thread", __FUNCTION__, res);
-					}
-				}
-			}
-			if (BroadcastEventData && BroadcastDataThreadHandle)
-			{
-				if (MonitorOnlineThreadHandle)
-					res = 0;
-			}
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Broadcast Module Not Installed", __FUNCTION__, RZRESULT_NOT_FOUND);
+			return RZRESULT_NOT_FOUND;
 		}
 
-		UninitEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+		RegisterApp(index, title);
+
+		RZRESULT res = AddContext(index, title, context);
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
 		return res;
 	}
 
-	static RZRESULT UnInit()
+	static std::string TracePath;
+
+	static RZRESULT DestroyContext(RZBroadcastContext* context)
 	{
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
-		SetEvent(UninitEvent);
 
-		if (BroadcastDataThreadHandle)
+		bool worker = IsWorkerThread();
+		if (!worker)
+			Lifecycle.Enter();
+
+		Critical.Enter();
+		if (!IsContext(context))
 		{
-			WaitForSingleObject(BroadcastDataThreadHandle, 1000);
-			if (CloseHandle(BroadcastDataThreadHandle))
-				BroadcastDataThreadHandle = INVALID_HANDLE_VALUE;
+			Critical.Leave();
+			if (!worker)
+				Lifecycle.Leave();
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Unknown context", __FUNCTION__, RZRESULT_INVALID_HANDLE);
+			return RZRESULT_INVALID_HANDLE;
 		}
 
-		if (MonitorOnlineThreadHandle)
+		Contexts.erase(std::find(Contexts.begin(), Contexts.end(), context));
+		Routes.erase((RZID)context->Index);
+		UpdateBrokerApps();
+		int sink = context->Sink;
+		// The worker calling back may still walk this context, it frees it when done
+		if (worker)
 		{
-			WaitForSingleObject(MonitorOnlineThreadHandle, 1000);
-			if (CloseHandle(MonitorOnlineThreadHandle))
-				MonitorOnlineThreadHandle = INVALID_HANDLE_VALUE;
+			context->Retired = true;
+			Retired.push_back(context);
 		}
 
-		if (CloseHandle(UninitEvent))
-			UninitEvent = INVALID_HANDLE_VALUE;
+		bool stop = Contexts.empty() && ThreadsRunning;
+		if (stop)
+			ThreadsRunning = false;
+		Critical.Leave();
+
+		// An output worker writing the context is waited for outside Critical, it may call in
+		Output.Remove(sink);
+		if (!worker)
+			delete context;
+
+		if (stop)
+			StopThreads(worker);
+
+		if (!worker)
+			Lifecycle.Leave();
 
-		if (BroadcastEventData)
+		CNamedEvent::Pulse(RZBROADCAST_APP_NUM_EVENT);
+
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
+		return RZRESULT_SUCCESS;
+	}
+
+	static RZRESULT RegisterEventNotification(RZBroadcastContext* context, RZEVENTNOTIFICATIONCALLBACK callback)
+	{
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
+
+		if (!callback)
 		{
-			if (CloseHandle(BroadcastEventData))
-				BroadcastEventData = INVALID_HANDLE_VALUE;
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Event Notification function is Null", __FUNCTION__, RZRESULT_INVALID_PARAMETER);
+			return RZRESULT_INVALID_PARAMETER;
 		}
 
-		HANDLE AppNumEvent = OpenEventW(EVENT_ALL_ACCESS, 0, RZBROADCAST_APP_NUM_EVENT);
-		if (AppNumEvent)
+		Critical.Enter();
+		bool valid = IsContext(context);
+		if (valid && !context->HasCallback())
+		{
+			CallbackLock.Enter();
+			context->NotificationCallback = callback;
+			CallbackLock.Leave();
+		}
+		Critical.Leave();
+		if (!valid)
 		{
-			PulseEvent(AppNumEvent);
-			CloseHandle(AppNumEvent);
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Unknown context", __FUNCTION__, RZRESULT_INVALID_HANDLE);
+			return RZRESULT_INVALID_HANDLE;
 		}
 
-		DeleteCriticalSection(&Critical);
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
 		return RZRESULT_SUCCESS;
 	}
 
-	static RZRESULT RegisterEventNotification(RZEVENTNOTIFICATIONCALLBACK callback)
+	static RZRESULT RegisterContextNotification(RZBroadcastContext* context, RZCONTEXTNOTIFICATIONCALLBACK callback, void* user)
 	{
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
 
@@ -644,52 +1101,189 @@ public:
 			return RZRESULT_INVALID_PARAMETER;
 		}
 
-		if (!NotificationCallback)
+		RZRESULT res = RZRESULT_SUCCESS;
+		Critical.Enter();
+		if (!IsContext(context))
+			res = RZRESULT_INVALID_HANDLE;
+		else
 		{
-			EnterCriticalSection(&Critical);
-			NotificationCallback = callback;
-			LeaveCriticalSection(&Critical);
+			CallbackLock.Enter();
+			context->NotificationCallback = nullptr;
+			context->ContextCallback = callback;
+			context->User = user;
+			CallbackLock.Leave();
 		}
+		Critical.Leave();
 
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
-		return RZRESULT_SUCCESS;
+		return res;
 	}
 
-	static RZRESULT UnRegisterEventNotification()
+	static RZRESULT UnRegisterEventNotification(RZBroadcastContext* context)
 	{
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][START]%s", __FUNCTION__);
 
-		if (NotificationCallback && TryEnterCriticalSection(&Critical))
+		// Waits for a callback in flight, the caller may free its state once this returns
+		RZRESULT res = RZRESULT_SUCCESS;
+		int sink = -1;
+		Critical.Enter();
+		if (!IsContext(context))
+			res = RZRESULT_INVALID_HANDLE;
+		else
 		{
-			NotificationCallback = nullptr;
-			LeaveCriticalSection(&Critical);
+			CallbackLock.Enter();
+			context->NotificationCallback = nullptr;
+			context->ContextCallback = nullptr;
+			context->User = nullptr;
+			CallbackLock.Leave();
+			sink = context->Sink;
 		}
+		Critical.Leave();
+		Output.Wait(sink);
 
 		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI][END]%s", __FUNCTION__);
 
+		return res;
+	}
+
+	static RZRESULT StartRecording(const char* path)
+	{
+		// Replaces a recording in progress, which is closed complete
+		Critical.Enter();
+		Recorder.Close();
+		bool opened = Recorder.Open(path);
+		Critical.Leave();
+
+		if (!opened)
+		{
+			Log(RZLOGLEVEL_ERROR, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns error code %d | Failed to create capture %s", __FUNCTION__, RZRESULT_FAILED, path);
+			return RZRESULT_FAILED;
+		}
+		Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s recording to %s", __FUNCTION__, path);
+		return RZRESULT_SUCCESS;
+	}
+
+	static void StopRecording()
+	{
+		Critical.Enter();
+		Recorder.Close();
+		Critical.Leave();
+	}
+
+	static void GetPacing(CHROMA_BROADCAST_PACING& pacing)
+	{
+		memset(&pacing, 0, sizeof(pacing));
+		if (!Pacing)
+			return;
+
+		RZFramePacerStats stats;
+		Pacer.GetStats(stats);
+		pacing.Enabled = TRUE;
+		pacing.Delay = stats.Delay;
+		pacing.MinDelay = PacingConfig.MinDelay;
+		pacing.MaxDelay = PacingConfig.MaxDelay;
+		pacing.Interval = stats.Interval;
+		pacing.Jitter = stats.Jitter;
+		pacing.Buffered = stats.Buffered;
+		pacing.FramesPaced = stats.Paced;
+		pacing.Underruns = stats.Underruns;
+		pacing.Overflows = stats.Overflows;
+		pacing.Resets = stats.Resets;
+		pacing.RateChanges = stats.RateChanges;
+	}
+
+	static RZRESULT GetOutputStats(RZBroadcastContext* context, CHROMA_BROADCAST_OUTPUT_STATS& stats)
+	{
+		memset(&stats, 0, sizeof(stats));
+		Critical.Enter();
+		if (!context)
+			context = DefaultContext;
+		bool valid = IsContext(context);
+		int sink = valid ? context->Sink : -1;
+		Critical.Leave();
+		if (!valid)
+			return RZRESULT_INVALID_HANDLE;
+
+		RZOutputSinkStats sinkStats;
+		if (!Output.GetStats(sink, sinkStats))
+			return RZRESULT_SUCCESS;
+		stats.Scheduled = TRUE;
+		stats.Deadline = OutputDeadline;
+		stats.Cost = (DWORD)(sinkStats.Cost / 1000);
+		stats.MaxCost = (DWORD)(sinkStats.MaxCost / 1000);
+		stats.Queued = (DWORD)sinkStats.Queued;
+		stats.Submitted = sinkStats.Submitted;
+		stats.Written = sinkStats.Written;
+		stats.Skipped = sinkStats.Skipped;
+		stats.DeadlineMisses = sinkStats.Misses;
+		stats.Statuses = sinkStats.Statuses;
 		return RZRESULT_SUCCESS;
 	}
+
+	//! Process attach: publishes the metrics page, reads RZBROADCAST_TRACE and RZBROADCAST_RECORD
+	//! and opens the log.
+	static void Attach()
+	{
+		CBroadcastMetrics::Publish();
+
+		// RZBROADCAST_TRACE=<file> traces from load and dumps the spans at UnInit
+		std::string tracePath = CPlatform::EnvironmentVariable("RZBROADCAST_TRACE");
+		if (!tracePath.empty())
+		{
+			TracePath = tracePath;
+			CBroadcastTrace::Enable(true);
+		}
+
+		OpenLog();
+
+		// RZBROADCAST_RECORD=<file> records from load until the process exits
+		std::string recordPath = CPlatform::EnvironmentVariable("RZBROADCAST_RECORD");
+		if (!recordPath.empty())
+			StartRecording(recordPath.c_str());
+	}
+
+	static void Detach()
+	{
+		StopRecording();
+		CBroadcastMetrics::Unpublish();
+		CloseLog();
+	}
 };
 
 bool CChromaBroadcastAPI::IsInitialized = false;
-RZEVENTNOTIFICATIONCALLBACK CChromaBroadcastAPI::NotificationCallback = nullptr;
-HANDLE CChromaBroadcastAPI::UninitEvent = INVALID_HANDLE_VALUE;
-HANDLE CChromaBroadcastAPI::BroadcastDataThreadHandle = INVALID_HANDLE_VALUE;
-HANDLE CChromaBroadcastAPI::MonitorOnlineThreadHandle = INVALID_HANDLE_VALUE;
-HANDLE CChromaBroadcastAPI::BroadcastEventData = INVALID_HANDLE_VALUE;
-int CChromaBroadcastAPI::Index = 0;
-std::string CChromaBroadcastAPI::Title;
-CRITICAL_SECTION CChromaBroadcastAPI::Critical;
+RZBroadcastContext* CChromaBroadcastAPI::DefaultContext = nullptr;
+CEvent CChromaBroadcastAPI::UninitEvent;
+CThread CChromaBroadcastAPI::BroadcastDataThread;
+CThread CChromaBroadcastAPI::MonitorOnlineThread;
+CNamedEvent CChromaBroadcastAPI::BroadcastEventData;
+CBrokerClient CChromaBroadcastAPI::Broker;
+CCaptureWriter CChromaBroadcastAPI::Recorder;
+CCaptureReader CChromaBroadcastAPI::Replay;
+double CChromaBroadcastAPI::ReplaySpeed = 1.0;
+CSyncFollower CChromaBroadcastAPI::Sync;
+bool CChromaBroadcastAPI::Pacing = false;
+RZFramePacerConfig CChromaBroadcastAPI::PacingConfig = CFramePacer::Defaults();
+CFramePacer CChromaBroadcastAPI::Pacer;
+COutputScheduler CChromaBroadcastAPI::Output;
+DWORD CChromaBroadcastAPI::OutputDeadline = 0;
+CLock CChromaBroadcastAPI::CallbackLock;
+CLock CChromaBroadcastAPI::Critical;
+CLock CChromaBroadcastAPI::Lifecycle;
+bool CChromaBroadcastAPI::ThreadsRunning = false;
+std::vector<RZBroadcastContext*> CChromaBroadcastAPI::Contexts;
+std::unordered_map<RZID, RZBroadcastContext*> CChromaBroadcastAPI::Routes;
+std::vector<RZBroadcastContext*> CChromaBroadcastAPI::Dispatching;
+std::vector<RZBroadcastContext*> CChromaBroadcastAPI::Retired;
 bool CChromaBroadcastAPI::Synapse3NotOnline = false;
-bool CChromaBroadcastAPI::Running = false;
 RZSTATUS CChromaBroadcastAPI::LogStatus = 0;
+std::string CChromaBroadcastAPI::TracePath;
 
 extern "C" RZRESULT Init(RZAPPID app)
 {
 	if (CChromaBroadcastAPI::IsInitialized)
 		return RZRESULT_ALREADY_INITIALIZED;
 	CChromaBroadcastAPI::IsInitialized = true;
-	return CChromaBroadcastAPI::Init(app);
+	return CChromaBroadcastAPI::CreateContext(app, CChromaBroadcastAPI::DefaultContext);
 }
 
 extern "C" RZRESULT InitEx(int index, const char *title)
@@ -697,7 +1291,7 @@ extern "C" RZRESULT InitEx(int index, const char *title)
 	if (CChromaBroadcastAPI::IsInitialized)
 		return RZRESULT_ALREADY_INITIALIZED;
 	CChromaBroadcastAPI::IsInitialized = true;
-	return CChromaBroadcastAPI::InitEx(index, title);
+	return CChromaBroadcastAPI::CreateContext(index, title, CChromaBroadcastAPI::DefaultContext);
 }
 
 extern "C" RZRESULT UnInit()
@@ -705,8 +1299,11 @@ extern "C" RZRESULT UnInit()
 	if (!CChromaBroadcastAPI::IsInitialized)
 		return RZRESULT_NOT_VALID_STATE;
 
-	RZRESULT result = CChromaBroadcastAPI::UnInit();
+	RZRESULT result = RZRESULT_SUCCESS;
+	if (CChromaBroadcastAPI::DefaultContext)
+		result = CChromaBroadcastAPI::DestroyContext(CChromaBroadcastAPI::DefaultContext);
 
+	CChromaBroadcastAPI::DefaultContext = nullptr;
 	CChromaBroadcastAPI::IsInitialized = false;
 
 	return result;
@@ -717,7 +1314,7 @@ extern "C" RZRESULT RegisterEventNotification(RZEVENTNOTIFICATIONCALLBACK callba
 	if (!CChromaBroadcastAPI::IsInitialized)
 		return RZRESULT_NOT_VALID_STATE;
 
-	return CChromaBroadcastAPI::RegisterEventNotification(callback);
+	return CChromaBroadcastAPI::RegisterEventNotification(CChromaBroadcastAPI::DefaultContext, callback);
 }
 
 extern "C" RZRESULT UnRegisterEventNotification()
@@ -725,49 +1322,116 @@ extern "C" RZRESULT UnRegisterEventNotification()
 	if (!CChromaBroadcastAPI::IsInitialized)
 		return RZRESULT_NOT_VALID_STATE;
 
-	return CChromaBroadcastAPI::UnRegisterEventNotification();
+	return CChromaBroadcastAPI::UnRegisterEventNotification(CChromaBroadcastAPI::DefaultContext);
 }
 
-BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved)
+extern "C" RZRESULT CreateContext(RZAPPID app, RZBROADCASTCONTEXT* context)
 {
-	if (dwReason == DLL_PROCESS_ATTACH)
-	{
-		DisableThreadLibraryCalls(hModule);
+	if (!context)
+		return RZRESULT_INVALID_PARAMETER;
 
-		HKEY phkResult;
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RZBROADCAST_REG_SUBKEY, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
-			return TRUE;
+	*context = nullptr;
+	return CChromaBroadcastAPI::CreateContext(app, *context);
+}
 
-		std::string InstallPath;
-		InstallPath.resize(260);
-		DWORD InstallPathLen = 260;
-		if (RegQueryValueExA(phkResult, "InstallPath", 0, 0, (LPBYTE)InstallPath.data(), &InstallPathLen))
-		{
-			RegCloseKey(phkResult);
-			return TRUE;
-		}
-		InstallPath.resize(strlen(InstallPath.c_str()));
-		RegCloseKey(phkResult);
-		InstallPath += "\\Logs\\";
+extern "C" RZRESULT CreateContextEx(int index, const char* title, RZBROADCASTCONTEXT* context)
+{
+	if (!context || !title || !*title)
+		return RZRESULT_INVALID_PARAMETER;
 
-		char Filename[260];
-		if (!GetModuleFileNameA(0, Filename, sizeof(Filename)))
-			return TRUE;
+	*context = nullptr;
+	return CChromaBroadcastAPI::CreateContext(index, title, *context);
+}
 
-		PathStripPathA(Filename);
-		PathRemoveExtensionA(Filename);
-		PathAddExtensionA(Filename, ".log");
-		InstallPath += Filename;
+extern "C" RZRESULT DestroyContext(RZBROADCASTCONTEXT context)
+{
+	return CChromaBroadcastAPI::DestroyContext(context);
+}
+
+extern "C" RZRESULT RegisterContextNotification(RZBROADCASTCONTEXT context, RZCONTEXTNOTIFICATIONCALLBACK callback, void* user)
+{
+	return CChromaBroadcastAPI::RegisterContextNotification(context, callback, user);
+}
 
-		logFile = fopen(InstallPath.c_str(), "a");
+extern "C" RZRESULT UnRegisterContextNotification(RZBROADCASTCONTEXT context)
+{
+	return CChromaBroadcastAPI::UnRegisterEventNotification(context);
+}
+
+extern "C" RZRESULT GetMetrics(CHROMA_BROADCAST_METRICS* metrics)
+{
+	if (!metrics)
+		return RZRESULT_INVALID_PARAMETER;
+
+	CBroadcastMetrics::Snapshot(*metrics);
+	return RZRESULT_SUCCESS;
+}
+
+extern "C" RZRESULT EnableTrace(BOOL enable)
+{
+	CBroadcastTrace::Enable(enable != FALSE);
+	return RZRESULT_SUCCESS;
+}
+
+extern "C" RZRESULT DumpTrace(const char* path)
+{
+	if (!path || !*path)
+		return RZRESULT_INVALID_PARAMETER;
+
+	return CBroadcastTrace::Dump(path) ? RZRESULT_SUCCESS : RZRESULT_FAILED;
+}
+
+extern "C" RZRESULT StartRecording(const char* path)
+{
+	if (!path || !*path)
+		return RZRESULT_INVALID_PARAMETER;
+
+	return CChromaBroadcastAPI::StartRecording(path);
+}
+
+extern "C" RZRESULT StopRecording()
+{
+	CChromaBroadcastAPI::StopRecording();
+	return RZRESULT_SUCCESS;
+}
+
+extern "C" RZRESULT GetPacing(CHROMA_BROADCAST_PACING* pacing)
+{
+	if (!pacing)
+		return RZRESULT_INVALID_PARAMETER;
+
+	CChromaBroadcastAPI::GetPacing(*pacing);
+	return RZRESULT_SUCCESS;
+}
+
+extern "C" RZRESULT GetOutputStats(RZBROADCASTCONTEXT context, CHROMA_BROADCAST_OUTPUT_STATS* stats)
+{
+	if (!stats)
+		return RZRESULT_INVALID_PARAMETER;
+
+	return CChromaBroadcastAPI::GetOutputStats(context, *stats);
+}
+
+#ifdef _WIN32
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved)
+{
+	if (dwReason == DLL_PROCESS_ATTACH)
+	{
+		DisableThreadLibraryCalls(hModule);
+		CChromaBroadcastAPI::Attach();
 	}
-	else
+	else if (dwReason == DLL_PROCESS_DETACH)
 	{
-		if (logFile)
-		{
-			fclose(logFile);
-			logFile = nullptr;
-		}
+		CChromaBroadcastAPI::Detach();
 	}
 	return TRUE;
 }
+#else
+//! Stands in for DllMain. Defined last so the statics above are constructed before Attach and
+//! destroyed after Detach.
+static struct CModule
+{
+	CModule() { CChromaBroadcastAPI::Attach(); }
+	~CModule() { CChromaBroadcastAPI::Detach(); }
+} Module;
+#endif
@@ -0,0 +1,307 @@
+#include <math.h>
+#include <string.h>
+#include "ColorConvert.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Effects converted per pass, their colors are gathered on the stack first.
+static const size_t EFFECT_BATCH = 64;
+
+//------------------------------------------------------------------------------------------------
+// Scalar kernels, also the reference the vector kernels match byte for byte
+
+static void PackScalar(const RZCOLOR* colors, size_t count, BYTE* out, const RZGammaTable* gamma, bool grb)
+{
+	for (size_t i = 0; i < count; i++, out += 3)
+	{
+		RZCOLOR c = colors[i];
+		BYTE r = (BYTE)c, g = (BYTE)(c >> 8), b = (BYTE)(c >> 16);
+		if (gamma)
+		{
+			r = gamma->Bytes[0][r];
+			g = gamma->Bytes[1][g];
+			b = gamma->Bytes[2][b];
+		}
+		out[0] = grb ? g : r;
+		out[1] = grb ? r : g;
+		out[2] = b;
+	}
+}
+
+static void ToHsvScalar(const RZCOLOR* colors, size_t count, BYTE* out)
+{
+	for (size_t i = 0; i < count; i++, out += 3)
+	{
+		RZCOLOR c = colors[i];
+		float r = (float)(c & 0xFF), g = (float)((c >> 8) & 0xFF), b = (float)((c >> 16) & 0xFF);
+		float max = r > g ? r : g;
+		max = max > b ? max : b;
+		float min = r < g ? r : g;
+		min = min < b ? min : b;
+		float delta = max - min;
+
+		// The vector kernels evaluate the same expressions in the same order
+		float h = 0.0f;
+		if (delta > 0.0f)
+		{
+			if (max == r)
+				h = (g - b) / delta;
+			else if (max == g)
+				h = (b - r) / delta + 2.0f;
+			else
+				h = (r - g) / delta + 4.0f;
+		}
+		h = h * (256.0f / 6.0f);
+		if (h < 0.0f)
+			h = h + 256.0f;
+		float s = max > 0.0f ? delta * 255.0f / max : 0.0f;
+
+		// A hue that rounds to 256 wraps to 0
+		out[0] = (BYTE)(int)(h + 0.5f);
+		out[1] = (BYTE)(int)(s + 0.5f);
+		out[2] = (BYTE)(int)max;
+	}
+}
+
+static void ToLinearScalar(const RZCOLOR* colors, size_t count, float* out, const float* table)
+{
+	for (size_t i = 0; i < count; i++, out += 4)
+	{
+		RZCOLOR c = colors[i];
+		out[0] = table[c & 0xFF];
+		out[1] = table[256 + ((c >> 8) & 0xFF)];
+		out[2] = table[512 + ((c >> 16) & 0xFF)];
+		out[3] = table[768 + (c >> 24)];
+	}
+}
+
+static void BlendScalar(const float* const* weights, const float* values, int colors, size_t first, size_t count, float* const* out)
+{
+	for (size_t i = first; i < count; i++)
+	{
+		float r = 0.0f, g = 0.0f, b = 0.0f;
+		for (int k = 0; k < colors; k++)
+		{
+			float w = weights[k][i];
+			r = r + w * values[k * 3];
+			g = g + w * values[k * 3 + 1];
+			b = b + w * values[k * 3 + 2];
+		}
+		out[0][i] = r;
+		out[1][i] = g;
+		out[2][i] = b;
+	}
+}
+
+static void CorrectScalar(const float* const* in, const WORD* const* tables, float limit, size_t first, size_t count, WORD* const* out)
+{
+	const float scale = CORRECTION_TABLE_SIZE - 1;
+	for (size_t i = first; i < count; i++)
+	{
+		WORD v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			// Compared the way max and min instructions do, so NaN ends up as 0 as well
+			float x = in[c][i] * scale;
+			x = x > 0.0f ? x : 0.0f;
+			x = x < scale ? x : scale;
+			v[c] = tables[c][(int)(x + 0.5f)];
+		}
+		if (limit > 0.0f)
+		{
+			float sum = (float)v[0] + (float)v[1] + (float)v[2];
+			if (sum > limit)
+			{
+				float s = limit / sum;
+				for (int c = 0; c < 3; c++)
+					v[c] = (WORD)(int)(v[c] * s);
+			}
+		}
+		out[0][i] = v[0];
+		out[1][i] = v[1];
+		out[2][i] = v[2];
+	}
+}
+
+static void DitherScalar(const WORD* const* in, WORD* const* error, int bits, size_t first, size_t count, WORD* const* levels, BYTE* packed, bool grb)
+{
+	// The scaled value and the error add up to 65535 at most
+	const int shift = 16 - bits;
+	const DWORD mask = (1u << shift) - 1;
+	const DWORD half = (1u << shift) >> 1;
+	for (size_t i = first; i < count; i++)
+	{
+		DWORD q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			DWORD v = in[c][i];
+			DWORD acc = v - (v >> bits) + (error ? error[c][i] : half);
+			q[c] = acc >> shift;
+			if (error)
+				error[c][i] = (WORD)(acc & mask);
+		}
+		if (packed)
+		{
+			BYTE* out = packed + i * 3;
+			out[0] = (BYTE)(grb ? q[1] : q[0]);
+			out[1] = (BYTE)(grb ? q[0] : q[1]);
+			out[2] = (BYTE)q[2];
+		}
+		else
+		{
+			for (int c = 0; c < 3; c++)
+				levels[c][i] = (WORD)q[c];
+		}
+	}
+}
+
+//! The bits of x divided by 3 through a float, as the vector kernels do it without an integer divide.
+static inline float CubeRoot(float x)
+{
+	int bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = (int)((float)bits * (1.0f / 3.0f)) + OKLAB_CBRT_MAGIC;
+	float y;
+	memcpy(&y, &bits, sizeof(y));
+	y = (y + y + x / (y * y)) * (1.0f / 3.0f);
+	return (y + y + x / (y * y)) * (1.0f / 3.0f);
+}
+
+static float OklabDeltaScalar(const float* const* light, float* const* lab, const float* const* last, float floor, size_t first, size_t count)
+{
+	float worst = floor;
+	for (size_t i = first; i < count; i++)
+	{
+		float rgb[3];
+		for (int c = 0; c < 3; c++)
+			rgb[c] = light[c][i] > 0.0f ? light[c][i] : 0.0f;
+		float lms[3];
+		for (int c = 0; c < 3; c++)
+			lms[c] = CubeRoot(OklabLms[c][0] * rgb[0] + OklabLms[c][1] * rgb[1] + OklabLms[c][2] * rgb[2] + OKLAB_LMS_FLOOR);
+		float distance = 0.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			float v = OklabLab[c][0] * lms[0] + OklabLab[c][1] * lms[1] + OklabLab[c][2] * lms[2];
+			float d = v - last[c][i];
+			distance = distance + d * d;
+			lab[c][i] = v;
+		}
+		worst = distance > worst ? distance : worst;
+	}
+	return worst;
+}
+
+const RZColorKernels ColorKernelsScalar = { PackScalar, ToHsvScalar, ToLinearScalar, BlendScalar, CorrectScalar, DitherScalar, OklabDeltaScalar };
+
+//------------------------------------------------------------------------------------------------
+// CColorConverter
+
+static const float* LinearTable()
+{
+	static struct CLinearTable
+	{
+		float Values[LINEAR_TABLE_SIZE];
+
+		CLinearTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				double v = i / 255.0;
+				float linear = (float)(v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+				Values[i] = linear;
+				Values[256 + i] = linear;
+				Values[512 + i] = linear;
+				Values[768 + i] = (float)v;
+			}
+		}
+	} table;
+	return table.Values;
+}
+
+const RZColorKernels* ColorKernelsFor(SIMD_LEVEL level)
+{
+	switch (level)
+	{
+#if defined(RZ_SIMD_X86)
+	case SIMD_SSE2:
+		return &ColorKernelsSse2;
+	case SIMD_AVX2:
+		return &ColorKernelsAvx2;
+#elif defined(RZ_SIMD_NEON)
+	case SIMD_NEON:
+		return &ColorKernelsNeon;
+#endif
+	default:
+		return &ColorKernelsScalar;
+	}
+}
+
+CColorConverter::CColorConverter(SIMD_LEVEL level) : HasGamma(false)
+{
+	Simd = CSimd::IsSupported(level) ? level : CSimd::Level();
+	Kernels = ColorKernelsFor(Simd);
+	memset(&Gamma, 0, sizeof(Gamma));
+}
+
+void CColorConverter::SetGamma(float gamma)
+{
+	if (gamma == 1.0f || gamma <= 0.0f)
+	{
+		HasGamma = false;
+		return;
+	}
+
+	BYTE table[256];
+	for (int i = 0; i < 256; i++)
+		table[i] = (BYTE)(pow(i / 255.0, (double)gamma) * 255.0 + 0.5);
+	SetGammaTable(table);
+}
+
+void CColorConverter::SetGammaTable(const BYTE table[256])
+{
+	for (int c = 0; c < 3; c++)
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			Gamma.Bytes[c][i] = table[i];
+			Gamma.Wide[c][i] = table[i];
+		}
+	}
+	HasGamma = true;
+}
+
+size_t CColorConverter::OutputSize(COLOR_LAYOUT layout, size_t count)
+{
+	return layout == COLOR_LAYOUT_LINEAR ? count * 4 * sizeof(float) : count * 3;
+}
+
+void CColorConverter::Convert(COLOR_LAYOUT layout, const RZCOLOR* colors, size_t count, void* out) const
+{
+	switch (layout)
+	{
+	case COLOR_LAYOUT_RGB:
+	case COLOR_LAYOUT_GRB:
+		Kernels->Pack(colors, count, (BYTE*)out, HasGamma ? &Gamma : nullptr, layout == COLOR_LAYOUT_GRB);
+		break;
+	case COLOR_LAYOUT_HSV:
+		Kernels->ToHsv(colors, count, (BYTE*)out);
+		break;
+	case COLOR_LAYOUT_LINEAR:
+		Kernels->ToLinear(colors, count, (float*)out, LinearTable());
+		break;
+	}
+}
+
+void CColorConverter::Convert(COLOR_LAYOUT layout, const CHROMA_BROADCAST_EFFECT* effects, size_t count, void* out) const
+{
+	RZCOLOR colors[EFFECT_BATCH * 5];
+	BYTE* output = (BYTE*)out;
+	for (size_t first = 0; first < count; first += EFFECT_BATCH)
+	{
+		size_t batch = count - first < EFFECT_BATCH ? count - first : EFFECT_BATCH;
+		for (size_t i = 0; i < batch; i++)
+			memcpy(&colors[i * 5], &effects[first + i].CL1, 5 * sizeof(RZCOLOR));
+		Convert(layout, colors, batch * 5, output);
+		output += OutputSize(layout, batch * 5);
+	}
+}
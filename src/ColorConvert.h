@@ -0,0 +1,51 @@
+//! \file ColorConvert.h
+//! \brief Batch conversion of RZCOLOR arrays and effects to the layouts LED sinks send: RGB or GRB byte triplets
+//! through an optional gamma table, HSV bytes and linear light floats. Each layout has kernels for SSE2, AVX2 and
+//! NEON next to the scalar one, the converter uses the best the CPU runs and every level writes the same output.
+
+#ifndef _COLORCONVERT_H_
+#define _COLORCONVERT_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+#include "ColorKernels.h"
+#include "Simd.h"
+
+enum COLOR_LAYOUT
+{
+	COLOR_LAYOUT_RGB,                       //!< 3 bytes per color.
+	COLOR_LAYOUT_GRB,                       //!< 3 bytes per color, the order WS2812 LEDs take.
+	COLOR_LAYOUT_HSV,                       //!< 3 bytes per color, hue 0 to 255 for 0 to 360 degrees.
+	COLOR_LAYOUT_LINEAR,                    //!< 4 floats per color: R, G and B in linear light, and alpha, 0 to 1.
+};
+
+class CColorConverter
+{
+public:
+	//! Uses level when the CPU supports it, else the best supported level.
+	explicit CColorConverter(SIMD_LEVEL level = CSimd::Level());
+
+	SIMD_LEVEL Level() const { return Simd; }
+
+	//! Gamma of the RGB and GRB layouts, 1 sends the bytes as they are.
+	void SetGamma(float gamma);
+	//! Replaces the gamma curve with any 256 entry table.
+	void SetGammaTable(const BYTE table[256]);
+
+	//! Bytes Convert writes for count colors.
+	static size_t OutputSize(COLOR_LAYOUT layout, size_t count);
+
+	//! Converts count colors into out, which must hold OutputSize(layout, count) bytes.
+	void Convert(COLOR_LAYOUT layout, const RZCOLOR* colors, size_t count, void* out) const;
+	//! Converts CL1 to CL5 of count effects, five colors per effect.
+	void Convert(COLOR_LAYOUT layout, const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT* effects, size_t count, void* out) const;
+
+private:
+	const RZColorKernels* Kernels;
+	SIMD_LEVEL Simd;
+	bool HasGamma;
+	RZGammaTable Gamma;
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "ColorKernels.h"
+
+// Built with AVX2 enabled, only called once CSimd found it. Keep code the rest of the library could share,
+// like inline functions from other headers, out of this file.
+#if defined(RZ_SIMD_X86)
+#include <immintrin.h>
+
+//! Packs the low 3 bytes of each 32-bit lane, R G B or G R B, into the first 12 bytes of each 128-bit half.
+static inline __m256i PackMask(bool grb)
+{
+	return grb
+		? _mm256_setr_epi8(1, 0, 2, 5, 4, 6, 9, 8, 10, 13, 12, 14, -1, -1, -1, -1, 1, 0, 2, 5, 4, 6, 9, 8, 10, 13, 12, 14, -1, -1, -1, -1)
+		: _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+}
+
+//! Writes 24 bytes through two 16 byte stores that write 28.
+static inline void Store8x24(__m256i packed, BYTE* out)
+{
+	_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(packed));
+	_mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(packed, 1));
+}
+
+static void PackAvx2(const RZCOLOR* colors, size_t count, BYTE* out, const RZGammaTable* gamma, bool grb)
+{
+	const __m256i mask = PackMask(grb);
+	const __m256i low = _mm256_set1_epi32(0xFF);
+	const int* red = gamma ? (const int*)gamma->Wide[0] : nullptr;
+	const int* green = gamma ? (const int*)gamma->Wide[1] : nullptr;
+	const int* blue = gamma ? (const int*)gamma->Wide[2] : nullptr;
+	size_t i = 0;
+	// Two more colors keep the overlapping stores inside the output
+	for (; i + 10 <= count; i += 8, out += 24)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(colors + i));
+		if (gamma)
+		{
+			__m256i r = _mm256_i32gather_epi32(red, _mm256_and_si256(x, low), 4);
+			__m256i g = _mm256_i32gather_epi32(green, _mm256_and_si256(_mm256_srli_epi32(x, 8), low), 4);
+			__m256i b = _mm256_i32gather_epi32(blue, _mm256_and_si256(_mm256_srli_epi32(x, 16), low), 4);
+			x = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+		}
+		Store8x24(_mm256_shuffle_epi8(x, mask), out);
+	}
+	ColorKernelsScalar.Pack(colors + i, count - i, out, gamma, grb);
+}
+
+static void ToHsvAvx2(const RZCOLOR* colors, size_t count, BYTE* out)
+{
+	const __m256i mask = PackMask(false);
+	const __m256i low = _mm256_set1_epi32(0xFF);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 scale = _mm256_set1_ps(256.0f / 6.0f);
+	size_t i = 0;
+	for (; i + 10 <= count; i += 8, out += 24)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(colors + i));
+		__m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(x, low));
+		__m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(x, 8), low));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(x, 16), low));
+		__m256 max = _mm256_max_ps(_mm256_max_ps(r, g), b);
+		__m256 min = _mm256_min_ps(_mm256_min_ps(r, g), b);
+		__m256 delta = _mm256_sub_ps(max, min);
+
+		// Same expressions as the scalar kernel, lanes with no delta divide by 0 and are dropped
+		__m256 hr = _mm256_div_ps(_mm256_sub_ps(g, b), delta);
+		__m256 hg = _mm256_add_ps(_mm256_div_ps(_mm256_sub_ps(b, r), delta), _mm256_set1_ps(2.0f));
+		__m256 hb = _mm256_add_ps(_mm256_div_ps(_mm256_sub_ps(r, g), delta), _mm256_set1_ps(4.0f));
+		__m256 isR = _mm256_cmp_ps(max, r, _CMP_EQ_OQ);
+		__m256 isG = _mm256_cmp_ps(max, g, _CMP_EQ_OQ);
+		__m256 h = _mm256_blendv_ps(_mm256_blendv_ps(hb, hg, isG), hr, isR);
+		h = _mm256_and_ps(_mm256_cmp_ps(delta, zero, _CMP_GT_OQ), h);
+		h = _mm256_mul_ps(h, scale);
+		h = _mm256_add_ps(h, _mm256_and_ps(_mm256_cmp_ps(h, zero, _CMP_LT_OQ), _mm256_set1_ps(256.0f)));
+		__m256 s = _mm256_and_ps(_mm256_cmp_ps(max, zero, _CMP_GT_OQ), _mm256_div_ps(_mm256_mul_ps(delta, _mm256_set1_ps(255.0f)), max));
+
+		__m256i hue = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(h, _mm256_set1_ps(0.5f))), low);
+		__m256i saturation = _mm256_cvttps_epi32(_mm256_add_ps(s, _mm256_set1_ps(0.5f)));
+		__m256i value = _mm256_cvttps_epi32(max);
+		x = _mm256_or_si256(hue, _mm256_or_si256(_mm256_slli_epi32(saturation, 8), _mm256_slli_epi32(value, 16)));
+		Store8x24(_mm256_shuffle_epi8(x, mask), out);
+	}
+	ColorKernelsScalar.ToHsv(colors + i, count - i, out);
+}
+
+//! One gather reads the four channels of two colors.
+static void ToLinearAvx2(const RZCOLOR* colors, size_t count, float* out, const float* table)
+{
+	const __m256i offsets = _mm256_setr_epi32(0, 256, 512, 768, 0, 256, 512, 768);
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2, out += 8)
+	{
+		__m256i index = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(colors + i))), offsets);
+		_mm256_storeu_ps(out, _mm256_i32gather_ps(table, index, 4));
+	}
+	ColorKernelsScalar.ToLinear(colors + i, count - i, out, table);
+}
+
+//! Multiplies and adds apart, a fused multiply-add would round differently from the other levels.
+static void BlendAvx2(const float* const* weights, const float* values, int colors, size_t first, size_t count, float* const* out)
+{
+	__m256 color[BLEND_MAX_COLORS][3];
+	for (int k = 0; k < colors; k++)
+	{
+		for (int c = 0; c < 3; c++)
+			color[k][c] = _mm256_set1_ps(values[k * 3 + c]);
+	}
+
+	size_t i = first;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 r = _mm256_setzero_ps(), g = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+		for (int k = 0; k < colors; k++)
+		{
+			__m256 w = _mm256_loadu_ps(weights[k] + i);
+			r = _mm256_add_ps(r, _mm256_mul_ps(w, color[k][0]));
+			g = _mm256_add_ps(g, _mm256_mul_ps(w, color[k][1]));
+			b = _mm256_add_ps(b, _mm256_mul_ps(w, color[k][2]));
+		}
+		_mm256_storeu_ps(out[0] + i, r);
+		_mm256_storeu_ps(out[1] + i, g);
+		_mm256_storeu_ps(out[2] + i, b);
+	}
+	ColorKernelsScalar.Blend(weights, values, colors, i, count, out);
+}
+
+//! Gathers 32 bits at each 16-bit entry and keeps the low half, the entry itself.
+static void CorrectAvx2(const float* const* in, const WORD* const* tables, float limit, size_t first, size_t count, WORD* const* out)
+{
+	const __m256 scale = _mm256_set1_ps(CORRECTION_TABLE_SIZE - 1);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 cap = _mm256_set1_ps(limit);
+	const __m256i low = _mm256_set1_epi32(0xFFFF);
+	size_t i = first;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 x = _mm256_mul_ps(_mm256_loadu_ps(in[c] + i), scale);
+			x = _mm256_min_ps(_mm256_max_ps(x, zero), scale);
+			__m256i index = _mm256_cvttps_epi32(_mm256_add_ps(x, half));
+			v[c] = _mm256_and_si256(_mm256_i32gather_epi32((const int*)tables[c], index, 2), low);
+		}
+		if (limit > 0.0f)
+		{
+			__m256 r = _mm256_cvtepi32_ps(v[0]), g = _mm256_cvtepi32_ps(v[1]), b = _mm256_cvtepi32_ps(v[2]);
+			__m256 sum = _mm256_add_ps(_mm256_add_ps(r, g), b);
+			__m256 s = _mm256_blendv_ps(one, _mm256_div_ps(cap, sum), _mm256_cmp_ps(sum, cap, _CMP_GT_OQ));
+			v[0] = _mm256_cvttps_epi32(_mm256_mul_ps(r, s));
+			v[1] = _mm256_cvttps_epi32(_mm256_mul_ps(g, s));
+			v[2] = _mm256_cvttps_epi32(_mm256_mul_ps(b, s));
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v[c], v[c]), 0x08);
+			_mm_storeu_si128((__m128i*)(out[c] + i), _mm256_castsi256_si128(packed));
+		}
+	}
+	ColorKernelsScalar.Correct(in, tables, limit, i, count, out);
+}
+
+static void DitherAvx2(const WORD* const* in, WORD* const* error, int bits, size_t first, size_t count, WORD* const* levels, BYTE* packed, bool grb)
+{
+	const __m128i scaleShift = _mm_cvtsi32_si128(bits);
+	const __m128i levelShift = _mm_cvtsi32_si128(16 - bits);
+	const __m256i mask = _mm256_set1_epi16((short)((1 << (16 - bits)) - 1));
+	const __m256i half = _mm256_set1_epi16((short)((1 << (16 - bits)) >> 1));
+	const __m256i pack = PackMask(false);
+	size_t i = first;
+	// Packed, two more elements keep the overlapping stores inside the output
+	for (; i + (packed ? 18 : 16) <= count; i += 16)
+	{
+		__m256i q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(in[c] + i));
+			__m256i acc = _mm256_sub_epi16(v, _mm256_srl_epi16(v, scaleShift));
+			if (error)
+			{
+				acc = _mm256_add_epi16(acc, _mm256_loadu_si256((const __m256i*)(error[c] + i)));
+				_mm256_storeu_si256((__m256i*)(error[c] + i), _mm256_and_si256(acc, mask));
+			}
+			else
+				acc = _mm256_add_epi16(acc, half);
+			q[c] = _mm256_srl_epi16(acc, levelShift);
+		}
+		if (packed)
+		{
+			// Unpacking works within 128-bit halves, the quarters are reordered so the low unpack holds
+			// elements 0 to 7 and the high one 8 to 15
+			__m256i pair = _mm256_or_si256(grb ? q[1] : q[0], _mm256_slli_epi16(grb ? q[0] : q[1], 8));
+			pair = _mm256_permute4x64_epi64(pair, 0xD8);
+			__m256i third = _mm256_permute4x64_epi64(q[2], 0xD8);
+			Store8x24(_mm256_shuffle_epi8(_mm256_unpacklo_epi16(pair, third), pack), packed + i * 3);
+			Store8x24(_mm256_shuffle_epi8(_mm256_unpackhi_epi16(pair, third), pack), packed + i * 3 + 24);
+		}
+		else
+		{
+			for (int c = 0; c < 3; c++)
+				_mm256_storeu_si256((__m256i*)(levels[c] + i), q[c]);
+		}
+	}
+	ColorKernelsScalar.Dither(in, error, bits, i, count, levels, packed, grb);
+}
+
+static inline __m256 CubeRoot(__m256 x)
+{
+	const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+	__m256i bits = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), third));
+	__m256 y = _mm256_castsi256_ps(_mm256_add_epi32(bits, _mm256_set1_epi32(OKLAB_CBRT_MAGIC)));
+	y = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))), third);
+	return _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))), third);
+}
+
+static float OklabDeltaAvx2(const float* const* light, float* const* lab, const float* const* last, float floor, size_t first, size_t count)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 lmsFloor = _mm256_set1_ps(OKLAB_LMS_FLOOR);
+	__m256 toLms[3][3], toLab[3][3];
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			toLms[r][c] = _mm256_set1_ps(OklabLms[r][c]);
+			toLab[r][c] = _mm256_set1_ps(OklabLab[r][c]);
+		}
+	}
+
+	__m256 worst = _mm256_set1_ps(floor);
+	size_t i = first;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 rgb[3], lms[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 x = _mm256_loadu_ps(light[c] + i);
+			rgb[c] = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ), x);
+		}
+		for (int r = 0; r < 3; r++)
+		{
+			__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toLms[r][0], rgb[0]), _mm256_mul_ps(toLms[r][1], rgb[1])), _mm256_mul_ps(toLms[r][2], rgb[2]));
+			lms[r] = CubeRoot(_mm256_add_ps(v, lmsFloor));
+		}
+		__m256 distance = zero;
+		for (int r = 0; r < 3; r++)
+		{
+			__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toLab[r][0], lms[0]), _mm256_mul_ps(toLab[r][1], lms[1])), _mm256_mul_ps(toLab[r][2], lms[2]));
+			__m256 d = _mm256_sub_ps(v, _mm256_loadu_ps(last[r] + i));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(d, d));
+			_mm256_storeu_ps(lab[r] + i, v);
+		}
+		worst = _mm256_max_ps(distance, worst);
+	}
+	__m128 half = _mm_max_ps(_mm256_castps256_ps128(worst), _mm256_extractf128_ps(worst, 1));
+	half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 0, 3, 2)));
+	half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(2, 3, 0, 1)));
+	return ColorKernelsScalar.OklabDelta(light, lab, last, _mm_cvtss_f32(half), i, count);
+}
+
+const RZColorKernels ColorKernelsAvx2 = { PackAvx2, ToHsvAvx2, ToLinearAvx2, BlendAvx2, CorrectAvx2, DitherAvx2, OklabDeltaAvx2 };
+
+#endif
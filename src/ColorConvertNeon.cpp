@@ -0,0 +1,271 @@
+#include "ColorKernels.h"
+
+#if defined(RZ_SIMD_NEON)
+#include <arm_neon.h>
+
+//! A 256 entry byte table as four 64 byte table registers.
+struct RZNeonTable
+{
+	uint8x16x4_t Quarters[4];
+};
+
+static inline void LoadTable(const BYTE* bytes, RZNeonTable& table)
+{
+	for (int q = 0; q < 4; q++)
+	{
+		for (int v = 0; v < 4; v++)
+			table.Quarters[q].val[v] = vld1q_u8(bytes + q * 64 + v * 16);
+	}
+}
+
+//! Each quarter answers the indexes in its range and leaves the others to the previous quarters.
+static inline uint8x16_t Lookup(uint8x16_t index, const RZNeonTable& table)
+{
+	uint8x16_t result = vqtbl4q_u8(table.Quarters[0], index);
+	result = vqtbx4q_u8(result, table.Quarters[1], vsubq_u8(index, vdupq_n_u8(64)));
+	result = vqtbx4q_u8(result, table.Quarters[2], vsubq_u8(index, vdupq_n_u8(128)));
+	return vqtbx4q_u8(result, table.Quarters[3], vsubq_u8(index, vdupq_n_u8(192)));
+}
+
+static void PackNeon(const RZCOLOR* colors, size_t count, BYTE* out, const RZGammaTable* gamma, bool grb)
+{
+	// Three tables do not fit the registers, the compiler keeps some of them on the stack
+	RZNeonTable tables[3];
+	if (gamma)
+	{
+		for (int c = 0; c < 3; c++)
+			LoadTable(gamma->Bytes[c], tables[c]);
+	}
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16, out += 48)
+	{
+		// Splits 16 colors into their R, G, B and A bytes
+		uint8x16x4_t x = vld4q_u8((const uint8_t*)(colors + i));
+		uint8x16_t r = x.val[0], g = x.val[1], b = x.val[2];
+		if (gamma)
+		{
+			r = Lookup(r, tables[0]);
+			g = Lookup(g, tables[1]);
+			b = Lookup(b, tables[2]);
+		}
+		uint8x16x3_t packed;
+		packed.val[0] = grb ? g : r;
+		packed.val[1] = grb ? r : g;
+		packed.val[2] = b;
+		vst3q_u8(out, packed);
+	}
+	ColorKernelsScalar.Pack(colors + i, count - i, out, gamma, grb);
+}
+
+//! Quarter q of 16 bytes as floats.
+static inline float32x4_t Widen(uint8x16_t x, int q)
+{
+	uint16x8_t half = q < 2 ? vmovl_u8(vget_low_u8(x)) : vmovl_u8(vget_high_u8(x));
+	return vcvtq_f32_u32((q & 1) ? vmovl_u16(vget_high_u16(half)) : vmovl_u16(vget_low_u16(half)));
+}
+
+//! Low byte of 16 lanes, a hue of 256 wraps to 0.
+static inline uint8x16_t Narrow(const uint32x4_t quarters[4])
+{
+	uint16x8_t low = vcombine_u16(vmovn_u32(quarters[0]), vmovn_u32(quarters[1]));
+	uint16x8_t high = vcombine_u16(vmovn_u32(quarters[2]), vmovn_u32(quarters[3]));
+	return vcombine_u8(vmovn_u16(low), vmovn_u16(high));
+}
+
+static inline float32x4_t AndMask(uint32x4_t mask, float32x4_t x)
+{
+	return vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(x)));
+}
+
+static void ToHsvNeon(const RZCOLOR* colors, size_t count, BYTE* out)
+{
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	const float32x4_t scale = vdupq_n_f32(256.0f / 6.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16, out += 48)
+	{
+		uint8x16x4_t x = vld4q_u8((const uint8_t*)(colors + i));
+		uint32x4_t hue[4], saturation[4], value[4];
+		for (int q = 0; q < 4; q++)
+		{
+			float32x4_t r = Widen(x.val[0], q), g = Widen(x.val[1], q), b = Widen(x.val[2], q);
+			float32x4_t max = vmaxq_f32(vmaxq_f32(r, g), b);
+			float32x4_t min = vminq_f32(vminq_f32(r, g), b);
+			float32x4_t delta = vsubq_f32(max, min);
+
+			// Same expressions as the scalar kernel, lanes with no delta divide by 0 and are dropped
+			float32x4_t hr = vdivq_f32(vsubq_f32(g, b), delta);
+			float32x4_t hg = vaddq_f32(vdivq_f32(vsubq_f32(b, r), delta), vdupq_n_f32(2.0f));
+			float32x4_t hb = vaddq_f32(vdivq_f32(vsubq_f32(r, g), delta), vdupq_n_f32(4.0f));
+			float32x4_t h = vbslq_f32(vceqq_f32(max, r), hr, vbslq_f32(vceqq_f32(max, g), hg, hb));
+			h = AndMask(vcgtq_f32(delta, zero), h);
+			h = vmulq_f32(h, scale);
+			h = vaddq_f32(h, AndMask(vcltq_f32(h, zero), vdupq_n_f32(256.0f)));
+			float32x4_t s = AndMask(vcgtq_f32(max, zero), vdivq_f32(vmulq_f32(delta, vdupq_n_f32(255.0f)), max));
+
+			hue[q] = vcvtq_u32_f32(vaddq_f32(h, half));
+			saturation[q] = vcvtq_u32_f32(vaddq_f32(s, half));
+			value[q] = vcvtq_u32_f32(max);
+		}
+		uint8x16x3_t packed;
+		packed.val[0] = Narrow(hue);
+		packed.val[1] = Narrow(saturation);
+		packed.val[2] = Narrow(value);
+		vst3q_u8(out, packed);
+	}
+	ColorKernelsScalar.ToHsv(colors + i, count - i, out);
+}
+
+//! NEON has no gather, a table lookup per channel is what the scalar kernel does already.
+static void ToLinearNeon(const RZCOLOR* colors, size_t count, float* out, const float* table)
+{
+	ColorKernelsScalar.ToLinear(colors, count, out, table);
+}
+
+//! vmulq and vaddq rather than vmlaq, which may be fused and round differently from the other levels.
+static void BlendNeon(const float* const* weights, const float* values, int colors, size_t first, size_t count, float* const* out)
+{
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t r = vdupq_n_f32(0.0f), g = vdupq_n_f32(0.0f), b = vdupq_n_f32(0.0f);
+		for (int k = 0; k < colors; k++)
+		{
+			float32x4_t w = vld1q_f32(weights[k] + i);
+			r = vaddq_f32(r, vmulq_n_f32(w, values[k * 3]));
+			g = vaddq_f32(g, vmulq_n_f32(w, values[k * 3 + 1]));
+			b = vaddq_f32(b, vmulq_n_f32(w, values[k * 3 + 2]));
+		}
+		vst1q_f32(out[0] + i, r);
+		vst1q_f32(out[1] + i, g);
+		vst1q_f32(out[2] + i, b);
+	}
+	ColorKernelsScalar.Blend(weights, values, colors, i, count, out);
+}
+
+//! The indexes and the current limit in vectors, the lookups one at a time, the tables are too large for table
+//! instructions. Clamped with selects, vmaxq and vminq would keep NaN where the scalar kernel ends up at 0.
+static void CorrectNeon(const float* const* in, const WORD* const* tables, float limit, size_t first, size_t count, WORD* const* out)
+{
+	const float32x4_t scale = vdupq_n_f32(CORRECTION_TABLE_SIZE - 1);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const float32x4_t cap = vdupq_n_f32(limit);
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint32x4_t v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			float32x4_t x = vmulq_f32(vld1q_f32(in[c] + i), scale);
+			x = vbslq_f32(vcgtq_f32(x, zero), x, zero);
+			x = vbslq_f32(vcltq_f32(x, scale), x, scale);
+			uint32_t index[4];
+			vst1q_u32(index, vcvtq_u32_f32(vaddq_f32(x, half)));
+			const WORD* table = tables[c];
+			const uint32_t values[4] = { table[index[0]], table[index[1]], table[index[2]], table[index[3]] };
+			v[c] = vld1q_u32(values);
+		}
+		if (limit > 0.0f)
+		{
+			float32x4_t r = vcvtq_f32_u32(v[0]), g = vcvtq_f32_u32(v[1]), b = vcvtq_f32_u32(v[2]);
+			float32x4_t sum = vaddq_f32(vaddq_f32(r, g), b);
+			float32x4_t s = vbslq_f32(vcgtq_f32(sum, cap), vdivq_f32(cap, sum), one);
+			v[0] = vcvtq_u32_f32(vmulq_f32(r, s));
+			v[1] = vcvtq_u32_f32(vmulq_f32(g, s));
+			v[2] = vcvtq_u32_f32(vmulq_f32(b, s));
+		}
+		for (int c = 0; c < 3; c++)
+			vst1_u16(out[c] + i, vmovn_u32(v[c]));
+	}
+	ColorKernelsScalar.Correct(in, tables, limit, i, count, out);
+}
+
+static void DitherNeon(const WORD* const* in, WORD* const* error, int bits, size_t first, size_t count, WORD* const* levels, BYTE* packed, bool grb)
+{
+	// Shifts by a negative count shift right
+	const int16x8_t scaleShift = vdupq_n_s16((int16_t)-bits);
+	const int16x8_t levelShift = vdupq_n_s16((int16_t)(bits - 16));
+	const uint16x8_t mask = vdupq_n_u16((uint16_t)((1 << (16 - bits)) - 1));
+	const uint16x8_t half = vdupq_n_u16((uint16_t)((1 << (16 - bits)) >> 1));
+	size_t i = first;
+	for (; i + 8 <= count; i += 8)
+	{
+		uint16x8_t q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			uint16x8_t v = vld1q_u16(in[c] + i);
+			uint16x8_t acc = vsubq_u16(v, vshlq_u16(v, scaleShift));
+			if (error)
+			{
+				acc = vaddq_u16(acc, vld1q_u16(error[c] + i));
+				vst1q_u16(error[c] + i, vandq_u16(acc, mask));
+			}
+			else
+				acc = vaddq_u16(acc, half);
+			q[c] = vshlq_u16(acc, levelShift);
+		}
+		if (packed)
+		{
+			uint8x8x3_t x;
+			x.val[0] = vmovn_u16(grb ? q[1] : q[0]);
+			x.val[1] = vmovn_u16(grb ? q[0] : q[1]);
+			x.val[2] = vmovn_u16(q[2]);
+			vst3_u8(packed + i * 3, x);
+		}
+		else
+		{
+			for (int c = 0; c < 3; c++)
+				vst1q_u16(levels[c] + i, q[c]);
+		}
+	}
+	ColorKernelsScalar.Dither(in, error, bits, i, count, levels, packed, grb);
+}
+
+static inline float32x4_t CubeRoot(float32x4_t x)
+{
+	const float32x4_t third = vdupq_n_f32(1.0f / 3.0f);
+	int32x4_t bits = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_f32(x)), third));
+	float32x4_t y = vreinterpretq_f32_s32(vaddq_s32(bits, vdupq_n_s32(OKLAB_CBRT_MAGIC)));
+	y = vmulq_f32(vaddq_f32(vaddq_f32(y, y), vdivq_f32(x, vmulq_f32(y, y))), third);
+	return vmulq_f32(vaddq_f32(vaddq_f32(y, y), vdivq_f32(x, vmulq_f32(y, y))), third);
+}
+
+static float OklabDeltaNeon(const float* const* light, float* const* lab, const float* const* last, float floor, size_t first, size_t count)
+{
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t lmsFloor = vdupq_n_f32(OKLAB_LMS_FLOOR);
+	float32x4_t worst = vdupq_n_f32(floor);
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t rgb[3], lms[3];
+		for (int c = 0; c < 3; c++)
+		{
+			float32x4_t x = vld1q_f32(light[c] + i);
+			rgb[c] = vbslq_f32(vcgtq_f32(x, zero), x, zero);
+		}
+		for (int r = 0; r < 3; r++)
+		{
+			float32x4_t v = vaddq_f32(vaddq_f32(vmulq_n_f32(rgb[0], OklabLms[r][0]), vmulq_n_f32(rgb[1], OklabLms[r][1])), vmulq_n_f32(rgb[2], OklabLms[r][2]));
+			lms[r] = CubeRoot(vaddq_f32(v, lmsFloor));
+		}
+		float32x4_t distance = zero;
+		for (int r = 0; r < 3; r++)
+		{
+			float32x4_t v = vaddq_f32(vaddq_f32(vmulq_n_f32(lms[0], OklabLab[r][0]), vmulq_n_f32(lms[1], OklabLab[r][1])), vmulq_n_f32(lms[2], OklabLab[r][2]));
+			float32x4_t d = vsubq_f32(v, vld1q_f32(last[r] + i));
+			distance = vaddq_f32(distance, vmulq_f32(d, d));
+			vst1q_f32(lab[r] + i, v);
+		}
+		worst = vmaxq_f32(distance, worst);
+	}
+	return ColorKernelsScalar.OklabDelta(light, lab, last, vmaxvq_f32(worst), i, count);
+}
+
+const RZColorKernels ColorKernelsNeon = { PackNeon, ToHsvNeon, ToLinearNeon, BlendNeon, CorrectNeon, DitherNeon, OklabDeltaNeon };
+
+#endif
@@ -0,0 +1,249 @@
+#include "ColorKernels.h"
+
+#if defined(RZ_SIMD_X86)
+#include <emmintrin.h>
+
+//! Writes the low 3 bytes of each lane, 12 bytes, through two 8 byte stores that write 14.
+static inline void Store4x24(__m128i x, BYTE* out)
+{
+	__m128i even = _mm_and_si128(x, _mm_set_epi32(0, -1, 0, -1));
+	__m128i packed = _mm_or_si128(even, _mm_slli_epi64(_mm_srli_epi64(x, 32), 24));
+	_mm_storel_epi64((__m128i*)out, packed);
+	_mm_storel_epi64((__m128i*)(out + 6), _mm_srli_si128(packed, 8));
+}
+
+static void PackSse2(const RZCOLOR* colors, size_t count, BYTE* out, const RZGammaTable* gamma, bool grb)
+{
+	// Without a gather the table lookups are scalar either way, and byte lookups are the cheaper ones
+	if (gamma)
+	{
+		ColorKernelsScalar.Pack(colors, count, out, gamma, grb);
+		return;
+	}
+
+	const __m128i low = _mm_set1_epi32(0xFF);
+	const __m128i blue = _mm_set1_epi32(0xFF0000);
+	const __m128i rgb = _mm_set1_epi32(0xFFFFFF);
+	size_t i = 0;
+	// A fifth color keeps the overlapping stores inside the output
+	for (; i + 5 <= count; i += 4, out += 12)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(colors + i));
+		if (grb)
+			x = _mm_or_si128(_mm_and_si128(x, blue), _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, low), 8), _mm_and_si128(_mm_srli_epi32(x, 8), low)));
+		else
+			x = _mm_and_si128(x, rgb);
+		Store4x24(x, out);
+	}
+	ColorKernelsScalar.Pack(colors + i, count - i, out, nullptr, grb);
+}
+
+static void ToHsvSse2(const RZCOLOR* colors, size_t count, BYTE* out)
+{
+	const __m128i low = _mm_set1_epi32(0xFF);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 scale = _mm_set1_ps(256.0f / 6.0f);
+	size_t i = 0;
+	for (; i + 5 <= count; i += 4, out += 12)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(colors + i));
+		__m128 r = _mm_cvtepi32_ps(_mm_and_si128(x, low));
+		__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 8), low));
+		__m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 16), low));
+		__m128 max = _mm_max_ps(_mm_max_ps(r, g), b);
+		__m128 min = _mm_min_ps(_mm_min_ps(r, g), b);
+		__m128 delta = _mm_sub_ps(max, min);
+
+		// Every branch of the scalar kernel, then the one it takes. Lanes with no delta divide by 0 and are dropped.
+		__m128 hr = _mm_div_ps(_mm_sub_ps(g, b), delta);
+		__m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), delta), _mm_set1_ps(2.0f));
+		__m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), delta), _mm_set1_ps(4.0f));
+		__m128 isR = _mm_cmpeq_ps(max, r);
+		__m128 isG = _mm_andnot_ps(isR, _mm_cmpeq_ps(max, g));
+		__m128 isB = _mm_andnot_ps(_mm_or_ps(isR, isG), _mm_cmpeq_ps(max, max));
+		__m128 h = _mm_or_ps(_mm_or_ps(_mm_and_ps(isR, hr), _mm_and_ps(isG, hg)), _mm_and_ps(isB, hb));
+		h = _mm_and_ps(_mm_cmpgt_ps(delta, zero), h);
+		h = _mm_mul_ps(h, scale);
+		h = _mm_add_ps(h, _mm_and_ps(_mm_cmplt_ps(h, zero), _mm_set1_ps(256.0f)));
+		__m128 s = _mm_and_ps(_mm_cmpgt_ps(max, zero), _mm_div_ps(_mm_mul_ps(delta, _mm_set1_ps(255.0f)), max));
+
+		__m128i hue = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(h, _mm_set1_ps(0.5f))), low);
+		__m128i saturation = _mm_cvttps_epi32(_mm_add_ps(s, _mm_set1_ps(0.5f)));
+		__m128i value = _mm_cvttps_epi32(max);
+		Store4x24(_mm_or_si128(hue, _mm_or_si128(_mm_slli_epi32(saturation, 8), _mm_slli_epi32(value, 16))), out);
+	}
+	ColorKernelsScalar.ToHsv(colors + i, count - i, out);
+}
+
+//! SSE2 has no gather, a table lookup per channel is what the scalar kernel does already.
+static void ToLinearSse2(const RZCOLOR* colors, size_t count, float* out, const float* table)
+{
+	ColorKernelsScalar.ToLinear(colors, count, out, table);
+}
+
+static void BlendSse2(const float* const* weights, const float* values, int colors, size_t first, size_t count, float* const* out)
+{
+	__m128 color[BLEND_MAX_COLORS][3];
+	for (int k = 0; k < colors; k++)
+	{
+		for (int c = 0; c < 3; c++)
+			color[k][c] = _mm_set1_ps(values[k * 3 + c]);
+	}
+
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 r = _mm_setzero_ps(), g = _mm_setzero_ps(), b = _mm_setzero_ps();
+		for (int k = 0; k < colors; k++)
+		{
+			__m128 w = _mm_loadu_ps(weights[k] + i);
+			r = _mm_add_ps(r, _mm_mul_ps(w, color[k][0]));
+			g = _mm_add_ps(g, _mm_mul_ps(w, color[k][1]));
+			b = _mm_add_ps(b, _mm_mul_ps(w, color[k][2]));
+		}
+		_mm_storeu_ps(out[0] + i, r);
+		_mm_storeu_ps(out[1] + i, g);
+		_mm_storeu_ps(out[2] + i, b);
+	}
+	ColorKernelsScalar.Blend(weights, values, colors, i, count, out);
+}
+
+//! The indexes and the current limit in vectors, the lookups one at a time.
+static void CorrectSse2(const float* const* in, const WORD* const* tables, float limit, size_t first, size_t count, WORD* const* out)
+{
+	const __m128 scale = _mm_set1_ps(CORRECTION_TABLE_SIZE - 1);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 cap = _mm_set1_ps(limit);
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 x = _mm_mul_ps(_mm_loadu_ps(in[c] + i), scale);
+			x = _mm_min_ps(_mm_max_ps(x, zero), scale);
+			alignas(16) int index[4];
+			_mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(x, half)));
+			const WORD* table = tables[c];
+			v[c] = _mm_setr_epi32(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+		}
+		if (limit > 0.0f)
+		{
+			__m128 r = _mm_cvtepi32_ps(v[0]), g = _mm_cvtepi32_ps(v[1]), b = _mm_cvtepi32_ps(v[2]);
+			__m128 sum = _mm_add_ps(_mm_add_ps(r, g), b);
+			__m128 over = _mm_cmpgt_ps(sum, cap);
+			__m128 s = _mm_or_ps(_mm_and_ps(over, _mm_div_ps(cap, sum)), _mm_andnot_ps(over, one));
+			v[0] = _mm_cvttps_epi32(_mm_mul_ps(r, s));
+			v[1] = _mm_cvttps_epi32(_mm_mul_ps(g, s));
+			v[2] = _mm_cvttps_epi32(_mm_mul_ps(b, s));
+		}
+		// No unsigned saturating pack before SSE4.1, the values are moved into the signed range and back
+		for (int c = 0; c < 3; c++)
+		{
+			__m128i biased = _mm_sub_epi32(v[c], bias);
+			__m128i packed = _mm_xor_si128(_mm_packs_epi32(biased, biased), _mm_set1_epi16((short)0x8000));
+			_mm_storel_epi64((__m128i*)(out[c] + i), packed);
+		}
+	}
+	ColorKernelsScalar.Correct(in, tables, limit, i, count, out);
+}
+
+static void DitherSse2(const WORD* const* in, WORD* const* error, int bits, size_t first, size_t count, WORD* const* levels, BYTE* packed, bool grb)
+{
+	const __m128i scaleShift = _mm_cvtsi32_si128(bits);
+	const __m128i levelShift = _mm_cvtsi32_si128(16 - bits);
+	const __m128i mask = _mm_set1_epi16((short)((1 << (16 - bits)) - 1));
+	const __m128i half = _mm_set1_epi16((short)((1 << (16 - bits)) >> 1));
+	size_t i = first;
+	// Packed, a ninth element keeps the overlapping stores inside the output
+	for (; i + (packed ? 9 : 8) <= count; i += 8)
+	{
+		__m128i q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(in[c] + i));
+			__m128i acc = _mm_sub_epi16(v, _mm_srl_epi16(v, scaleShift));
+			if (error)
+			{
+				acc = _mm_add_epi16(acc, _mm_loadu_si128((const __m128i*)(error[c] + i)));
+				_mm_storeu_si128((__m128i*)(error[c] + i), _mm_and_si128(acc, mask));
+			}
+			else
+				acc = _mm_add_epi16(acc, half);
+			q[c] = _mm_srl_epi16(acc, levelShift);
+		}
+		if (packed)
+		{
+			// The first two channels share a 16-bit lane, with the third they make a 32-bit color
+			__m128i pair = _mm_or_si128(grb ? q[1] : q[0], _mm_slli_epi16(grb ? q[0] : q[1], 8));
+			Store4x24(_mm_unpacklo_epi16(pair, q[2]), packed + i * 3);
+			Store4x24(_mm_unpackhi_epi16(pair, q[2]), packed + i * 3 + 12);
+		}
+		else
+		{
+			for (int c = 0; c < 3; c++)
+				_mm_storeu_si128((__m128i*)(levels[c] + i), q[c]);
+		}
+	}
+	ColorKernelsScalar.Dither(in, error, bits, i, count, levels, packed, grb);
+}
+
+static inline __m128 CubeRoot(__m128 x)
+{
+	const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+	__m128i bits = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)), third));
+	__m128 y = _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(OKLAB_CBRT_MAGIC)));
+	y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(x, _mm_mul_ps(y, y))), third);
+	return _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(x, _mm_mul_ps(y, y))), third);
+}
+
+static float OklabDeltaSse2(const float* const* light, float* const* lab, const float* const* last, float floor, size_t first, size_t count)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lmsFloor = _mm_set1_ps(OKLAB_LMS_FLOOR);
+	__m128 toLms[3][3], toLab[3][3];
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			toLms[r][c] = _mm_set1_ps(OklabLms[r][c]);
+			toLab[r][c] = _mm_set1_ps(OklabLab[r][c]);
+		}
+	}
+
+	__m128 worst = _mm_set1_ps(floor);
+	size_t i = first;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 rgb[3], lms[3];
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 x = _mm_loadu_ps(light[c] + i);
+			rgb[c] = _mm_and_ps(_mm_cmpgt_ps(x, zero), x);
+		}
+		for (int r = 0; r < 3; r++)
+		{
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toLms[r][0], rgb[0]), _mm_mul_ps(toLms[r][1], rgb[1])), _mm_mul_ps(toLms[r][2], rgb[2]));
+			lms[r] = CubeRoot(_mm_add_ps(v, lmsFloor));
+		}
+		__m128 distance = zero;
+		for (int r = 0; r < 3; r++)
+		{
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toLab[r][0], lms[0]), _mm_mul_ps(toLab[r][1], lms[1])), _mm_mul_ps(toLab[r][2], lms[2]));
+			__m128 d = _mm_sub_ps(v, _mm_loadu_ps(last[r] + i));
+			distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+			_mm_storeu_ps(lab[r] + i, v);
+		}
+		worst = _mm_max_ps(distance, worst);
+	}
+	worst = _mm_max_ps(worst, _mm_shuffle_ps(worst, worst, _MM_SHUFFLE(1, 0, 3, 2)));
+	worst = _mm_max_ps(worst, _mm_shuffle_ps(worst, worst, _MM_SHUFFLE(2, 3, 0, 1)));
+	return ColorKernelsScalar.OklabDelta(light, lab, last, _mm_cvtss_f32(worst), i, count);
+}
+
+const RZColorKernels ColorKernelsSse2 = { PackSse2, ToHsvSse2, ToLinearSse2, BlendSse2, CorrectSse2, DitherSse2, OklabDeltaSse2 };
+
+#endif
@@ -0,0 +1,84 @@
+//! \file ColorKernels.h
+//! \brief Kernels behind CColorConverter and CZoneMap, one table of them per instruction set. The vector kernels
+//! leave the colors that do not fill a vector to the scalar ones.
+
+#ifndef _COLORKERNELS_H_
+#define _COLORKERNELS_H_
+
+#pragma once
+
+#include <stddef.h>
+#include "BroadcastProtocol.h"
+#include "Simd.h"
+
+//! A curve for each of R, G and B, in the two forms the kernels look them up in.
+struct RZGammaTable
+{
+	DWORD Wide[3][256];                     //!< For 32-bit gathers.
+	BYTE Bytes[3][256];                     //!< For byte lookups and table instructions.
+};
+
+//! Entries of the linear light table, 256 for each of R, G, B and A.
+const int LINEAR_TABLE_SIZE = 4 * 256;
+
+//! Most colors Blend mixes, those of an effect.
+const int BLEND_MAX_COLORS = 5;
+
+//! Linear sRGB to the LMS cone responses of Oklab, and the cube roots of those to L, a and b.
+const float OklabLms[3][3] = {
+	{ 0.4122214708f, 0.5363325363f, 0.0514459929f },
+	{ 0.2119034982f, 0.6806995451f, 0.1073969566f },
+	{ 0.0883024619f, 0.2817188376f, 0.6299787005f },
+};
+const float OklabLab[3][3] = {
+	{ 0.2104542553f, 0.7936177850f, -0.0040720468f },
+	{ 1.9779984951f, -2.4285922050f, 0.4505937099f },
+	{ 0.0259040371f, 0.7827717662f, -0.8086757660f },
+};
+//! Added to the cone responses so black has a cube root the Newton steps converge on. L of black becomes 0.001.
+const float OKLAB_LMS_FLOOR = 1e-9f;
+//! Bits of 1.0f less a third of them, the cube root estimate is a third of the bits of x plus this.
+const int OKLAB_CBRT_MAGIC = 0x2A555555;
+
+//! Entries of the tables Correct looks linear light up in. The tables hold one more entry, a copy of the last, so
+//! 32-bit gathers of the last entry stay inside them.
+const int CORRECTION_TABLE_SIZE = 4096;
+
+struct RZColorKernels
+{
+	//! 3 bytes per color in R, G, B or G, R, B order, each channel through its gamma curve unless gamma is null.
+	void (*Pack)(const RZCOLOR* colors, size_t count, BYTE* out, const RZGammaTable* gamma, bool grb);
+	//! 3 bytes per color: hue 0 to 255, saturation and value.
+	void (*ToHsv)(const RZCOLOR* colors, size_t count, BYTE* out);
+	//! 4 floats per color, byte v of channel c read from table[c * 256 + v].
+	void (*ToLinear)(const RZCOLOR* colors, size_t count, float* out, const float* table);
+	//! Weighted sums of colors R, G and B for elements first to count - 1: out[c][i] is the sum over k of
+	//! weights[k][i] * values[k * 3 + c], added up in order of k.
+	void (*Blend)(const float* const* weights, const float* values, int colors, size_t first, size_t count, float* const* out);
+	//! Linear light 0 to 1 of elements first to count - 1 to 16-bit values, channel c through tables[c] at the
+	//! value scaled to 0..CORRECTION_TABLE_SIZE - 1 and rounded. Unless limit is 0, the three values of an element
+	//! that add up to more than limit are scaled down to add up to it.
+	void (*Correct)(const float* const* in, const WORD* const* tables, float limit, size_t first, size_t count, WORD* const* out);
+	//! 16-bit values of elements first to count - 1 to levels of bits, 1 to 16. Each value is scaled by
+	//! (2^bits - 1) / 2^bits, added to its error and split into the level and the new error. Without error the
+	//! values are rounded. Levels go to levels[c], or as 3 bytes per element to packed + 3 * element, R, G, B or
+	//! G, R, B, when packed is not null and bits is at most 8.
+	void (*Dither)(const WORD* const* in, WORD* const* error, int bits, size_t first, size_t count, WORD* const* levels, BYTE* packed, bool grb);
+	//! Linear light R, G and B of elements first to count - 1 to Oklab L, a and b in lab, with cube roots from a
+	//! bit level estimate and two Newton steps. Returns the largest squared distance to the same element in last,
+	//! at least floor.
+	float (*OklabDelta)(const float* const* light, float* const* lab, const float* const* last, float floor, size_t first, size_t count);
+};
+
+extern const RZColorKernels ColorKernelsScalar;
+#if defined(RZ_SIMD_X86)
+extern const RZColorKernels ColorKernelsSse2;
+extern const RZColorKernels ColorKernelsAvx2;
+#elif defined(RZ_SIMD_NEON)
+extern const RZColorKernels ColorKernelsNeon;
+#endif
+
+//! The kernels of level, which must be supported.
+const RZColorKernels* ColorKernelsFor(SIMD_LEVEL level);
+
+#endif
@@ -0,0 +1,85 @@
+#include <math.h>
+#include <string.h>
+#include "Correction.h"
+
+COutputCorrection::COutputCorrection(SIMD_LEVEL level) : Limit16(0), Limit8(0)
+{
+	Simd = CSimd::IsSupported(level) ? level : CSimd::Level();
+	Kernels = ColorKernelsFor(Simd);
+	Config = Defaults();
+	Build();
+}
+
+RZCorrection COutputCorrection::Defaults()
+{
+	RZCorrection config = { 1.0f, { 1.0f, 1.0f, 1.0f }, 1.0f, 1.0f };
+	return config;
+}
+
+bool COutputCorrection::Configure(const RZCorrection& config)
+{
+	if (!memcmp(&config, &Config, sizeof(Config)))
+		return false;
+
+	Config = config;
+	Build();
+	return true;
+}
+
+void COutputCorrection::Build()
+{
+	double gamma = Config.Gamma > 0.0f ? Config.Gamma : 1.0;
+	double brightness = Config.Brightness < 0.0f ? 0.0 : Config.Brightness > 1.0f ? 1.0 : Config.Brightness;
+	double limit = Config.CurrentLimit;
+	Limit16 = limit > 0.0 && limit < 1.0 ? (float)(limit * 3 * 65535) : 0.0f;
+	Limit8 = limit > 0.0 && limit < 1.0 ? (float)(limit * 3 * 255) : 0.0f;
+
+	// light is in linear light, duty what the LED is driven with for it
+	for (int c = 0; c < 3; c++)
+	{
+		double gain = Config.Gain[c] > 0.0f ? Config.Gain[c] * brightness : 0.0;
+		for (int i = 0; i < CORRECTION_TABLE_SIZE; i++)
+		{
+			double light = (double)i / (CORRECTION_TABLE_SIZE - 1) * gain;
+			double duty = pow(light < 1.0 ? light : 1.0, 1.0 / gamma);
+			Tables[c][i] = (WORD)(duty * 65535.0 + 0.5);
+		}
+		Tables[c][CORRECTION_TABLE_SIZE] = Tables[c][CORRECTION_TABLE_SIZE - 1];
+
+		for (int v = 0; v < 256; v++)
+		{
+			double srgb = v / 255.0;
+			double light = (srgb <= 0.04045 ? srgb / 12.92 : pow((srgb + 0.055) / 1.055, 2.4)) * gain;
+			double duty = pow(light < 1.0 ? light : 1.0, 1.0 / gamma);
+			Bytes.Bytes[c][v] = (BYTE)(duty * 255.0 + 0.5);
+			Bytes.Wide[c][v] = Bytes.Bytes[c][v];
+		}
+	}
+}
+
+void COutputCorrection::Apply(const RZLedPlanes& in, size_t count, const RZLedPlanes16& out) const
+{
+	const float* const planes[3] = { in.R, in.G, in.B };
+	const WORD* const tables[3] = { Tables[0], Tables[1], Tables[2] };
+	WORD* const outputs[3] = { out.R, out.G, out.B };
+	Kernels->Correct(planes, tables, Limit16, 0, count, outputs);
+}
+
+void COutputCorrection::Apply(const RZCOLOR* colors, size_t count, BYTE* out, bool grb) const
+{
+	Kernels->Pack(colors, count, out, &Bytes, grb);
+	if (!Limit8)
+		return;
+
+	// Few LEDs draw more than the limit, they are scaled as Correct scales them
+	for (size_t i = 0; i < count; i++, out += 3)
+	{
+		float sum = (float)out[0] + (float)out[1] + (float)out[2];
+		if (sum > Limit8)
+		{
+			float s = Limit8 / sum;
+			for (int c = 0; c < 3; c++)
+				out[c] = (BYTE)(int)(out[c] * s);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+//! \file Correction.h
+//! \brief Color correction of one output: the response of its LEDs, white point gains, a brightness cap and a limit
+//! on the current each LED draws. The configuration is compiled into lookup tables, again only when it changes, and
+//! each frame is a table lookup per channel in the kernels of the color converter.
+
+#ifndef _CORRECTION_H_
+#define _CORRECTION_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+#include "ColorKernels.h"
+#include "Simd.h"
+#include "ZoneMap.h"
+
+struct RZCorrection
+{
+	//! Response of the LEDs, light = duty ^ Gamma, 1 for LEDs dimmed by PWM. The input is linear light already, a
+	//! sink that raised RZCOLOR values to 2.2 gets the same with 1.
+	float Gamma;
+	float Gain[3];                          //!< White point, the share of full output R, G and B are driven to.
+	float Brightness;                       //!< Cap on all channels, 0 to 1.
+	//! Most current an LED draws, as a share of the current of its three channels at full. 1 does not limit it.
+	float CurrentLimit;
+};
+
+//! 16-bit output of a correction, one value per LED in each plane.
+struct RZLedPlanes16
+{
+	WORD* R;
+	WORD* G;
+	WORD* B;
+};
+
+class COutputCorrection
+{
+public:
+	//! Uses level when the CPU supports it, else the best supported level. Starts with Defaults().
+	explicit COutputCorrection(SIMD_LEVEL level = CSimd::Level());
+
+	SIMD_LEVEL Level() const { return Simd; }
+
+	//! Gamma 1, gains 1, brightness 1 and no current limit: linear light as it is.
+	static RZCorrection Defaults();
+
+	//! Compiles config into the tables, unless it is the configuration they hold. Returns true when it did.
+	bool Configure(const RZCorrection& config);
+	const RZCorrection& GetConfig() const { return Config; }
+
+	//! Corrects count LEDs rendered by CZoneMap to 16-bit duties. Allocates nothing.
+	void Apply(const RZLedPlanes& in, size_t count, const RZLedPlanes16& out) const;
+	//! Corrects sRGB colors as the callback gets them to 3 bytes per color, R, G, B or G, R, B. Allocates nothing.
+	void Apply(const RZCOLOR* colors, size_t count, BYTE* out, bool grb) const;
+
+private:
+	void Build();
+
+	RZCorrection Config;
+	float Limit16;                          //!< CurrentLimit in 16-bit duties summed over R, G and B, 0 for none.
+	float Limit8;                           //!< The same in 8-bit duties.
+	WORD Tables[3][CORRECTION_TABLE_SIZE + 1];
+	RZGammaTable Bytes;                     //!< sRGB bytes to 8-bit duties.
+	const RZColorKernels* Kernels;
+	SIMD_LEVEL Simd;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "DdpSink.h"
+
+static const BYTE DDP_VERSION = 0x40;
+static const BYTE DDP_PUSH = 0x01;
+//! RGB, 8 bits a channel.
+static const BYTE DDP_TYPE_RGB24 = 0x0B;
+static const BYTE DDP_ID_DISPLAY = 1;
+//! DDP sequence numbers count 1 to 15, 0 means none.
+static const BYTE DDP_MAX_SEQUENCE = 15;
+
+static const BYTE WLED_DRGB = 2;
+static const BYTE WLED_DNRGB = 4;
+static const BYTE WLED_DEFAULT_TIMEOUT = 2;
+
+//! Longest wait of the sending thread without a frame to send.
+static const DWORD DDP_IDLE_WAIT = 100;
+//! Waits shorter than this sleep instead of waiting for a new frame.
+static const unsigned long long DDP_SLEEP_BELOW = 2000000;
+static const size_t DDP_SEND_BUFFER = 1 << 20;
+
+static void Put16(BYTE* p, size_t value)
+{
+	p[0] = (BYTE)(value >> 8);
+	p[1] = (BYTE)value;
+}
+
+static void Put32(BYTE* p, size_t value)
+{
+	p[0] = (BYTE)(value >> 24);
+	p[1] = (BYTE)(value >> 16);
+	p[2] = (BYTE)(value >> 8);
+	p[3] = (BYTE)value;
+}
+
+CDdpSink::CDdpSink() : Version(0), Count(0)
+{
+}
+
+CDdpSink::~CDdpSink()
+{
+	Close();
+}
+
+RZLedController CDdpSink::Defaults(LED_PROTOCOL protocol, DWORD ip, size_t firstLed, size_t leds)
+{
+	RZLedController config;
+	memset(&config, 0, sizeof(config));
+	config.Protocol = protocol;
+	config.Ip = ip;
+	config.FirstLed = firstLed;
+	config.Leds = leds;
+	config.MaxFps = LED_CONTROLLER_DEFAULT_FPS;
+	config.PacketGap = LED_CONTROLLER_DEFAULT_GAP;
+	config.Timeout = WLED_DEFAULT_TIMEOUT;
+	return config;
+}
+
+bool CDdpSink::Open(const std::vector<RZLedController>& controllers, size_t leds, std::string& error)
+{
+	Close();
+	for (size_t i = 0; i < controllers.size(); i++)
+	{
+		const RZLedController& config = controllers[i];
+		if (!config.Leds || config.FirstLed + config.Leds > leds)
+		{
+			error = "Controller " + std::to_string(i) + " shows LEDs " + std::to_string(config.FirstLed) + " to " +
+				std::to_string(config.FirstLed + config.Leds) + " of a frame of " + std::to_string(leds);
+			return false;
+		}
+		if (config.Protocol == LED_PROTOCOL_DDP && config.Leds * 3 > 0xFFFFFFFF)
+		{
+			error = "Controller " + std::to_string(i) + " has more LEDs than DDP addresses";
+			return false;
+		}
+		if (config.Protocol == LED_PROTOCOL_WLED && config.Leds > 0x10000)
+		{
+			error = "Controller " + std::to_string(i) + " has more LEDs than DNRGB addresses";
+			return false;
+		}
+	}
+	if (controllers.empty())
+	{
+		error = "No controllers";
+		return false;
+	}
+
+	if (!Socket.Open())
+	{
+		error = "Failed to open a UDP socket";
+		return false;
+	}
+	Socket.SetBuffers(DDP_SEND_BUFFER, 0);
+
+	Count = leds;
+	Pending.assign(leds * 3, 0);
+	Version = 0;
+	States.assign(controllers.size(), RZControllerState());
+	for (size_t i = 0; i < controllers.size(); i++)
+	{
+		States[i].Config = controllers[i];
+		Build(States[i]);
+	}
+
+	Stop.Reset();
+	Wake.Reset();
+	if (!Thread.Start(Run, this))
+	{
+		error = "Failed to start the sending thread";
+		Socket.Close();
+		return false;
+	}
+	return true;
+}
+
+void CDdpSink::Build(RZControllerState& state)
+{
+	const RZLedController& config = state.Config;
+	bool ddp = config.Protocol == LED_PROTOCOL_DDP;
+	bool drgb = !ddp && config.Leds <= WLED_DRGB_LEDS;
+	size_t header = ddp ? DDP_HEADER_SIZE : drgb ? 2 : 4;
+	size_t perPacket = ddp ? DDP_MAX_CHANNELS : (drgb ? WLED_DRGB_LEDS : WLED_DNRGB_LEDS) * 3;
+	size_t channels = config.Leds * 3;
+	size_t packets = (channels + perPacket - 1) / perPacket;
+
+	state.Buffer.assign(packets * header + channels, 0);
+	state.Datagrams.assign(packets, RZDatagram());
+	state.Offsets.assign(packets, 0);
+	state.Sizes.assign(packets, 0);
+	RZNetAddress to = { config.Ip, config.Port ? config.Port : ddp ? DDP_PORT : WLED_PORT };
+	size_t at = 0;
+	for (size_t p = 0; p < packets; p++)
+	{
+		size_t first = p * perPacket;
+		size_t size = channels - first < perPacket ? channels - first : perPacket;
+		BYTE* packet = &state.Buffer[at];
+		if (ddp)
+		{
+			packet[0] = DDP_VERSION | (p + 1 == packets ? DDP_PUSH : 0);
+			packet[2] = DDP_TYPE_RGB24;
+			packet[3] = DDP_ID_DISPLAY;
+			Put32(packet + 4, first);
+			Put16(packet + 8, size);
+		}
+		else
+		{
+			packet[0] = drgb ? WLED_DRGB : WLED_DNRGB;
+			packet[1] = config.Timeout;
+			if (!drgb)
+				Put16(packet + 2, first / 3);
+		}
+
+		RZDatagram& datagram = state.Datagrams[p];
+		datagram.To = to;
+		datagram.Parts = 1;
+		datagram.Data[0] = packet;
+		datagram.Size[0] = header + size;
+		state.Offsets[p] = at + header;
+		state.Sizes[p] = size;
+		at += header + size;
+	}
+
+	state.NextPacket = packets;
+	state.Version = 0;
+	state.NextFrame = 0;
+	state.NextSend = 0;
+	state.Sequence = 0;
+	memset(&state.Stats, 0, sizeof(state.Stats));
+}
+
+void CDdpSink::Start(RZControllerState& state, unsigned long long now)
+{
+	const BYTE* leds = &Pending[state.Config.FirstLed * 3];
+	for (size_t p = 0, first = 0; p < state.Datagrams.size(); first += state.Sizes[p], p++)
+		memcpy(&state.Buffer[state.Offsets[p]], leds + first, state.Sizes[p]);
+
+	if (state.Config.Protocol == LED_PROTOCOL_DDP)
+	{
+		state.Sequence = state.Sequence % DDP_MAX_SEQUENCE + 1;
+		for (size_t p = 0; p < state.Datagrams.size(); p++)
+			state.Buffer[state.Offsets[p] - DDP_HEADER_SIZE + 1] = state.Sequence;
+	}
+
+	state.Stats.Frames++;
+	state.Stats.Dropped += Version - state.Version - 1;
+	state.Version = Version;
+	state.NextPacket = 0;
+	state.NextSend = now;
+	state.NextFrame = now + (state.Config.MaxFps ? 1000000000ULL / state.Config.MaxFps : 0);
+}
+
+DWORD CDdpSink::Run(void* self)
+{
+	CDdpSink& sink = *(CDdpSink*)self;
+	while (!sink.Stop.IsSet())
+	{
+		// Reset before looking at the frames, a frame submitted from here on wakes the next wait
+		sink.Wake.Reset();
+		unsigned long long now = CPlatform::Now();
+		unsigned long long wake = 0;
+		sink.Lock.Enter();
+		for (RZControllerState& state : sink.States)
+		{
+			bool idle = state.NextPacket == state.Datagrams.size();
+			if (idle && state.Version < sink.Version)
+			{
+				if (now >= state.NextFrame)
+					sink.Start(state, now);
+				else if (!wake || state.NextFrame < wake)
+					wake = state.NextFrame;
+			}
+		}
+		sink.Lock.Leave();
+
+		for (RZControllerState& state : sink.States)
+		{
+			size_t packets = state.Datagrams.size();
+			if (state.NextPacket == packets)
+				continue;
+			if (state.NextSend <= now)
+			{
+				size_t count = state.Config.PacketGap ? 1 : packets - state.NextPacket;
+				size_t sent = sink.Socket.Send(&state.Datagrams[state.NextPacket], count);
+				unsigned long long bytes = 0;
+				for (size_t p = 0; p < sent; p++)
+					bytes += state.Datagrams[state.NextPacket + p].Size[0];
+
+				sink.Lock.Enter();
+				state.Stats.Packets += sent;
+				state.Stats.Bytes += bytes;
+				state.Stats.Failed += count - sent;
+				sink.Lock.Leave();
+				state.NextPacket += count;
+				state.NextSend = now + state.Config.PacketGap * 1000ULL;
+			}
+			if (state.NextPacket < packets && (!wake || state.NextSend < wake))
+				wake = state.NextSend;
+		}
+
+		now = CPlatform::Now();
+		if (wake && wake <= now)
+			continue;
+		if (wake && wake - now < DDP_SLEEP_BELOW)
+			std::this_thread::sleep_for(std::chrono::nanoseconds(wake - now));
+		else
+			sink.Wake.Wait(wake ? (DWORD)((wake - now) / 1000000) : DDP_IDLE_WAIT);
+	}
+	return 0;
+}
+
+bool CDdpSink::Submit(const BYTE* rgb)
+{
+	if (!Thread.IsStarted())
+		return false;
+
+	Lock.Enter();
+	memcpy(Pending.data(), rgb, Pending.size());
+	Version++;
+	Lock.Leave();
+	Wake.Set();
+	return true;
+}
+
+void CDdpSink::Close()
+{
+	if (Thread.IsStarted())
+	{
+		Stop.Set();
+		Wake.Set();
+		Thread.Join(INFINITE);
+	}
+	Socket.Close();
+	States.clear();
+	Pending.clear();
+	Count = 0;
+}
+
+bool CDdpSink::GetStats(size_t controller, RZLedControllerStats& stats)
+{
+	if (controller >= States.size())
+		return false;
+
+	Lock.Enter();
+	stats = States[controller].Stats;
+	Lock.Leave();
+	return true;
+}
+
+void CDdpSink::ResetStats()
+{
+	Lock.Enter();
+	for (RZControllerState& state : States)
+		memset(&state.Stats, 0, sizeof(state.Stats));
+	Lock.Leave();
+}
@@ -0,0 +1,119 @@
+//! \file DdpSink.h
+//! \brief Sends LED frames to network controllers, ESP32s running WLED for example, over DDP or the WLED realtime
+//! UDP protocol (DRGB, or DNRGB once a controller has more LEDs than one packet holds). Frames are split into as
+//! many packets as the LEDs of a controller need. A thread of the sink paces each controller to the frames per
+//! second and the gap between packets it can take. A frame that is still waiting when a newer one arrives is dropped,
+//! so a slow controller shows the latest frame late by at most one frame interval instead of falling behind.
+
+#ifndef _DDPSINK_H_
+#define _DDPSINK_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+enum LED_PROTOCOL
+{
+	LED_PROTOCOL_DDP,
+	LED_PROTOCOL_WLED,
+};
+
+const WORD DDP_PORT = 4048;
+const WORD WLED_PORT = 21324;
+const size_t DDP_HEADER_SIZE = 10;
+//! Channels in a DDP packet, 480 LEDs, the most WLED takes.
+const size_t DDP_MAX_CHANNELS = 1440;
+//! LEDs in a DRGB packet and in a DNRGB packet, after its start index.
+const size_t WLED_DRGB_LEDS = 490;
+const size_t WLED_DNRGB_LEDS = 489;
+//! A start for an ESP32 on WiFi.
+const DWORD LED_CONTROLLER_DEFAULT_FPS = 100;
+const DWORD LED_CONTROLLER_DEFAULT_GAP = 100;
+
+struct RZLedController
+{
+	LED_PROTOCOL Protocol;
+	DWORD Ip;
+	WORD Port;                              //!< 0 for the port of the protocol.
+	size_t FirstLed;                        //!< First LED of the frame the controller shows.
+	size_t Leds;
+	DWORD MaxFps;                           //!< Most frames a second the controller takes, 0 for no limit.
+	DWORD PacketGap;                        //!< Microseconds between two packets of a frame, 0 sends them at once.
+	//! WLED: seconds the controller keeps showing the stream after its last packet, 255 for ever.
+	BYTE Timeout;
+};
+
+struct RZLedControllerStats
+{
+	unsigned long long Frames;              //!< Frames sent.
+	unsigned long long Dropped;             //!< Frames replaced by a newer one before the controller could take them.
+	unsigned long long Packets;
+	unsigned long long Bytes;
+	unsigned long long Failed;              //!< Packets the socket did not take.
+};
+
+class CDdpSink
+{
+public:
+	CDdpSink();
+	~CDdpSink();
+
+	//! A controller of leds LEDs from firstLed at ip, paced for an ESP32.
+	static RZLedController Defaults(LED_PROTOCOL protocol, DWORD ip, size_t firstLed, size_t leds);
+
+	//! Builds the packets of each controller for frames of leds LEDs and starts sending.
+	bool Open(const std::vector<RZLedController>& controllers, size_t leds, std::string& error);
+	//! Stops sending, a frame half sent is left so.
+	void Close();
+	bool IsOpen() const { return Thread.IsStarted(); }
+
+	size_t Controllers() const { return States.size(); }
+	size_t Leds() const { return Count; }
+
+	//! Hands a frame of Leds() LEDs, 3 bytes each, to the sending thread. It replaces a frame not sent yet. Copies
+	//! the frame and allocates nothing, so it is cheap enough for the broadcast callback.
+	bool Submit(const BYTE* rgb);
+
+	bool GetStats(size_t controller, RZLedControllerStats& stats);
+	void ResetStats();
+
+private:
+	CDdpSink(const CDdpSink&) = delete;
+	CDdpSink& operator=(const CDdpSink&) = delete;
+
+	//! A controller and the packets of the frame it is sending.
+	struct RZControllerState
+	{
+		RZLedController Config;
+		std::vector<BYTE> Buffer;           //!< The packets, header and LEDs, one after another.
+		std::vector<RZDatagram> Datagrams;
+		std::vector<size_t> Offsets;        //!< Where the LEDs of each packet start in Buffer.
+		std::vector<size_t> Sizes;          //!< Bytes of LEDs in each packet.
+		size_t NextPacket;                  //!< Datagrams.size() once the frame is sent.
+		unsigned long long Version;         //!< Frame sent or being sent.
+		unsigned long long NextFrame;       //!< When the controller takes its next frame.
+		unsigned long long NextSend;        //!< When the next packet of the frame goes out.
+		BYTE Sequence;
+		RZLedControllerStats Stats;
+	};
+
+	static DWORD Run(void* self);
+	void Build(RZControllerState& state);
+	//! Copies the LEDs of the pending frame into the packets of state.
+	void Start(RZControllerState& state, unsigned long long now);
+
+	CUdpSocket Socket;
+	CThread Thread;
+	CEvent Stop;
+	CEvent Wake;
+	CLock Lock;                             //!< Guards Pending, Version and the stats.
+	std::vector<BYTE> Pending;
+	unsigned long long Version;             //!< Frames submitted.
+	size_t Count;
+	std::vector<RZControllerState> States;
+};
+
+#endif
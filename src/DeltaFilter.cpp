@@ -0,0 +1,65 @@
+#include <math.h>
+#include <string.h>
+#include "DeltaFilter.h"
+
+//! Planes start on cache lines of their own.
+static const size_t DELTA_PLANE_ALIGN = 64 / sizeof(float);
+
+CDeltaFilter::CDeltaFilter(SIMD_LEVEL level) : Count(0), Stride(0), Sent(false), LastWrite(0), Threshold(DELTA_DEFAULT_THRESHOLD),
+	MaxInterval(DELTA_DEFAULT_MAX_INTERVAL), Delta(0), Current(0)
+{
+	Simd = CSimd::IsSupported(level) ? level : CSimd::Level();
+	Kernels = ColorKernelsFor(Simd);
+	ResetStats();
+}
+
+void CDeltaFilter::Reset(size_t leds)
+{
+	Count = leds;
+	Stride = (leds + DELTA_PLANE_ALIGN - 1) / DELTA_PLANE_ALIGN * DELTA_PLANE_ALIGN;
+	Lab.assign(6 * Stride, 0.0f);
+	Current = 0;
+	Sent = false;
+}
+
+void CDeltaFilter::ResetStats()
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+bool CDeltaFilter::ShouldSend(const RZLedPlanes& light, unsigned long long time, size_t bytes)
+{
+	// The frame offered is converted into the planes not holding the frame sent, sending it swaps them
+	size_t next = 3 - Current;
+	const float* const planes[3] = { light.R, light.G, light.B };
+	float* const lab[3] = { Lab.data() + next * Stride, Lab.data() + (next + 1) * Stride, Lab.data() + (next + 2) * Stride };
+	const float* const last[3] = { Lab.data() + Current * Stride, Lab.data() + (Current + 1) * Stride, Lab.data() + (Current + 2) * Stride };
+	float worst = Kernels->OklabDelta(planes, lab, last, 0.0f, 0, Count);
+	Delta = sqrtf(worst) * 100.0f;
+	Stats.Frames++;
+
+	bool due = !Sent || time - LastWrite >= MaxInterval;
+	if (Delta <= Threshold && !due)
+	{
+		Stats.WritesSaved++;
+		Stats.BytesSaved += bytes;
+		return false;
+	}
+
+	if (Sent && Delta <= Threshold)
+		Stats.Refreshes++;
+	Stats.Writes++;
+	Current = next;
+	Sent = true;
+	LastWrite = time;
+	return true;
+}
+
+bool CDeltaFilter::ShouldSend(const RZLinearEffect& effect, unsigned long long time, size_t bytes)
+{
+	// The planes of an effect hold LINEAR_EFFECT_LANES colors, more LEDs than that are not an effect
+	if (Count > (size_t)LINEAR_EFFECT_LANES)
+		return true;
+	RZLedPlanes light = { const_cast<float*>(effect.R), const_cast<float*>(effect.G), const_cast<float*>(effect.B) };
+	return ShouldSend(light, time, bytes);
+}
@@ -0,0 +1,80 @@
+//! \file DeltaFilter.h
+//! \brief Skips the writes to an output that nobody would see. Each frame is compared in Oklab with the last frame
+//! sent, and only sent when some LED moved further than the threshold or the last write is older than the maximum
+//! interval, which repairs whatever a device lost. An output that dithers needs every frame while a color sits
+//! between two levels, suppress its writes only where the device holds the levels itself.
+
+#ifndef _DELTAFILTER_H_
+#define _DELTAFILTER_H_
+
+#pragma once
+
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "ColorKernels.h"
+#include "Interpolator.h"
+#include "Simd.h"
+#include "ZoneMap.h"
+
+//! Distance in Oklab times 100, so 1 is about the same step as 1 of CIELAB ΔE. A difference of 2 is about the
+//! smallest most viewers notice side by side.
+const float DELTA_DEFAULT_THRESHOLD = 1.0f;
+//! Longest time between two writes, in nanoseconds.
+const unsigned long long DELTA_DEFAULT_MAX_INTERVAL = 1000000000ULL;
+
+struct RZDeltaStats
+{
+	unsigned long long Frames;              //!< Frames offered.
+	unsigned long long Writes;              //!< Frames sent.
+	unsigned long long Refreshes;           //!< Frames sent only because the maximum interval passed.
+	unsigned long long WritesSaved;
+	unsigned long long BytesSaved;
+};
+
+class CDeltaFilter
+{
+public:
+	//! Uses level when the CPU supports it, else the best supported level.
+	explicit CDeltaFilter(SIMD_LEVEL level = CSimd::Level());
+
+	SIMD_LEVEL Level() const { return Simd; }
+
+	//! Starts comparing frames of leds LEDs. The next frame is sent.
+	void Reset(size_t leds);
+	size_t Leds() const { return Count; }
+
+	void SetThreshold(float deltaE) { Threshold = deltaE; }
+	float GetThreshold() const { return Threshold; }
+	void SetMaxInterval(unsigned long long ns) { MaxInterval = ns; }
+
+	//! Whether the frame rendered into light, Leds() LEDs in linear light, has to be written at time in
+	//! nanoseconds. When it has, it becomes the frame the next ones are compared with. bytes is the size of the
+	//! write, counted as saved when it is skipped. Allocates nothing.
+	bool ShouldSend(const RZLedPlanes& light, unsigned long long time, size_t bytes);
+	//! The same for outputs that write the five colors of an effect, after Reset(LINEAR_EFFECT_COLORS).
+	bool ShouldSend(const RZLinearEffect& effect, unsigned long long time, size_t bytes);
+
+	//! Sends the next frame whatever it shows, after the device was reconnected for example.
+	void Invalidate() { Sent = false; }
+
+	//! Largest distance of an LED from the last frame sent, of the last frame offered.
+	float LastDelta() const { return Delta; }
+	const RZDeltaStats& GetStats() const { return Stats; }
+	void ResetStats();
+
+private:
+	std::vector<float> Lab;                 //!< 6 planes of Stride: the frame sent, then the one offered.
+	size_t Count;
+	size_t Stride;
+	bool Sent;                              //!< A frame was sent since the filter was reset or invalidated.
+	unsigned long long LastWrite;
+	float Threshold;
+	unsigned long long MaxInterval;
+	float Delta;
+	size_t Current;                         //!< Plane the frame sent starts at, 0 or 3.
+	RZDeltaStats Stats;
+	const RZColorKernels* Kernels;
+	SIMD_LEVEL Simd;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "Dither.h"
+
+//! Planes start on cache lines of their own.
+static const size_t DITHER_PLANE_ALIGN = 64 / sizeof(WORD);
+
+CTemporalDither::CTemporalDither(SIMD_LEVEL level) : Count(0), Stride(0), Depth(8), Enabled(true)
+{
+	Simd = CSimd::IsSupported(level) ? level : CSimd::Level();
+	Kernels = ColorKernelsFor(Simd);
+}
+
+bool CTemporalDither::Reset(size_t leds, int bits)
+{
+	if (bits < 1 || bits > 16)
+		return false;
+
+	Count = leds;
+	Depth = bits;
+	Stride = (leds + DITHER_PLANE_ALIGN - 1) / DITHER_PLANE_ALIGN * DITHER_PLANE_ALIGN;
+	Error.assign(3 * Stride, 0);
+
+	// Starting errors from a hash of the LED and channel, spread over the whole step
+	const DWORD mask = (1u << (16 - bits)) - 1;
+	for (size_t i = 0; i < 3 * Stride; i++)
+	{
+		DWORD h = (DWORD)i * 0x9E3779B1u;
+		h ^= h >> 15;
+		h *= 0x85EBCA77u;
+		h ^= h >> 13;
+		Error[i] = (WORD)(h & mask);
+	}
+	return true;
+}
+
+WORD* const* CTemporalDither::ErrorPlanes(WORD* planes[3])
+{
+	if (!Enabled)
+		return nullptr;
+	for (int c = 0; c < 3; c++)
+		planes[c] = Error.data() + c * Stride;
+	return planes;
+}
+
+void CTemporalDither::Apply(const RZLedPlanes16& in, const RZLedPlanes16& out)
+{
+	const WORD* const inputs[3] = { in.R, in.G, in.B };
+	WORD* const levels[3] = { out.R, out.G, out.B };
+	WORD* planes[3];
+	Kernels->Dither(inputs, ErrorPlanes(planes), Depth, 0, Count, levels, nullptr, false);
+}
+
+bool CTemporalDither::Apply(const RZLedPlanes16& in, BYTE* out, bool grb)
+{
+	if (Depth > 8)
+		return false;
+
+	const WORD* const inputs[3] = { in.R, in.G, in.B };
+	WORD* planes[3];
+	Kernels->Dither(inputs, ErrorPlanes(planes), Depth, 0, Count, nullptr, out, grb);
+	return true;
+}
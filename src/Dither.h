@@ -0,0 +1,52 @@
+//! \file Dither.h
+//! \brief Temporal dithering of 16-bit duties to the bit depth of a device. Each channel of each LED carries the part
+//! of its duty the last level could not show into the next frame, so at low brightness the LED alternates between
+//! two levels and shows the duty in between on average instead of a band.
+
+#ifndef _DITHER_H_
+#define _DITHER_H_
+
+#pragma once
+
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "ColorKernels.h"
+#include "Correction.h"
+#include "Simd.h"
+
+class CTemporalDither
+{
+public:
+	//! Uses level when the CPU supports it, else the best supported level.
+	explicit CTemporalDither(SIMD_LEVEL level = CSimd::Level());
+
+	SIMD_LEVEL Level() const { return Simd; }
+
+	//! Starts dithering leds LEDs to bits per channel, 1 to 16. The error of each LED starts at a different
+	//! point, so LEDs showing the same duty do not change level in the same frames.
+	bool Reset(size_t leds, int bits);
+	size_t Leds() const { return Count; }
+	int Bits() const { return Depth; }
+
+	//! Without dithering the duties are rounded to the nearest level.
+	void SetEnabled(bool enabled) { Enabled = enabled; }
+	bool IsEnabled() const { return Enabled; }
+
+	//! Quantizes the duties of Leds() LEDs to levels 0 to 2^bits - 1 in out.
+	void Apply(const RZLedPlanes16& in, const RZLedPlanes16& out);
+	//! The same as 3 bytes per LED, R, G, B or G, R, B. Fails above 8 bits.
+	bool Apply(const RZLedPlanes16& in, BYTE* out, bool grb);
+
+private:
+	WORD* const* ErrorPlanes(WORD* planes[3]);
+
+	std::vector<WORD> Error;                //!< 3 planes of Stride accumulators.
+	size_t Count;
+	size_t Stride;
+	int Depth;
+	bool Enabled;
+	const RZColorKernels* Kernels;
+	SIMD_LEVEL Simd;
+};
+
+#endif
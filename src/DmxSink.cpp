@@ -0,0 +1,299 @@
+#include <string.h>
+#include <random>
+#include "DmxSink.h"
+
+//! ACN packet identifier that opens every E1.31 packet.
+static const BYTE ACN_IDENTIFIER[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+static const BYTE ARTNET_IDENTIFIER[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+//! Sent after the channels of an Art-Net universe of odd size, ArtDmx lengths are even.
+static const BYTE ARTNET_PAD = 0;
+
+//! Offsets of the sequence numbers and of the E1.31 options.
+static const size_t E131_SEQUENCE = 111;
+static const size_t E131_OPTIONS = 112;
+static const size_t E131_SYNC_SEQUENCE = 44;
+static const size_t ARTNET_SEQUENCE = 12;
+
+static const BYTE E131_OPTION_TERMINATED = 0x40;
+static const WORD E131_MAX_UNIVERSE = 63999;
+static const WORD ARTNET_MAX_PORT_ADDRESS = 32767;
+static const int E131_TERMINATE_PACKETS = 3;
+//! Kernel send buffer, a frame of a few hundred universes goes out in one burst.
+static const size_t DMX_SEND_BUFFER = 1 << 20;
+
+static void Put16(BYTE* p, size_t value)
+{
+	p[0] = (BYTE)(value >> 8);
+	p[1] = (BYTE)value;
+}
+
+static void Put32(BYTE* p, DWORD value)
+{
+	p[0] = (BYTE)(value >> 24);
+	p[1] = (BYTE)(value >> 16);
+	p[2] = (BYTE)(value >> 8);
+	p[3] = (BYTE)value;
+}
+
+//! Root layer of an E1.31 packet of length bytes.
+static void PutRoot(BYTE* p, size_t length, DWORD vector, const BYTE* cid)
+{
+	Put16(p, 0x0010);
+	Put16(p + 2, 0);
+	memcpy(p + 4, ACN_IDENTIFIER, sizeof(ACN_IDENTIFIER));
+	Put16(p + 16, 0x7000 | (length - 16));
+	Put32(p + 18, vector);
+	memcpy(p + 22, cid, 16);
+}
+
+CDmxSink::CDmxSink() : Count(0), Size(0), HeaderSize(0), Next(0)
+{
+	Config = Defaults(DMX_PROTOCOL_E131);
+	memset(Sync, 0, sizeof(Sync));
+	ResetStats();
+}
+
+CDmxSink::~CDmxSink()
+{
+	Close();
+}
+
+RZDmxConfig CDmxSink::Defaults(DMX_PROTOCOL protocol)
+{
+	RZDmxConfig config;
+	memset(&config, 0, sizeof(config));
+	config.Protocol = protocol;
+	config.FirstUniverse = protocol == DMX_PROTOCOL_E131 ? 1 : 0;
+	config.ChannelsPerUniverse = 510;
+	config.Priority = 100;
+	strcpy(config.SourceName, "Chroma Broadcast");
+	return config;
+}
+
+DWORD CDmxSink::MulticastAddress(WORD universe)
+{
+	return 0xEFFF0000 | universe;
+}
+
+bool CDmxSink::Open(const RZDmxConfig& config, size_t channels, std::string& error)
+{
+	Close();
+	if (config.ChannelsPerUniverse < 1 || config.ChannelsPerUniverse > DMX_UNIVERSE_CHANNELS)
+	{
+		error = "Channels per universe must be 1 to 512";
+		return false;
+	}
+	if (!channels)
+	{
+		error = "No channels to send";
+		return false;
+	}
+
+	size_t universes = (channels + config.ChannelsPerUniverse - 1) / config.ChannelsPerUniverse;
+	bool e131 = config.Protocol == DMX_PROTOCOL_E131;
+	size_t last = (size_t)config.FirstUniverse + universes - 1;
+	if (e131 && (config.FirstUniverse < 1 || last > E131_MAX_UNIVERSE))
+	{
+		error = "E1.31 universes must be 1 to 63999, " + std::to_string(universes) + " universes from " +
+			std::to_string(config.FirstUniverse) + " do not fit";
+		return false;
+	}
+	if (!e131 && last > ARTNET_MAX_PORT_ADDRESS)
+	{
+		error = "Art-Net port addresses must be 0 to 32767, " + std::to_string(universes) + " universes from " +
+			std::to_string(config.FirstUniverse) + " do not fit";
+		return false;
+	}
+	if (e131 && config.SyncUniverse > E131_MAX_UNIVERSE)
+	{
+		error = "The E1.31 sync universe must be 1 to 63999";
+		return false;
+	}
+	if (e131 && config.Priority > 200)
+	{
+		error = "E1.31 priority must be 0 to 200";
+		return false;
+	}
+
+	if (!Socket.Open())
+	{
+		error = "Failed to open a UDP socket";
+		return false;
+	}
+	Socket.SetBuffers(DMX_SEND_BUFFER, 0);
+	if (!e131)
+		Socket.SetBroadcast(true);
+
+	Config = config;
+	Config.SourceName[sizeof(Config.SourceName) - 1] = 0;
+	static const BYTE none[16] = {};
+	if (!memcmp(Config.Cid, none, sizeof(none)))
+	{
+		std::random_device random;
+		for (size_t i = 0; i < sizeof(Config.Cid); i += 4)
+			Put32(Config.Cid + i, (DWORD)random());
+		// Version 4 UUID
+		Config.Cid[6] = (BYTE)(0x40 | (Config.Cid[6] & 0x0F));
+		Config.Cid[8] = (BYTE)(0x80 | (Config.Cid[8] & 0x3F));
+	}
+
+	Count = universes;
+	Size = channels;
+	HeaderSize = e131 ? E131_HEADER_SIZE : ARTNET_HEADER_SIZE;
+	Data.assign(channels, 0);
+	Headers.assign(Count * HeaderSize, 0);
+	Datagrams.assign(Count + (Config.SyncUniverse ? 1 : 0), RZDatagram());
+
+	WORD port = Config.Port ? Config.Port : e131 ? E131_PORT : ARTNET_PORT;
+	DWORD broadcast = 0xFFFFFFFF;
+	for (size_t u = 0; u < Count; u++)
+	{
+		size_t first = u * Config.ChannelsPerUniverse;
+		size_t size = channels - first < Config.ChannelsPerUniverse ? channels - first : Config.ChannelsPerUniverse;
+		BYTE* header = &Headers[u * HeaderSize];
+		RZDatagram& datagram = Datagrams[u];
+		datagram.To.Port = port;
+		datagram.Parts = 2;
+		datagram.Data[0] = header;
+		datagram.Size[0] = HeaderSize;
+		datagram.Data[1] = &Data[first];
+		datagram.Size[1] = size;
+		if (e131)
+		{
+			BuildE131(u, header, size);
+			datagram.To.Ip = Config.Destination ? Config.Destination : MulticastAddress((WORD)(Config.FirstUniverse + u));
+		}
+		else
+		{
+			BuildArtNet(u, header, size);
+			datagram.To.Ip = Config.Destination ? Config.Destination : broadcast;
+			if (size & 1)
+			{
+				datagram.Parts = 3;
+				datagram.Data[2] = &ARTNET_PAD;
+				datagram.Size[2] = 1;
+			}
+		}
+	}
+
+	if (Config.SyncUniverse)
+	{
+		memset(Sync, 0, sizeof(Sync));
+		RZDatagram& datagram = Datagrams[Count];
+		datagram.To.Port = port;
+		datagram.Parts = 1;
+		datagram.Data[0] = Sync;
+		if (e131)
+		{
+			PutRoot(Sync, E131_SYNC_SIZE, 0x00000008, Config.Cid);
+			Put16(Sync + 38, 0x7000 | (E131_SYNC_SIZE - 38));
+			Put32(Sync + 40, 0x00000001);
+			Put16(Sync + 45, Config.SyncUniverse);
+			datagram.Size[0] = E131_SYNC_SIZE;
+			datagram.To.Ip = Config.Destination ? Config.Destination : MulticastAddress(Config.SyncUniverse);
+		}
+		else
+		{
+			memcpy(Sync, ARTNET_IDENTIFIER, sizeof(ARTNET_IDENTIFIER));
+			Sync[8] = 0x00;
+			Sync[9] = 0x52;
+			Put16(Sync + 10, 14);
+			datagram.Size[0] = ARTNET_SYNC_SIZE;
+			datagram.To.Ip = Config.Destination ? Config.Destination : broadcast;
+		}
+	}
+	Next = 0;
+	return true;
+}
+
+void CDmxSink::BuildE131(size_t universe, BYTE* header, size_t channels)
+{
+	size_t length = E131_HEADER_SIZE + channels;
+	PutRoot(header, length, 0x00000004, Config.Cid);
+
+	// Framing layer
+	Put16(header + 38, 0x7000 | (length - 38));
+	Put32(header + 40, 0x00000002);
+	memcpy(header + 44, Config.SourceName, sizeof(Config.SourceName));
+	header[108] = Config.Priority;
+	Put16(header + 109, Config.SyncUniverse);
+	Put16(header + 113, Config.FirstUniverse + universe);
+
+	// DMP layer, the start code and then the channels
+	Put16(header + 115, 0x7000 | (length - 115));
+	header[117] = 0x02;
+	header[118] = 0xA1;
+	Put16(header + 119, 0);
+	Put16(header + 121, 1);
+	Put16(header + 123, channels + 1);
+	header[125] = 0;
+}
+
+void CDmxSink::BuildArtNet(size_t universe, BYTE* header, size_t channels)
+{
+	size_t portAddress = Config.FirstUniverse + universe;
+	memcpy(header, ARTNET_IDENTIFIER, sizeof(ARTNET_IDENTIFIER));
+	header[8] = 0x00;
+	header[9] = 0x50;
+	Put16(header + 10, 14);
+	header[13] = 0;
+	header[14] = (BYTE)portAddress;
+	header[15] = (BYTE)(portAddress >> 8);
+	Put16(header + 16, (channels + 1) & ~(size_t)1);
+}
+
+void CDmxSink::Sequence()
+{
+	// Art-Net reserves 0 for senders without sequence numbers
+	Next++;
+	if (Config.Protocol == DMX_PROTOCOL_ARTNET && !Next)
+		Next = 1;
+	size_t offset = Config.Protocol == DMX_PROTOCOL_E131 ? E131_SEQUENCE : ARTNET_SEQUENCE;
+	for (size_t u = 0; u < Count; u++)
+		Headers[u * HeaderSize + offset] = Next;
+	if (Config.Protocol == DMX_PROTOCOL_E131)
+		Sync[E131_SYNC_SEQUENCE] = Next;
+}
+
+bool CDmxSink::Send()
+{
+	if (!Socket.IsOpen())
+		return false;
+
+	Sequence();
+	size_t sent = Socket.Send(Datagrams.data(), Datagrams.size());
+	Stats.Frames++;
+	Stats.Packets += sent;
+	Stats.Failed += Datagrams.size() - sent;
+	for (size_t i = 0; i < sent; i++)
+	{
+		for (size_t p = 0; p < Datagrams[i].Parts; p++)
+			Stats.Bytes += Datagrams[i].Size[p];
+	}
+	return sent == Datagrams.size();
+}
+
+void CDmxSink::Close()
+{
+	if (Socket.IsOpen() && Config.Protocol == DMX_PROTOCOL_E131)
+	{
+		for (size_t u = 0; u < Count; u++)
+			Headers[u * HeaderSize + E131_OPTIONS] |= E131_OPTION_TERMINATED;
+		for (int i = 0; i < E131_TERMINATE_PACKETS; i++)
+		{
+			Sequence();
+			Socket.Send(Datagrams.data(), Count);
+		}
+	}
+	Socket.Close();
+	Count = 0;
+	Size = 0;
+	Data.clear();
+	Headers.clear();
+	Datagrams.clear();
+}
+
+void CDmxSink::ResetStats()
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
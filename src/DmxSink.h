@@ -0,0 +1,108 @@
+//! \file DmxSink.h
+//! \brief Sends the channels of LED outputs to DMX fixtures over E1.31 (sACN) or Art-Net. The header of every
+//! universe is built once, frames are rendered straight into the channel buffer of the sink and each packet is
+//! gathered from its header and its slice of that buffer by the socket, so a frame is copied by nobody. Universe
+//! sync makes the receivers show all universes of a frame at once.
+
+#ifndef _DMXSINK_H_
+#define _DMXSINK_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+enum DMX_PROTOCOL
+{
+	DMX_PROTOCOL_E131,
+	DMX_PROTOCOL_ARTNET,
+};
+
+const size_t DMX_UNIVERSE_CHANNELS = 512;
+const WORD E131_PORT = 5568;
+const WORD ARTNET_PORT = 6454;
+//! Header of an E1.31 data packet up to the start code, the channels follow it.
+const size_t E131_HEADER_SIZE = 126;
+const size_t E131_SYNC_SIZE = 49;
+//! Header of an ArtDmx packet.
+const size_t ARTNET_HEADER_SIZE = 18;
+const size_t ARTNET_SYNC_SIZE = 14;
+
+struct RZDmxConfig
+{
+	DMX_PROTOCOL Protocol;
+	WORD FirstUniverse;                     //!< E1.31 universe 1 to 63999, Art-Net port address 0 to 32767.
+	WORD ChannelsPerUniverse;               //!< 1 to 512, 510 keeps the 3 channels of an LED in one universe.
+	DWORD Destination;                      //!< IPv4 address of the receiver, 0 for E1.31 multicast or Art-Net broadcast.
+	WORD Port;                              //!< 0 for the port of the protocol.
+	//! Universe the E1.31 sync packet goes to, 1 to 63999, Art-Net sends ArtSync for any other than 0. 0 sends
+	//! none and receivers show universes as they arrive.
+	WORD SyncUniverse;
+	BYTE Priority;                          //!< E1.31 priority, 0 to 200.
+	BYTE Cid[16];                           //!< E1.31 component identifier, all zero for a random one.
+	char SourceName[64];                    //!< E1.31 source name, UTF-8.
+};
+
+struct RZDmxStats
+{
+	unsigned long long Frames;
+	unsigned long long Packets;             //!< Data and sync packets sent.
+	unsigned long long Bytes;
+	unsigned long long Failed;              //!< Packets the socket did not take.
+};
+
+class CDmxSink
+{
+public:
+	CDmxSink();
+	~CDmxSink();
+
+	//! E1.31 to multicast from universe 1, 510 channels a universe, priority 100 and no sync.
+	static RZDmxConfig Defaults(DMX_PROTOCOL protocol);
+
+	//! Builds the packets of channels channels and opens the socket.
+	bool Open(const RZDmxConfig& config, size_t channels, std::string& error);
+	//! Tells E1.31 receivers the stream ended, so they release the universes at once, and closes the socket.
+	void Close();
+	bool IsOpen() const { return Socket.IsOpen(); }
+
+	const RZDmxConfig& GetConfig() const { return Config; }
+	size_t Universes() const { return Count; }
+	size_t Channels() const { return Size; }
+	//! The channels of the next frame, render into it, 3 bytes per LED for CLedOutput.
+	BYTE* Frame() { return Data.data(); }
+
+	//! Sends Frame() in one packet per universe, then the sync packet. Allocates nothing.
+	bool Send();
+
+	const RZDmxStats& GetStats() const { return Stats; }
+	void ResetStats();
+
+	//! Multicast address of an E1.31 universe, 239.255.hi.lo.
+	static DWORD MulticastAddress(WORD universe);
+
+private:
+	CDmxSink(const CDmxSink&) = delete;
+	CDmxSink& operator=(const CDmxSink&) = delete;
+
+	void BuildE131(size_t universe, BYTE* header, size_t channels);
+	void BuildArtNet(size_t universe, BYTE* header, size_t channels);
+	//! Stamps the sequence number of the next frame into every header.
+	void Sequence();
+
+	RZDmxConfig Config;
+	CUdpSocket Socket;
+	size_t Count;
+	size_t Size;
+	size_t HeaderSize;
+	std::vector<BYTE> Data;
+	std::vector<BYTE> Headers;              //!< HeaderSize bytes for each universe.
+	BYTE Sync[E131_SYNC_SIZE];
+	std::vector<RZDatagram> Datagrams;      //!< A datagram for each universe, then the sync packet.
+	BYTE Next;                              //!< Sequence number of the next frame.
+	RZDmxStats Stats;
+};
+
+#endif
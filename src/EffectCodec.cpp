@@ -0,0 +1,254 @@
+#include <string.h>
+#include "EffectCodec.h"
+
+static void GetColors(const RZEventData& frame, DWORD colors[EFFECT_COLORS])
+{
+	colors[0] = frame.effect.CL1;
+	colors[1] = frame.effect.CL2;
+	colors[2] = frame.effect.CL3;
+	colors[3] = frame.effect.CL4;
+	colors[4] = frame.effect.CL5;
+}
+
+static void SetFrame(RZEventData& frame, DWORD index, const DWORD colors[EFFECT_COLORS], bool appSpecific)
+{
+	memset(&frame, 0, sizeof(frame));
+	frame.index = index;
+	frame.effect.CL1 = colors[0];
+	frame.effect.CL2 = colors[1];
+	frame.effect.CL3 = colors[2];
+	frame.effect.CL4 = colors[3];
+	frame.effect.CL5 = colors[4];
+	frame.effect.IsAppSpecific = appSpecific ? TRUE : FALSE;
+}
+
+static size_t PutVarint(BYTE* out, DWORD value)
+{
+	size_t length = 0;
+	while (value >= 0x80)
+	{
+		out[length++] = (BYTE)(value | 0x80);
+		value >>= 7;
+	}
+	out[length++] = (BYTE)value;
+	return length;
+}
+
+static bool GetVarint(const BYTE* data, size_t size, size_t& offset, DWORD& value)
+{
+	value = 0;
+	for (unsigned int shift = 0; shift < 32 && offset < size; shift += 7)
+	{
+		BYTE byte = data[offset++];
+		value |= (DWORD)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static DWORD CountColors(BYTE flags)
+{
+	DWORD count = 0;
+	for (DWORD i = 0; i < EFFECT_COLORS; i++)
+	{
+		if (flags & (EFFECT_FIELD_CL1 << i))
+			count++;
+	}
+	return count;
+}
+
+CEffectEncoder::CEffectEncoder(DWORD keyframeInterval)
+{
+	Reset(keyframeInterval);
+}
+
+void CEffectEncoder::Reset(DWORD keyframeInterval)
+{
+	memset(&Previous, 0, sizeof(Previous));
+	memset(&Stats, 0, sizeof(Stats));
+	Sequence = 0;
+	Interval = keyframeInterval;
+	SinceKeyframe = 0;
+	Keyframe = true;
+}
+
+size_t CEffectEncoder::Encode(const RZEventData& frame, BYTE* out)
+{
+	bool keyframe = Keyframe || (Interval && SinceKeyframe >= Interval);
+	DWORD colors[EFFECT_COLORS], before[EFFECT_COLORS] = {};
+	GetColors(frame, colors);
+	DWORD index = frame.index;
+	DWORD indexBefore = 0;
+	if (!keyframe)
+	{
+		GetColors(Previous, before);
+		indexBefore = Previous.index;
+	}
+
+	BYTE flags = keyframe ? EFFECT_FIELD_KEYFRAME : 0;
+	if (frame.effect.IsAppSpecific)
+		flags |= EFFECT_FIELD_APP_SPECIFIC;
+	if (index != indexBefore)
+		flags |= EFFECT_FIELD_INDEX;
+
+	BYTE masks[EFFECT_COLORS];
+	DWORD changed = 0;
+	for (DWORD i = 0; i < EFFECT_COLORS; i++)
+	{
+		DWORD difference = colors[i] ^ before[i];
+		if (!difference)
+			continue;
+		BYTE mask = 0;
+		for (DWORD b = 0; b < 4; b++)
+		{
+			if ((difference >> (b * 8)) & 0xFF)
+				mask |= (BYTE)(1 << b);
+		}
+		flags |= (BYTE)(EFFECT_FIELD_CL1 << i);
+		masks[changed++] = mask;
+	}
+
+	out[0] = flags;
+	out[1] = Sequence++;
+	size_t length = 2;
+	if (flags & EFFECT_FIELD_INDEX)
+		length += PutVarint(out + length, index);
+	for (DWORD i = 0; i < changed; i += 2)
+		out[length++] = (BYTE)(masks[i] | (i + 1 < changed ? masks[i + 1] << 4 : 0));
+
+	for (DWORD i = 0; i < EFFECT_COLORS; i++)
+	{
+		for (DWORD b = 0; b < 4; b++)
+		{
+			BYTE now = (BYTE)(colors[i] >> (b * 8));
+			BYTE then = (BYTE)(before[i] >> (b * 8));
+			if (now == then)
+				continue;
+			// Zigzag keeps small steps either way below 64, so they fit a single varint byte
+			signed char step = (signed char)(BYTE)(now - then);
+			BYTE zigzag = (BYTE)((step << 1) ^ (step >> 7));
+			if (zigzag < 0x80)
+				out[length++] = zigzag;
+			else
+			{
+				out[length++] = (BYTE)(zigzag | 0x80);
+				out[length++] = 1;
+			}
+		}
+	}
+
+	Previous = frame;
+	if (keyframe)
+	{
+		SinceKeyframe = 0;
+		Keyframe = false;
+		Stats.Keyframes++;
+	}
+	SinceKeyframe++;
+	Stats.Frames++;
+	Stats.Bytes += length;
+	return length;
+}
+
+CEffectDecoder::CEffectDecoder()
+{
+	Reset();
+}
+
+void CEffectDecoder::Reset()
+{
+	memset(&Previous, 0, sizeof(Previous));
+	memset(&Stats, 0, sizeof(Stats));
+	Sequence = 0;
+	Started = false;
+	Synced = false;
+}
+
+EFFECT_DECODE CEffectDecoder::Decode(const BYTE* data, size_t size, RZEventData& frame, size_t* used)
+{
+	if (size < 2)
+	{
+		Synced = false;
+		return EFFECT_DECODE_INVALID;
+	}
+
+	BYTE flags = data[0];
+	BYTE sequence = data[1];
+	bool keyframe = (flags & EFFECT_FIELD_KEYFRAME) != 0;
+	DWORD colors[EFFECT_COLORS] = {};
+	DWORD index = 0;
+	if (!keyframe)
+	{
+		GetColors(Previous, colors);
+		index = Previous.index;
+	}
+
+	size_t offset = 2;
+	DWORD changed = CountColors(flags);
+	if ((flags & EFFECT_FIELD_INDEX) && !GetVarint(data, size, offset, index))
+	{
+		Synced = false;
+		return EFFECT_DECODE_INVALID;
+	}
+	if (size - offset < (changed + 1) / 2)
+	{
+		Synced = false;
+		return EFFECT_DECODE_INVALID;
+	}
+	const BYTE* masks = data + offset;
+	offset += (changed + 1) / 2;
+
+	DWORD color = 0;
+	for (DWORD i = 0; i < EFFECT_COLORS; i++)
+	{
+		if (!(flags & (EFFECT_FIELD_CL1 << i)))
+			continue;
+		BYTE mask = (BYTE)((masks[color / 2] >> ((color % 2) * 4)) & 0x0F);
+		color++;
+		// A color listed as changed has at least one byte that changed
+		if (!mask)
+		{
+			Synced = false;
+			return EFFECT_DECODE_INVALID;
+		}
+		for (DWORD b = 0; b < 4; b++)
+		{
+			if (!(mask & (1 << b)))
+				continue;
+			DWORD zigzag;
+			if (!GetVarint(data, size, offset, zigzag) || zigzag > 0xFF)
+			{
+				Synced = false;
+				return EFFECT_DECODE_INVALID;
+			}
+			BYTE step = (BYTE)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+			BYTE value = (BYTE)((BYTE)(colors[i] >> (b * 8)) + step);
+			colors[i] = (colors[i] & ~(0xFFu << (b * 8))) | ((DWORD)value << (b * 8));
+		}
+	}
+
+	if (used)
+		*used = offset;
+	Stats.Bytes += offset;
+	if (Started && sequence != Sequence)
+	{
+		Stats.Lost += (BYTE)(sequence - Sequence);
+		Synced = false;
+	}
+	Started = true;
+	Sequence = (BYTE)(sequence + 1);
+
+	if (!keyframe && !Synced)
+	{
+		Stats.Dropped++;
+		return EFFECT_DECODE_WAITING;
+	}
+	if (keyframe)
+		Stats.Keyframes++;
+	Synced = true;
+	SetFrame(Previous, index, colors, (flags & EFFECT_FIELD_APP_SPECIFIC) != 0);
+	frame = Previous;
+	Stats.Frames++;
+	return EFFECT_DECODE_FRAME;
+}
@@ -0,0 +1,110 @@
+//! \file EffectCodec.h
+//! \brief Compact encoding of effect streams for the network: each frame only carries what changed since the frame
+//! before it. A frame holding still takes 2 bytes and one changing a color about 6, against the 28 of an app index
+//! and a raw CHROMA_BROADCAST_EFFECT; a fade moving every channel of every color takes about 20.
+//!
+//! A frame starts with a flags byte and a sequence number byte:
+//!   bits 0-4  EFFECT_FIELD_CL1 to EFFECT_FIELD_CL5, the colors that changed
+//!   bit 5     EFFECT_FIELD_INDEX, the app index follows as a varint
+//!   bit 6     EFFECT_FIELD_APP_SPECIFIC, the value of IsAppSpecific
+//!   bit 7     EFFECT_FIELD_KEYFRAME, the frame is encoded against a frame of zeros
+//! Each changed color then has a nibble telling which of its 4 bytes changed, two colors to a byte, low nibble
+//! first. Last comes each changed byte as the difference to its previous value, wrapped to -128..127, zigzagged and
+//! written as a LEB128 varint: 1 byte for a step below 64, 2 bytes for any other.
+//!
+//! A keyframe is sent every so many frames and when asked for. A decoder that missed a sequence number, or joined
+//! the stream late, drops the frames until the next keyframe instead of showing wrong colors.
+//!
+//! The codec is for links where bytes cost: the delta clients of the stream server and the followers of a sync
+//! leader. The broker's frame ring keeps raw frames. It is local shared memory with a fixed 64-byte slot a frame,
+//! so a smaller frame saves neither a copy nor a cache line, and every reader would pay for decoding and lose the
+//! frames up to the next keyframe after it fell more than the depth behind.
+
+#ifndef _EFFECTCODEC_H_
+#define _EFFECTCODEC_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+
+enum EFFECT_FIELD : BYTE
+{
+	EFFECT_FIELD_CL1 = 0x01,                //!< CL1 to CL5 are consecutive bits.
+	EFFECT_FIELD_INDEX = 0x20,
+	EFFECT_FIELD_APP_SPECIFIC = 0x40,
+	EFFECT_FIELD_KEYFRAME = 0x80,
+};
+
+const DWORD EFFECT_COLORS = 5;
+//! Longest encoded frame: flags, sequence, index, 3 bytes of nibbles and 20 bytes of 2 byte differences.
+const size_t EFFECT_MAX_ENCODED = 2 + 5 + 3 + EFFECT_COLORS * 4 * 2;
+//! Frames between two keyframes, a decoder that lost one recovers within 64 frames.
+const DWORD EFFECT_DEFAULT_KEYFRAME_INTERVAL = 64;
+
+enum EFFECT_DECODE
+{
+	EFFECT_DECODE_FRAME,                    //!< frame holds the frame decoded.
+	EFFECT_DECODE_WAITING,                  //!< A delta before the first keyframe or after a lost frame, dropped.
+	EFFECT_DECODE_INVALID,                  //!< Truncated or malformed, the decoder waits for a keyframe.
+};
+
+struct RZEffectCodecStats
+{
+	unsigned long long Frames;
+	unsigned long long Keyframes;
+	unsigned long long Bytes;
+	unsigned long long Lost;                //!< Decoder: frames missing between two sequence numbers.
+	unsigned long long Dropped;             //!< Decoder: frames dropped waiting for a keyframe.
+};
+
+//! Encodes a stream of frames. Holds only the previous frame, allocates nothing.
+class CEffectEncoder
+{
+public:
+	explicit CEffectEncoder(DWORD keyframeInterval = EFFECT_DEFAULT_KEYFRAME_INTERVAL);
+
+	//! Starts a new stream, the next frame is a keyframe. 0 sends keyframes only when asked.
+	void Reset(DWORD keyframeInterval = EFFECT_DEFAULT_KEYFRAME_INTERVAL);
+	//! Makes the next frame a keyframe, for a receiver that joined or lost frames.
+	void RequestKeyframe() { Keyframe = true; }
+
+	//! Encodes the app index and the effect of frame into out, which has room for EFFECT_MAX_ENCODED bytes.
+	//! Returns the bytes written.
+	size_t Encode(const RZEventData& frame, BYTE* out);
+
+	const RZEffectCodecStats& GetStats() const { return Stats; }
+
+private:
+	RZEventData Previous;
+	BYTE Sequence;
+	DWORD Interval;
+	DWORD SinceKeyframe;
+	bool Keyframe;
+	RZEffectCodecStats Stats;
+};
+
+//! Decodes what CEffectEncoder encoded. Allocates nothing.
+class CEffectDecoder
+{
+public:
+	CEffectDecoder();
+
+	//! Forgets the stream, frames are dropped until the next keyframe.
+	void Reset();
+	bool IsSynced() const { return Synced; }
+
+	//! Decodes one frame from data. used receives its size unless the frame is invalid. The app index and the
+	//! effect of frame are set, its other fields zeroed.
+	EFFECT_DECODE Decode(const BYTE* data, size_t size, RZEventData& frame, size_t* used = nullptr);
+
+	const RZEffectCodecStats& GetStats() const { return Stats; }
+
+private:
+	RZEventData Previous;
+	BYTE Sequence;                          //!< Sequence number of the next frame, once Started.
+	bool Started;
+	bool Synced;                            //!< Previous holds the frame the next delta applies to.
+	RZEffectCodecStats Stats;
+};
+
+#endif
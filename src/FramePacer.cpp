@@ -0,0 +1,198 @@
+#include <string.h>
+#include <algorithm>
+#include "FramePacer.h"
+
+//! Pause taken for the stream stopping before the interval is known.
+static const unsigned long long FRAME_PACER_PAUSE = 100000000ULL;
+//! Arrivals the interval is measured over. Their times telescope, so the error is the spread of two arrivals
+//! over 31 intervals, and a change of rate is followed within as many frames.
+static const size_t FRAME_PACER_RATE_WINDOW = 32;
+//! Arrivals after which the interval is trusted to measure lateness against, and the rate is checked over.
+static const size_t FRAME_PACER_TRUSTED = 8;
+//! The slots move a sixteenth of the way to where the delay puts them each frame, so a clock a little off or an
+//! interval measured a little short shifts them slowly instead of piling frames up.
+static const long long FRAME_PACER_CATCH_UP = 16;
+//! Lateness drains by this part of the interval each frame, or a rate measured a hair fast would add up.
+static const unsigned long long FRAME_PACER_SLACK = 32;
+//! The delay shrinks by this part of its excess each frame, about two windows to settle after a burst.
+static const unsigned long long FRAME_PACER_SHRINK = 64;
+
+CFramePacer::CFramePacer()
+{
+	Configure(Defaults());
+}
+
+RZFramePacerConfig CFramePacer::Defaults()
+{
+	RZFramePacerConfig config;
+	config.MinDelay = 4000;
+	config.MaxDelay = 50000;
+	config.Interval = 0;
+	return config;
+}
+
+void CFramePacer::Configure(const RZFramePacerConfig& config)
+{
+	Config = config;
+	Config.MaxDelay = std::max(Config.MaxDelay, Config.MinDelay);
+	Reset();
+}
+
+void CFramePacer::Reset()
+{
+	First = 0;
+	Count = 0;
+	Samples = 0;
+	Next = 0;
+	Rated = 0;
+	Late = 0;
+	Interval = Config.Interval * 1000ULL;
+	CurrentDelay = Config.MinDelay * 1000ULL;
+	LastDue = 0;
+	Lock.Enter();
+	memset(&Stats, 0, sizeof(Stats));
+	Stats.Delay = Config.MinDelay;
+	Stats.Interval = Config.Interval;
+	Lock.Leave();
+}
+
+unsigned long long CFramePacer::Adapt()
+{
+	unsigned long long sorted[FRAME_PACER_WINDOW];
+	memcpy(sorted, Lateness, Samples * sizeof(sorted[0]));
+	size_t rank = Samples * 99 / 100;
+	std::nth_element(sorted, sorted + rank, sorted + Samples);
+	unsigned long long jitter = sorted[rank];
+
+	// A quarter over the lateness seen covers the frame a little later than any in the window
+	unsigned long long target = jitter + jitter / 4;
+	target = std::max(target, Config.MinDelay * 1000ULL);
+	target = std::min(target, Config.MaxDelay * 1000ULL);
+	if (target > CurrentDelay)
+		CurrentDelay = target;
+	else
+		CurrentDelay -= (CurrentDelay - target) / FRAME_PACER_SHRINK;
+	return jitter;
+}
+
+unsigned long long CFramePacer::MeanInterval(size_t arrivals) const
+{
+	unsigned long long newest = Arrivals[(Next + FRAME_PACER_WINDOW - 1) % FRAME_PACER_WINDOW];
+	unsigned long long oldest = Arrivals[(Next + FRAME_PACER_WINDOW - arrivals) % FRAME_PACER_WINDOW];
+	return (newest - oldest) / (arrivals - 1);
+}
+
+bool CFramePacer::OffRate(size_t arrivals) const
+{
+	unsigned long long mean = MeanInterval(arrivals);
+	return 4 * mean < 3 * Interval || 4 * mean > 5 * Interval;
+}
+
+void CFramePacer::Push(const RZEventData& frame, unsigned long long now)
+{
+	const unsigned long long maxDelay = Config.MaxDelay * 1000ULL;
+	unsigned long long last = Samples ? Arrivals[(Next + FRAME_PACER_WINDOW - 1) % FRAME_PACER_WINDOW] : 0;
+
+	// A pause no delay could cover is the stream stopping, the health checks of the reader or an app that holds
+	// still for example, not lateness. The stream may come back at another rate.
+	bool reset = Samples && now - last > (Interval ? maxDelay + 2 * Interval : FRAME_PACER_PAUSE);
+	bool rateChanged = false;
+	if (reset)
+	{
+		Samples = 0;
+		Next = 0;
+		Rated = 0;
+		LastDue = 0;
+		Interval = Config.Interval * 1000ULL;
+	}
+	if (Samples && (Config.Interval || Rated >= FRAME_PACER_TRUSTED))
+	{
+		unsigned long long drained = Interval + Interval / FRAME_PACER_SLACK;
+		Late = Late + (now - last) > drained ? std::min(Late + (now - last) - drained, maxDelay) : 0;
+	}
+	else
+		Late = 0;
+
+	Arrivals[Next] = now;
+	Lateness[Next] = Late;
+	Next = (Next + 1) % FRAME_PACER_WINDOW;
+	Samples = std::min(Samples + 1, FRAME_PACER_WINDOW);
+	Rated = std::min(Rated + 1, FRAME_PACER_RATE_WINDOW);
+	// Two arrivals give a first guess for the slots, a burst can make it far off, so lateness waits for a few more
+	if (!Config.Interval && Rated >= 2)
+	{
+		// The last arrivals a quarter off the interval are a new rate, not jitter: the rate is measured from them
+		// on, and the lateness measured against the old one starts over. One late frame can move the mean of the
+		// last few that far, not that of twice as many as well.
+		if (Rated > FRAME_PACER_TRUSTED && OffRate(FRAME_PACER_TRUSTED) && OffRate(std::min(Rated, 2 * FRAME_PACER_TRUSTED)))
+		{
+			Rated = FRAME_PACER_TRUSTED;
+			Late = 0;
+			memset(Lateness, 0, sizeof(Lateness));
+			CurrentDelay = Config.MinDelay * 1000ULL;
+			rateChanged = true;
+		}
+		Interval = MeanInterval(Rated);
+	}
+	unsigned long long jitter = Adapt();
+
+	unsigned long long target = now + CurrentDelay;
+	unsigned long long due = target;
+	bool underrun = false;
+	if (LastDue && Interval)
+	{
+		unsigned long long slot = LastDue + Interval;
+		due = slot + (long long)(target - slot) / FRAME_PACER_CATCH_UP;
+		underrun = slot < now;
+	}
+	// The slots settle about the mean arrival, so a frame early by the jitter waits up to twice the delay. Only
+	// slots that fell behind the frames, an interval measured long when the rate went up for example, hold longer.
+	due = std::max(std::min(due, target + CurrentDelay), now);
+	due = std::max(due, LastDue);
+	LastDue = due;
+
+	bool overflow = Count == FRAME_PACER_DEPTH;
+	if (overflow)
+	{
+		First = (First + 1) % FRAME_PACER_DEPTH;
+		Count--;
+	}
+	RZPacedFrame& entry = Entries[(First + Count) % FRAME_PACER_DEPTH];
+	entry.Due = due;
+	entry.Frame = frame;
+	Count++;
+
+	Lock.Enter();
+	Stats.Frames++;
+	Stats.Underruns += underrun ? 1 : 0;
+	Stats.Overflows += overflow ? 1 : 0;
+	Stats.Resets += reset ? 1 : 0;
+	Stats.RateChanges += rateChanged ? 1 : 0;
+	Stats.Delay = (DWORD)(CurrentDelay / 1000);
+	Stats.Interval = (DWORD)(Interval / 1000);
+	Stats.Jitter = (DWORD)(jitter / 1000);
+	Stats.Buffered = (DWORD)Count;
+	Lock.Leave();
+}
+
+bool CFramePacer::Pop(unsigned long long now, RZEventData& frame)
+{
+	if (!Count || Entries[First].Due > now)
+		return false;
+	frame = Entries[First].Frame;
+	First = (First + 1) % FRAME_PACER_DEPTH;
+	Count--;
+
+	Lock.Enter();
+	Stats.Paced++;
+	Stats.Buffered = (DWORD)Count;
+	Lock.Leave();
+	return true;
+}
+
+void CFramePacer::GetStats(RZFramePacerStats& stats)
+{
+	Lock.Enter();
+	stats = Stats;
+	Lock.Leave();
+}
@@ -0,0 +1,105 @@
+//! \file FramePacer.h
+//! \brief Evens out the cadence of frames that arrive in bursts. Each frame is held until its slot, one interval
+//! after the slot of the frame before it, and the interval follows the rate the frames arrive at. The delay, how long
+//! a frame that arrived on time waits for its slot, adapts to how late frames have been arriving: it grows at once
+//! when they come later and shrinks slowly when they come steadily again, between a minimum and a maximum.
+//!
+//! Lateness is measured against the cadence, not the previous frame: a frame that is late by 5 ms and the two that
+//! come right after it in a burst all need 5 ms of buffer, which the running sum of interval minus cadence, kept
+//! above 0, gives for each. A pause longer than the maximum delay could cover is the stream stopping, the cadence
+//! starts over after it instead of counting it as lateness.
+
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+//! Frames held at most, the oldest is dropped for a new one.
+const size_t FRAME_PACER_DEPTH = 64;
+//! Arrivals the lateness is measured over.
+const size_t FRAME_PACER_WINDOW = 128;
+
+struct RZFramePacerConfig
+{
+	DWORD MinDelay;                         //!< Microseconds a frame on time waits at least.
+	DWORD MaxDelay;                         //!< Microseconds the delay adapts up to, MinDelay for a fixed delay.
+	DWORD Interval;                         //!< Microseconds between two frames out, 0 follows the frames in.
+};
+
+struct RZFramePacerStats
+{
+	unsigned long long Frames;              //!< Frames pushed.
+	unsigned long long Paced;               //!< Frames popped.
+	unsigned long long Underruns;           //!< Frames that arrived after their slot, the buffer had run dry.
+	unsigned long long Overflows;           //!< Frames dropped for a full buffer.
+	unsigned long long Resets;              //!< Pauses after which the cadence started over.
+	unsigned long long RateChanges;         //!< Changes of the rate the frames arrive at.
+	DWORD Delay;                            //!< Microseconds a frame on time waits now.
+	DWORD Interval;                         //!< Microseconds between two slots.
+	DWORD Jitter;                           //!< 99th percentile of the lateness in the window, in microseconds.
+	DWORD Buffered;
+};
+
+//! Paces the frames of one stream. Push and Pop are for a single thread, GetStats for any. Allocates nothing.
+class CFramePacer
+{
+public:
+	CFramePacer();
+
+	//! 4 ms of delay at least and 50 ms at most, at the rate the frames arrive.
+	static RZFramePacerConfig Defaults();
+
+	//! Applies config and starts over, empty.
+	void Configure(const RZFramePacerConfig& config);
+	void Reset();
+
+	//! Queues frame, arrived at now on CPlatform::Now().
+	void Push(const RZEventData& frame, unsigned long long now);
+	//! Takes the oldest frame into frame if its slot came by now.
+	bool Pop(unsigned long long now, RZEventData& frame);
+	//! Slot of the oldest frame, 0 when none is held.
+	unsigned long long NextDue() const { return Count ? Entries[First].Due : 0; }
+	size_t Buffered() const { return Count; }
+	//! Nanoseconds a frame on time waits now.
+	unsigned long long Delay() const { return CurrentDelay; }
+
+	void GetStats(RZFramePacerStats& stats);
+
+private:
+	CFramePacer(const CFramePacer&) = delete;
+	CFramePacer& operator=(const CFramePacer&) = delete;
+
+	struct RZPacedFrame
+	{
+		unsigned long long Due;
+		RZEventData Frame;
+	};
+
+	//! Moves the delay towards the lateness the window needs, returns that lateness.
+	unsigned long long Adapt();
+	//! Mean interval between the last arrivals, 2 or more.
+	unsigned long long MeanInterval(size_t arrivals) const;
+	//! Whether the last arrivals came a quarter faster or slower than the interval.
+	bool OffRate(size_t arrivals) const;
+
+	RZFramePacerConfig Config;
+	RZPacedFrame Entries[FRAME_PACER_DEPTH];
+	size_t First;
+	size_t Count;
+	unsigned long long Arrivals[FRAME_PACER_WINDOW];    //!< Ring of arrival times since the last reset.
+	unsigned long long Lateness[FRAME_PACER_WINDOW];    //!< Ring of the lateness of the same arrivals.
+	size_t Samples;
+	size_t Next;
+	size_t Rated;                           //!< Last arrivals the interval is measured over, those at the current rate.
+	unsigned long long Late;                //!< Lateness of the last arrival.
+	unsigned long long Interval;            //!< Nanoseconds between two slots, 0 until measured.
+	unsigned long long CurrentDelay;
+	unsigned long long LastDue;             //!< Slot of the last frame pushed, 0 after a reset.
+	CLock Lock;                             //!< Guards Stats.
+	RZFramePacerStats Stats;
+};
+
+#endif
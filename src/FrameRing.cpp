@@ -0,0 +1,163 @@
+#include <string.h>
+#include <new>
+#include "FrameRing.h"
+
+static DWORD RoundDepth(DWORD depth)
+{
+	DWORD rounded = FRAME_RING_MIN_DEPTH;
+	while (rounded < depth && rounded < FRAME_RING_MAX_DEPTH)
+		rounded <<= 1;
+	return rounded;
+}
+
+static size_t RingSize(DWORD depth)
+{
+	return sizeof(RZFrameRingHeader) + (size_t)depth * sizeof(RZFrameRingSlot);
+}
+
+//------------------------------------------------------------------------------------------------
+// CFrameRingWriter
+
+CFrameRingWriter::CFrameRingWriter() : Header(nullptr), Slots(nullptr), Mask(0)
+{
+}
+
+CFrameRingWriter::~CFrameRingWriter()
+{
+	Close();
+}
+
+bool CFrameRingWriter::Open(const char* name, DWORD depth)
+{
+	Close();
+
+	depth = RoundDepth(depth);
+	if (!Memory.Open(name, RingSize(depth), SHARED_MEMORY_CREATE, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+
+	// A ring left behind under the same name is reset, readers still on it see the magic go away
+	RZFrameRingHeader* header = (RZFrameRingHeader*)Memory.Data();
+	header->Magic = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	RZFrameRingSlot* slots = (RZFrameRingSlot*)(header + 1);
+	for (DWORD i = 0; i < depth; i++)
+		new (&slots[i]) RZFrameRingSlot();
+	new (header) RZFrameRingHeader();
+	header->Version = RZBROADCAST_FRAME_RING_VERSION;
+	header->Depth = depth;
+	header->SlotSize = sizeof(RZFrameRingSlot);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->Magic = RZBROADCAST_FRAME_RING_MAGIC;
+
+	Header = header;
+	Slots = slots;
+	Mask = depth - 1;
+	return true;
+}
+
+void CFrameRingWriter::Close()
+{
+	Header = nullptr;
+	Slots = nullptr;
+	Mask = 0;
+	Memory.Close();
+}
+
+ULONGLONG CFrameRingWriter::Publish(const RZEventData& frame, ULONGLONG timestamp)
+{
+	ULONGLONG sequence = Header->WriteSequence.load(std::memory_order_relaxed) + 1;
+	RZFrameRingSlot& slot = Slots[sequence & Mask];
+
+	slot.Sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.Timestamp = timestamp;
+	memcpy(&slot.Frame, &frame, sizeof(RZEventData));
+	slot.Sequence.store(sequence, std::memory_order_release);
+	Header->WriteSequence.store(sequence, std::memory_order_release);
+	return sequence;
+}
+
+//------------------------------------------------------------------------------------------------
+// CFrameRingReader
+
+CFrameRingReader::CFrameRingReader() : Header(nullptr), Slots(nullptr), Mask(0), LastSequence(0)
+{
+}
+
+CFrameRingReader::~CFrameRingReader()
+{
+	Close();
+}
+
+bool CFrameRingReader::Open(const char* name)
+{
+	Close();
+
+	// The depth is only known from the header, map it alone first
+	if (!Memory.Open(name, sizeof(RZFrameRingHeader), SHARED_MEMORY_READ_ONLY, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+
+	const RZFrameRingHeader* header = (const RZFrameRingHeader*)Memory.Data();
+	DWORD magic = header->Magic;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	DWORD depth = header->Depth;
+	if (magic != RZBROADCAST_FRAME_RING_MAGIC || header->Version != RZBROADCAST_FRAME_RING_VERSION
+		|| header->SlotSize != sizeof(RZFrameRingSlot) || depth < FRAME_RING_MIN_DEPTH || depth > FRAME_RING_MAX_DEPTH || (depth & (depth - 1)))
+	{
+		Memory.Close();
+		return false;
+	}
+
+	if (!Memory.Open(name, RingSize(depth), SHARED_MEMORY_READ_ONLY, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+
+	Header = (const RZFrameRingHeader*)Memory.Data();
+	Slots = (const RZFrameRingSlot*)(Header + 1);
+	Mask = depth - 1;
+	LastSequence = Header->WriteSequence.load(std::memory_order_acquire);
+	return true;
+}
+
+void CFrameRingReader::Close()
+{
+	Header = nullptr;
+	Slots = nullptr;
+	Mask = 0;
+	LastSequence = 0;
+	Memory.Close();
+}
+
+bool CFrameRingReader::Read(RZFrameRingEntry& entry, ULONGLONG& missed)
+{
+	missed = 0;
+	for (;;)
+	{
+		ULONGLONG newest = Header->WriteSequence.load(std::memory_order_acquire);
+		if (LastSequence >= newest)
+			return false;
+
+		ULONGLONG sequence = LastSequence + 1;
+		if (newest - sequence > Mask)
+		{
+			ULONGLONG oldest = newest - Mask;
+			missed += oldest - sequence;
+			sequence = oldest;
+		}
+
+		const RZFrameRingSlot& slot = Slots[sequence & Mask];
+		ULONGLONG before = slot.Sequence.load(std::memory_order_acquire);
+		entry.Timestamp = slot.Timestamp;
+		memcpy(&entry.Frame, (const void*)&slot.Frame, sizeof(RZEventData));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		ULONGLONG after = slot.Sequence.load(std::memory_order_relaxed);
+
+		LastSequence = sequence;
+		if (before == sequence && after == sequence)
+		{
+			entry.Sequence = sequence;
+			return true;
+		}
+		// The writer lapped the reader while it copied, the frame is gone
+		missed++;
+	}
+}
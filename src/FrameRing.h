@@ -0,0 +1,113 @@
+//! \file FrameRing.h
+//! \brief Single writer, many reader frame ring in shared memory. Every frame carries a 64-bit sequence number and
+//! a nanosecond timestamp; readers validate each copy against the slot's sequence and never write to the ring,
+//! so any number of them can follow it at their own pace and count the frames they missed.
+
+#ifndef _FRAMERING_H_
+#define _FRAMERING_H_
+
+#pragma once
+
+#include <atomic>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+const DWORD RZBROADCAST_FRAME_RING_MAGIC = 0x52465A52; // "RZFR"
+const DWORD RZBROADCAST_FRAME_RING_VERSION = 1;
+
+const DWORD FRAME_RING_DEFAULT_DEPTH = 4096;
+const DWORD FRAME_RING_MIN_DEPTH = 16;
+const DWORD FRAME_RING_MAX_DEPTH = 1 << 20;
+
+//! First cache line of the ring, the slots follow it.
+struct alignas(64) RZFrameRingHeader
+{
+	DWORD Magic;
+	DWORD Version;
+	DWORD Depth;                            //!< Number of slots, a power of two.
+	DWORD SlotSize;
+	std::atomic<ULONGLONG> WriteSequence;   //!< Sequence of the newest frame, frames start at 1.
+};
+
+//! Frame n lives in slot n % Depth. Sequence is 0 while the writer rewrites the slot, a reader
+//! copying frame n keeps the copy only if Sequence reads n before and after.
+struct alignas(64) RZFrameRingSlot
+{
+	std::atomic<ULONGLONG> Sequence;
+	ULONGLONG Timestamp;                    //!< CPlatform::Now() when the frame was ingested.
+	RZEventData Frame;
+};
+
+static_assert(sizeof(RZFrameRingHeader) == 64, "the ring header must fill one cache line");
+static_assert(sizeof(RZFrameRingSlot) == 64, "a ring slot must fill one cache line");
+
+//! A frame as copied out of the ring.
+struct RZFrameRingEntry
+{
+	ULONGLONG Sequence;
+	ULONGLONG Timestamp;
+	RZEventData Frame;
+};
+
+//! Creates a ring and publishes frames to it. Only one writer may exist per ring.
+class CFrameRingWriter
+{
+public:
+	CFrameRingWriter();
+	~CFrameRingWriter();
+
+	//! Creates the ring, depth is rounded up to a power of two within the depth limits.
+	bool Open(const char* name, DWORD depth);
+	void Close();
+	bool IsOpen() const { return Header != nullptr; }
+
+	//! Appends a frame stamped with timestamp and returns its sequence number.
+	ULONGLONG Publish(const RZEventData& frame, ULONGLONG timestamp);
+
+	DWORD Depth() const { return Header ? Header->Depth : 0; }
+	ULONGLONG Newest() const { return Header ? Header->WriteSequence.load(std::memory_order_relaxed) : 0; }
+
+private:
+	CFrameRingWriter(const CFrameRingWriter&) = delete;
+	CFrameRingWriter& operator=(const CFrameRingWriter&) = delete;
+
+	CSharedMemory Memory;
+	RZFrameRingHeader* Header;
+	RZFrameRingSlot* Slots;
+	ULONGLONG Mask;
+};
+
+//! Maps a ring read only and follows it from the frame after the newest one at Open.
+class CFrameRingReader
+{
+public:
+	CFrameRingReader();
+	~CFrameRingReader();
+
+	bool Open(const char* name);
+	void Close();
+	bool IsOpen() const { return Header != nullptr; }
+
+	//! Copies the oldest frame not read yet. Returns false when there is none. missed is set to
+	//! the number of frames the writer overwrote since the previous read, they are skipped.
+	bool Read(RZFrameRingEntry& entry, ULONGLONG& missed);
+
+	//! Continues with the frame after sequence, older frames still in the ring are read again.
+	void Seek(ULONGLONG sequence) { LastSequence = sequence; }
+	ULONGLONG Newest() const { return Header ? Header->WriteSequence.load(std::memory_order_acquire) : 0; }
+	//! Sequence of the last frame read or skipped.
+	ULONGLONG Position() const { return LastSequence; }
+	DWORD Depth() const { return Header ? Header->Depth : 0; }
+
+private:
+	CFrameRingReader(const CFrameRingReader&) = delete;
+	CFrameRingReader& operator=(const CFrameRingReader&) = delete;
+
+	CSharedMemory Memory;
+	const RZFrameRingHeader* Header;
+	const RZFrameRingSlot* Slots;
+	ULONGLONG Mask;
+	ULONGLONG LastSequence;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include <math.h>
+#include <string.h>
+#include "Interpolator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INTERPOLATOR_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define INTERPOLATOR_NEON
+#endif
+
+using namespace RzChromaBroadcastAPI;
+
+static const int LINEAR_TO_SRGB_SIZE = 4096;
+static const int LINEAR_EFFECT_FLOATS = LINEAR_EFFECT_LANES * 4;
+
+struct CGammaTables
+{
+	float SrgbToLinear[256];
+	BYTE LinearToSrgb[LINEAR_TO_SRGB_SIZE];
+
+	CGammaTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			double v = i / 255.0;
+			SrgbToLinear[i] = (float)(v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+		}
+		for (int i = 0; i < LINEAR_TO_SRGB_SIZE; i++)
+		{
+			double v = (double)i / (LINEAR_TO_SRGB_SIZE - 1);
+			double s = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+			LinearToSrgb[i] = (BYTE)(s * 255.0 + 0.5);
+		}
+	}
+};
+
+static const CGammaTables& Tables()
+{
+	static const CGammaTables tables;
+	return tables;
+}
+
+//! out = from + (to - from) * weight over all channels and lanes.
+static void Blend(const RZLinearEffect& from, const RZLinearEffect& to, float weight, RZLinearEffect& out)
+{
+	const float* a = from.R;
+	const float* b = to.R;
+	float* o = out.R;
+#if defined(INTERPOLATOR_SSE2)
+	__m128 w = _mm_set1_ps(weight);
+	for (int i = 0; i < LINEAR_EFFECT_FLOATS; i += 4)
+	{
+		__m128 x = _mm_load_ps(a + i);
+		__m128 y = _mm_load_ps(b + i);
+		_mm_store_ps(o + i, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), w)));
+	}
+#elif defined(INTERPOLATOR_NEON)
+	float32x4_t w = vdupq_n_f32(weight);
+	for (int i = 0; i < LINEAR_EFFECT_FLOATS; i += 4)
+	{
+		float32x4_t x = vld1q_f32(a + i);
+		float32x4_t y = vld1q_f32(b + i);
+		vst1q_f32(o + i, vmlaq_f32(x, vsubq_f32(y, x), w));
+	}
+#else
+	for (int i = 0; i < LINEAR_EFFECT_FLOATS; i++)
+		o[i] = a[i] + (b[i] - a[i]) * weight;
+#endif
+}
+
+void CEffectInterpolator::ToLinear(const CHROMA_BROADCAST_EFFECT& effect, RZLinearEffect& out)
+{
+	const float* table = Tables().SrgbToLinear;
+	const RZCOLOR colors[LINEAR_EFFECT_COLORS] = { effect.CL1, effect.CL2, effect.CL3, effect.CL4, effect.CL5 };
+	memset(&out, 0, sizeof(out));
+	for (int i = 0; i < LINEAR_EFFECT_COLORS; i++)
+	{
+		out.R[i] = table[colors[i] & 0xFF];
+		out.G[i] = table[(colors[i] >> 8) & 0xFF];
+		out.B[i] = table[(colors[i] >> 16) & 0xFF];
+		out.A[i] = (colors[i] >> 24) / 255.0f;
+	}
+	out.IsAppSpecific = effect.IsAppSpecific;
+}
+
+//! Rounds and clamps the first LINEAR_EFFECT_COLORS lanes of channel to 0..limit.
+static void ToIndices(const float* channel, float limit, int indices[LINEAR_EFFECT_LANES])
+{
+#if defined(INTERPOLATOR_SSE2)
+	__m128 scale = _mm_set1_ps(limit);
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < LINEAR_EFFECT_LANES; i += 4)
+	{
+		__m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_load_ps(channel + i), scale), zero), scale);
+		_mm_storeu_si128((__m128i*)(indices + i), _mm_cvtps_epi32(v));
+	}
+#elif defined(INTERPOLATOR_NEON)
+	float32x4_t scale = vdupq_n_f32(limit);
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	for (int i = 0; i < LINEAR_EFFECT_LANES; i += 4)
+	{
+		float32x4_t v = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(channel + i), scale), zero), scale);
+		vst1q_s32(indices + i, vcvtnq_s32_f32(v));
+	}
+#else
+	for (int i = 0; i < LINEAR_EFFECT_COLORS; i++)
+	{
+		float v = channel[i] * limit;
+		indices[i] = v <= 0.0f ? 0 : v >= limit ? (int)limit : (int)(v + 0.5f);
+	}
+#endif
+}
+
+void CEffectInterpolator::FromLinear(const RZLinearEffect& effect, CHROMA_BROADCAST_EFFECT& out)
+{
+	const BYTE* table = Tables().LinearToSrgb;
+	int r[LINEAR_EFFECT_LANES], g[LINEAR_EFFECT_LANES], b[LINEAR_EFFECT_LANES], a[LINEAR_EFFECT_LANES];
+	ToIndices(effect.R, LINEAR_TO_SRGB_SIZE - 1, r);
+	ToIndices(effect.G, LINEAR_TO_SRGB_SIZE - 1, g);
+	ToIndices(effect.B, LINEAR_TO_SRGB_SIZE - 1, b);
+	ToIndices(effect.A, 255, a);
+
+	RZCOLOR colors[LINEAR_EFFECT_COLORS];
+	for (int i = 0; i < LINEAR_EFFECT_COLORS; i++)
+		colors[i] = table[r[i]] | (table[g[i]] << 8) | (table[b[i]] << 16) | ((RZCOLOR)a[i] << 24);
+	out.CL1 = colors[0];
+	out.CL2 = colors[1];
+	out.CL3 = colors[2];
+	out.CL4 = colors[3];
+	out.CL5 = colors[4];
+	out.IsAppSpecific = effect.IsAppSpecific;
+}
+
+CEffectInterpolator::CEffectInterpolator() : Start(0), Duration(0), MaxTransition(INTERPOLATION_DEFAULT_MAX_TRANSITION), Effects(0), Curve(INTERPOLATION_LINEAR)
+{
+	memset(&From, 0, sizeof(From));
+	memset(&To, 0, sizeof(To));
+}
+
+void CEffectInterpolator::Reset()
+{
+	Effects = 0;
+	Start = 0;
+	Duration = 0;
+}
+
+void CEffectInterpolator::Push(const CHROMA_BROADCAST_EFFECT& effect, unsigned long long time)
+{
+	// The transition starts where the output is, an unfinished one is not jumped over
+	if (Effects)
+	{
+		RZLinearEffect current;
+		Render(time, current);
+		From = current;
+		Duration = time > Start ? time - Start : 0;
+		if (Duration > MaxTransition)
+			Duration = MaxTransition;
+	}
+	ToLinear(effect, To);
+	if (!Effects)
+		From = To;
+	Start = time;
+	Effects++;
+}
+
+float CEffectInterpolator::Weight(unsigned long long time) const
+{
+	if (Curve == INTERPOLATION_STEP || !Duration || time >= Start + Duration)
+		return 1.0f;
+	if (time <= Start)
+		return 0.0f;
+
+	float u = (float)(time - Start) / (float)Duration;
+	switch (Curve)
+	{
+	case INTERPOLATION_EASE_OUT:
+		return 1.0f - (1.0f - u) * (1.0f - u);
+	case INTERPOLATION_EASE_IN_OUT:
+		return u * u * (3.0f - 2.0f * u);
+	default:
+		return u;
+	}
+}
+
+bool CEffectInterpolator::Render(unsigned long long time, RZLinearEffect& out) const
+{
+	if (!Effects)
+		return false;
+
+	float weight = Weight(time);
+	if (weight >= 1.0f)
+		out = To;
+	else
+	{
+		Blend(From, To, weight, out);
+		out.IsAppSpecific = To.IsAppSpecific;
+	}
+	return true;
+}
+
+bool CEffectInterpolator::Render(unsigned long long time, CHROMA_BROADCAST_EFFECT& out) const
+{
+	RZLinearEffect linear;
+	if (!Render(time, linear))
+		return false;
+	FromLinear(linear, out);
+	return true;
+}
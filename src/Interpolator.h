@@ -0,0 +1,111 @@
+//! \file Interpolator.h
+//! \brief Upsamples broadcast effects to the refresh rate of an output. Each new effect starts a transition from
+//! where the output is to the new colors, lasting as long as the effects arrived apart, and the output samples it
+//! on its own fixed-rate clock. Colors are blended in linear light, one SIMD lane per color.
+
+#ifndef _INTERPOLATOR_H_
+#define _INTERPOLATOR_H_
+
+#pragma once
+
+#include "BroadcastProtocol.h"
+
+//! Lanes of an RZLinearEffect channel: the five colors and three unused lanes, so a channel is two SSE or NEON
+//! registers or one AVX register.
+const int LINEAR_EFFECT_LANES = 8;
+const int LINEAR_EFFECT_COLORS = 5;
+
+//! Longest transition, in nanoseconds. Effects further apart than this still fade in this time.
+const unsigned long long INTERPOLATION_DEFAULT_MAX_TRANSITION = 100000000ULL;
+
+enum INTERPOLATION_CURVE
+{
+	INTERPOLATION_STEP,                     //!< No blending, every frame shows the latest effect.
+	INTERPOLATION_LINEAR,
+	INTERPOLATION_EASE_OUT,                 //!< Fast start, slow end.
+	INTERPOLATION_EASE_IN_OUT,              //!< Smoothstep.
+};
+
+//! The colors of an effect in linear light, 0 to 1, one array per channel. Alpha is not gamma encoded.
+struct alignas(32) RZLinearEffect
+{
+	float R[LINEAR_EFFECT_LANES];
+	float G[LINEAR_EFFECT_LANES];
+	float B[LINEAR_EFFECT_LANES];
+	float A[LINEAR_EFFECT_LANES];
+	BOOL IsAppSpecific;
+};
+
+class CEffectInterpolator
+{
+public:
+	CEffectInterpolator();
+
+	void SetCurve(INTERPOLATION_CURVE curve) { Curve = curve; }
+	INTERPOLATION_CURVE GetCurve() const { return Curve; }
+	void SetMaxTransition(unsigned long long ns) { MaxTransition = ns; }
+
+	//! Starts the transition to effect, received at time in nanoseconds.
+	void Push(const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& effect, unsigned long long time);
+	//! Forgets the effects pushed, the next one is shown at once.
+	void Reset();
+	bool HasEffect() const { return Effects != 0; }
+
+	//! Samples the output at time. Returns false before the first effect.
+	bool Render(unsigned long long time, RZLinearEffect& out) const;
+	bool Render(unsigned long long time, RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& out) const;
+
+	//! sRGB to linear light through a 256 entry table.
+	static void ToLinear(const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& effect, RZLinearEffect& out);
+	//! Linear light to sRGB through a 4096 entry table, rounded to the nearest 8-bit value.
+	static void FromLinear(const RZLinearEffect& effect, RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& out);
+
+private:
+	//! Progress of the transition at time, shaped by the curve, 0 to 1.
+	float Weight(unsigned long long time) const;
+
+	RZLinearEffect From;                    //!< Where the output was when the latest effect arrived.
+	RZLinearEffect To;                      //!< The latest effect.
+	unsigned long long Start;               //!< Arrival of the latest effect.
+	unsigned long long Duration;
+	unsigned long long MaxTransition;
+	unsigned long long Effects;
+	INTERPOLATION_CURVE Curve;
+};
+
+//! Ticks at a fixed rate from a start time, for outputs that refresh at their own pace.
+class CFrameClock
+{
+public:
+	CFrameClock() : Origin(0), Period(0), Tick(0) {}
+
+	void Start(DWORD rateHz, unsigned long long now)
+	{
+		Origin = now;
+		Period = 1000000000ULL / (rateHz ? rateHz : 1);
+		Tick = 0;
+	}
+
+	//! Time of the next tick at or after now. Ticks that passed unused are skipped and counted in skipped.
+	unsigned long long Next(unsigned long long now, unsigned long long& skipped)
+	{
+		unsigned long long due = Origin + Tick * Period;
+		skipped = 0;
+		if (now > due)
+		{
+			unsigned long long late = (now - due + Period - 1) / Period;
+			skipped = late;
+			Tick += late;
+		}
+		return Origin + Tick++ * Period;
+	}
+
+	unsigned long long GetPeriod() const { return Period; }
+
+private:
+	unsigned long long Origin;
+	unsigned long long Period;
+	unsigned long long Tick;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "LedOutput.h"
+
+using namespace RzChromaBroadcastAPI;
+
+CLedOutput::CLedOutput(SIMD_LEVEL level) : Map(level), Correction(level), Dither(level)
+{
+	LightPlanes = { nullptr, nullptr, nullptr };
+	DutyPlanes = { nullptr, nullptr, nullptr };
+}
+
+bool CLedOutput::Reset(int bits)
+{
+	size_t leds = Map.Leds();
+	if (!Dither.Reset(leds, bits))
+		return false;
+
+	Light.assign(3 * leds, 0.0f);
+	Duties.assign(3 * leds, 0);
+	LightPlanes = { Light.data(), Light.data() + leds, Light.data() + 2 * leds };
+	DutyPlanes = { Duties.data(), Duties.data() + leds, Duties.data() + 2 * leds };
+	return true;
+}
+
+bool CLedOutput::RenderDuties(const RZLinearEffect& effect)
+{
+	if (Map.Leds() != Dither.Leds())
+		return false;
+
+	Map.Render(effect, LightPlanes);
+	Correction.Apply(LightPlanes, Map.Leds(), DutyPlanes);
+	return true;
+}
+
+bool CLedOutput::Render(const RZLinearEffect& effect, BYTE* out, bool grb)
+{
+	return RenderDuties(effect) && Dither.Apply(DutyPlanes, out, grb);
+}
+
+bool CLedOutput::Render(const CHROMA_BROADCAST_EFFECT& effect, BYTE* out, bool grb)
+{
+	RZLinearEffect linear;
+	CEffectInterpolator::ToLinear(effect, linear);
+	return Render(linear, out, grb);
+}
+
+bool CLedOutput::Render(const RZLinearEffect& effect, const RZLedPlanes16& out)
+{
+	if (!RenderDuties(effect))
+		return false;
+	Dither.Apply(DutyPlanes, out);
+	return true;
+}
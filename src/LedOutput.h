@@ -0,0 +1,51 @@
+//! \file LedOutput.h
+//! \brief The 16-bit path from an effect to the bytes of an LED device: the zone map renders linear light, the
+//! correction turns it into 16-bit duties and temporal dithering quantizes them to the bit depth of the device, so
+//! the 8-bit steps of RZCOLOR never reach the LEDs.
+
+#ifndef _LEDOUTPUT_H_
+#define _LEDOUTPUT_H_
+
+#pragma once
+
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "Correction.h"
+#include "Dither.h"
+#include "Interpolator.h"
+#include "ZoneMap.h"
+
+class CLedOutput
+{
+public:
+	//! Uses level for every stage when the CPU supports it, else the best supported level.
+	explicit CLedOutput(SIMD_LEVEL level = CSimd::Level());
+
+	CZoneMap& GetMap() { return Map; }
+	COutputCorrection& GetCorrection() { return Correction; }
+	CTemporalDither& GetDither() { return Dither; }
+
+	//! Sizes the planes between the stages for the LEDs of the map and dithers to bits. Call again once the
+	//! layout changed.
+	bool Reset(int bits);
+
+	//! Renders effect into out, 3 bytes per LED, for devices of at most 8 bits. Allocates nothing.
+	bool Render(const RZLinearEffect& effect, BYTE* out, bool grb);
+	bool Render(const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& effect, BYTE* out, bool grb);
+	//! Renders effect into planes of levels, for devices of any depth.
+	bool Render(const RZLinearEffect& effect, const RZLedPlanes16& out);
+
+private:
+	//! Renders up to the duties. False when the layout changed since Reset.
+	bool RenderDuties(const RZLinearEffect& effect);
+
+	CZoneMap Map;
+	COutputCorrection Correction;
+	CTemporalDither Dither;
+	std::vector<float> Light;
+	std::vector<WORD> Duties;
+	RZLedPlanes LightPlanes;
+	RZLedPlanes16 DutyPlanes;
+};
+
+#endif
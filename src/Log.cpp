@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+#include "Log.h"
+
+static FILE* logFile = nullptr;
+
+void OpenLog()
+{
+	std::string InstallPath;
+	if (!CSettings::GetString(RZBROADCAST_REG_SUBKEY, "InstallPath", InstallPath))
+		return;
+
+	std::string Filename = CPlatform::ExecutablePath();
+	if (Filename.empty())
+		return;
+
+	InstallPath = CPlatform::PathJoin(CPlatform::PathJoin(InstallPath, "Logs"), CPlatform::PathStem(Filename) + ".log");
+	logFile = fopen(InstallPath.c_str(), "a");
+}
+
+void CloseLog()
+{
+	if (logFile)
+	{
+		fclose(logFile);
+		logFile = nullptr;
+	}
+}
+
+void Log(unsigned char loglevel, const char *filename, int fileline, const char *format, ...)
+{
+	if (!logFile)
+		return;
+
+	if (loglevel > RZLOGLEVEL_DEBUG)
+		loglevel = RZLOGLEVEL_DEBUG;
+
+	va_list ArgList;
+	va_start(ArgList, format);
+
+	char line[260];
+	vsnprintf(line, sizeof(line), format, ArgList);
+
+	const char* levels[] = { "Fatal", "Error", "Warn", "Info", "Debug" };
+
+	fprintf(logFile, "[%s][%s][%s:%d]%s\n", CPlatform::LocalTime().c_str(), levels[loglevel], filename, fileline, line);
+
+	va_end(ArgList);
+}
+
+static RZSTATUS lastLogStatus = BROADCAST_SUCCESS;
+void SetBroadcastLog(RZSTATUS value)
+{
+	if (lastLogStatus == value)
+		return;
+
+	switch (value)
+	{
+	case BROADCAST_SUCCESS: Log(RZLOGLEVEL_INFO, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_SUCCESS", __FUNCTION__); break;
+	case CHROMA_DEVICE_NOT_FOUND: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status CHROMA_DEVICE_NOT_FOUND", __FUNCTION__); break;
+	case SYNAPSE3_NOT_INSTALLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_INSTALLED", __FUNCTION__); break;
+	case SYNAPSE3_NOT_RUNNING: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_RUNNING", __FUNCTION__); break;
+	case SYNAPSE3_NOT_ONLINE: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status SYNAPSE3_NOT_ONLINE", __FUNCTION__); break;
+	case BROADCAST_DISABLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DISABLED", __FUNCTION__); break;
+	case BROADCAST_APP_DISABLED: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_APP_DISABLED", __FUNCTION__); break;
+	case BROADCAST_MODULE_NOT_FOUND: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_MODULE_NOT_FOUND", __FUNCTION__); break;
+	case BROADCAST_DATA_NULL: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DATA_NULL", "SetBroadcastLog"); break;
+	case BROADCAST_DATA_INIT_SUCCESS: Log(RZLOGLEVEL_WARN, __FILE__, __LINE__, "[ChromaBroadcastAPI]%s returns status BROADCAST_DATA_INIT_SUCCESS", __FUNCTION__); break;
+	}
+
+	lastLogStatus = value;
+}
@@ -0,0 +1,41 @@
+//! \file Log.h
+//! \brief Log file of the host process and the broadcast status it reports.
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#pragma once
+
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <RzChromaBroadcastAPITypes.h>
+
+#define RZLOGLEVEL_FATAL 0
+#define RZLOGLEVEL_ERROR 1
+#define RZLOGLEVEL_WARN 2
+#define RZLOGLEVEL_INFO 3
+#define RZLOGLEVEL_DEBUG 4
+
+#define BROADCAST_SUCCESS 0
+#define CHROMA_DEVICE_NOT_FOUND 1
+#define SYNAPSE3_NOT_INSTALLED 2
+#define SYNAPSE3_NOT_RUNNING 3
+#define SYNAPSE3_NOT_ONLINE 4
+#define BROADCAST_DISABLED 5
+#define BROADCAST_APP_DISABLED 6
+#define BROADCAST_MODULE_NOT_FOUND 7
+#define BROADCAST_DATA_NULL 8
+#define BROADCAST_DATA_INIT_SUCCESS 9
+
+//! Opens <InstallPath>/Logs/<process name>.log when the broadcast module is installed.
+void OpenLog();
+void CloseLog();
+
+void Log(unsigned char loglevel, const char *filename, int fileline, const char *format, ...);
+
+//! Logs a status once, until it changes.
+void SetBroadcastLog(RZSTATUS value);
+
+#endif
@@ -0,0 +1,128 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "Metrics.h"
+
+using namespace RzChromaBroadcastAPI;
+
+CMetricsShard CBroadcastMetrics::LocalShards[METRICS_SHARD_COUNT];
+CMetricsShard* CBroadcastMetrics::Shards = CBroadcastMetrics::LocalShards;
+RZMetricsPage* CBroadcastMetrics::Page = nullptr;
+CSharedMemory* CBroadcastMetrics::PageMemory = nullptr;
+
+unsigned int CMetricsShard::Bucket(unsigned long long us)
+{
+	if (!us)
+		return 0;
+
+#ifdef _MSC_VER
+	unsigned long msb;
+#ifdef _WIN64
+	_BitScanReverse64(&msb, us);
+#else
+	if (us >> 32)
+	{
+		_BitScanReverse(&msb, (unsigned long)(us >> 32));
+		msb += 32;
+	}
+	else
+		_BitScanReverse(&msb, (unsigned long)us);
+#endif
+#else
+	unsigned int msb = 63 - __builtin_clzll(us);
+#endif
+
+	unsigned int bucket = msb + 1;
+	return bucket < CHROMA_BROADCAST_METRICS_BUCKETS ? bucket : CHROMA_BROADCAST_METRICS_BUCKETS - 1;
+}
+
+void CBroadcastMetrics::Snapshot(const CMetricsShard* shards, DWORD count, CHROMA_BROADCAST_METRICS& metrics)
+{
+	memset(&metrics, 0, sizeof(metrics));
+
+	ULONGLONG* counters[METRIC_COUNTER_COUNT] =
+	{
+		&metrics.FramesRead,
+		&metrics.FramesDelivered,
+		&metrics.FramesDeduped,
+		&metrics.FramesDropped,
+		&metrics.FramesFiltered,
+		&metrics.HealthChecks,
+		&metrics.StatusTransitions,
+	};
+
+	for (DWORD s = 0; s < count; s++)
+	{
+		const CMetricsShard& shard = shards[s];
+
+		for (int i = 0; i < METRIC_COUNTER_COUNT; i++)
+			*counters[i] += shard.Counters[i].load(std::memory_order_relaxed);
+
+		for (int i = 0; i < CHROMA_BROADCAST_METRICS_BUCKETS; i++)
+		{
+			metrics.CallbackTime[i] += shard.CallbackTime[i].load(std::memory_order_relaxed);
+			metrics.Latency[i] += shard.Latency[i].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool CBroadcastMetrics::Publish()
+{
+	if (Page)
+		return true;
+
+	char name[128];
+	DWORD pid = CPlatform::ProcessId();
+	snprintf(name, sizeof(name), RZBROADCAST_METRICS_SHARED_MEMORY, (unsigned long)pid);
+	// Allocated rather than static: Publish and Unpublish run from the module constructor and destructor
+	PageMemory = new CSharedMemory();
+	if (!PageMemory->Open(name, sizeof(RZMetricsPage), SHARED_MEMORY_CREATE, SHARED_MEMORY_GLOBAL_OR_SESSION))
+	{
+		delete PageMemory;
+		PageMemory = nullptr;
+		return false;
+	}
+
+	void* mem = PageMemory->Data();
+	Page = new (mem) RZMetricsPage();
+	Page->Header.Version = RZBROADCAST_METRICS_VERSION;
+	Page->Header.ProcessId = pid;
+	Page->Header.ShardCount = METRICS_SHARD_COUNT;
+
+	// Readers check the magic last, so they never see a half initialised header
+	std::atomic_thread_fence(std::memory_order_release);
+	Page->Header.Magic = RZBROADCAST_METRICS_MAGIC;
+	Shards = Page->Shards;
+	return true;
+}
+
+void CBroadcastMetrics::Unpublish()
+{
+	if (!Page)
+		return;
+
+	Shards = LocalShards;
+	Page->Header.Magic = 0;
+
+	delete PageMemory;
+	PageMemory = nullptr;
+	Page = nullptr;
+}
+
+void CBroadcastMetrics::SetTitle(const std::string& title)
+{
+	if (!Page)
+		return;
+
+	size_t len = title.size() < sizeof(Page->Header.Title) - 1 ? title.size() : sizeof(Page->Header.Title) - 1;
+	memcpy(Page->Header.Title, title.c_str(), len);
+	Page->Header.Title[len] = 0;
+}
+
+unsigned long long CBroadcastMetrics::Now()
+{
+	return CPlatform::Now() / 1000ULL;
+}
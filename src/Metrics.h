@@ -0,0 +1,118 @@
+//! \file Metrics.h
+//! \brief Lock-free pipeline counters and histograms.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <RzChromaBroadcastAPITypes.h>
+#include "Platform.h"
+
+enum METRICS_COUNTER
+{
+	METRIC_FRAMES_READ,
+	METRIC_FRAMES_DELIVERED,
+	METRIC_FRAMES_DEDUPED,
+	METRIC_FRAMES_DROPPED,
+	METRIC_FRAMES_FILTERED,
+	METRIC_HEALTH_CHECKS,
+	METRIC_STATUS_TRANSITIONS,
+	METRIC_COUNTER_COUNT
+};
+
+//! One shard per worker thread, so every counter has a single writer.
+enum METRICS_SHARD
+{
+	METRICS_SHARD_BROADCAST,
+	METRICS_SHARD_MONITOR,
+	METRICS_SHARD_OUTPUT,                   //!< The first of the OUTPUT_MAX_WORKERS output workers.
+	METRICS_SHARD_COUNT = METRICS_SHARD_OUTPUT + 4
+};
+
+struct alignas(64) CMetricsShard
+{
+	std::atomic<unsigned long long> Counters[METRIC_COUNTER_COUNT];
+	std::atomic<unsigned long long> CallbackTime[RzChromaBroadcastAPI::CHROMA_BROADCAST_METRICS_BUCKETS];
+	std::atomic<unsigned long long> Latency[RzChromaBroadcastAPI::CHROMA_BROADCAST_METRICS_BUCKETS];
+
+	// Only the owning thread writes a shard, a relaxed load/store pair is enough and avoids a locked add.
+	void Add(METRICS_COUNTER counter, unsigned long long value = 1)
+	{
+		Counters[counter].store(Counters[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	void AddCallbackTime(unsigned long long us)
+	{
+		auto& bucket = CallbackTime[Bucket(us)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void AddLatency(unsigned long long us)
+	{
+		auto& bucket = Latency[Bucket(us)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	static unsigned int Bucket(unsigned long long us);
+};
+
+//! Name of the per process metrics page, formatted with the process id.
+const char RZBROADCAST_METRICS_SHARED_MEMORY[] = "{3F6C2B8E-7A41-4D9B-9E25-C0D1A7B4E862}-%lu";
+const DWORD RZBROADCAST_METRICS_MAGIC = 0x504D5A52; // "RZMP"
+//! 2 added the output worker shards. The shards keep their layout, readers size the page from Header.ShardCount.
+const DWORD RZBROADCAST_METRICS_VERSION = 2;
+
+struct RZMetricsPageHeader
+{
+	DWORD Magic;
+	DWORD Version;
+	DWORD ProcessId;
+	DWORD ShardCount;
+	char Title[48];
+};
+
+//! Layout of the shared metrics page. The host writes the shards in place, monitoring tools map it read only.
+struct RZMetricsPage
+{
+	RZMetricsPageHeader Header;
+	CMetricsShard Shards[METRICS_SHARD_COUNT];
+};
+
+//! Bytes of a page holding shards shards, fewer than METRICS_SHARD_COUNT in pages of older versions.
+inline size_t MetricsPageSize(DWORD shards)
+{
+	return sizeof(RZMetricsPage) - sizeof(RZMetricsPage::Shards) + shards * sizeof(CMetricsShard);
+}
+
+class CBroadcastMetrics
+{
+public:
+	static CMetricsShard& Shard(METRICS_SHARD shard) { return Shards[shard]; }
+
+	//! Sums all shards into a POD snapshot. Readers never block the writers.
+	static void Snapshot(RzChromaBroadcastAPI::CHROMA_BROADCAST_METRICS& metrics) { Snapshot(Shards, METRICS_SHARD_COUNT, metrics); }
+	static void Snapshot(const CMetricsShard* shards, DWORD count, RzChromaBroadcastAPI::CHROMA_BROADCAST_METRICS& metrics);
+
+	//! Moves the shards into a named shared memory page so external tools can scrape them.
+	//! Must run before the worker threads start; on failure the in-process shards stay in use.
+	static bool Publish();
+	static void Unpublish();
+	static void SetTitle(const std::string& title);
+
+	//! Monotonic clock in microseconds used for the callback time histogram.
+	static unsigned long long Now();
+
+private:
+	static CMetricsShard LocalShards[METRICS_SHARD_COUNT];
+	static CMetricsShard* Shards;
+	static RZMetricsPage* Page;
+	static CSharedMemory* PageMemory;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "OutputScheduler.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Longest wait of a worker without a sink to write.
+static const DWORD OUTPUT_IDLE_WAIT = 100;
+//! Waits shorter than this sleep instead of waiting for a new frame.
+static const unsigned long long OUTPUT_SLEEP_BELOW = 2000000;
+//! The cost follows the writes by an eighth of the difference each.
+static const unsigned long long OUTPUT_COST_WEIGHT = 8;
+
+//! The scheduler and the worker running on this thread, if it is one.
+static thread_local const COutputScheduler* ThreadScheduler = nullptr;
+static thread_local size_t ThreadWorker = OUTPUT_MAX_WORKERS;
+
+COutputScheduler::COutputScheduler()
+{
+}
+
+COutputScheduler::~COutputScheduler()
+{
+	Close();
+}
+
+RZOutputConfig COutputScheduler::Defaults()
+{
+	RZOutputConfig config;
+	config.Workers = 2;
+	config.MaxSinks = 32;
+	return config;
+}
+
+bool COutputScheduler::Open(const RZOutputConfig& config, std::string& error)
+{
+	Close();
+	if (!config.Workers || config.Workers > OUTPUT_MAX_WORKERS)
+	{
+		error = "An output scheduler takes 1 to " + std::to_string(OUTPUT_MAX_WORKERS) + " workers";
+		return false;
+	}
+	if (!config.MaxSinks)
+	{
+		error = "An output scheduler needs a sink at least";
+		return false;
+	}
+
+	Sinks.assign(config.MaxSinks, RZOutputSink());
+	Halt.Reset();
+	Wake.Reset();
+	for (DWORD i = 0; i < config.Workers; i++)
+	{
+		RZOutputWorker* worker = new RZOutputWorker();
+		worker->Scheduler = this;
+		worker->Index = i;
+		if (!worker->Thread.Start(Run, worker))
+		{
+			delete worker;
+			Close();
+			error = "Failed to start the output workers";
+			return false;
+		}
+		Workers.push_back(worker);
+	}
+	return true;
+}
+
+void COutputScheduler::Stop()
+{
+	Halt.Set();
+	Wake.Set();
+}
+
+void COutputScheduler::Close()
+{
+	// A worker cannot join itself, the next Close from another thread does
+	Stop();
+	if (IsWorker())
+		return;
+	for (RZOutputWorker* worker : Workers)
+	{
+		worker->Thread.Join(INFINITE);
+		delete worker;
+	}
+	Workers.clear();
+	Sinks.clear();
+}
+
+bool COutputScheduler::IsWorker() const
+{
+	return CurrentWorker() < OUTPUT_MAX_WORKERS;
+}
+
+size_t COutputScheduler::CurrentWorker() const
+{
+	return ThreadScheduler == this ? ThreadWorker : OUTPUT_MAX_WORKERS;
+}
+
+int COutputScheduler::Add(const RZOutputSinkConfig& config)
+{
+	if (!config.Write)
+		return -1;
+
+	int found = -1;
+	Lock.Enter();
+	for (size_t i = 0; i < Sinks.size() && found < 0; i++)
+	{
+		// A sink removed from its own write is still busy with it
+		RZOutputSink& sink = Sinks[i];
+		if (sink.Used || sink.Busy)
+			continue;
+		memset(&sink, 0, sizeof(sink));
+		sink.Config = config;
+		sink.Used = true;
+		sink.Status = NOT_LIVE;
+		found = (int)i;
+	}
+	Lock.Leave();
+	return found;
+}
+
+void COutputScheduler::Remove(int sink)
+{
+	if (sink < 0 || (size_t)sink >= Sinks.size())
+		return;
+
+	Lock.Enter();
+	Sinks[sink].Used = false;
+	Sinks[sink].Count = 0;
+	Lock.Leave();
+	Wait(sink);
+}
+
+void COutputScheduler::Wait(int sink)
+{
+	if (sink < 0 || (size_t)sink >= Sinks.size())
+		return;
+
+	size_t current = CurrentWorker();
+	for (;;)
+	{
+		Lock.Enter();
+		bool busy = Sinks[sink].Busy && Sinks[sink].Writer != current;
+		Lock.Leave();
+		if (!busy)
+			return;
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+void COutputScheduler::Queue(RZOutputSink& sink, const RZOutputEntry& entry)
+{
+	if (entry.HasFrame && sink.Count)
+	{
+		RZOutputEntry& last = sink.Entries[(sink.First + sink.Count - 1) % OUTPUT_SINK_DEPTH];
+		if (last.HasFrame)
+		{
+			last = entry;
+			sink.Stats.Skipped++;
+			return;
+		}
+	}
+	// Only an output stuck in a write through many status changes fills up, the oldest entry goes
+	if (sink.Count == OUTPUT_SINK_DEPTH)
+	{
+		sink.Stats.Skipped += sink.Entries[sink.First].HasFrame ? 1 : 0;
+		sink.First = (sink.First + 1) % OUTPUT_SINK_DEPTH;
+		sink.Count--;
+	}
+	sink.Entries[(sink.First + sink.Count) % OUTPUT_SINK_DEPTH] = entry;
+	sink.Count++;
+}
+
+bool COutputScheduler::Submit(int sink, const RZEventData& frame, unsigned long long now)
+{
+	if (sink < 0 || (size_t)sink >= Sinks.size())
+		return false;
+
+	Lock.Enter();
+	RZOutputSink& state = Sinks[sink];
+	bool used = state.Used;
+	if (used)
+	{
+		RZOutputEntry entry;
+		entry.HasFrame = true;
+		entry.Status = state.Status;
+		entry.Deadline = now + state.Config.Deadline * 1000ULL;
+		entry.Submitted = now;
+		entry.Frame = frame;
+		state.Stats.Submitted++;
+		Queue(state, entry);
+	}
+	Lock.Leave();
+	if (used)
+		Wake.Set();
+	return used;
+}
+
+bool COutputScheduler::SubmitStatus(int sink, CHROMA_BROADCAST_STATUS status, unsigned long long now)
+{
+	if (sink < 0 || (size_t)sink >= Sinks.size())
+		return false;
+
+	Lock.Enter();
+	RZOutputSink& state = Sinks[sink];
+	bool used = state.Used;
+	if (used)
+	{
+		RZOutputEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.Status = (BYTE)status;
+		entry.Submitted = now;
+		state.Status = (BYTE)status;
+		Queue(state, entry);
+	}
+	Lock.Leave();
+	if (used)
+		Wake.Set();
+	return used;
+}
+
+bool COutputScheduler::GetStats(int sink, RZOutputSinkStats& stats)
+{
+	if (sink < 0 || (size_t)sink >= Sinks.size())
+		return false;
+
+	Lock.Enter();
+	bool used = Sinks[sink].Used;
+	stats = Sinks[sink].Stats;
+	stats.Queued = Sinks[sink].Count;
+	Lock.Leave();
+	return used;
+}
+
+unsigned long long COutputScheduler::ReadyAt(const RZOutputSink& sink) const
+{
+	if (!sink.Used || sink.Busy || !sink.Count)
+		return 0;
+	// Status changes go at once, frames when the output takes them
+	const RZOutputEntry& head = sink.Entries[sink.First];
+	return head.HasFrame ? std::max(sink.NextStart, 1ULL) : 1;
+}
+
+unsigned long long COutputScheduler::StartBy(const RZOutputSink& sink) const
+{
+	const RZOutputEntry& head = sink.Entries[sink.First];
+	if (!head.HasFrame)
+		return head.Submitted;
+	return head.Deadline > sink.Stats.Cost ? head.Deadline - sink.Stats.Cost : 0;
+}
+
+DWORD COutputScheduler::Run(void* self)
+{
+	RZOutputWorker& worker = *(RZOutputWorker*)self;
+	worker.Scheduler->Loop(worker.Index);
+	return 0;
+}
+
+void COutputScheduler::Loop(size_t worker)
+{
+	ThreadScheduler = this;
+	ThreadWorker = worker;
+	while (!Halt.IsSet())
+	{
+		// Reset before looking at the sinks, a frame submitted from here on wakes the next wait
+		Wake.Reset();
+		unsigned long long now = CPlatform::Now();
+		unsigned long long wake = 0;
+		size_t ready = 0;
+		RZOutputSink* pick = nullptr;
+		RZOutputEntry entry;
+		Lock.Enter();
+		for (RZOutputSink& sink : Sinks)
+		{
+			unsigned long long at = ReadyAt(sink);
+			if (!at)
+				continue;
+			if (at > now)
+			{
+				if (!wake || at < wake)
+					wake = at;
+				continue;
+			}
+			ready++;
+			if (!pick || StartBy(sink) < StartBy(*pick))
+				pick = &sink;
+		}
+		if (pick)
+		{
+			entry = pick->Entries[pick->First];
+			pick->First = (pick->First + 1) % OUTPUT_SINK_DEPTH;
+			pick->Count--;
+			pick->Busy = true;
+			pick->Writer = worker;
+			if (entry.HasFrame)
+				pick->NextStart = now + pick->Config.MinInterval * 1000ULL;
+		}
+		Lock.Leave();
+
+		if (!pick)
+		{
+			now = CPlatform::Now();
+			if (wake && wake <= now)
+				continue;
+			if (wake && wake - now < OUTPUT_SLEEP_BELOW)
+				std::this_thread::sleep_for(std::chrono::nanoseconds(wake - now));
+			else
+				Wake.Wait(wake ? (DWORD)((wake - now) / 1000000) : OUTPUT_IDLE_WAIT);
+			continue;
+		}
+		// The other sinks ready go to the other workers
+		if (ready > 1)
+			Wake.Set();
+
+		// The config stays while the sink is busy, Add skips it even once removed
+		unsigned long long start = CPlatform::Now();
+		pick->Config.Write(entry.HasFrame ? &entry.Frame : nullptr, (CHROMA_BROADCAST_STATUS)entry.Status, pick->Config.User, worker);
+		unsigned long long end = CPlatform::Now();
+
+		Lock.Enter();
+		RZOutputSinkStats& stats = pick->Stats;
+		if (pick->Used && entry.HasFrame)
+		{
+			unsigned long long cost = end - start;
+			stats.Written++;
+			stats.Misses += end > entry.Deadline ? 1 : 0;
+			stats.Cost = stats.Written == 1 ? cost : stats.Cost - stats.Cost / OUTPUT_COST_WEIGHT + cost / OUTPUT_COST_WEIGHT;
+			stats.MaxCost = std::max(stats.MaxCost, cost);
+		}
+		else if (pick->Used)
+			stats.Statuses++;
+		pick->Busy = false;
+		Lock.Leave();
+	}
+}
@@ -0,0 +1,139 @@
+//! \file OutputScheduler.h
+//! \brief Writes frames to several outputs, USB devices, DMX or WLED controllers or the callbacks of the contexts,
+//! from a small pool of worker threads, so a slow output no longer holds back the others the way writing them one
+//! after another in a fixed order does. Every frame submitted to a sink must be written by its deadline. The worker
+//! that frees up takes the sink whose frame must start soonest, its deadline less the time its writes have been
+//! taking, earliest deadline first. A sink that is still writing when newer frames arrive skips the stale ones and
+//! writes only the latest, so it lags by at most one frame, and a write that ends past its deadline counts as a miss.
+//!
+//! Status changes are written in order with the frames and are never skipped.
+
+#ifndef _OUTPUTSCHEDULER_H_
+#define _OUTPUTSCHEDULER_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+const size_t OUTPUT_MAX_WORKERS = 4;
+//! Frames and status changes a sink holds, a frame replaces one not started yet.
+const size_t OUTPUT_SINK_DEPTH = 8;
+
+//! Writes a frame, or only a change of the status when frame is null, on worker worker of the pool.
+typedef void (*OUTPUT_WRITE_CALLBACK)(const RZEventData* frame, RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status, void* user, size_t worker);
+
+struct RZOutputConfig
+{
+	DWORD Workers;                          //!< 1 to OUTPUT_MAX_WORKERS.
+	DWORD MaxSinks;
+};
+
+struct RZOutputSinkConfig
+{
+	OUTPUT_WRITE_CALLBACK Write;
+	void* User;
+	DWORD Deadline;                         //!< Microseconds from its submission a frame must be written in.
+	DWORD MinInterval;                      //!< Microseconds between two frames the output takes, 0 for no limit.
+};
+
+struct RZOutputSinkStats
+{
+	unsigned long long Submitted;           //!< Frames submitted.
+	unsigned long long Written;             //!< Frames written.
+	unsigned long long Skipped;             //!< Frames replaced by a newer one before their write started.
+	unsigned long long Misses;              //!< Frames written after their deadline.
+	unsigned long long Statuses;            //!< Status changes written.
+	unsigned long long Cost;                //!< Nanoseconds a write has been taking, a moving average.
+	unsigned long long MaxCost;             //!< Nanoseconds of the longest write.
+	size_t Queued;
+};
+
+//! Add, Remove, Submit and GetStats are for any thread. Submit allocates nothing.
+class COutputScheduler
+{
+public:
+	COutputScheduler();
+	~COutputScheduler();
+
+	//! 2 workers and 32 sinks.
+	static RZOutputConfig Defaults();
+
+	bool Open(const RZOutputConfig& config, std::string& error);
+	//! Tells the workers to exit after the write they are in, for a worker stopping the pool from a write.
+	void Stop();
+	//! Stops and joins the workers, the sinks are gone.
+	void Close();
+	bool IsOpen() const { return !Workers.empty(); }
+	//! True when called from one of the workers.
+	bool IsWorker() const;
+
+	//! Returns the sink, -1 when MaxSinks are taken.
+	int Add(const RZOutputSinkConfig& config);
+	//! Drops what sink holds and waits for a write of it in flight, unless called from that write.
+	void Remove(int sink);
+	//! Waits for a write of sink in flight, unless called from that write.
+	void Wait(int sink);
+
+	//! Queues frame, submitted at now on CPlatform::Now(), for sink.
+	bool Submit(int sink, const RZEventData& frame, unsigned long long now);
+	//! Queues a change of the status behind the frames of sink.
+	bool SubmitStatus(int sink, RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status, unsigned long long now);
+
+	bool GetStats(int sink, RZOutputSinkStats& stats);
+
+private:
+	COutputScheduler(const COutputScheduler&) = delete;
+	COutputScheduler& operator=(const COutputScheduler&) = delete;
+
+	struct RZOutputEntry
+	{
+		bool HasFrame;
+		BYTE Status;
+		unsigned long long Deadline;        //!< Frames only, when it must be written by.
+		unsigned long long Submitted;
+		RZEventData Frame;
+	};
+
+	struct RZOutputSink
+	{
+		RZOutputSinkConfig Config;
+		bool Used;
+		bool Busy;                          //!< A worker is writing it.
+		size_t Writer;                      //!< The worker writing it.
+		BYTE Status;                        //!< Last submitted, passed along with the frames.
+		RZOutputEntry Entries[OUTPUT_SINK_DEPTH];
+		size_t First;
+		size_t Count;
+		unsigned long long NextStart;       //!< When the output takes its next frame.
+		RZOutputSinkStats Stats;
+	};
+
+	struct RZOutputWorker
+	{
+		COutputScheduler* Scheduler;
+		size_t Index;
+		CThread Thread;
+	};
+
+	static DWORD Run(void* self);
+	void Loop(size_t worker);
+	//! Queues entry for sink, replacing a frame not started yet with a frame. Called with Lock held.
+	void Queue(RZOutputSink& sink, const RZOutputEntry& entry);
+	//! When the head of sink can start, 0 when it is empty or being written. Called with Lock held.
+	unsigned long long ReadyAt(const RZOutputSink& sink) const;
+	//! Latest time the head of sink can start and still make its deadline. Called with Lock held.
+	unsigned long long StartBy(const RZOutputSink& sink) const;
+	//! The worker running on this thread, OUTPUT_MAX_WORKERS for none.
+	size_t CurrentWorker() const;
+
+	std::vector<RZOutputWorker*> Workers;
+	CEvent Halt;
+	CEvent Wake;
+	CLock Lock;                             //!< Guards the sinks.
+	std::vector<RZOutputSink> Sinks;        //!< Sized at Open.
+};
+
+#endif
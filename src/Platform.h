@@ -0,0 +1,363 @@
+//! \file Platform.h
+//! \brief Thin operating system layer: shared memory, events, locks, threads, UDP sockets, settings and clocks.
+//!
+//! Object names are given without a namespace prefix ("{GUID}"). On Windows they resolve to
+//! Global\ objects (Local\ for the shared memory of this DLL when Global cannot be created, see SHARED_MEMORY_SCOPE),
+//! on POSIX to shm objects "/{GUID}".
+
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <atomic>
+#include <string>
+#include <vector>
+#include <RzChromaBroadcastAPITypes.h>
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+
+enum SHARED_MEMORY_ACCESS
+{
+	SHARED_MEMORY_OPEN_OR_CREATE,   //!< Maps an existing object, or creates a zeroed one.
+	SHARED_MEMORY_CREATE,           //!< Creates an object owned by this process, its name is removed when closed. An existing object is mapped but not owned.
+	SHARED_MEMORY_READ_ONLY,        //!< Maps an existing object read only.
+	SHARED_MEMORY_OPEN_EXISTING,    //!< Maps an existing object read write, fails when there is none.
+};
+
+//! Namespaces a shared memory object is looked for and created in on Windows. POSIX has a single one.
+enum SHARED_MEMORY_SCOPE
+{
+	SHARED_MEMORY_GLOBAL,           //!< Global only, for the objects of Synapse: a session copy is one Synapse never writes.
+	SHARED_MEMORY_GLOBAL_OR_SESSION,//!< Global, else the session namespace when creating Global objects needs a privilege the process lacks. For the objects of this DLL.
+};
+
+class CSharedMemory
+{
+public:
+	CSharedMemory();
+	~CSharedMemory();
+
+	bool Open(const char* name, size_t size, SHARED_MEMORY_ACCESS access, SHARED_MEMORY_SCOPE scope = SHARED_MEMORY_GLOBAL);
+	void Close();
+
+	void* Data() const { return Mem; }
+	size_t Size() const { return Length; }
+	//! True when Open created the object rather than mapping an existing one.
+	bool Created() const { return IsCreated; }
+
+private:
+	CSharedMemory(const CSharedMemory&) = delete;
+	CSharedMemory& operator=(const CSharedMemory&) = delete;
+
+	void* Mem;
+	size_t Length;
+	bool IsCreated;
+#ifdef _WIN32
+	HANDLE File;
+#else
+	std::string Name;
+	bool Owner;
+#endif
+};
+
+//! A file mapped into memory. Writers create it and grow it by remapping, Close trims it to the
+//! bytes actually used.
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	//! Creates or truncates the file and maps size bytes of it read write.
+	bool Create(const char* path, size_t size);
+	//! Maps the whole of an existing file read only.
+	bool OpenReadOnly(const char* path);
+	//! Grows the file and the mapping of a created file, Data() may move.
+	bool Resize(size_t size);
+	//! Unmaps the file, a created file is truncated to length. Returns false when it could not be
+	//! truncated, it then keeps its mapped size.
+	bool Close(size_t length = 0);
+
+	void* Data() const { return Mem; }
+	size_t Size() const { return Length; }
+
+private:
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	bool Map(bool writable);
+
+	void* Mem;
+	size_t Length;
+	bool Writable;
+#ifdef _WIN32
+	HANDLE File;
+	HANDLE Mapping;
+#else
+	int File;
+#endif
+};
+
+//! Process local manual reset event, used to cancel waits.
+class CEvent
+{
+public:
+	CEvent();
+	~CEvent();
+
+	void Set();
+	void Reset();
+	bool IsSet() const;
+	//! Returns true when the event is set, false on timeout.
+	bool Wait(DWORD milliseconds);
+
+private:
+	CEvent(const CEvent&) = delete;
+	CEvent& operator=(const CEvent&) = delete;
+
+	friend class CNamedEvent;
+#ifdef _WIN32
+	HANDLE Event;
+#else
+	std::atomic<unsigned int> Signaled;
+	//! Futex of the named event a thread is waiting on with this event as cancellation.
+	std::atomic<std::atomic<unsigned int>*> WakeTarget;
+#endif
+};
+
+enum WAIT_RESULT
+{
+	WAIT_RESULT_SIGNALED,
+	WAIT_RESULT_CANCELLED,
+	WAIT_RESULT_TIMEOUT,
+	WAIT_RESULT_FAILED,
+};
+
+//! Manual reset event shared between processes by name.
+class CNamedEvent
+{
+public:
+	CNamedEvent();
+	~CNamedEvent();
+
+	//! Opens the event, creating it when no other process has. access follows CSharedMemory:
+	//! SHARED_MEMORY_CREATE removes the name when closed, SHARED_MEMORY_OPEN_EXISTING never creates.
+	bool Open(const char* name, SHARED_MEMORY_ACCESS access = SHARED_MEMORY_OPEN_OR_CREATE);
+	void Close();
+	bool IsOpen() const;
+
+	void Set();
+	void Reset();
+
+	//! Waits for the event. Returns WAIT_RESULT_CANCELLED as soon as cancel is set.
+	WAIT_RESULT Wait(DWORD milliseconds, CEvent* cancel = nullptr);
+
+	//! Pulses an event only if another process created it.
+	static void Pulse(const char* name);
+
+private:
+	CNamedEvent(const CNamedEvent&) = delete;
+	CNamedEvent& operator=(const CNamedEvent&) = delete;
+
+#ifdef _WIN32
+	HANDLE Event;
+#else
+	CSharedMemory Memory;
+#endif
+};
+
+//! Named mutex whose existence tells other processes its owner is running.
+class CNamedMutex
+{
+public:
+	CNamedMutex();
+	~CNamedMutex();
+
+	bool Create(const char* name);
+	void Close();
+
+	static bool Exists(const char* name);
+
+private:
+	CNamedMutex(const CNamedMutex&) = delete;
+	CNamedMutex& operator=(const CNamedMutex&) = delete;
+
+#ifdef _WIN32
+	HANDLE Mutex;
+#else
+	CSharedMemory Memory;
+#endif
+};
+
+//! Recursive lock, a CRITICAL_SECTION on Windows.
+class CLock
+{
+public:
+	CLock();
+	~CLock();
+
+	void Enter();
+	bool TryEnter();
+	void Leave();
+
+private:
+	CLock(const CLock&) = delete;
+	CLock& operator=(const CLock&) = delete;
+
+#ifdef _WIN32
+	CRITICAL_SECTION Critical;
+#else
+	pthread_mutex_t Mutex;
+#endif
+};
+
+typedef DWORD(*THREAD_ROUTINE)(void* parameter);
+
+class CThread
+{
+public:
+	CThread();
+	~CThread();
+
+	bool Start(THREAD_ROUTINE routine, void* parameter = nullptr);
+	//! Waits for the thread to exit. On timeout, or when called from the thread itself (UnInit
+	//! from a callback), the thread is left running and released.
+	bool Join(DWORD milliseconds);
+	bool IsStarted() const { return Started; }
+	//! True when called from the thread itself.
+	bool IsCurrent() const;
+
+private:
+	CThread(const CThread&) = delete;
+	CThread& operator=(const CThread&) = delete;
+
+	THREAD_ROUTINE Routine;
+	void* Parameter;
+	bool Started;
+	CEvent Finished;
+#ifdef _WIN32
+	HANDLE Thread;
+	static DWORD WINAPI Trampoline(LPVOID self);
+#else
+	pthread_t Thread;
+	static void* Trampoline(void* self);
+#endif
+};
+
+//! IPv4 address and port, in host byte order.
+struct RZNetAddress
+{
+	DWORD Ip;
+	WORD Port;
+};
+
+//! Most parts a datagram is gathered from.
+const size_t DATAGRAM_MAX_PARTS = 3;
+
+//! A datagram gathered from its parts where they are, a prebuilt header and a slice of a frame for example.
+struct RZDatagram
+{
+	RZNetAddress To;
+	size_t Parts;
+	const void* Data[DATAGRAM_MAX_PARTS];
+	size_t Size[DATAGRAM_MAX_PARTS];
+};
+
+//! Blocking IPv4 UDP socket.
+class CUdpSocket
+{
+public:
+	CUdpSocket();
+	~CUdpSocket();
+
+	//! Binds to port on ip, 0 for any port or any interface.
+	bool Open(WORD port = 0, DWORD ip = 0);
+	void Close();
+	bool IsOpen() const;
+	//! Port bound, the one the system picked when Open got 0.
+	WORD Port() const;
+
+	bool SetBroadcast(bool enabled);
+	//! Sizes the send and receive buffers of the kernel, 0 keeps one. Bursts of packets need more than the default.
+	bool SetBuffers(size_t send, size_t receive);
+	//! Receives the datagrams sent to the multicast address group.
+	bool JoinGroup(DWORD group);
+
+	//! Sends count datagrams, in batches of one sendmmsg call where the system has it. Returns how many were
+	//! sent, the ones after failed. Allocates nothing.
+	size_t Send(const RZDatagram* datagrams, size_t count);
+	//! Waits up to milliseconds for a datagram and receives it into buffer. Returns its size, 0 on timeout and -1
+	//! on failure.
+	int Receive(void* buffer, size_t size, DWORD milliseconds, RZNetAddress* from = nullptr);
+
+	//! Parses a dotted IPv4 address.
+	static bool ParseAddress(const char* text, DWORD& ip);
+
+private:
+	CUdpSocket(const CUdpSocket&) = delete;
+	CUdpSocket& operator=(const CUdpSocket&) = delete;
+
+#ifdef _WIN32
+	UINT_PTR Socket;
+#else
+	int Socket;
+#endif
+};
+
+//! Machine wide settings: HKLM (32 bit view) on Windows, a JSON file on POSIX.
+//! Keys are registry style paths such as "Software\\Razer\\ChromaBroadcast".
+class CSettings
+{
+public:
+	static bool KeyExists(const std::string& key);
+	//! Creates the key when missing, created reports whether it was new.
+	static bool CreateKey(const std::string& key, bool* created = nullptr);
+
+	static bool GetDword(const std::string& key, const char* name, DWORD& value);
+	static bool GetString(const std::string& key, const char* name, std::string& value);
+	static bool SetDword(const std::string& key, const char* name, DWORD value);
+	static bool SetString(const std::string& key, const char* name, const std::string& value);
+
+#ifndef _WIN32
+	//! Path of the settings file: $RZBROADCAST_SETTINGS, else $XDG_CONFIG_HOME or ~/.config /ChromaBroadcast/settings.json.
+	static std::string Path();
+#endif
+};
+
+class CPlatform
+{
+public:
+	//! Milliseconds since boot, wraps like GetTickCount().
+	static DWORD TickCount();
+	//! Monotonic clock in nanoseconds.
+	static unsigned long long Now();
+	//! Sleeps until deadline on Now(), to tens of microseconds where a millisecond wait lands on the next tick.
+	static void SleepUntil(unsigned long long deadline);
+	//! Local wall clock time formatted as "yyyy-MM-dd HH:mm".
+	static std::string LocalTime();
+
+	static DWORD ProcessId();
+	static unsigned long ThreadId();
+	static std::vector<DWORD> ListProcesses();
+	static bool IsProcessAlive(DWORD pid);
+
+	static std::string ExecutablePath();
+	static std::string EnvironmentVariable(const char* name);
+	static bool FileExists(const std::string& path);
+	static std::string PathJoin(const std::string& directory, const std::string& name);
+	static std::string PathStem(const std::string& path);
+
+	//! Whether the named system service is running. POSIX has no service manager: services count
+	//! as running unless the settings key "Services\\<name>" has Running = 0.
+	static bool IsServiceRunning(const char* name);
+};
+
+#endif
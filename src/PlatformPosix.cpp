@@ -0,0 +1,977 @@
+#ifndef _WIN32
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#include <mutex>
+#include "json.hpp"
+#include "BroadcastProtocol.h"
+#include "Platform.h"
+
+static unsigned long long ToNanoseconds(const timespec& ts)
+{
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+//! Sleeps while *word == expected, for at most timeoutNs (0 = forever). shared selects a process shared futex.
+static void FutexWait(std::atomic<unsigned int>* word, unsigned int expected, unsigned long long timeoutNs, bool shared)
+{
+#ifdef __linux__
+	timespec ts;
+	ts.tv_sec = (time_t)(timeoutNs / 1000000000ULL);
+	ts.tv_nsec = (long)(timeoutNs % 1000000000ULL);
+	syscall(SYS_futex, (unsigned int*)word, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected, timeoutNs ? &ts : NULL, NULL, 0);
+#else
+	(void)shared;
+	if (word->load(std::memory_order_acquire) == expected)
+	{
+		timespec ts = { 0, (long)(timeoutNs && timeoutNs < 1000000 ? timeoutNs : 1000000) };
+		nanosleep(&ts, NULL);
+	}
+#endif
+}
+
+static void FutexWakeAll(std::atomic<unsigned int>* word, bool shared)
+{
+#ifdef __linux__
+	syscall(SYS_futex, (unsigned int*)word, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)word;
+	(void)shared;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------
+// CSharedMemory
+
+CSharedMemory::CSharedMemory() : Mem(nullptr), Length(0), IsCreated(false), Owner(false)
+{
+}
+
+CSharedMemory::~CSharedMemory()
+{
+	Close();
+}
+
+bool CSharedMemory::Open(const char* name, size_t size, SHARED_MEMORY_ACCESS access, SHARED_MEMORY_SCOPE scope)
+{
+	Close();
+
+	Name = std::string("/") + name;
+	int fd = -1;
+	if (access == SHARED_MEMORY_READ_ONLY)
+	{
+		fd = shm_open(Name.c_str(), O_RDONLY, 0);
+	}
+	else if (access == SHARED_MEMORY_OPEN_EXISTING)
+	{
+		fd = shm_open(Name.c_str(), O_RDWR, 0);
+	}
+	else
+	{
+		fd = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+		if (fd >= 0)
+		{
+			// Not subject to the umask, other users' readers must be able to map it
+			fchmod(fd, access == SHARED_MEMORY_CREATE ? 0644 : 0666);
+			IsCreated = true;
+		}
+		else if (errno == EEXIST)
+		{
+			fd = shm_open(Name.c_str(), O_RDWR, 0);
+		}
+	}
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < size)
+	{
+		if (access == SHARED_MEMORY_READ_ONLY || access == SHARED_MEMORY_OPEN_EXISTING || ftruncate(fd, size))
+		{
+			close(fd);
+			if (IsCreated)
+				shm_unlink(Name.c_str());
+			IsCreated = false;
+			return false;
+		}
+	}
+
+	void* mem = mmap(NULL, size, access == SHARED_MEMORY_READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		if (IsCreated)
+			shm_unlink(Name.c_str());
+		IsCreated = false;
+		return false;
+	}
+
+	Mem = mem;
+	Length = size;
+	Owner = access == SHARED_MEMORY_CREATE && IsCreated;
+	return true;
+}
+
+void CSharedMemory::Close()
+{
+	if (Mem)
+		munmap(Mem, Length);
+	if (Owner)
+		shm_unlink(Name.c_str());
+	Mem = nullptr;
+	Length = 0;
+	IsCreated = false;
+	Owner = false;
+}
+
+//------------------------------------------------------------------------------------------------
+// CMappedFile
+
+CMappedFile::CMappedFile() : Mem(nullptr), Length(0), Writable(false), File(-1)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Create(const char* path, size_t size)
+{
+	Close();
+
+	File = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (File < 0)
+		return false;
+	if (ftruncate(File, (off_t)size))
+	{
+		Close();
+		return false;
+	}
+	Length = size;
+	if (!Map(true))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool CMappedFile::OpenReadOnly(const char* path)
+{
+	Close();
+
+	File = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (File < 0 || fstat(File, &st) || st.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+	Length = (size_t)st.st_size;
+	if (!Map(false))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+//! Maps Length bytes, leaves the file open on failure.
+bool CMappedFile::Map(bool writable)
+{
+	void* mem = mmap(NULL, Length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, File, 0);
+	if (mem == MAP_FAILED)
+		return false;
+	Mem = mem;
+	Writable = writable;
+	return true;
+}
+
+bool CMappedFile::Resize(size_t size)
+{
+	if (!Mem || !Writable)
+		return false;
+	if (size <= Length)
+		return true;
+
+	munmap(Mem, Length);
+	Mem = nullptr;
+	size_t previous = Length;
+	if (!ftruncate(File, (off_t)size))
+	{
+		Length = size;
+		if (Map(true))
+			return true;
+	}
+
+	// Keep what was written mapped, the caller stops appending
+	Length = previous;
+	Map(true);
+	return false;
+}
+
+bool CMappedFile::Close(size_t length)
+{
+	bool trimmed = true;
+	if (Mem)
+		munmap(Mem, Length);
+	if (File >= 0)
+	{
+		if (Writable)
+			trimmed = ftruncate(File, (off_t)length) == 0;
+		close(File);
+	}
+	Mem = nullptr;
+	Length = 0;
+	Writable = false;
+	File = -1;
+	return trimmed;
+}
+
+//------------------------------------------------------------------------------------------------
+// CEvent
+
+CEvent::CEvent() : Signaled(0), WakeTarget(nullptr)
+{
+}
+
+CEvent::~CEvent()
+{
+}
+
+void CEvent::Set()
+{
+	Signaled.store(1, std::memory_order_seq_cst);
+	FutexWakeAll(&Signaled, false);
+
+	// Bumping the generation makes a waiter that is about to sleep on the named event return.
+	// Other processes waiting on it only see a spurious wake up. Sequentially consistent with the
+	// waiter publishing WakeTarget then checking IsSet, so one of the two always sees the other.
+	std::atomic<unsigned int>* target = WakeTarget.load(std::memory_order_seq_cst);
+	if (target)
+	{
+		target->fetch_add(1, std::memory_order_acq_rel);
+		FutexWakeAll(target, true);
+	}
+}
+
+void CEvent::Reset()
+{
+	Signaled.store(0, std::memory_order_release);
+}
+
+bool CEvent::IsSet() const
+{
+	return Signaled.load(std::memory_order_seq_cst) != 0;
+}
+
+bool CEvent::Wait(DWORD milliseconds)
+{
+	unsigned long long deadline = CPlatform::Now() + (unsigned long long)milliseconds * 1000000ULL;
+	while (!IsSet())
+	{
+		unsigned long long timeout = 0;
+		if (milliseconds != INFINITE)
+		{
+			unsigned long long now = CPlatform::Now();
+			if (now >= deadline)
+				return false;
+			timeout = deadline - now;
+		}
+		FutexWait(&Signaled, 0, timeout, false);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CNamedEvent
+
+CNamedEvent::CNamedEvent()
+{
+}
+
+CNamedEvent::~CNamedEvent()
+{
+	Close();
+}
+
+bool CNamedEvent::Open(const char* name, SHARED_MEMORY_ACCESS access)
+{
+	return access != SHARED_MEMORY_READ_ONLY && Memory.Open(name, sizeof(RZPosixEvent), access);
+}
+
+void CNamedEvent::Close()
+{
+	Memory.Close();
+}
+
+bool CNamedEvent::IsOpen() const
+{
+	return Memory.Data() != nullptr;
+}
+
+void CNamedEvent::Set()
+{
+	RZPosixEvent* event = (RZPosixEvent*)Memory.Data();
+	event->Signaled.store(1, std::memory_order_release);
+	event->Generation.fetch_add(1, std::memory_order_acq_rel);
+	FutexWakeAll(&event->Generation, true);
+}
+
+void CNamedEvent::Reset()
+{
+	RZPosixEvent* event = (RZPosixEvent*)Memory.Data();
+	event->Signaled.store(0, std::memory_order_release);
+}
+
+WAIT_RESULT CNamedEvent::Wait(DWORD milliseconds, CEvent* cancel)
+{
+	RZPosixEvent* event = (RZPosixEvent*)Memory.Data();
+	if (!event)
+		return WAIT_RESULT_FAILED;
+
+	if (cancel)
+		cancel->WakeTarget.store(&event->Generation, std::memory_order_seq_cst);
+
+	WAIT_RESULT result = WAIT_RESULT_TIMEOUT;
+	unsigned long long deadline = CPlatform::Now() + (unsigned long long)milliseconds * 1000000ULL;
+	for (;;)
+	{
+		unsigned int generation = event->Generation.load(std::memory_order_acquire);
+		if (cancel && cancel->IsSet())
+		{
+			result = WAIT_RESULT_CANCELLED;
+			break;
+		}
+		if (event->Signaled.load(std::memory_order_acquire))
+		{
+			result = WAIT_RESULT_SIGNALED;
+			break;
+		}
+
+		unsigned long long timeout = 0;
+		if (milliseconds != INFINITE)
+		{
+			unsigned long long now = CPlatform::Now();
+			if (now >= deadline)
+				break;
+			timeout = deadline - now;
+		}
+		FutexWait(&event->Generation, generation, timeout, true);
+	}
+
+	if (cancel)
+		cancel->WakeTarget.store(nullptr, std::memory_order_release);
+	return result;
+}
+
+void CNamedEvent::Pulse(const char* name)
+{
+	CSharedMemory memory;
+	if (!memory.Open(name, sizeof(RZPosixEvent), SHARED_MEMORY_OPEN_OR_CREATE))
+		return;
+
+	RZPosixEvent* event = (RZPosixEvent*)memory.Data();
+	if (memory.Created())
+	{
+		// Nobody listens, do not leave the object behind
+		memory.Close();
+		shm_unlink((std::string("/") + name).c_str());
+		return;
+	}
+	event->Generation.fetch_add(1, std::memory_order_acq_rel);
+	FutexWakeAll(&event->Generation, true);
+}
+
+//------------------------------------------------------------------------------------------------
+// CNamedMutex
+
+CNamedMutex::CNamedMutex()
+{
+}
+
+CNamedMutex::~CNamedMutex()
+{
+	Close();
+}
+
+bool CNamedMutex::Create(const char* name)
+{
+	return Memory.Open(name, sizeof(DWORD), SHARED_MEMORY_CREATE);
+}
+
+void CNamedMutex::Close()
+{
+	Memory.Close();
+}
+
+bool CNamedMutex::Exists(const char* name)
+{
+	int fd = shm_open((std::string("/") + name).c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+	close(fd);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CLock
+
+CLock::CLock()
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&Mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+CLock::~CLock()
+{
+	pthread_mutex_destroy(&Mutex);
+}
+
+void CLock::Enter()
+{
+	pthread_mutex_lock(&Mutex);
+}
+
+bool CLock::TryEnter()
+{
+	return pthread_mutex_trylock(&Mutex) == 0;
+}
+
+void CLock::Leave()
+{
+	pthread_mutex_unlock(&Mutex);
+}
+
+//------------------------------------------------------------------------------------------------
+// CThread
+
+CThread::CThread() : Routine(nullptr), Parameter(nullptr), Started(false), Thread()
+{
+}
+
+CThread::~CThread()
+{
+	if (Started)
+		pthread_detach(Thread);
+}
+
+void* CThread::Trampoline(void* self)
+{
+	CThread* thread = (CThread*)self;
+	thread->Routine(thread->Parameter);
+	thread->Finished.Set();
+	return nullptr;
+}
+
+bool CThread::Start(THREAD_ROUTINE routine, void* parameter)
+{
+	if (Started)
+		return false;
+
+	Routine = routine;
+	Parameter = parameter;
+	Finished.Reset();
+	Started = pthread_create(&Thread, NULL, Trampoline, this) == 0;
+	return Started;
+}
+
+bool CThread::Join(DWORD milliseconds)
+{
+	if (!Started)
+		return true;
+
+	bool finished = !IsCurrent() && Finished.Wait(milliseconds);
+	if (finished)
+		pthread_join(Thread, NULL);
+	else
+		pthread_detach(Thread);
+	Started = false;
+	return finished;
+}
+
+bool CThread::IsCurrent() const
+{
+	return Started && pthread_equal(Thread, pthread_self());
+}
+
+//------------------------------------------------------------------------------------------------
+// CUdpSocket
+
+//! Datagrams per sendmmsg call.
+static const size_t UDP_SEND_BATCH = 64;
+
+static sockaddr_in SocketAddress(DWORD ip, WORD port)
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(ip);
+	address.sin_port = htons(port);
+	return address;
+}
+
+CUdpSocket::CUdpSocket() : Socket(-1)
+{
+}
+
+CUdpSocket::~CUdpSocket()
+{
+	Close();
+}
+
+bool CUdpSocket::Open(WORD port, DWORD ip)
+{
+	Close();
+	Socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (Socket < 0)
+		return false;
+	fcntl(Socket, F_SETFD, FD_CLOEXEC);
+
+	sockaddr_in address = SocketAddress(ip, port);
+	if (bind(Socket, (sockaddr*)&address, sizeof(address)))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CUdpSocket::Close()
+{
+	if (Socket >= 0)
+		close(Socket);
+	Socket = -1;
+}
+
+bool CUdpSocket::IsOpen() const
+{
+	return Socket >= 0;
+}
+
+WORD CUdpSocket::Port() const
+{
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	if (Socket < 0 || getsockname(Socket, (sockaddr*)&address, &length))
+		return 0;
+	return ntohs(address.sin_port);
+}
+
+bool CUdpSocket::SetBroadcast(bool enabled)
+{
+	int value = enabled ? 1 : 0;
+	return setsockopt(Socket, SOL_SOCKET, SO_BROADCAST, &value, sizeof(value)) == 0;
+}
+
+bool CUdpSocket::SetBuffers(size_t send, size_t receive)
+{
+	int sendSize = (int)send, receiveSize = (int)receive;
+	bool ok = true;
+	if (send)
+		ok = setsockopt(Socket, SOL_SOCKET, SO_SNDBUF, &sendSize, sizeof(sendSize)) == 0 && ok;
+	if (receive)
+		ok = setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, &receiveSize, sizeof(receiveSize)) == 0 && ok;
+	return ok;
+}
+
+bool CUdpSocket::JoinGroup(DWORD group)
+{
+	ip_mreq request;
+	request.imr_multiaddr.s_addr = htonl(group);
+	request.imr_interface.s_addr = htonl(INADDR_ANY);
+	return setsockopt(Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0;
+}
+
+size_t CUdpSocket::Send(const RZDatagram* datagrams, size_t count)
+{
+	sockaddr_in addresses[UDP_SEND_BATCH];
+	iovec parts[UDP_SEND_BATCH][DATAGRAM_MAX_PARTS];
+#ifdef __linux__
+	mmsghdr messages[UDP_SEND_BATCH];
+#else
+	msghdr messages[UDP_SEND_BATCH];
+#endif
+	size_t sent = 0;
+	while (sent < count)
+	{
+		size_t batch = count - sent < UDP_SEND_BATCH ? count - sent : UDP_SEND_BATCH;
+		for (size_t i = 0; i < batch; i++)
+		{
+			const RZDatagram& datagram = datagrams[sent + i];
+			addresses[i] = SocketAddress(datagram.To.Ip, datagram.To.Port);
+			for (size_t p = 0; p < datagram.Parts; p++)
+			{
+				parts[i][p].iov_base = const_cast<void*>(datagram.Data[p]);
+				parts[i][p].iov_len = datagram.Size[p];
+			}
+#ifdef __linux__
+			msghdr& message = messages[i].msg_hdr;
+			messages[i].msg_len = 0;
+#else
+			msghdr& message = messages[i];
+#endif
+			memset(&message, 0, sizeof(message));
+			message.msg_name = &addresses[i];
+			message.msg_namelen = sizeof(addresses[i]);
+			message.msg_iov = parts[i];
+			message.msg_iovlen = datagram.Parts;
+		}
+
+#ifdef __linux__
+		int done = sendmmsg(Socket, messages, (unsigned int)batch, 0);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			break;
+		sent += (size_t)done;
+#else
+		size_t done = 0;
+		while (done < batch && sendmsg(Socket, &messages[done], 0) >= 0)
+			done++;
+		sent += done;
+		if (done < batch)
+			break;
+#endif
+	}
+	return sent;
+}
+
+int CUdpSocket::Receive(void* buffer, size_t size, DWORD milliseconds, RZNetAddress* from)
+{
+	pollfd poller = { Socket, POLLIN, 0 };
+	int ready = poll(&poller, 1, milliseconds == INFINITE ? -1 : (int)milliseconds);
+	if (ready <= 0)
+		return ready < 0 && errno != EINTR ? -1 : 0;
+
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	ssize_t received = recvfrom(Socket, buffer, size, 0, (sockaddr*)&address, &length);
+	if (received < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	if (from)
+	{
+		from->Ip = ntohl(address.sin_addr.s_addr);
+		from->Port = ntohs(address.sin_port);
+	}
+	return (int)received;
+}
+
+bool CUdpSocket::ParseAddress(const char* text, DWORD& ip)
+{
+	in_addr address;
+	if (inet_pton(AF_INET, text, &address) != 1)
+		return false;
+	ip = ntohl(address.s_addr);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CSettings
+
+struct CSettingsCache
+{
+	std::mutex Lock;
+	nlohmann::json Settings;
+	struct timespec Time = {};
+	off_t Size = -1;
+	ino_t Inode = 0;
+};
+
+//! Built on first use, the library reads its settings from the module constructor.
+static CSettingsCache& SettingsCache()
+{
+	static CSettingsCache cache;
+	return cache;
+}
+
+std::string CSettings::Path()
+{
+	std::string path = CPlatform::EnvironmentVariable("RZBROADCAST_SETTINGS");
+	if (!path.empty())
+		return path;
+
+	std::string config = CPlatform::EnvironmentVariable("XDG_CONFIG_HOME");
+	if (config.empty())
+		config = CPlatform::EnvironmentVariable("HOME") + "/.config";
+	return config + "/ChromaBroadcast/settings.json";
+}
+
+//! Reloads the file only when it changed, the health checks read it every few hundred milliseconds.
+static nlohmann::json& LoadSettings(const std::string& path)
+{
+	CSettingsCache& cache = SettingsCache();
+	struct stat st;
+	if (stat(path.c_str(), &st))
+	{
+		cache.Settings = nlohmann::json::object();
+		cache.Size = -1;
+		return cache.Settings;
+	}
+
+	if (st.st_size == cache.Size && st.st_ino == cache.Inode &&
+		st.st_mtim.tv_sec == cache.Time.tv_sec && st.st_mtim.tv_nsec == cache.Time.tv_nsec)
+		return cache.Settings;
+
+	cache.Settings = nlohmann::json::object();
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f)
+	{
+		std::string text;
+		char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			text.append(buffer, read);
+		fclose(f);
+
+		nlohmann::json parsed = nlohmann::json::parse(text, nullptr, false);
+		if (parsed.is_object())
+			cache.Settings = parsed;
+	}
+	cache.Size = st.st_size;
+	cache.Inode = st.st_ino;
+	cache.Time = st.st_mtim;
+	return cache.Settings;
+}
+
+static bool SaveSettings(const std::string& path, const nlohmann::json& settings)
+{
+	size_t slash = path.rfind('/');
+	if (slash != std::string::npos && slash)
+	{
+		std::string directory = path.substr(0, slash);
+		for (size_t i = 1; i <= directory.size(); i++)
+		{
+			if (i == directory.size() || directory[i] == '/')
+				mkdir(directory.substr(0, i).c_str(), 0755);
+		}
+	}
+
+	// Write then rename, readers in other processes never see a partial file
+	std::string temp = path + "." + std::to_string(getpid()) + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+	if (!f)
+		return false;
+	std::string text = settings.dump(1, '\t');
+	bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(temp.c_str(), path.c_str()))
+	{
+		unlink(temp.c_str());
+		return false;
+	}
+	SettingsCache().Size = -1;
+	return true;
+}
+
+bool CSettings::KeyExists(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	nlohmann::json& settings = LoadSettings(Path());
+	return settings.contains(key) && settings[key].is_object();
+}
+
+bool CSettings::CreateKey(const std::string& key, bool* created)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	std::string path = Path();
+	nlohmann::json settings = LoadSettings(path);
+	bool exists = settings.contains(key) && settings[key].is_object();
+	if (created)
+		*created = !exists;
+	if (exists)
+		return true;
+
+	settings[key] = nlohmann::json::object();
+	return SaveSettings(path, settings);
+}
+
+bool CSettings::GetDword(const std::string& key, const char* name, DWORD& value)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	nlohmann::json& settings = LoadSettings(Path());
+	auto k = settings.find(key);
+	if (k == settings.end() || !k->is_object())
+		return false;
+	auto v = k->find(name);
+	if (v == k->end() || !v->is_number_integer())
+		return false;
+	value = v->get<DWORD>();
+	return true;
+}
+
+bool CSettings::GetString(const std::string& key, const char* name, std::string& value)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	nlohmann::json& settings = LoadSettings(Path());
+	auto k = settings.find(key);
+	if (k == settings.end() || !k->is_object())
+		return false;
+	auto v = k->find(name);
+	if (v == k->end() || !v->is_string())
+		return false;
+	value = v->get<std::string>();
+	return true;
+}
+
+bool CSettings::SetDword(const std::string& key, const char* name, DWORD value)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	std::string path = Path();
+	nlohmann::json settings = LoadSettings(path);
+	if (!settings.contains(key) || !settings[key].is_object())
+		return false;
+	if (settings[key].contains(name) && settings[key][name] == value)
+		return true;
+	settings[key][name] = value;
+	return SaveSettings(path, settings);
+}
+
+bool CSettings::SetString(const std::string& key, const char* name, const std::string& value)
+{
+	std::lock_guard<std::mutex> lock(SettingsCache().Lock);
+	std::string path = Path();
+	nlohmann::json settings = LoadSettings(path);
+	if (!settings.contains(key) || !settings[key].is_object())
+		return false;
+	if (settings[key].contains(name) && settings[key][name] == value)
+		return true;
+	settings[key][name] = value;
+	return SaveSettings(path, settings);
+}
+
+//------------------------------------------------------------------------------------------------
+// CPlatform
+
+DWORD CPlatform::TickCount()
+{
+	return (DWORD)(Now() / 1000000ULL);
+}
+
+unsigned long long CPlatform::Now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ToNanoseconds(ts);
+}
+
+void CPlatform::SleepUntil(unsigned long long deadline)
+{
+	timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	{
+	}
+}
+
+std::string CPlatform::LocalTime()
+{
+	time_t now = time(NULL);
+	struct tm local;
+	localtime_r(&now, &local);
+	char text[32];
+	strftime(text, sizeof(text), "%Y-%m-%d %H:%M", &local);
+	return text;
+}
+
+DWORD CPlatform::ProcessId()
+{
+	return (DWORD)getpid();
+}
+
+unsigned long CPlatform::ThreadId()
+{
+#ifdef __linux__
+	return (unsigned long)syscall(SYS_gettid);
+#else
+	return (unsigned long)(uintptr_t)pthread_self();
+#endif
+}
+
+std::vector<DWORD> CPlatform::ListProcesses()
+{
+	std::vector<DWORD> pids;
+	DIR* dir = opendir("/proc");
+	if (!dir)
+		return pids;
+	while (dirent* entry = readdir(dir))
+	{
+		char* end;
+		unsigned long pid = strtoul(entry->d_name, &end, 10);
+		if (*end == 0 && pid)
+			pids.push_back((DWORD)pid);
+	}
+	closedir(dir);
+	return pids;
+}
+
+bool CPlatform::IsProcessAlive(DWORD pid)
+{
+	return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+std::string CPlatform::ExecutablePath()
+{
+	char path[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len <= 0)
+		return std::string();
+	path[len] = 0;
+	return path;
+}
+
+std::string CPlatform::EnvironmentVariable(const char* name)
+{
+	const char* value = getenv(name);
+	return value ? value : std::string();
+}
+
+bool CPlatform::FileExists(const std::string& path)
+{
+	return access(path.c_str(), F_OK) == 0;
+}
+
+std::string CPlatform::PathJoin(const std::string& directory, const std::string& name)
+{
+	if (directory.empty() || directory.back() == '/')
+		return directory + name;
+	return directory + "/" + name;
+}
+
+std::string CPlatform::PathStem(const std::string& path)
+{
+	size_t slash = path.rfind('/');
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	return dot == std::string::npos || !dot ? name : name.substr(0, dot);
+}
+
+bool CPlatform::IsServiceRunning(const char* name)
+{
+	DWORD running = 1;
+	CSettings::GetDword(std::string("Services\\") + name, "Running", running);
+	return running != 0;
+}
+
+#endif
@@ -0,0 +1,811 @@
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <Windows.h>
+#include <tlhelp32.h>
+#include <shlwapi.h>
+#include <stdio.h>
+#include "Platform.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+#ifdef _MSC_VER
+#pragma comment(lib, "Shlwapi.lib")
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+
+static std::wstring ObjectName(const wchar_t* ns, const char* name)
+{
+	std::wstring result(ns);
+	result += L"\\";
+	for (const char* c = name; *c; c++)
+		result += (wchar_t)(unsigned char)*c;
+	return result;
+}
+
+//------------------------------------------------------------------------------------------------
+// CSharedMemory
+
+CSharedMemory::CSharedMemory() : Mem(nullptr), Length(0), IsCreated(false), File(nullptr)
+{
+}
+
+CSharedMemory::~CSharedMemory()
+{
+	Close();
+}
+
+bool CSharedMemory::Open(const char* name, size_t size, SHARED_MEMORY_ACCESS access, SHARED_MEMORY_SCOPE scope)
+{
+	Close();
+
+	const wchar_t* namespaces[] = { L"Global", L"Local" };
+	size_t count = scope == SHARED_MEMORY_GLOBAL_OR_SESSION ? 2 : 1;
+	DWORD mapAccess = access == SHARED_MEMORY_READ_ONLY ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+	for (size_t i = 0; i < count; i++)
+	{
+		const wchar_t* ns = namespaces[i];
+		std::wstring objectName = ObjectName(ns, name);
+		HANDLE file = nullptr;
+		bool created = false;
+		if (access != SHARED_MEMORY_CREATE)
+			file = OpenFileMappingW(mapAccess, FALSE, objectName.c_str());
+		if (!file && access != SHARED_MEMORY_READ_ONLY && access != SHARED_MEMORY_OPEN_EXISTING)
+		{
+			// Creating Global objects needs SeCreateGlobalPrivilege, objects of this DLL fall back to the session namespace
+			file = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, objectName.c_str());
+			created = file && GetLastError() != ERROR_ALREADY_EXISTS;
+		}
+		if (!file)
+			continue;
+
+		void* mem = MapViewOfFile(file, mapAccess, 0, 0, size);
+		if (!mem)
+		{
+			CloseHandle(file);
+			continue;
+		}
+
+		if (created)
+			memset(mem, 0, size);
+		File = file;
+		Mem = mem;
+		Length = size;
+		IsCreated = created;
+		return true;
+	}
+	return false;
+}
+
+void CSharedMemory::Close()
+{
+	if (Mem)
+		UnmapViewOfFile(Mem);
+	if (File)
+		CloseHandle(File);
+	Mem = nullptr;
+	File = nullptr;
+	Length = 0;
+	IsCreated = false;
+}
+
+//------------------------------------------------------------------------------------------------
+// CMappedFile
+
+CMappedFile::CMappedFile() : Mem(nullptr), Length(0), Writable(false), File(INVALID_HANDLE_VALUE), Mapping(nullptr)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Create(const char* path, size_t size)
+{
+	Close();
+
+	File = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+	Length = size;
+	if (!Map(true))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool CMappedFile::OpenReadOnly(const char* path)
+{
+	Close();
+
+	File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (File == INVALID_HANDLE_VALUE || !GetFileSizeEx(File, &size) || size.QuadPart <= 0)
+	{
+		Close();
+		return false;
+	}
+	Length = (size_t)size.QuadPart;
+	if (!Map(false))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+//! Maps Length bytes, leaves the file open on failure.
+bool CMappedFile::Map(bool writable)
+{
+	// Mapping a writable file larger than it is grows it to the mapping size
+	ULONGLONG size = writable ? (ULONGLONG)Length : 0;
+	Mapping = CreateFileMappingW(File, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(size >> 32), (DWORD)size, NULL);
+	void* mem = Mapping ? MapViewOfFile(Mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, Length) : nullptr;
+	if (!mem)
+	{
+		if (Mapping)
+			CloseHandle(Mapping);
+		Mapping = nullptr;
+		return false;
+	}
+	Mem = mem;
+	Writable = writable;
+	return true;
+}
+
+bool CMappedFile::Resize(size_t size)
+{
+	if (!Mem || !Writable)
+		return false;
+	if (size <= Length)
+		return true;
+
+	UnmapViewOfFile(Mem);
+	CloseHandle(Mapping);
+	Mem = nullptr;
+	Mapping = nullptr;
+	size_t previous = Length;
+	Length = size;
+	if (Map(true))
+		return true;
+
+	// Keep what was written mapped, the caller stops appending
+	Length = previous;
+	Map(true);
+	return false;
+}
+
+bool CMappedFile::Close(size_t length)
+{
+	bool trimmed = true;
+	if (Mem)
+		UnmapViewOfFile(Mem);
+	if (Mapping)
+		CloseHandle(Mapping);
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		if (Writable)
+		{
+			LARGE_INTEGER end;
+			end.QuadPart = (LONGLONG)length;
+			trimmed = SetFilePointerEx(File, end, NULL, FILE_BEGIN) && SetEndOfFile(File);
+		}
+		CloseHandle(File);
+	}
+	Mem = nullptr;
+	Mapping = nullptr;
+	Length = 0;
+	Writable = false;
+	File = INVALID_HANDLE_VALUE;
+	return trimmed;
+}
+
+//------------------------------------------------------------------------------------------------
+// CEvent
+
+CEvent::CEvent()
+{
+	Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+}
+
+CEvent::~CEvent()
+{
+	if (Event)
+		CloseHandle(Event);
+}
+
+void CEvent::Set()
+{
+	SetEvent(Event);
+}
+
+void CEvent::Reset()
+{
+	ResetEvent(Event);
+}
+
+bool CEvent::IsSet() const
+{
+	return WaitForSingleObject(Event, 0) == WAIT_OBJECT_0;
+}
+
+bool CEvent::Wait(DWORD milliseconds)
+{
+	return WaitForSingleObject(Event, milliseconds) == WAIT_OBJECT_0;
+}
+
+//------------------------------------------------------------------------------------------------
+// CNamedEvent
+
+CNamedEvent::CNamedEvent() : Event(nullptr)
+{
+}
+
+CNamedEvent::~CNamedEvent()
+{
+	Close();
+}
+
+bool CNamedEvent::Open(const char* name, SHARED_MEMORY_ACCESS access)
+{
+	Close();
+	// Kernel objects go away with their last handle, there is no name to remove
+	if (access == SHARED_MEMORY_OPEN_EXISTING)
+		Event = OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, ObjectName(L"Global", name).c_str());
+	else if (access != SHARED_MEMORY_READ_ONLY)
+		Event = CreateEventW(NULL, TRUE, FALSE, ObjectName(L"Global", name).c_str());
+	return Event != nullptr;
+}
+
+void CNamedEvent::Close()
+{
+	if (Event)
+		CloseHandle(Event);
+	Event = nullptr;
+}
+
+bool CNamedEvent::IsOpen() const
+{
+	return Event != nullptr;
+}
+
+void CNamedEvent::Set()
+{
+	SetEvent(Event);
+}
+
+void CNamedEvent::Reset()
+{
+	ResetEvent(Event);
+}
+
+WAIT_RESULT CNamedEvent::Wait(DWORD milliseconds, CEvent* cancel)
+{
+	if (!Event)
+		return WAIT_RESULT_FAILED;
+
+	// WaitForMultipleObjects reports the lowest index signaled, the cancel goes first so an event
+	// left set cannot hide it, as on POSIX
+	if (!cancel)
+	{
+		switch (WaitForSingleObject(Event, milliseconds))
+		{
+		case WAIT_OBJECT_0: return WAIT_RESULT_SIGNALED;
+		case WAIT_TIMEOUT: return WAIT_RESULT_TIMEOUT;
+		default: return WAIT_RESULT_FAILED;
+		}
+	}
+	HANDLE handles[] = { cancel->Event, Event };
+	switch (WaitForMultipleObjects(2, handles, FALSE, milliseconds))
+	{
+	case WAIT_OBJECT_0: return WAIT_RESULT_CANCELLED;
+	case WAIT_OBJECT_0 + 1: return WAIT_RESULT_SIGNALED;
+	case WAIT_TIMEOUT: return WAIT_RESULT_TIMEOUT;
+	default: return WAIT_RESULT_FAILED;
+	}
+}
+
+void CNamedEvent::Pulse(const char* name)
+{
+	HANDLE event = OpenEventW(EVENT_ALL_ACCESS, FALSE, ObjectName(L"Global", name).c_str());
+	if (event)
+	{
+		PulseEvent(event);
+		CloseHandle(event);
+	}
+}
+
+//------------------------------------------------------------------------------------------------
+// CNamedMutex
+
+CNamedMutex::CNamedMutex() : Mutex(nullptr)
+{
+}
+
+CNamedMutex::~CNamedMutex()
+{
+	Close();
+}
+
+bool CNamedMutex::Create(const char* name)
+{
+	Close();
+	Mutex = CreateMutexW(NULL, FALSE, ObjectName(L"Global", name).c_str());
+	return Mutex != nullptr;
+}
+
+void CNamedMutex::Close()
+{
+	if (Mutex)
+		CloseHandle(Mutex);
+	Mutex = nullptr;
+}
+
+bool CNamedMutex::Exists(const char* name)
+{
+	HANDLE mutex = OpenMutexW(MUTEX_ALL_ACCESS, FALSE, ObjectName(L"Global", name).c_str());
+	if (!mutex)
+		return false;
+	CloseHandle(mutex);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CLock
+
+CLock::CLock()
+{
+	InitializeCriticalSection(&Critical);
+}
+
+CLock::~CLock()
+{
+	DeleteCriticalSection(&Critical);
+}
+
+void CLock::Enter()
+{
+	EnterCriticalSection(&Critical);
+}
+
+bool CLock::TryEnter()
+{
+	return TryEnterCriticalSection(&Critical) != FALSE;
+}
+
+void CLock::Leave()
+{
+	LeaveCriticalSection(&Critical);
+}
+
+//------------------------------------------------------------------------------------------------
+// CThread
+
+CThread::CThread() : Routine(nullptr), Parameter(nullptr), Started(false), Thread(nullptr)
+{
+}
+
+CThread::~CThread()
+{
+	if (Thread)
+		CloseHandle(Thread);
+}
+
+DWORD WINAPI CThread::Trampoline(LPVOID self)
+{
+	CThread* thread = (CThread*)self;
+	DWORD result = thread->Routine(thread->Parameter);
+	thread->Finished.Set();
+	return result;
+}
+
+bool CThread::Start(THREAD_ROUTINE routine, void* parameter)
+{
+	if (Started)
+		return false;
+
+	Routine = routine;
+	Parameter = parameter;
+	Finished.Reset();
+	Thread = CreateThread(NULL, 0, Trampoline, this, 0, NULL);
+	Started = Thread != nullptr;
+	return Started;
+}
+
+bool CThread::Join(DWORD milliseconds)
+{
+	if (!Started)
+		return true;
+
+	bool finished = !IsCurrent() && WaitForSingleObject(Thread, milliseconds) == WAIT_OBJECT_0;
+	CloseHandle(Thread);
+	Thread = nullptr;
+	Started = false;
+	return finished;
+}
+
+bool CThread::IsCurrent() const
+{
+	return Started && GetThreadId(Thread) == GetCurrentThreadId();
+}
+
+//------------------------------------------------------------------------------------------------
+// CUdpSocket
+
+//! Starts Winsock once for the process, it stays started until the process exits.
+static bool StartWinsock()
+{
+	static bool started = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+}
+
+static sockaddr_in SocketAddress(DWORD ip, WORD port)
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(ip);
+	address.sin_port = htons(port);
+	return address;
+}
+
+CUdpSocket::CUdpSocket() : Socket(INVALID_SOCKET)
+{
+}
+
+CUdpSocket::~CUdpSocket()
+{
+	Close();
+}
+
+bool CUdpSocket::Open(WORD port, DWORD ip)
+{
+	Close();
+	if (!StartWinsock())
+		return false;
+	Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (Socket == INVALID_SOCKET)
+		return false;
+
+	sockaddr_in address = SocketAddress(ip, port);
+	if (bind(Socket, (sockaddr*)&address, sizeof(address)))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CUdpSocket::Close()
+{
+	if (Socket != INVALID_SOCKET)
+		closesocket(Socket);
+	Socket = INVALID_SOCKET;
+}
+
+bool CUdpSocket::IsOpen() const
+{
+	return Socket != INVALID_SOCKET;
+}
+
+WORD CUdpSocket::Port() const
+{
+	sockaddr_in address;
+	int length = sizeof(address);
+	if (Socket == INVALID_SOCKET || getsockname(Socket, (sockaddr*)&address, &length))
+		return 0;
+	return ntohs(address.sin_port);
+}
+
+bool CUdpSocket::SetBroadcast(bool enabled)
+{
+	BOOL value = enabled ? TRUE : FALSE;
+	return setsockopt(Socket, SOL_SOCKET, SO_BROADCAST, (const char*)&value, sizeof(value)) == 0;
+}
+
+bool CUdpSocket::SetBuffers(size_t send, size_t receive)
+{
+	int sendSize = (int)send, receiveSize = (int)receive;
+	bool ok = true;
+	if (send)
+		ok = setsockopt(Socket, SOL_SOCKET, SO_SNDBUF, (const char*)&sendSize, sizeof(sendSize)) == 0 && ok;
+	if (receive)
+		ok = setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveSize, sizeof(receiveSize)) == 0 && ok;
+	return ok;
+}
+
+bool CUdpSocket::JoinGroup(DWORD group)
+{
+	ip_mreq request;
+	request.imr_multiaddr.s_addr = htonl(group);
+	request.imr_interface.s_addr = htonl(INADDR_ANY);
+	return setsockopt(Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&request, sizeof(request)) == 0;
+}
+
+size_t CUdpSocket::Send(const RZDatagram* datagrams, size_t count)
+{
+	// Windows has no sendmmsg, each datagram is still gathered from its parts
+	size_t sent = 0;
+	for (; sent < count; sent++)
+	{
+		const RZDatagram& datagram = datagrams[sent];
+		sockaddr_in address = SocketAddress(datagram.To.Ip, datagram.To.Port);
+		WSABUF parts[DATAGRAM_MAX_PARTS];
+		for (size_t p = 0; p < datagram.Parts; p++)
+		{
+			parts[p].buf = (CHAR*)datagram.Data[p];
+			parts[p].len = (ULONG)datagram.Size[p];
+		}
+		DWORD bytes = 0;
+		if (WSASendTo(Socket, parts, (DWORD)datagram.Parts, &bytes, 0, (sockaddr*)&address, sizeof(address), NULL, NULL))
+			break;
+	}
+	return sent;
+}
+
+int CUdpSocket::Receive(void* buffer, size_t size, DWORD milliseconds, RZNetAddress* from)
+{
+	WSAPOLLFD poller = { Socket, POLLRDNORM, 0 };
+	int ready = WSAPoll(&poller, 1, milliseconds == INFINITE ? -1 : (int)milliseconds);
+	if (ready <= 0)
+		return ready < 0 ? -1 : 0;
+
+	sockaddr_in address;
+	int length = sizeof(address);
+	int received = recvfrom(Socket, (char*)buffer, (int)size, 0, (sockaddr*)&address, &length);
+	if (received == SOCKET_ERROR)
+		return WSAGetLastError() == WSAEMSGSIZE ? (int)size : -1;
+	if (from)
+	{
+		from->Ip = ntohl(address.sin_addr.s_addr);
+		from->Port = ntohs(address.sin_port);
+	}
+	return received;
+}
+
+bool CUdpSocket::ParseAddress(const char* text, DWORD& ip)
+{
+	IN_ADDR address;
+	if (inet_pton(AF_INET, text, &address) != 1)
+		return false;
+	ip = ntohl(address.s_addr);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------
+// CSettings
+
+bool CSettings::KeyExists(const std::string& key)
+{
+	HKEY phkResult;
+	if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+		return false;
+	RegCloseKey(phkResult);
+	return true;
+}
+
+bool CSettings::CreateKey(const std::string& key, bool* created)
+{
+	HKEY hKey;
+	DWORD disposition = 0;
+	if (RegCreateKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, 0, 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, 0, &hKey, &disposition))
+		return false;
+	RegCloseKey(hKey);
+	if (created)
+		*created = disposition == REG_CREATED_NEW_KEY;
+	return true;
+}
+
+bool CSettings::GetDword(const std::string& key, const char* name, DWORD& value)
+{
+	HKEY phkResult;
+	if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+		return false;
+
+	DWORD data = 0;
+	DWORD dataLen = sizeof(data);
+	LSTATUS status = RegQueryValueExA(phkResult, name, 0, 0, (LPBYTE)&data, &dataLen);
+	RegCloseKey(phkResult);
+	if (status)
+		return false;
+
+	value = data;
+	return true;
+}
+
+bool CSettings::GetString(const std::string& key, const char* name, std::string& value)
+{
+	HKEY phkResult;
+	if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &phkResult))
+		return false;
+
+	std::string data;
+	data.resize(MAX_PATH);
+	DWORD dataLen = MAX_PATH;
+	LSTATUS status = RegQueryValueExA(phkResult, name, 0, 0, (LPBYTE)data.data(), &dataLen);
+	RegCloseKey(phkResult);
+	if (status)
+		return false;
+
+	data.resize(strlen(data.c_str()));
+	value = data;
+	return true;
+}
+
+bool CSettings::SetDword(const std::string& key, const char* name, DWORD value)
+{
+	HKEY hKey;
+	if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &hKey))
+		return false;
+	LSTATUS status = RegSetValueExA(hKey, name, 0, REG_DWORD, (LPBYTE)&value, sizeof(value));
+	RegCloseKey(hKey);
+	return status == ERROR_SUCCESS;
+}
+
+bool CSettings::SetString(const std::string& key, const char* name, const std::string& value)
+{
+	HKEY hKey;
+	if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, key.c_str(), 0, KEY_ALL_ACCESS | KEY_WOW64_32KEY, &hKey))
+		return false;
+	LSTATUS status = RegSetValueExA(hKey, name, 0, REG_SZ, (LPBYTE)value.c_str(), (DWORD)value.size());
+	RegCloseKey(hKey);
+	return status == ERROR_SUCCESS;
+}
+
+//------------------------------------------------------------------------------------------------
+// CPlatform
+
+DWORD CPlatform::TickCount()
+{
+	return GetTickCount();
+}
+
+unsigned long long CPlatform::Now()
+{
+	static LARGE_INTEGER frequency = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+		+ (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+}
+
+void CPlatform::SleepUntil(unsigned long long deadline)
+{
+	// A high resolution timer (Windows 10 1803 and later) wakes to the tens of microseconds, an
+	// ordinary one on the tick, the last stretch is yielded through
+	const unsigned long long spin = 50000;
+	unsigned long long now = Now();
+	if (deadline > now + spin)
+	{
+		HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (!timer)
+			timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((deadline - now - spin) / 100);
+		if (timer && SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+			WaitForSingleObject(timer, INFINITE);
+		if (timer)
+			CloseHandle(timer);
+	}
+	while (Now() < deadline)
+		SwitchToThread();
+}
+
+std::string CPlatform::LocalTime()
+{
+	char time[100];
+	GetDateFormatA(LOCALE_USER_DEFAULT, 0, NULL, "yyyy'-'MM'-'dd HH':'mm", time, sizeof(time));
+	return time;
+}
+
+DWORD CPlatform::ProcessId()
+{
+	return GetCurrentProcessId();
+}
+
+unsigned long CPlatform::ThreadId()
+{
+	return GetCurrentThreadId();
+}
+
+std::vector<DWORD> CPlatform::ListProcesses()
+{
+	std::vector<DWORD> pids;
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return pids;
+
+	PROCESSENTRY32W entry;
+	entry.dwSize = sizeof(entry);
+	if (Process32FirstW(snapshot, &entry))
+	{
+		do
+		{
+			pids.push_back(entry.th32ProcessID);
+		} while (Process32NextW(snapshot, &entry));
+	}
+	CloseHandle(snapshot);
+	return pids;
+}
+
+bool CPlatform::IsProcessAlive(DWORD pid)
+{
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	if (!process)
+		return false;
+	bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+}
+
+std::string CPlatform::ExecutablePath()
+{
+	char path[MAX_PATH];
+	if (!GetModuleFileNameA(0, path, sizeof(path)))
+		return std::string();
+	return path;
+}
+
+std::string CPlatform::EnvironmentVariable(const char* name)
+{
+	char value[MAX_PATH];
+	DWORD len = GetEnvironmentVariableA(name, value, sizeof(value));
+	if (!len || len >= sizeof(value))
+		return std::string();
+	return value;
+}
+
+bool CPlatform::FileExists(const std::string& path)
+{
+	return PathFileExistsA(path.c_str()) != FALSE;
+}
+
+std::string CPlatform::PathJoin(const std::string& directory, const std::string& name)
+{
+	if (directory.empty() || directory.back() == '\\' || directory.back() == '/')
+		return directory + name;
+	return directory + "\\" + name;
+}
+
+std::string CPlatform::PathStem(const std::string& path)
+{
+	char name[MAX_PATH];
+	strncpy_s(name, path.c_str(), _TRUNCATE);
+	PathStripPathA(name);
+	PathRemoveExtensionA(name);
+	return name;
+}
+
+bool CPlatform::IsServiceRunning(const char* name)
+{
+	SC_HANDLE hSCObject = OpenSCManagerW(NULL, NULL, SC_MANAGER_ENUMERATE_SERVICE);
+	if (!hSCObject)
+		return false;
+
+	bool running = false;
+	SC_HANDLE service = OpenServiceA(hSCObject, name, SC_MANAGER_ENUMERATE_SERVICE);
+	if (service)
+	{
+		DWORD pcbBytesNeeded = 0;
+		SERVICE_STATUS_PROCESS status;
+		memset(&status, 0, sizeof(SERVICE_STATUS_PROCESS));
+		if (QueryServiceStatusEx(service, SC_STATUS_PROCESS_INFO, (LPBYTE)&status, sizeof(SERVICE_STATUS_PROCESS), &pcbBytesNeeded) && status.dwCurrentState == SERVICE_RUNNING)
+			running = true;
+		CloseServiceHandle(service);
+	}
+	CloseServiceHandle(hSCObject);
+	return running;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include <string>
+#include "Platform.h"
+#include "Simd.h"
+
+#if defined(RZ_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static const char* SimdNames[SIMD_LEVEL_COUNT] = { "scalar", "sse2", "avx2", "neon" };
+
+#if defined(RZ_SIMD_X86)
+static bool CpuHasSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+//! AVX2 needs the CPU to have it and the OS to save the YMM registers.
+static bool CpuHasAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const int osxsave = 1 << 27, avx = 1 << 28;
+	if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	// Checks the OS support through xgetbv as well
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+bool CSimd::IsSupported(SIMD_LEVEL level)
+{
+	switch (level)
+	{
+	case SIMD_SCALAR:
+		return true;
+#if defined(RZ_SIMD_X86)
+	case SIMD_SSE2:
+		return CpuHasSse2();
+	case SIMD_AVX2:
+		return CpuHasAvx2();
+#elif defined(RZ_SIMD_NEON)
+	case SIMD_NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+static SIMD_LEVEL DetectLevel()
+{
+	SIMD_LEVEL best = SIMD_SCALAR;
+	for (int level = SIMD_SCALAR + 1; level < SIMD_LEVEL_COUNT; level++)
+	{
+		// Levels of one architecture are in ascending order, the other architecture's are never supported
+		if (CSimd::IsSupported((SIMD_LEVEL)level))
+			best = (SIMD_LEVEL)level;
+	}
+
+	std::string cap = CPlatform::EnvironmentVariable("RZBROADCAST_SIMD");
+	for (int level = SIMD_SCALAR; level < SIMD_LEVEL_COUNT && !cap.empty(); level++)
+	{
+		if (cap == SimdNames[level] && level < best && CSimd::IsSupported((SIMD_LEVEL)level))
+			best = (SIMD_LEVEL)level;
+	}
+	return best;
+}
+
+SIMD_LEVEL CSimd::Level()
+{
+	static const SIMD_LEVEL level = DetectLevel();
+	return level;
+}
+
+const char* CSimd::Name(SIMD_LEVEL level)
+{
+	return level >= SIMD_SCALAR && level < SIMD_LEVEL_COUNT ? SimdNames[level] : "unknown";
+}
@@ -0,0 +1,35 @@
+//! \file Simd.h
+//! \brief Instruction sets the vectorized kernels are built for, and the best of them the CPU runs. Kernels for
+//! each set live in their own translation unit, built with that set enabled, and are picked at run time.
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RZ_SIMD_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RZ_SIMD_NEON
+#endif
+
+enum SIMD_LEVEL
+{
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_NEON,
+	SIMD_LEVEL_COUNT
+};
+
+class CSimd
+{
+public:
+	//! The best level supported, detected once. RZBROADCAST_SIMD=scalar, sse2, avx2 or neon lowers it.
+	static SIMD_LEVEL Level();
+	//! True when kernels for level are built in and the CPU and the OS run them.
+	static bool IsSupported(SIMD_LEVEL level);
+	static const char* Name(SIMD_LEVEL level);
+};
+
+#endif
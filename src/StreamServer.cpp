@@ -0,0 +1,721 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "StreamServer.h"
+#include "json.hpp"
+
+using namespace RzChromaBroadcastAPI;
+
+static const DWORD STREAM_DEFAULT_ADDRESS = 0x7F000001;
+static const DWORD STREAM_DEFAULT_CLIENTS = 1024;
+static const DWORD STREAM_DEFAULT_FPS = 240;
+static const DWORD STREAM_DEFAULT_BUFFERED = 64 * 1024;
+static const DWORD STREAM_DEFAULT_REQUEST_TIMEOUT = 5000;
+//! Holds the handshake and a few messages.
+static const DWORD STREAM_MIN_BUFFERED = 1024;
+
+//! WebSocket opcodes, 0 queues bytes as they are.
+static const BYTE WS_RAW = 0x0;
+static const BYTE WS_TEXT = 0x1;
+static const BYTE WS_BINARY = 0x2;
+static const BYTE WS_CLOSE = 0x8;
+static const BYTE WS_PING = 0x9;
+static const BYTE WS_PONG = 0xA;
+static const BYTE WS_FINAL = 0x80;
+static const BYTE WS_MASKED = 0x80;
+static const char WS_ACCEPT_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static const char STATUS_LIVE_JSON[] = "{\"type\":\"status\",\"status\":\"LIVE\"}";
+static const char STATUS_NOT_LIVE_JSON[] = "{\"type\":\"status\",\"status\":\"NOT_LIVE\"}";
+
+static void Put32(BYTE* p, DWORD value)
+{
+	p[0] = (BYTE)value;
+	p[1] = (BYTE)(value >> 8);
+	p[2] = (BYTE)(value >> 16);
+	p[3] = (BYTE)(value >> 24);
+}
+
+static uint32_t Rotate(uint32_t value, int bits)
+{
+	return value << bits | value >> (32 - bits);
+}
+
+//! SHA-1, only for the Sec-WebSocket-Accept of a handshake.
+static void Sha1(const std::string& text, BYTE digest[20])
+{
+	std::vector<BYTE> message(text.begin(), text.end());
+	unsigned long long bits = (unsigned long long)text.size() * 8;
+	message.push_back(0x80);
+	while (message.size() % 64 != 56)
+		message.push_back(0);
+	for (int i = 7; i >= 0; i--)
+		message.push_back((BYTE)(bits >> (i * 8)));
+
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	for (size_t block = 0; block < message.size(); block += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; i++)
+		{
+			const BYTE* p = &message[block + i * 4];
+			w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+		}
+		for (int i = 16; i < 80; i++)
+			w[i] = Rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = Rotate(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = Rotate(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+	for (int i = 0; i < 20; i++)
+		digest[i] = (BYTE)(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+static std::string Base64(const BYTE* data, size_t size)
+{
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string text;
+	for (size_t i = 0; i < size; i += 3)
+	{
+		DWORD group = (DWORD)data[i] << 16 | (i + 1 < size ? (DWORD)data[i + 1] << 8 : 0) | (i + 2 < size ? data[i + 2] : 0);
+		text += digits[group >> 18 & 63];
+		text += digits[group >> 12 & 63];
+		text += i + 1 < size ? digits[group >> 6 & 63] : '=';
+		text += i + 2 < size ? digits[group & 63] : '=';
+	}
+	return text;
+}
+
+static std::string Lower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+	return text;
+}
+
+static std::string Trim(const std::string& text)
+{
+	size_t first = text.find_first_not_of(" \t");
+	size_t last = text.find_last_not_of(" \t\r");
+	return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+}
+
+CStreamServer::CStreamServer() : ListenPort(0), Closed(0), Published(0), Status(0), StatusVersion(0), Taken(0),
+	LoopStatus(0), LoopStatusVersion(0), HasFrame(false), NewestNumber(0), JsonValid(false),
+#ifdef _WIN32
+	// INVALID_SOCKET, winsock2.h stays in StreamServerWin32.cpp
+	Listener(~(UINT_PTR)0), Completion(NULL), AcceptFunction(nullptr), AcceptsPending(0)
+#else
+	Listener(-1), Poller(-1)
+#endif
+{
+#ifndef _WIN32
+	WakeFds[0] = WakeFds[1] = -1;
+#endif
+	memset(&Stats, 0, sizeof(Stats));
+	memset(&Snapshot, 0, sizeof(Snapshot));
+}
+
+CStreamServer::~CStreamServer()
+{
+	Close();
+}
+
+RZStreamConfig CStreamServer::Defaults()
+{
+	RZStreamConfig config;
+	memset(&config, 0, sizeof(config));
+	config.Address = STREAM_DEFAULT_ADDRESS;
+	config.MaxClients = STREAM_DEFAULT_CLIENTS;
+	config.MaxFps = STREAM_DEFAULT_FPS;
+	config.MaxBuffered = STREAM_DEFAULT_BUFFERED;
+	config.RequestTimeout = STREAM_DEFAULT_REQUEST_TIMEOUT;
+	return config;
+}
+
+bool CStreamServer::Open(const RZStreamConfig& config, std::string& error)
+{
+	Close();
+	if (config.MaxBuffered < STREAM_MIN_BUFFERED)
+	{
+		error = "MaxBuffered has to be " + std::to_string(STREAM_MIN_BUFFERED) + " bytes at least";
+		return false;
+	}
+
+	Config = config;
+	Published = 0;
+	Status = 0;
+	StatusVersion = 0;
+	Taken = 0;
+	LoopStatus = 0;
+	LoopStatusVersion = 0;
+	HasFrame = false;
+	JsonValid = false;
+	memset(&Stats, 0, sizeof(Stats));
+	memset(&Snapshot, 0, sizeof(Snapshot));
+	Stop.Reset();
+
+	if (!Listen(error))
+	{
+		Shutdown();
+		return false;
+	}
+	if (!Thread.Start(Run, this))
+	{
+		error = "Failed to start the stream server thread";
+		Shutdown();
+		return false;
+	}
+	return true;
+}
+
+void CStreamServer::Close()
+{
+	if (Thread.IsStarted())
+	{
+		Stop.Set();
+		Wake();
+		Thread.Join(INFINITE);
+	}
+	Shutdown();
+
+	Lock.Enter();
+	Stats.Clients = 0;
+	Snapshot = Stats;
+	Lock.Leave();
+}
+
+DWORD CStreamServer::Run(void* self)
+{
+	((CStreamServer*)self)->Loop();
+	return 0;
+}
+
+void CStreamServer::Publish(const RZEventData& frame)
+{
+	if (!Thread.IsStarted())
+		return;
+
+	Lock.Enter();
+	Frames[Published % STREAM_FRAME_RING] = frame;
+	Published++;
+	Lock.Leave();
+	Wake();
+}
+
+void CStreamServer::SetStatus(CHROMA_BROADCAST_STATUS status)
+{
+	if (!Thread.IsStarted())
+		return;
+
+	Lock.Enter();
+	bool changed = Status != (DWORD)status;
+	if (changed)
+	{
+		Status = status;
+		StatusVersion++;
+	}
+	Lock.Leave();
+	if (changed)
+		Wake();
+}
+
+void CStreamServer::GetStats(RZStreamStats& stats)
+{
+	Lock.Enter();
+	stats = Snapshot;
+	Lock.Leave();
+}
+
+RZStreamClient* CStreamServer::Accept(unsigned long long now)
+{
+	if (Clients.size() >= Config.MaxClients)
+	{
+		Stats.Rejected++;
+		return nullptr;
+	}
+
+	RZStreamClient* client = new RZStreamClient();
+	client->State = STREAM_CLIENT_REQUEST;
+	client->Interval = Config.MaxFps ? 1000000000ULL / Config.MaxFps : 0;
+	client->Connected = now;
+	Clients.push_back(client);
+	Stats.Accepted++;
+	Stats.Clients = Clients.size();
+	return client;
+}
+
+bool CStreamServer::Received(RZStreamClient* client, const BYTE* data, size_t size, unsigned long long now)
+{
+	std::vector<BYTE>& in = client->In;
+	in.insert(in.end(), data, data + size);
+
+	if (client->State == STREAM_CLIENT_REQUEST)
+	{
+		static const char get[] = "GET ";
+		if (!memcmp(in.data(), get, std::min(in.size(), sizeof(get) - 1)))
+		{
+			static const char end[] = "\r\n\r\n";
+			auto found = std::search(in.begin(), in.end(), end, end + 4);
+			if (in.size() < sizeof(get) - 1 || found == in.end())
+			{
+				if (in.size() <= STREAM_MAX_REQUEST)
+					return true;
+				Stats.Rejected++;
+				return false;
+			}
+			std::string request(in.begin(), found);
+			in.erase(in.begin(), found + 4);
+			if (!Upgrade(client, request))
+			{
+				Stats.Rejected++;
+				return false;
+			}
+		}
+		else
+		{
+			auto found = std::find(in.begin(), in.end(), '\n');
+			if (found == in.end())
+			{
+				if (in.size() <= STREAM_MAX_REQUEST)
+					return true;
+				Stats.Rejected++;
+				return false;
+			}
+			std::string line(in.begin(), found);
+			in.erase(in.begin(), found + 1);
+			if (!Options(client, Trim(line)))
+			{
+				Stats.Rejected++;
+				return false;
+			}
+		}
+		if (!Start(client, now))
+			return false;
+	}
+
+	if (client->WebSocket)
+		return WebSocketMessages(client);
+
+	// Lines after the first change the options
+	for (;;)
+	{
+		auto found = std::find(in.begin(), in.end(), '\n');
+		if (found == in.end())
+			break;
+		std::string line(in.begin(), found);
+		in.erase(in.begin(), found + 1);
+		if (!Options(client, Trim(line)))
+			return false;
+	}
+	return in.size() <= STREAM_MAX_REQUEST;
+}
+
+bool CStreamServer::Upgrade(RZStreamClient* client, const std::string& request)
+{
+	// GET <target> HTTP/1.1, then the headers
+	size_t lineEnd = request.find("\r\n");
+	std::string line = request.substr(0, lineEnd);
+	size_t first = line.find(' ');
+	size_t second = first == std::string::npos ? first : line.find(' ', first + 1);
+	if (second == std::string::npos)
+		return false;
+	std::string target = line.substr(first + 1, second - first - 1);
+
+	std::string key;
+	bool upgrade = false;
+	while (lineEnd != std::string::npos)
+	{
+		size_t start = lineEnd + 2;
+		lineEnd = request.find("\r\n", start);
+		std::string header = request.substr(start, lineEnd == std::string::npos ? std::string::npos : lineEnd - start);
+		size_t colon = header.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = Lower(Trim(header.substr(0, colon)));
+		std::string value = Trim(header.substr(colon + 1));
+		if (name == "upgrade")
+			upgrade = Lower(value) == "websocket";
+		else if (name == "sec-websocket-key")
+			key = value;
+	}
+	if (!upgrade || key.empty())
+		return false;
+
+	size_t query = target.find('?');
+	if (!Options(client, query == std::string::npos ? std::string() : target.substr(query + 1)))
+		return false;
+
+	BYTE digest[20];
+	Sha1(key + WS_ACCEPT_GUID, digest);
+	std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+		Base64(digest, sizeof(digest)) + "\r\n\r\n";
+	if (!Queue(client, response.data(), response.size(), WS_RAW))
+		return false;
+	client->WebSocket = true;
+	return true;
+}
+
+bool CStreamServer::Options(RZStreamClient* client, const std::string& query)
+{
+	STREAM_FORMAT format = client->Format;
+	unsigned long long interval = client->Interval;
+	size_t at = !query.empty() && query[0] == '?' ? 1 : 0;
+	while (at < query.size())
+	{
+		size_t end = query.find('&', at);
+		if (end == std::string::npos)
+			end = query.size();
+		std::string option = query.substr(at, end - at);
+		at = end + 1;
+
+		size_t equals = option.find('=');
+		std::string name = option.substr(0, equals);
+		std::string value = equals == std::string::npos ? std::string() : option.substr(equals + 1);
+		if (name == "format")
+		{
+			if (value == "binary")
+				format = STREAM_FORMAT_BINARY;
+			else if (value == "json")
+				format = STREAM_FORMAT_JSON;
+			else if (value == "delta")
+				format = STREAM_FORMAT_DELTA;
+			else
+				return false;
+		}
+		else if (name == "rate")
+		{
+			char* last = nullptr;
+			unsigned long fps = strtoul(value.c_str(), &last, 10);
+			if (value.empty() || *last)
+				return false;
+			if (Config.MaxFps && (!fps || fps > Config.MaxFps))
+				fps = Config.MaxFps;
+			interval = fps ? 1000000000ULL / fps : 0;
+		}
+		// Options this server does not know are left to newer ones
+	}
+
+	// A client switching to deltas starts from a keyframe
+	if (format == STREAM_FORMAT_DELTA && client->Format != STREAM_FORMAT_DELTA)
+		client->Delta.Reset();
+	client->Format = format;
+	client->Interval = interval;
+	return true;
+}
+
+bool CStreamServer::WebSocketMessages(RZStreamClient* client)
+{
+	std::vector<BYTE>& in = client->In;
+	size_t at = 0;
+	while (in.size() - at >= 2)
+	{
+		BYTE opcode = in[at] & 0x0F;
+		bool whole = (in[at] & WS_FINAL) != 0;
+		// Clients have to mask what they send
+		if (!(in[at + 1] & WS_MASKED))
+			return false;
+
+		unsigned long long length = in[at + 1] & 0x7F;
+		size_t header = 2;
+		if (length == 126)
+		{
+			if (in.size() - at < 4)
+				break;
+			length = (unsigned)in[at + 2] << 8 | in[at + 3];
+			header = 4;
+		}
+		else if (length == 127)
+		{
+			if (in.size() - at < 10)
+				break;
+			length = 0;
+			for (int i = 0; i < 8; i++)
+				length = length << 8 | in[at + 2 + i];
+			header = 10;
+		}
+		if (length > STREAM_MAX_REQUEST)
+			return false;
+		if (in.size() - at < header + 4 + length)
+			break;
+
+		const BYTE* mask = &in[at + header];
+		BYTE* payload = &in[at + header + 4];
+		for (size_t i = 0; i < length; i++)
+			payload[i] ^= mask[i % 4];
+
+		if (opcode == WS_CLOSE)
+			return false;
+		if (opcode == WS_PING && !Queue(client, payload, (size_t)length, WS_PONG))
+			return false;
+		// Options fit one message, fragments and binary messages mean nothing to the server
+		if (opcode == WS_TEXT && whole && !Options(client, Trim(std::string(payload, payload + length))))
+			return false;
+		at += header + 4 + (size_t)length;
+	}
+
+	in.erase(in.begin(), in.begin() + at);
+	return true;
+}
+
+bool CStreamServer::Start(RZStreamClient* client, unsigned long long now)
+{
+	client->State = STREAM_CLIENT_STREAMING;
+	if (LoopStatus && !QueueStatus(client))
+		return false;
+	if (HasFrame && !QueueFrame(client, now))
+		return false;
+	return true;
+}
+
+bool CStreamServer::Queue(RZStreamClient* client, const void* data, size_t size, BYTE opcode)
+{
+	BYTE header[10];
+	size_t headerSize = 0;
+	if (client->WebSocket && opcode != WS_RAW)
+	{
+		header[0] = WS_FINAL | opcode;
+		if (size < 126)
+		{
+			header[1] = (BYTE)size;
+			headerSize = 2;
+		}
+		else if (size < 0x10000)
+		{
+			header[1] = 126;
+			header[2] = (BYTE)(size >> 8);
+			header[3] = (BYTE)size;
+			headerSize = 4;
+		}
+		else
+		{
+			header[1] = 127;
+			for (int i = 0; i < 8; i++)
+				header[2 + i] = (BYTE)((unsigned long long)size >> (56 - i * 8));
+			headerSize = 10;
+		}
+	}
+	// JSON over TCP is one object per line
+	bool line = !client->WebSocket && opcode == WS_TEXT;
+
+	size_t buffered = client->Sending.size() - client->Sent + client->Out.size();
+	if (buffered + headerSize + size + (line ? 1 : 0) > Config.MaxBuffered)
+	{
+		Stats.SlowDisconnects++;
+		Disconnect(client);
+		return false;
+	}
+
+	std::vector<BYTE>& out = client->Out;
+	out.insert(out.end(), header, header + headerSize);
+	out.insert(out.end(), (const BYTE*)data, (const BYTE*)data + size);
+	if (line)
+		out.push_back('\n');
+	Stats.Messages++;
+
+	// Otherwise a write is under way and takes Out along once it completes
+	if (client->Sent == client->Sending.size())
+		Flush(client);
+	return client->State != STREAM_CLIENT_CLOSED;
+}
+
+bool CStreamServer::QueueFrame(RZStreamClient* client, unsigned long long now)
+{
+	client->Waiting = false;
+	if (client->Interval)
+	{
+		// Keeps the rate on average without sending two frames closer than it after a late one
+		unsigned long long next = client->NextFrame + client->Interval;
+		client->NextFrame = next > now ? next : now + client->Interval;
+	}
+
+	if (client->Format == STREAM_FORMAT_BINARY)
+		return Queue(client, Binary, sizeof(Binary), WS_BINARY);
+	if (client->Format == STREAM_FORMAT_DELTA)
+	{
+		BYTE message[2 + EFFECT_MAX_ENCODED];
+		size_t size = client->Delta.Encode(Newest, message + 2);
+		message[0] = STREAM_MESSAGE_DELTA;
+		message[1] = (BYTE)size;
+		return Queue(client, message, 2 + size, WS_BINARY);
+	}
+
+	if (!JsonValid)
+	{
+		// Copied out, the fields of the packed frame may not be aligned for the references json takes
+		const CHROMA_BROADCAST_EFFECT& effect = Newest.effect;
+		DWORD app = Newest.index;
+		DWORD colors[5] = { effect.CL1, effect.CL2, effect.CL3, effect.CL4, effect.CL5 };
+		nlohmann::json message = {
+			{"type", "frame"},
+			{"frame", NewestNumber},
+			{"app", app},
+			{"colors", colors},
+			{"app_specific", effect.IsAppSpecific != 0},
+		};
+		Json = message.dump();
+		JsonValid = true;
+	}
+	return Queue(client, Json.data(), Json.size(), WS_TEXT);
+}
+
+bool CStreamServer::QueueStatus(RZStreamClient* client)
+{
+	if (client->Format == STREAM_FORMAT_JSON)
+	{
+		const char* json = LoopStatus == LIVE ? STATUS_LIVE_JSON : STATUS_NOT_LIVE_JSON;
+		return Queue(client, json, strlen(json), WS_TEXT);
+	}
+	BYTE message[2 + STREAM_STATUS_PAYLOAD] = { STREAM_MESSAGE_STATUS, STREAM_STATUS_PAYLOAD, (BYTE)LoopStatus };
+	return Queue(client, message, sizeof(message), WS_BINARY);
+}
+
+unsigned long long CStreamServer::Dispatch(unsigned long long now)
+{
+	Lock.Enter();
+	DWORD count = Published - Taken;
+	if (count > STREAM_FRAME_RING)
+	{
+		Stats.Dropped += count - STREAM_FRAME_RING;
+		Taken = Published - STREAM_FRAME_RING;
+		count = STREAM_FRAME_RING;
+	}
+	for (DWORD i = 0; i < count; i++)
+		Batch[i] = Frames[(Taken + i) % STREAM_FRAME_RING];
+	DWORD first = Taken;
+	Taken = Published;
+	DWORD status = Status;
+	DWORD statusVersion = StatusVersion;
+	Snapshot = Stats;
+	Lock.Leave();
+
+	if (statusVersion != LoopStatusVersion)
+	{
+		LoopStatus = status;
+		LoopStatusVersion = statusVersion;
+		for (RZStreamClient* client : Clients)
+		{
+			if (client->State == STREAM_CLIENT_STREAMING)
+				QueueStatus(client);
+		}
+	}
+
+	for (DWORD i = 0; i < count; i++)
+	{
+		const CHROMA_BROADCAST_EFFECT& effect = Batch[i].effect;
+		Newest = Batch[i];
+		NewestNumber = first + i;
+		HasFrame = true;
+		JsonValid = false;
+		Binary[0] = STREAM_MESSAGE_FRAME;
+		Binary[1] = (BYTE)STREAM_FRAME_PAYLOAD;
+		Put32(Binary + 2, NewestNumber);
+		Put32(Binary + 6, Newest.index);
+		Put32(Binary + 10, effect.CL1);
+		Put32(Binary + 14, effect.CL2);
+		Put32(Binary + 18, effect.CL3);
+		Put32(Binary + 22, effect.CL4);
+		Put32(Binary + 26, effect.CL5);
+		Binary[30] = effect.IsAppSpecific ? 1 : 0;
+		Stats.Frames++;
+
+		bool last = i + 1 == count;
+		for (RZStreamClient* client : Clients)
+		{
+			if (client->State != STREAM_CLIENT_STREAMING)
+				continue;
+			if (!client->Interval)
+			{
+				QueueFrame(client, now);
+				continue;
+			}
+			// A client limited by its rate only ever gets the newest frame
+			if (client->Waiting)
+				Stats.Skipped++;
+			client->Waiting = true;
+			if (last && now >= client->NextFrame)
+				QueueFrame(client, now);
+		}
+	}
+
+	unsigned long long due = 0;
+	unsigned long long timeout = Config.RequestTimeout * 1000000ULL;
+	for (RZStreamClient* client : Clients)
+	{
+		unsigned long long next = 0;
+		if (client->State == STREAM_CLIENT_STREAMING && client->Waiting)
+		{
+			if (now >= client->NextFrame)
+				QueueFrame(client, now);
+			else
+				next = client->NextFrame;
+		}
+		else if (client->State == STREAM_CLIENT_REQUEST && timeout)
+		{
+			if (now - client->Connected >= timeout)
+			{
+				Stats.Rejected++;
+				Disconnect(client);
+			}
+			else
+				next = client->Connected + timeout;
+		}
+		if (next && (!due || next < due))
+			due = next;
+	}
+	return due;
+}
+
+void CStreamServer::Sweep()
+{
+	if (!Closed)
+		return;
+
+	size_t kept = 0;
+	for (RZStreamClient* client : Clients)
+	{
+		if (client->State == STREAM_CLIENT_CLOSED && !client->Operations)
+		{
+			Free(client);
+			Closed--;
+		}
+		else
+			Clients[kept++] = client;
+	}
+	Clients.resize(kept);
+	Stats.Clients = kept;
+}
@@ -0,0 +1,216 @@
+//! \file StreamServer.h
+//! \brief Streams the broadcast to dashboards and other machines over TCP or WebSocket, so they need neither the
+//! DLL nor Synapse. One thread runs an event loop over all clients, epoll on Linux and an I/O completion port on
+//! Windows, and each frame is encoded once for all the binary and all the JSON clients.
+//!
+//! A TCP client sends one line of options, a WebSocket client gives them as the query of its request:
+//!   format=binary|json|delta  binary messages, one JSON object per line or per text message, or binary messages
+//!                       holding only what changed since the frame the client got before, binary by default
+//!   rate=<fps>          most frames a second, the server caps it at MaxFps
+//! It then gets the status and the newest frame, and every frame and status change after them. A frame arriving
+//! before the rate of a client lets it out waits, and a newer frame replaces it. A client that falls MaxBuffered
+//! bytes behind is disconnected instead of buffered for; the kernel buffers the same again at most. Later lines or
+//! WebSocket text messages change the options.
+//!
+//! Binary messages are a type byte, a length byte and the payload, little endian:
+//!   STREAM_MESSAGE_FRAME   frame number (4), app index (4), CL1 to CL5 (4 each), flags (1, bit 0 app specific)
+//!   STREAM_MESSAGE_STATUS  status (1), LIVE or NOT_LIVE
+//!   STREAM_MESSAGE_DELTA   a frame as CEffectEncoder encodes it, EffectCodec.h, the first one a keyframe
+
+#ifndef _STREAMSERVER_H_
+#define _STREAMSERVER_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "EffectCodec.h"
+#include "Platform.h"
+
+enum STREAM_MESSAGE : BYTE
+{
+	STREAM_MESSAGE_FRAME = 1,
+	STREAM_MESSAGE_STATUS = 2,
+	STREAM_MESSAGE_DELTA = 3,
+};
+
+enum STREAM_FORMAT
+{
+	STREAM_FORMAT_BINARY,
+	STREAM_FORMAT_JSON,
+	STREAM_FORMAT_DELTA,
+};
+
+const size_t STREAM_FRAME_PAYLOAD = 29;
+const size_t STREAM_STATUS_PAYLOAD = 1;
+//! Longest options line, WebSocket request or message from a client.
+const size_t STREAM_MAX_REQUEST = 4096;
+//! Frames the loop can fall behind the publisher before it skips to the newest.
+const DWORD STREAM_FRAME_RING = 256;
+
+struct RZStreamConfig
+{
+	DWORD Address;                          //!< Interface to listen on, loopback by default.
+	WORD Port;                              //!< 0 lets the system pick one, see CStreamServer::Port().
+	DWORD MaxClients;
+	DWORD MaxFps;                           //!< Rate of clients that ask for none, and the most any gets. 0 for no limit.
+	DWORD MaxBuffered;                      //!< Bytes a client may fall behind before it is disconnected.
+	DWORD RequestTimeout;                   //!< Milliseconds a client has to send its options.
+};
+
+struct RZStreamStats
+{
+	unsigned long long Clients;             //!< Connected now.
+	unsigned long long Accepted;
+	unsigned long long Rejected;            //!< Turned away at MaxClients, for a bad request or for sending none.
+	unsigned long long SlowDisconnects;     //!< Disconnected for falling MaxBuffered bytes behind.
+	unsigned long long Frames;              //!< Frames streamed.
+	unsigned long long Dropped;             //!< Frames published while the loop was STREAM_FRAME_RING behind.
+	unsigned long long Messages;            //!< Messages queued to clients.
+	unsigned long long Skipped;             //!< Frames a client did not get because of its rate.
+	unsigned long long Bytes;               //!< Bytes written to clients.
+};
+
+enum STREAM_CLIENT_STATE
+{
+	STREAM_CLIENT_REQUEST,                  //!< Waiting for the options line or WebSocket request.
+	STREAM_CLIENT_STREAMING,
+	STREAM_CLIENT_CLOSED,                   //!< Disconnected, freed once no operation uses it.
+};
+
+#ifdef _WIN32
+//! An overlapped accept, receive or send, StreamServerWin32.cpp.
+struct RZStreamOperation;
+#endif
+
+//! A connected client, owned by the thread of the loop.
+struct RZStreamClient
+{
+	STREAM_CLIENT_STATE State;
+	bool WebSocket;
+	STREAM_FORMAT Format;
+	CEffectEncoder Delta;                   //!< Encodes the frames of a delta client against the one it got before.
+	unsigned long long Interval;            //!< Nanoseconds between two frames, 0 for every frame.
+	unsigned long long Connected;
+	unsigned long long NextFrame;           //!< When the rate lets the next frame out.
+	bool Waiting;                           //!< The newest frame waits for the rate.
+	std::vector<BYTE> In;                   //!< Received bytes not handled yet.
+	std::vector<BYTE> Out;                  //!< Queued while Sending is written.
+	std::vector<BYTE> Sending;
+	size_t Sent;                            //!< Bytes of Sending written.
+	int Operations;                         //!< Overlapped operations not completed, always 0 on POSIX.
+#ifdef _WIN32
+	UINT_PTR Socket;
+	RZStreamOperation* Receive;
+	RZStreamOperation* Send;
+#else
+	int Socket;
+	bool PollOut;                           //!< Waiting for the socket to take more.
+#endif
+};
+
+class CStreamServer
+{
+public:
+	CStreamServer();
+	~CStreamServer();
+
+	//! Loopback, a free port, 1024 clients, 240 frames a second, 64 KB behind at most and 5 s for the options.
+	static RZStreamConfig Defaults();
+
+	bool Open(const RZStreamConfig& config, std::string& error);
+	void Close();
+	bool IsOpen() const { return Thread.IsStarted(); }
+	WORD Port() const { return ListenPort; }
+
+	//! Streams frame to the clients. Any thread, allocates nothing.
+	void Publish(const RZEventData& frame);
+	//! Streams status to the clients when it changed. Any thread.
+	void SetStatus(RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status);
+
+	void GetStats(RZStreamStats& stats);
+
+private:
+	CStreamServer(const CStreamServer&) = delete;
+	CStreamServer& operator=(const CStreamServer&) = delete;
+
+	static DWORD Run(void* self);
+
+	// Platform side, StreamServerPosix.cpp and StreamServerWin32.cpp
+	bool Listen(std::string& error);
+	void Loop();
+	void Wake();
+	//! Writes what is queued for client, or starts to.
+	void Flush(RZStreamClient* client);
+	//! Closes the socket of client, it is freed once no operation uses it. Does nothing to a closed client.
+	void Disconnect(RZStreamClient* client);
+	void Free(RZStreamClient* client);
+	void Shutdown();
+#ifdef _WIN32
+	void PostAccept(RZStreamOperation* operation);
+	void PostReceive(RZStreamClient* client);
+	void Complete(RZStreamOperation* operation, bool succeeded, DWORD bytes, unsigned long long now);
+#endif
+
+	// Protocol side, StreamServer.cpp
+	RZStreamClient* Accept(unsigned long long now);
+	//! Handles bytes received. False when the client has to be disconnected.
+	bool Received(RZStreamClient* client, const BYTE* data, size_t size, unsigned long long now);
+	bool Upgrade(RZStreamClient* client, const std::string& request);
+	bool Options(RZStreamClient* client, const std::string& query);
+	bool WebSocketMessages(RZStreamClient* client);
+	bool Start(RZStreamClient* client, unsigned long long now);
+	//! Queues a message, framed as a WebSocket message of opcode for WebSocket clients. A client that fell too
+	//! far behind is disconnected and false returned.
+	bool Queue(RZStreamClient* client, const void* data, size_t size, BYTE opcode);
+	bool QueueFrame(RZStreamClient* client, unsigned long long now);
+	bool QueueStatus(RZStreamClient* client);
+	//! Queues the frames and status published since the last call and the frames clients waited for. Returns when
+	//! the next client waiting for its rate or its request is due, 0 for none.
+	unsigned long long Dispatch(unsigned long long now);
+	//! Frees the clients closed that no operation uses any more.
+	void Sweep();
+
+	RZStreamConfig Config;
+	WORD ListenPort;
+	CThread Thread;
+	CEvent Stop;
+	std::vector<RZStreamClient*> Clients;
+	size_t Closed;                          //!< Clients closed and not freed yet.
+
+	// Written by the publishers, taken by the loop under Lock
+	CLock Lock;
+	RZEventData Frames[STREAM_FRAME_RING];
+	DWORD Published;
+	DWORD Status;
+	DWORD StatusVersion;
+	RZStreamStats Snapshot;
+
+	// Loop side
+	RZEventData Batch[STREAM_FRAME_RING];
+	DWORD Taken;                            //!< Frames taken from Frames.
+	DWORD LoopStatus;
+	DWORD LoopStatusVersion;
+	bool HasFrame;
+	RZEventData Newest;
+	DWORD NewestNumber;
+	BYTE Binary[2 + STREAM_FRAME_PAYLOAD];  //!< Newest, encoded.
+	std::string Json;                       //!< Newest as JSON, once a JSON client needed it.
+	bool JsonValid;
+	RZStreamStats Stats;
+
+#ifdef _WIN32
+	UINT_PTR Listener;
+	HANDLE Completion;
+	void* AcceptFunction;                   //!< AcceptEx, loaded from the provider of the listener.
+	std::vector<RZStreamOperation*> Accepts;
+	int AcceptsPending;
+#else
+	int Listener;
+	int Poller;
+	int WakeFds[2];
+#endif
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "StreamServer.h"
+
+//! Readiness events taken from epoll per wait.
+static const int STREAM_EVENTS = 256;
+static const size_t STREAM_RECEIVE_BUFFER = 4096;
+
+#ifdef __linux__
+
+static bool Watch(int poller, int op, int fd, unsigned int events, void* data)
+{
+	epoll_event event;
+	event.events = events;
+	event.data.ptr = data;
+	return epoll_ctl(poller, op, fd, &event) == 0;
+}
+
+bool CStreamServer::Listen(std::string& error)
+{
+	Listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (Listener < 0)
+	{
+		error = "Failed to open the listening socket";
+		return false;
+	}
+	int reuse = 1;
+	setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(Config.Address);
+	address.sin_port = htons(Config.Port);
+	socklen_t length = sizeof(address);
+	if (bind(Listener, (sockaddr*)&address, sizeof(address)) || listen(Listener, SOMAXCONN) ||
+		getsockname(Listener, (sockaddr*)&address, &length))
+	{
+		error = "Failed to listen on port " + std::to_string(Config.Port) + ": " + strerror(errno);
+		return false;
+	}
+	ListenPort = ntohs(address.sin_port);
+
+	Poller = epoll_create1(EPOLL_CLOEXEC);
+	if (Poller < 0 || pipe2(WakeFds, O_NONBLOCK | O_CLOEXEC) ||
+		!Watch(Poller, EPOLL_CTL_ADD, Listener, EPOLLIN, &Listener) || !Watch(Poller, EPOLL_CTL_ADD, WakeFds[0], EPOLLIN, WakeFds))
+	{
+		error = "Failed to set up epoll";
+		return false;
+	}
+	return true;
+}
+
+void CStreamServer::Loop()
+{
+	epoll_event events[STREAM_EVENTS];
+	BYTE buffer[STREAM_RECEIVE_BUFFER];
+	unsigned long long due = 0;
+	while (!Stop.IsSet())
+	{
+		int timeout = -1;
+		if (due)
+		{
+			unsigned long long now = CPlatform::Now();
+			timeout = due > now ? (int)((due - now + 999999) / 1000000) : 0;
+		}
+		int count = epoll_wait(Poller, events, STREAM_EVENTS, timeout);
+		unsigned long long now = CPlatform::Now();
+
+		for (int i = 0; i < count; i++)
+		{
+			void* data = events[i].data.ptr;
+			if (data == &Listener)
+			{
+				for (;;)
+				{
+					int fd = accept4(Listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+					if (fd < 0)
+						break;
+					RZStreamClient* client = Accept(now);
+					if (!client)
+					{
+						close(fd);
+						continue;
+					}
+					client->Socket = fd;
+					int noDelay = 1;
+					int sendBuffer = (int)Config.MaxBuffered;
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+					setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+					if (!Watch(Poller, EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLRDHUP, client))
+						Disconnect(client);
+				}
+				continue;
+			}
+			if (data == WakeFds)
+			{
+				while (read(WakeFds[0], buffer, sizeof(buffer)) > 0)
+				{
+				}
+				continue;
+			}
+
+			// Events of a client closed earlier in this batch stay valid until Sweep
+			RZStreamClient* client = (RZStreamClient*)data;
+			if (client->State != STREAM_CLIENT_CLOSED && (events[i].events & (EPOLLOUT | EPOLLERR)))
+				Flush(client);
+			while (client->State != STREAM_CLIENT_CLOSED && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+			{
+				ssize_t received = recv(client->Socket, buffer, sizeof(buffer), 0);
+				if (received < 0 && errno == EINTR)
+					continue;
+				if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					break;
+				if (received <= 0 || !Received(client, buffer, (size_t)received, now))
+					Disconnect(client);
+				else if ((size_t)received < sizeof(buffer))
+					break;
+			}
+		}
+
+		due = Dispatch(now);
+		Sweep();
+	}
+}
+
+void CStreamServer::Wake()
+{
+	BYTE signal = 1;
+	if (WakeFds[1] >= 0 && write(WakeFds[1], &signal, 1) < 0)
+	{
+		// The pipe is full, the loop wakes up anyway
+	}
+}
+
+void CStreamServer::Flush(RZStreamClient* client)
+{
+	for (;;)
+	{
+		if (client->Sent == client->Sending.size())
+		{
+			if (client->Out.empty())
+				break;
+			client->Sending.swap(client->Out);
+			client->Out.clear();
+			client->Sent = 0;
+		}
+
+		ssize_t sent = send(client->Socket, client->Sending.data() + client->Sent, client->Sending.size() - client->Sent, MSG_NOSIGNAL);
+		if (sent > 0)
+		{
+			client->Sent += (size_t)sent;
+			Stats.Bytes += (unsigned long long)sent;
+			continue;
+		}
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			if (!client->PollOut && Watch(Poller, EPOLL_CTL_MOD, client->Socket, EPOLLIN | EPOLLRDHUP | EPOLLOUT, client))
+				client->PollOut = true;
+			return;
+		}
+		Disconnect(client);
+		return;
+	}
+
+	client->Sending.clear();
+	client->Sent = 0;
+	if (client->PollOut && Watch(Poller, EPOLL_CTL_MOD, client->Socket, EPOLLIN | EPOLLRDHUP, client))
+		client->PollOut = false;
+}
+
+void CStreamServer::Disconnect(RZStreamClient* client)
+{
+	if (client->State == STREAM_CLIENT_CLOSED)
+		return;
+	// Closing the descriptor takes it out of the epoll set
+	close(client->Socket);
+	client->Socket = -1;
+	client->State = STREAM_CLIENT_CLOSED;
+	Closed++;
+}
+
+void CStreamServer::Free(RZStreamClient* client)
+{
+	delete client;
+}
+
+void CStreamServer::Shutdown()
+{
+	for (RZStreamClient* client : Clients)
+	{
+		Disconnect(client);
+		Free(client);
+	}
+	Clients.clear();
+	Closed = 0;
+
+	if (Listener >= 0)
+		close(Listener);
+	if (Poller >= 0)
+		close(Poller);
+	for (int& fd : WakeFds)
+	{
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+	Listener = -1;
+	Poller = -1;
+	ListenPort = 0;
+}
+
+#else
+
+// Other POSIX systems would need a kqueue loop
+bool CStreamServer::Listen(std::string& error)
+{
+	error = "The stream server needs epoll";
+	return false;
+}
+
+void CStreamServer::Loop()
+{
+}
+
+void CStreamServer::Wake()
+{
+}
+
+void CStreamServer::Flush(RZStreamClient* client)
+{
+}
+
+void CStreamServer::Disconnect(RZStreamClient* client)
+{
+}
+
+void CStreamServer::Free(RZStreamClient* client)
+{
+	delete client;
+}
+
+void CStreamServer::Shutdown()
+{
+}
+
+#endif
+
+#endif
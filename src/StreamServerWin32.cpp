@@ -0,0 +1,335 @@
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <mswsock.h>
+#include <Windows.h>
+#include "StreamServer.h"
+
+#ifdef _MSC_VER
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+
+//! Completions taken from the port per wait.
+static const ULONG STREAM_EVENTS = 256;
+static const size_t STREAM_RECEIVE_BUFFER = 4096;
+//! AcceptEx calls kept waiting for connections.
+static const size_t STREAM_ACCEPTS = 16;
+//! Room AcceptEx needs for each address.
+static const DWORD STREAM_ADDRESS_SIZE = sizeof(sockaddr_in) + 16;
+//! Longest wait for the operations aborted by Shutdown to complete.
+static const DWORD STREAM_DRAIN_TIMEOUT = 1000;
+
+enum STREAM_OPERATION
+{
+	STREAM_OPERATION_ACCEPT,
+	STREAM_OPERATION_RECEIVE,
+	STREAM_OPERATION_SEND,
+};
+
+struct RZStreamOperation
+{
+	OVERLAPPED Overlapped;
+	STREAM_OPERATION Kind;
+	RZStreamClient* Client;
+	SOCKET Socket;                          //!< Accept: the socket the connection is accepted on.
+	BYTE Data[STREAM_RECEIVE_BUFFER];       //!< Receive: the bytes received. Accept: the addresses.
+};
+
+static bool StartWinsock()
+{
+	static bool started = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+}
+
+static RZStreamOperation* NewOperation(STREAM_OPERATION kind, RZStreamClient* client)
+{
+	RZStreamOperation* operation = new RZStreamOperation();
+	operation->Kind = kind;
+	operation->Client = client;
+	operation->Socket = INVALID_SOCKET;
+	return operation;
+}
+
+bool CStreamServer::Listen(std::string& error)
+{
+	if (!StartWinsock())
+	{
+		error = "Failed to start Winsock";
+		return false;
+	}
+	Completion = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	Listener = WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+	if (!Completion || Listener == INVALID_SOCKET)
+	{
+		error = "Failed to open the listening socket";
+		return false;
+	}
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(Config.Address);
+	address.sin_port = htons(Config.Port);
+	int length = sizeof(address);
+	if (bind(Listener, (sockaddr*)&address, sizeof(address)) || listen(Listener, SOMAXCONN) ||
+		getsockname(Listener, (sockaddr*)&address, &length))
+	{
+		error = "Failed to listen on port " + std::to_string(Config.Port) + ", error " + std::to_string(WSAGetLastError());
+		return false;
+	}
+	ListenPort = ntohs(address.sin_port);
+
+	GUID guid = WSAID_ACCEPTEX;
+	LPFN_ACCEPTEX acceptEx = nullptr;
+	DWORD bytes = 0;
+	if (!CreateIoCompletionPort((HANDLE)Listener, Completion, 0, 0) ||
+		WSAIoctl(Listener, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &acceptEx, sizeof(acceptEx), &bytes, NULL, NULL))
+	{
+		error = "Failed to set up the completion port";
+		return false;
+	}
+	AcceptFunction = (void*)acceptEx;
+
+	for (size_t i = 0; i < STREAM_ACCEPTS; i++)
+	{
+		Accepts.push_back(NewOperation(STREAM_OPERATION_ACCEPT, nullptr));
+		PostAccept(Accepts.back());
+	}
+	if (!AcceptsPending)
+	{
+		error = "Failed to accept connections";
+		return false;
+	}
+	return true;
+}
+
+void CStreamServer::PostAccept(RZStreamOperation* operation)
+{
+	operation->Socket = WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+	if (operation->Socket == INVALID_SOCKET)
+		return;
+
+	memset(&operation->Overlapped, 0, sizeof(operation->Overlapped));
+	DWORD bytes = 0;
+	LPFN_ACCEPTEX acceptEx = (LPFN_ACCEPTEX)AcceptFunction;
+	if (!acceptEx(Listener, operation->Socket, operation->Data, 0, STREAM_ADDRESS_SIZE, STREAM_ADDRESS_SIZE, &bytes, &operation->Overlapped) &&
+		WSAGetLastError() != ERROR_IO_PENDING)
+	{
+		closesocket(operation->Socket);
+		operation->Socket = INVALID_SOCKET;
+		return;
+	}
+	AcceptsPending++;
+}
+
+void CStreamServer::PostReceive(RZStreamClient* client)
+{
+	RZStreamOperation* operation = client->Receive;
+	memset(&operation->Overlapped, 0, sizeof(operation->Overlapped));
+	WSABUF buffer = { (ULONG)sizeof(operation->Data), (CHAR*)operation->Data };
+	DWORD flags = 0;
+	if (WSARecv(client->Socket, &buffer, 1, NULL, &flags, &operation->Overlapped, NULL) && WSAGetLastError() != WSA_IO_PENDING)
+	{
+		Disconnect(client);
+		return;
+	}
+	client->Operations++;
+}
+
+void CStreamServer::Complete(RZStreamOperation* operation, bool succeeded, DWORD bytes, unsigned long long now)
+{
+	RZStreamClient* client = operation->Client;
+	switch (operation->Kind)
+	{
+	case STREAM_OPERATION_ACCEPT:
+	{
+		AcceptsPending--;
+		SOCKET socket = operation->Socket;
+		operation->Socket = INVALID_SOCKET;
+		if (!succeeded || Stop.IsSet())
+		{
+			closesocket(socket);
+			if (!Stop.IsSet())
+				PostAccept(operation);
+			break;
+		}
+
+		setsockopt(socket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (const char*)&Listener, sizeof(Listener));
+		client = Accept(now);
+		PostAccept(operation);
+		if (!client)
+		{
+			closesocket(socket);
+			break;
+		}
+		client->Socket = socket;
+		client->Receive = NewOperation(STREAM_OPERATION_RECEIVE, client);
+		client->Send = NewOperation(STREAM_OPERATION_SEND, client);
+		BOOL noDelay = TRUE;
+		int sendBuffer = (int)Config.MaxBuffered;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		setsockopt(socket, SOL_SOCKET, SO_SNDBUF, (const char*)&sendBuffer, sizeof(sendBuffer));
+		if (!CreateIoCompletionPort((HANDLE)socket, Completion, 0, 0))
+			Disconnect(client);
+		else
+			PostReceive(client);
+		break;
+	}
+
+	case STREAM_OPERATION_RECEIVE:
+		client->Operations--;
+		if (client->State == STREAM_CLIENT_CLOSED)
+			break;
+		if (!succeeded || !bytes || !Received(client, operation->Data, bytes, now))
+			Disconnect(client);
+		else
+			PostReceive(client);
+		break;
+
+	case STREAM_OPERATION_SEND:
+		client->Operations--;
+		if (client->State == STREAM_CLIENT_CLOSED)
+			break;
+		// Sends on a stream complete whole unless the connection failed
+		if (!succeeded || bytes != client->Sending.size())
+		{
+			Disconnect(client);
+			break;
+		}
+		Stats.Bytes += bytes;
+		client->Sending.clear();
+		client->Sent = 0;
+		Flush(client);
+		break;
+	}
+}
+
+void CStreamServer::Loop()
+{
+	OVERLAPPED_ENTRY entries[STREAM_EVENTS];
+	unsigned long long due = 0;
+	while (!Stop.IsSet())
+	{
+		DWORD timeout = INFINITE;
+		if (due)
+		{
+			unsigned long long now = CPlatform::Now();
+			timeout = due > now ? (DWORD)((due - now + 999999) / 1000000) : 0;
+		}
+		ULONG count = 0;
+		if (!GetQueuedCompletionStatusEx(Completion, entries, STREAM_EVENTS, &count, timeout, FALSE))
+			count = 0;
+		unsigned long long now = CPlatform::Now();
+
+		for (ULONG i = 0; i < count; i++)
+		{
+			// Wake posts no operation
+			if (!entries[i].lpOverlapped)
+				continue;
+			RZStreamOperation* operation = CONTAINING_RECORD(entries[i].lpOverlapped, RZStreamOperation, Overlapped);
+			Complete(operation, operation->Overlapped.Internal == 0, entries[i].dwNumberOfBytesTransferred, now);
+		}
+
+		due = Dispatch(now);
+		Sweep();
+	}
+}
+
+void CStreamServer::Wake()
+{
+	if (Completion)
+		PostQueuedCompletionStatus(Completion, 0, 0, NULL);
+}
+
+void CStreamServer::Flush(RZStreamClient* client)
+{
+	// A send under way takes Out along once it completes
+	if (client->State == STREAM_CLIENT_CLOSED || client->Sent < client->Sending.size() || client->Out.empty())
+		return;
+
+	client->Sending.swap(client->Out);
+	client->Out.clear();
+	client->Sent = 0;
+	RZStreamOperation* operation = client->Send;
+	memset(&operation->Overlapped, 0, sizeof(operation->Overlapped));
+	WSABUF buffer = { (ULONG)client->Sending.size(), (CHAR*)client->Sending.data() };
+	if (WSASend(client->Socket, &buffer, 1, NULL, 0, &operation->Overlapped, NULL) && WSAGetLastError() != WSA_IO_PENDING)
+	{
+		Disconnect(client);
+		return;
+	}
+	client->Operations++;
+}
+
+void CStreamServer::Disconnect(RZStreamClient* client)
+{
+	if (client->State == STREAM_CLIENT_CLOSED)
+		return;
+	// Aborts the operations of the socket, they complete with an error before Sweep frees the client
+	closesocket(client->Socket);
+	client->Socket = INVALID_SOCKET;
+	client->State = STREAM_CLIENT_CLOSED;
+	Closed++;
+}
+
+void CStreamServer::Free(RZStreamClient* client)
+{
+	delete client->Receive;
+	delete client->Send;
+	delete client;
+}
+
+void CStreamServer::Shutdown()
+{
+	// Completions of aborted accepts must not start new ones
+	Stop.Set();
+	if (Listener != INVALID_SOCKET)
+		closesocket(Listener);
+	Listener = INVALID_SOCKET;
+	for (RZStreamClient* client : Clients)
+		Disconnect(client);
+
+	if (Completion)
+	{
+		OVERLAPPED_ENTRY entries[STREAM_EVENTS];
+		for (;;)
+		{
+			int pending = AcceptsPending;
+			for (RZStreamClient* client : Clients)
+				pending += client->Operations;
+			ULONG count = 0;
+			if (!pending || !GetQueuedCompletionStatusEx(Completion, entries, STREAM_EVENTS, &count, STREAM_DRAIN_TIMEOUT, FALSE))
+				break;
+			for (ULONG i = 0; i < count; i++)
+			{
+				if (!entries[i].lpOverlapped)
+					continue;
+				RZStreamOperation* operation = CONTAINING_RECORD(entries[i].lpOverlapped, RZStreamOperation, Overlapped);
+				Complete(operation, false, 0, 0);
+			}
+		}
+		CloseHandle(Completion);
+		Completion = NULL;
+	}
+
+	for (RZStreamClient* client : Clients)
+		Free(client);
+	Clients.clear();
+	Closed = 0;
+	for (RZStreamOperation* operation : Accepts)
+	{
+		if (operation->Socket != INVALID_SOCKET)
+			closesocket(operation->Socket);
+		delete operation;
+	}
+	Accepts.clear();
+	AcceptsPending = 0;
+	AcceptFunction = nullptr;
+	ListenPort = 0;
+}
+
+#endif
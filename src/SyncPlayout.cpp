@@ -0,0 +1,647 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include "SyncPlayout.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const BYTE SYNC_MAGIC[2] = { 'R', 'S' };
+//! Longest a thread blocks on its socket before it looks at its stop event again.
+static const DWORD SYNC_STOP_POLL = 20;
+//! The last stretch before a presentation time is yielded through rather than slept, poll wakes up late.
+static const unsigned long long SYNC_SPIN = 1000000ULL;
+//! Time requests sent SYNC_FAST_INTERVAL apart after the start or a new session, for a first estimate quickly.
+static const size_t SYNC_FAST_REQUESTS = 8;
+static const unsigned long long SYNC_FAST_INTERVAL = 100000000ULL;
+//! Exchanges whose round trip is this much, or as much again, over the shortest are not trusted.
+static const unsigned long long SYNC_ROUND_TRIP_SLACK = 200000ULL;
+//! The drift is estimated once the trusted exchanges are this many and span this long.
+static const size_t SYNC_DRIFT_SAMPLES = 4;
+static const unsigned long long SYNC_DRIFT_SPAN = 4000000000ULL;
+//! Crystals are within a few tens of ppm, a larger drift comes from a bad estimate.
+static const double SYNC_MAX_RATE = 500e-6;
+//! A frame later than this past its presentation time counts as late.
+static const unsigned long long SYNC_LATE_MARGIN = 1000000ULL;
+
+static void Put64(BYTE* p, unsigned long long value)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (BYTE)(value >> (i * 8));
+}
+
+static unsigned long long Get64(const BYTE* p)
+{
+	unsigned long long value = 0;
+	for (int i = 0; i < 8; i++)
+		value |= (unsigned long long)p[i] << (i * 8);
+	return value;
+}
+
+static DWORD Get32(const BYTE* p)
+{
+	return (DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+static void PutHeader(BYTE* p, SYNC_MESSAGE type, BYTE status, DWORD session)
+{
+	p[0] = SYNC_MAGIC[0];
+	p[1] = SYNC_MAGIC[1];
+	p[2] = type;
+	p[3] = status;
+	for (int i = 0; i < 4; i++)
+		p[4 + i] = (BYTE)(session >> (i * 8));
+}
+
+static bool IsMessage(const BYTE* p, size_t size, SYNC_MESSAGE type, size_t minimum)
+{
+	return size >= minimum && p[0] == SYNC_MAGIC[0] && p[1] == SYNC_MAGIC[1] && p[2] == type;
+}
+
+//------------------------------------------------------------------------------------------------
+// CSyncClock
+
+CSyncClock::CSyncClock()
+{
+	Reset();
+}
+
+void CSyncClock::Reset()
+{
+	memset(History, 0, sizeof(History));
+	Count = 0;
+	Next = 0;
+	Reference = 0;
+	Base = 0;
+	Rate = 0.0;
+	MinRoundTrip = 0;
+}
+
+void CSyncClock::AddSample(unsigned long long t1, unsigned long long t2, unsigned long long t3, unsigned long long t4)
+{
+	// The clocks are unrelated, only differences of the same clock are meaningful
+	long long out = (long long)(t2 - t1);
+	long long back = (long long)(t3 - t4);
+	long long roundTrip = (long long)(t4 - t1) - (long long)(t3 - t2);
+	RZClockSample& sample = History[Next];
+	sample.Local = t1 + (t4 - t1) / 2;
+	sample.Offset = out / 2 + back / 2;
+	sample.RoundTrip = roundTrip > 0 ? (unsigned long long)roundTrip : 0;
+	Next = (Next + 1) % SYNC_CLOCK_SAMPLES;
+	Count = std::min(Count + 1, SYNC_CLOCK_SAMPLES);
+	Estimate();
+}
+
+void CSyncClock::Estimate()
+{
+	MinRoundTrip = History[0].RoundTrip;
+	for (size_t i = 1; i < Count; i++)
+		MinRoundTrip = std::min(MinRoundTrip, History[i].RoundTrip);
+	unsigned long long limit = MinRoundTrip + std::max(MinRoundTrip, SYNC_ROUND_TRIP_SLACK);
+
+	// The offset of an exchange is off by at most half of what its round trip has over the shortest
+	size_t trusted[SYNC_CLOCK_SAMPLES];
+	size_t count = 0;
+	size_t latest = 0;
+	unsigned long long first = 0;
+	for (size_t i = 0; i < Count; i++)
+	{
+		if (History[i].RoundTrip > limit)
+			continue;
+		if (!count || History[i].Local > History[latest].Local)
+			latest = i;
+		if (!count || History[i].Local < first)
+			first = History[i].Local;
+		trusted[count++] = i;
+	}
+
+	Reference = History[latest].Local;
+	Base = History[latest].Offset;
+	Rate = 0.0;
+	if (count < SYNC_DRIFT_SAMPLES || Reference - first < SYNC_DRIFT_SPAN)
+		return;
+
+	// Least squares around the latest trusted exchange, in doubles relative to it so nothing large is squared
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const RZClockSample& sample = History[trusted[i]];
+		double x = -(double)(Reference - sample.Local);
+		double y = (double)(sample.Offset - Base);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	double n = (double)count;
+	double variance = sxx - sx * sx / n;
+	if (variance <= 0)
+		return;
+	double rate = (sxy - sx * sy / n) / variance;
+	Rate = std::max(-SYNC_MAX_RATE, std::min(SYNC_MAX_RATE, rate));
+	Base += (long long)(sy / n - Rate * sx / n);
+}
+
+long long CSyncClock::Offset(unsigned long long local) const
+{
+	return Base + (long long)(Rate * (double)(long long)(local - Reference));
+}
+
+unsigned long long CSyncClock::ToRemote(unsigned long long local) const
+{
+	return local + Offset(local);
+}
+
+unsigned long long CSyncClock::ToLocal(unsigned long long remote) const
+{
+	// The offset changes by Rate per nanosecond, within a ppm of it taken at the guess
+	unsigned long long guess = remote - Base;
+	return remote - Offset(guess);
+}
+
+//------------------------------------------------------------------------------------------------
+// CSyncLeader
+
+CSyncLeader::CSyncLeader() : Session(0), Status(NOT_LIVE), LastSent(0)
+{
+	memset(&Config, 0, sizeof(Config));
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+CSyncLeader::~CSyncLeader()
+{
+	Close();
+}
+
+RZSyncLeaderConfig CSyncLeader::Defaults()
+{
+	RZSyncLeaderConfig config;
+	config.Address = 0;
+	config.Port = SYNC_DEFAULT_PORT;
+	config.Delay = 50000;
+	config.KeyframeInterval = 8;
+	config.MaxFollowers = 64;
+	config.FollowerTimeout = 5000;
+	return config;
+}
+
+bool CSyncLeader::Open(const RZSyncLeaderConfig& config, std::string& error)
+{
+	Close();
+	if (!config.MaxFollowers || !config.KeyframeInterval)
+	{
+		error = "The sync leader needs room for a follower and a keyframe interval";
+		return false;
+	}
+	if (!Socket.Open(config.Port, config.Address))
+	{
+		error = "Failed to open the sync socket on port " + std::to_string(config.Port);
+		return false;
+	}
+
+	Config = config;
+	// Followers tell a restarted leader by its session
+	Session = (DWORD)(CPlatform::Now() ^ ((unsigned long long)CPlatform::ProcessId() << 20)) | 1;
+	Encoder.Reset(config.KeyframeInterval);
+	Followers.clear();
+	Followers.reserve(config.MaxFollowers);
+	Datagrams.assign(config.MaxFollowers, RZDatagram());
+	LastSent = 0;
+	memset(&Stats, 0, sizeof(Stats));
+
+	Stop.Reset();
+	if (!Thread.Start(Run, this))
+	{
+		error = "Failed to start the sync thread";
+		Socket.Close();
+		return false;
+	}
+	return true;
+}
+
+void CSyncLeader::Close()
+{
+	if (Thread.IsStarted())
+	{
+		Stop.Set();
+		Thread.Join(INFINITE);
+	}
+	Socket.Close();
+	Followers.clear();
+	Datagrams.clear();
+}
+
+void CSyncLeader::SetStatus(CHROMA_BROADCAST_STATUS status)
+{
+	Lock.Enter();
+	Status = (BYTE)status;
+	Lock.Leave();
+}
+
+unsigned long long CSyncLeader::Publish(const RZEventData& frame)
+{
+	unsigned long long now = CPlatform::Now();
+	unsigned long long presentation = now + Config.Delay * 1000ULL;
+	BYTE message[SYNC_MAX_DATAGRAM];
+	Lock.Enter();
+	PutHeader(message, SYNC_MESSAGE_FRAME, Status, Session);
+	Put64(message + SYNC_HEADER_SIZE, presentation);
+	size_t size = SYNC_HEADER_SIZE + 8 + Encoder.Encode(frame, message + SYNC_HEADER_SIZE + 8);
+	SendAll(message, size);
+	Stats.Frames++;
+	LastSent = now;
+	Lock.Leave();
+	return presentation;
+}
+
+void CSyncLeader::SendAll(const BYTE* message, size_t size)
+{
+	size_t count = Followers.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		RZDatagram& datagram = Datagrams[i];
+		datagram.To = Followers[i].Address;
+		datagram.Parts = 1;
+		datagram.Data[0] = message;
+		datagram.Size[0] = size;
+	}
+	size_t sent = count ? Socket.Send(Datagrams.data(), count) : 0;
+	Stats.Datagrams += sent;
+	Stats.Failed += count - sent;
+}
+
+void CSyncLeader::GetStats(RZSyncLeaderStats& stats)
+{
+	Lock.Enter();
+	stats = Stats;
+	Lock.Leave();
+}
+
+DWORD CSyncLeader::Run(void* self)
+{
+	((CSyncLeader*)self)->Loop();
+	return 0;
+}
+
+void CSyncLeader::Loop()
+{
+	const unsigned long long heartbeat = SYNC_HEARTBEAT * 1000000ULL;
+	const unsigned long long timeout = Config.FollowerTimeout * 1000000ULL;
+	BYTE buffer[SYNC_MAX_DATAGRAM];
+	while (!Stop.IsSet())
+	{
+		unsigned long long now = CPlatform::Now();
+		Lock.Enter();
+		if (now - LastSent >= heartbeat)
+		{
+			BYTE message[SYNC_HEADER_SIZE + 8];
+			PutHeader(message, SYNC_MESSAGE_STATUS, Status, Session);
+			Put64(message + SYNC_HEADER_SIZE, now + Config.Delay * 1000ULL);
+			SendAll(message, sizeof(message));
+			Stats.Statuses++;
+			LastSent = now;
+		}
+		Followers.erase(std::remove_if(Followers.begin(), Followers.end(),
+			[&](const RZSyncPeer& peer) { return now - peer.LastSeen > timeout; }), Followers.end());
+		Stats.Followers = Followers.size();
+		DWORD wait = (DWORD)((LastSent + heartbeat - now) / 1000000ULL);
+		Lock.Leave();
+
+		RZNetAddress from;
+		int size = Socket.Receive(buffer, sizeof(buffer), std::min(wait, SYNC_STOP_POLL), &from);
+		if (size > 0)
+			Answer(buffer, (size_t)size, from, CPlatform::Now());
+		else if (size < 0)
+			Stop.Wait(1);
+	}
+}
+
+void CSyncLeader::Answer(const BYTE* request, size_t size, const RZNetAddress& from, unsigned long long received)
+{
+	if (!IsMessage(request, size, SYNC_MESSAGE_TIME_REQUEST, SYNC_HEADER_SIZE + 8))
+		return;
+
+	BYTE reply[SYNC_HEADER_SIZE + 24];
+	Lock.Enter();
+	auto peer = std::find_if(Followers.begin(), Followers.end(),
+		[&](const RZSyncPeer& known) { return known.Address.Ip == from.Ip && known.Address.Port == from.Port; });
+	if (peer != Followers.end())
+		peer->LastSeen = received;
+	else if (Followers.size() < Config.MaxFollowers)
+	{
+		RZSyncPeer added = { from, received };
+		Followers.push_back(added);
+		Stats.Followers = Followers.size();
+		// A new follower decodes nothing before a keyframe
+		Encoder.RequestKeyframe();
+	}
+	else
+	{
+		Stats.Rejected++;
+		Lock.Leave();
+		return;
+	}
+	Stats.Requests++;
+	PutHeader(reply, SYNC_MESSAGE_TIME_REPLY, Status, Session);
+	Lock.Leave();
+
+	memcpy(reply + SYNC_HEADER_SIZE, request + SYNC_HEADER_SIZE, 8);
+	Put64(reply + SYNC_HEADER_SIZE + 8, received);
+	RZDatagram datagram;
+	datagram.To = from;
+	datagram.Parts = 1;
+	datagram.Data[0] = reply;
+	datagram.Size[0] = sizeof(reply);
+	// Stamped last, the time between t3 and the send counts as network delay
+	Put64(reply + SYNC_HEADER_SIZE + 16, CPlatform::Now());
+	size_t sent = Socket.Send(&datagram, 1);
+
+	Lock.Enter();
+	Stats.Datagrams += sent;
+	Stats.Failed += 1 - sent;
+	Lock.Leave();
+}
+
+//------------------------------------------------------------------------------------------------
+// CSyncFollower
+
+CSyncFollower::CSyncFollower() : Session(0), HasSession(false), Played(0), LastHeard(0), NextRequest(0), First(0), Count(0)
+{
+	memset(&Config, 0, sizeof(Config));
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+CSyncFollower::~CSyncFollower()
+{
+	Close();
+}
+
+RZSyncFollowerConfig CSyncFollower::Defaults(DWORD ip)
+{
+	RZSyncFollowerConfig config;
+	config.Leader.Ip = ip;
+	config.Leader.Port = SYNC_DEFAULT_PORT;
+	config.PollInterval = 1000;
+	config.LeaderTimeout = 3000;
+	config.ClockOffset = 0;
+	config.ClockDrift = 0;
+	return config;
+}
+
+bool CSyncFollower::ParseLeader(const std::string& text, RZNetAddress& leader)
+{
+	size_t colon = text.find(':');
+	std::string ip = text.substr(0, colon);
+	leader.Port = SYNC_DEFAULT_PORT;
+	if (colon != std::string::npos)
+	{
+		char* end = nullptr;
+		unsigned long port = strtoul(text.c_str() + colon + 1, &end, 10);
+		if (*end || !port || port > 0xFFFF)
+			return false;
+		leader.Port = (WORD)port;
+	}
+	return CUdpSocket::ParseAddress(ip.c_str(), leader.Ip);
+}
+
+bool CSyncFollower::Open(const RZSyncFollowerConfig& config, std::string& error)
+{
+	Close();
+	if (!config.Leader.Ip || !config.Leader.Port || !config.PollInterval)
+	{
+		error = "The sync follower needs the address of the leader and a poll interval";
+		return false;
+	}
+	if (!Socket.Open())
+	{
+		error = "Failed to open a UDP socket";
+		return false;
+	}
+	Config = config;
+	Clock.Reset();
+	Decoder.Reset();
+	HasSession = false;
+	Played = 0;
+	LastHeard = 0;
+	First = 0;
+	Count = 0;
+	memset(&Stats, 0, sizeof(Stats));
+	return true;
+}
+
+void CSyncFollower::Close()
+{
+	Socket.Close();
+}
+
+void CSyncFollower::Wake()
+{
+	if (!Socket.IsOpen())
+		return;
+	RZDatagram datagram;
+	CUdpSocket::ParseAddress("127.0.0.1", datagram.To.Ip);
+	datagram.To.Port = Socket.Port();
+	datagram.Parts = 1;
+	datagram.Data[0] = nullptr;
+	datagram.Size[0] = 0;
+	Socket.Send(&datagram, 1);
+}
+
+void CSyncFollower::GetStats(RZSyncFollowerStats& stats)
+{
+	Lock.Enter();
+	stats = Stats;
+	Lock.Leave();
+}
+
+unsigned long long CSyncFollower::LocalNow() const
+{
+	unsigned long long now = CPlatform::Now();
+	if (!Config.ClockOffset && !Config.ClockDrift)
+		return now;
+	return now + Config.ClockOffset + (long long)((double)now * Config.ClockDrift * 1e-6);
+}
+
+void CSyncFollower::Request(unsigned long long now)
+{
+	BYTE request[SYNC_HEADER_SIZE + 8];
+	PutHeader(request, SYNC_MESSAGE_TIME_REQUEST, 0, HasSession ? Session : 0);
+	Put64(request + SYNC_HEADER_SIZE, now);
+	RZDatagram datagram;
+	datagram.To = Config.Leader;
+	datagram.Parts = 1;
+	datagram.Data[0] = request;
+	datagram.Size[0] = sizeof(request);
+	Socket.Send(&datagram, 1);
+
+	Lock.Enter();
+	Stats.Requests++;
+	Lock.Leave();
+}
+
+void CSyncFollower::NewSession(DWORD session)
+{
+	// A restarted leader has a clock and a stream of its own
+	Session = session;
+	HasSession = true;
+	Clock.Reset();
+	Decoder.Reset();
+	Count = 0;
+	NextRequest = 0;
+	Lock.Enter();
+	Stats.Sessions++;
+	Stats.Samples = 0;
+	Stats.Buffered = 0;
+	Lock.Leave();
+}
+
+void CSyncFollower::Received(const BYTE* data, size_t size, unsigned long long now)
+{
+	if (size < SYNC_HEADER_SIZE || data[0] != SYNC_MAGIC[0] || data[1] != SYNC_MAGIC[1])
+		return;
+	BYTE status = data[3];
+	DWORD session = Get32(data + 4);
+	if (!HasSession || session != Session)
+		NewSession(session);
+	LastHeard = now;
+
+	if (IsMessage(data, size, SYNC_MESSAGE_TIME_REPLY, SYNC_HEADER_SIZE + 24))
+	{
+		Clock.AddSample(Get64(data + SYNC_HEADER_SIZE), Get64(data + SYNC_HEADER_SIZE + 8), Get64(data + SYNC_HEADER_SIZE + 16), now);
+		Lock.Enter();
+		Stats.Replies++;
+		Stats.Samples = Clock.Samples();
+		Stats.Offset = Clock.Offset(now);
+		Stats.Drift = Clock.Drift();
+		Stats.RoundTrip = Clock.RoundTrip();
+		Lock.Leave();
+	}
+	else if (IsMessage(data, size, SYNC_MESSAGE_STATUS, SYNC_HEADER_SIZE + 8))
+		Buffer(Get64(data + SYNC_HEADER_SIZE), status, nullptr, now);
+	else if (IsMessage(data, size, SYNC_MESSAGE_FRAME, SYNC_HEADER_SIZE + 8))
+	{
+		RZEventData frame;
+		unsigned long long lost = Decoder.GetStats().Lost;
+		EFFECT_DECODE result = Decoder.Decode(data + SYNC_HEADER_SIZE + 8, size - SYNC_HEADER_SIZE - 8, frame);
+		Lock.Enter();
+		Stats.Lost += Decoder.GetStats().Lost - lost;
+		if (result != EFFECT_DECODE_FRAME)
+			Stats.Waiting++;
+		Lock.Leave();
+		if (result == EFFECT_DECODE_FRAME)
+			Buffer(Get64(data + SYNC_HEADER_SIZE), status, &frame, now);
+	}
+}
+
+void CSyncFollower::Buffer(unsigned long long presentation, BYTE status, const RZEventData* frame, unsigned long long now)
+{
+	Lock.Enter();
+	if (!Clock.IsSynced())
+	{
+		if (frame)
+			Stats.Unsynced++;
+		Lock.Leave();
+		return;
+	}
+	if (Count == SYNC_BUFFER_DEPTH)
+	{
+		// Only a leader publishing faster than the buffer holds gets here, the oldest entry goes
+		if (Entries[First].HasFrame)
+			Stats.Overflows++;
+		First = (First + 1) % SYNC_BUFFER_DEPTH;
+		Count--;
+	}
+	if (frame && Clock.ToLocal(presentation) + SYNC_LATE_MARGIN < now)
+		Stats.Late++;
+	Lock.Leave();
+
+	// Datagrams rarely overtake each other, the entry almost always goes at the end
+	size_t at = Count;
+	while (at && Entries[(First + at - 1) % SYNC_BUFFER_DEPTH].Presentation > presentation)
+	{
+		Entries[(First + at) % SYNC_BUFFER_DEPTH] = Entries[(First + at - 1) % SYNC_BUFFER_DEPTH];
+		at--;
+	}
+	RZSyncEntry& entry = Entries[(First + at) % SYNC_BUFFER_DEPTH];
+	entry.Presentation = presentation;
+	entry.HasFrame = frame != nullptr;
+	entry.Status = status;
+	if (frame)
+		entry.Frame = *frame;
+	Count++;
+}
+
+unsigned long long CSyncFollower::Play(unsigned long long now, SYNC_PLAYOUT_CALLBACK callback, void* user)
+{
+	while (Count)
+	{
+		const RZSyncEntry& entry = Entries[First];
+		unsigned long long due = Clock.ToLocal(entry.Presentation);
+		if (due > now)
+			return due;
+
+		RZSyncEntry played = entry;
+		First = (First + 1) % SYNC_BUFFER_DEPTH;
+		Count--;
+		CHROMA_BROADCAST_STATUS status = played.Status == LIVE ? LIVE : NOT_LIVE;
+		if (played.HasFrame)
+		{
+			Lock.Enter();
+			Stats.Frames++;
+			Lock.Leave();
+			callback(&played.Frame, status, user);
+		}
+		else if (played.Status != Played)
+			callback(nullptr, status, user);
+		Played = (BYTE)status;
+		now = LocalNow();
+	}
+	return 0;
+}
+
+void CSyncFollower::Run(CEvent& stop, SYNC_PLAYOUT_CALLBACK callback, void* user)
+{
+	if (!Socket.IsOpen())
+		return;
+
+	const unsigned long long silence = Config.LeaderTimeout * 1000000ULL;
+	BYTE buffer[SYNC_MAX_DATAGRAM];
+	NextRequest = 0;
+	while (!stop.IsSet())
+	{
+		unsigned long long now = LocalNow();
+		if (now >= NextRequest)
+		{
+			Request(now);
+			NextRequest = now + (Clock.Samples() < SYNC_FAST_REQUESTS ? SYNC_FAST_INTERVAL : Config.PollInterval * 1000000ULL);
+		}
+
+		// A silent leader is gone, NOT_LIVE instead of the last frame for ever
+		if (Played == LIVE && LastHeard && now - LastHeard > silence)
+		{
+			Count = 0;
+			Played = NOT_LIVE;
+			callback(nullptr, NOT_LIVE, user);
+		}
+
+		unsigned long long due = Play(now, callback, user);
+		now = LocalNow();
+		unsigned long long wake = std::min(NextRequest, now + SYNC_STOP_POLL * 1000000ULL);
+		if (due)
+			wake = std::min(wake, due);
+		Lock.Enter();
+		Stats.Buffered = Count;
+		Lock.Leave();
+
+		unsigned long long wait = wake > now ? wake - now : 0;
+		DWORD milliseconds = wait > SYNC_SPIN ? (DWORD)((wait - SYNC_SPIN) / 1000000ULL) : 0;
+		RZNetAddress from;
+		int size = Socket.Receive(buffer, sizeof(buffer), milliseconds, &from);
+		if (size > 0 && from.Ip == Config.Leader.Ip && from.Port == Config.Leader.Port)
+			Received(buffer, (size_t)size, LocalNow());
+		else if (size < 0)
+			stop.Wait(1);
+		else if (!size && !milliseconds)
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,254 @@
+//! \file SyncPlayout.h
+//! \brief Plays the broadcast at the same moment on several machines. A leader, chroma-broker -y, stamps every frame
+//! with a presentation time on its own clock, Delay after it arrived, and sends it over UDP to each follower.
+//! Followers keep an estimate of the leader's clock from NTP style exchanges and hold each frame in a jitter buffer
+//! until its presentation time comes on that estimate. The DLL follows a leader when RZBROADCAST_SYNC is set, the
+//! processes on the leader's machine follow it over the loopback interface like any other.
+//!
+//! Datagrams start with the magic "RS", a type byte, the stream status and the session of the leader, a random
+//! number that changes when it restarts, then carry little endian times in nanoseconds:
+//!   SYNC_MESSAGE_FRAME         presentation time (8), the frame as CEffectEncoder encodes it
+//!   SYNC_MESSAGE_STATUS        presentation time (8), sent when no frame went out for SYNC_HEARTBEAT
+//!   SYNC_MESSAGE_TIME_REQUEST  follower send time (8), also registers the follower with the leader
+//!   SYNC_MESSAGE_TIME_REPLY    follower send time, leader receive time, leader send time (8 each)
+//! A follower that misses a frame waits for the next keyframe, a few frames later.
+
+#ifndef _SYNCPLAYOUT_H_
+#define _SYNCPLAYOUT_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "EffectCodec.h"
+#include "Platform.h"
+
+enum SYNC_MESSAGE : BYTE
+{
+	SYNC_MESSAGE_FRAME = 1,
+	SYNC_MESSAGE_STATUS = 2,
+	SYNC_MESSAGE_TIME_REQUEST = 3,
+	SYNC_MESSAGE_TIME_REPLY = 4,
+};
+
+const WORD SYNC_DEFAULT_PORT = 21330;
+const size_t SYNC_HEADER_SIZE = 8;
+const size_t SYNC_MAX_DATAGRAM = SYNC_HEADER_SIZE + 8 + EFFECT_MAX_ENCODED;
+//! Exchanges the clock estimate is made from, a window of about half a minute once synced.
+const size_t SYNC_CLOCK_SAMPLES = 32;
+//! Frames and status changes a follower holds for their presentation time.
+const size_t SYNC_BUFFER_DEPTH = 256;
+//! Milliseconds between two status messages of a leader publishing no frames.
+const DWORD SYNC_HEARTBEAT = 500;
+
+//! Estimates a remote clock from request and reply exchanges, NTP style: each exchange gives an offset, accurate to
+//! half its round trip. Only the exchanges whose round trip is close to the shortest seen are trusted, and once
+//! they span a few seconds a least squares line through their offsets gives the drift as well. Allocates nothing.
+class CSyncClock
+{
+public:
+	CSyncClock();
+
+	void Reset();
+	//! Adds an exchange: the request left at t1 and the reply arrived at t4 on the local clock, the remote clock
+	//! received the request at t2 and sent the reply at t3.
+	void AddSample(unsigned long long t1, unsigned long long t2, unsigned long long t3, unsigned long long t4);
+
+	bool IsSynced() const { return Count != 0; }
+	size_t Samples() const { return Count; }
+	unsigned long long ToRemote(unsigned long long local) const;
+	unsigned long long ToLocal(unsigned long long remote) const;
+	//! Remote time minus local time now, in nanoseconds.
+	long long Offset(unsigned long long local) const;
+	//! Parts per million the remote clock runs faster than the local one.
+	double Drift() const { return Rate * 1e6; }
+	//! Shortest round trip in the window, in nanoseconds.
+	unsigned long long RoundTrip() const { return MinRoundTrip; }
+
+private:
+	struct RZClockSample
+	{
+		unsigned long long Local;           //!< Middle of the exchange on the local clock.
+		long long Offset;
+		unsigned long long RoundTrip;
+	};
+
+	void Estimate();
+
+	RZClockSample History[SYNC_CLOCK_SAMPLES];
+	size_t Count;
+	size_t Next;
+	unsigned long long Reference;           //!< Local time the estimate is anchored at.
+	long long Base;                         //!< Offset at Reference.
+	double Rate;                            //!< Change of the offset per nanosecond.
+	unsigned long long MinRoundTrip;
+};
+
+struct RZSyncLeaderConfig
+{
+	DWORD Address;                          //!< Interface to listen on, any by default.
+	WORD Port;                              //!< 0 lets the system pick one, see CSyncLeader::Port().
+	DWORD Delay;                            //!< Microseconds from Publish to the presentation of a frame.
+	DWORD KeyframeInterval;                 //!< Frames between two keyframes, a follower that lost one waits as many.
+	DWORD MaxFollowers;
+	DWORD FollowerTimeout;                  //!< Milliseconds a follower is served after its last time request.
+};
+
+struct RZSyncLeaderStats
+{
+	unsigned long long Followers;           //!< Served now.
+	unsigned long long Frames;
+	unsigned long long Statuses;            //!< Status messages sent while no frames went out.
+	unsigned long long Requests;            //!< Time requests answered.
+	unsigned long long Rejected;            //!< Time requests from followers past MaxFollowers.
+	unsigned long long Datagrams;
+	unsigned long long Failed;              //!< Datagrams the socket did not take.
+};
+
+//! Publishes the frames with their presentation time to the followers that asked for the time in the last
+//! FollowerTimeout, and answers their time requests on a thread of its own.
+class CSyncLeader
+{
+public:
+	CSyncLeader();
+	~CSyncLeader();
+
+	//! Any interface, SYNC_DEFAULT_PORT, 50 ms of delay, a keyframe every 8 frames, 64 followers for 5 s each.
+	static RZSyncLeaderConfig Defaults();
+
+	bool Open(const RZSyncLeaderConfig& config, std::string& error);
+	void Close();
+	bool IsOpen() const { return Thread.IsStarted(); }
+	WORD Port() const { return Socket.Port(); }
+
+	//! Sends frame to every follower and returns its presentation time on CPlatform::Now(). Allocates nothing.
+	unsigned long long Publish(const RZEventData& frame);
+	//! The status sent with the frames and the heartbeats, NOT_LIVE until set.
+	void SetStatus(RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status);
+
+	void GetStats(RZSyncLeaderStats& stats);
+
+private:
+	CSyncLeader(const CSyncLeader&) = delete;
+	CSyncLeader& operator=(const CSyncLeader&) = delete;
+
+	struct RZSyncPeer
+	{
+		RZNetAddress Address;
+		unsigned long long LastSeen;
+	};
+
+	static DWORD Run(void* self);
+	void Loop();
+	//! Sends message to every follower. Called with Lock held.
+	void SendAll(const BYTE* message, size_t size);
+	void Answer(const BYTE* request, size_t size, const RZNetAddress& from, unsigned long long received);
+
+	RZSyncLeaderConfig Config;
+	CUdpSocket Socket;
+	CThread Thread;
+	CEvent Stop;
+	CLock Lock;                             //!< Guards everything below.
+	DWORD Session;
+	BYTE Status;
+	CEffectEncoder Encoder;
+	std::vector<RZSyncPeer> Followers;
+	std::vector<RZDatagram> Datagrams;      //!< One for each follower, sized at Open.
+	unsigned long long LastSent;
+	RZSyncLeaderStats Stats;
+};
+
+//! Plays a frame, or only a change of the status when frame is null, at its presentation time.
+typedef void (*SYNC_PLAYOUT_CALLBACK)(const RZEventData* frame, RzChromaBroadcastAPI::CHROMA_BROADCAST_STATUS status, void* user);
+
+struct RZSyncFollowerConfig
+{
+	RZNetAddress Leader;
+	DWORD PollInterval;                     //!< Milliseconds between two time requests once synced.
+	DWORD LeaderTimeout;                    //!< Milliseconds without a datagram before the stream counts as NOT_LIVE.
+	long long ClockOffset;                  //!< Test only: nanoseconds added to the local clock.
+	int ClockDrift;                         //!< Test only: parts per million the local clock runs fast.
+};
+
+struct RZSyncFollowerStats
+{
+	unsigned long long Frames;              //!< Frames played.
+	unsigned long long Late;                //!< Frames that arrived after their presentation time, played at once.
+	unsigned long long Unsynced;            //!< Frames dropped before the first clock exchange.
+	unsigned long long Overflows;           //!< Frames dropped for a full jitter buffer.
+	unsigned long long Lost;                //!< Frames the leader sent that never arrived.
+	unsigned long long Waiting;             //!< Frames dropped waiting for a keyframe.
+	unsigned long long Requests;
+	unsigned long long Replies;
+	unsigned long long Sessions;            //!< Leader sessions followed, more than 1 after a leader restarted.
+	size_t Samples;                         //!< Exchanges the clock estimate is made from.
+	long long Offset;                       //!< Leader clock minus the local clock, in nanoseconds.
+	double Drift;                           //!< Parts per million the leader clock runs faster.
+	unsigned long long RoundTrip;           //!< Shortest recent round trip, in nanoseconds.
+	size_t Buffered;                        //!< Entries waiting in the jitter buffer.
+};
+
+//! Follows a leader on the thread that calls Run: asks it for the time every 100 ms until 8 exchanges came back and
+//! then every PollInterval, and calls back each frame and status change at its presentation time on the local clock.
+class CSyncFollower
+{
+public:
+	CSyncFollower();
+	~CSyncFollower();
+
+	//! The leader at ip on SYNC_DEFAULT_PORT, a time request every second, NOT_LIVE after 3 s of silence.
+	static RZSyncFollowerConfig Defaults(DWORD ip);
+	//! Parses "ip" or "ip:port".
+	static bool ParseLeader(const std::string& text, RZNetAddress& leader);
+
+	bool Open(const RZSyncFollowerConfig& config, std::string& error);
+	void Close();
+	bool IsOpen() const { return Socket.IsOpen(); }
+
+	//! Follows the leader until stop is set, calling callback on this thread. Notices stop within 20 ms, at once
+	//! after a Wake.
+	void Run(CEvent& stop, SYNC_PLAYOUT_CALLBACK callback, void* user);
+	//! Sends Run an empty datagram, for a stop set from another thread.
+	void Wake();
+
+	void GetStats(RZSyncFollowerStats& stats);
+
+private:
+	CSyncFollower(const CSyncFollower&) = delete;
+	CSyncFollower& operator=(const CSyncFollower&) = delete;
+
+	struct RZSyncEntry
+	{
+		unsigned long long Presentation;    //!< On the leader's clock.
+		bool HasFrame;
+		BYTE Status;
+		RZEventData Frame;
+	};
+
+	//! The local clock, shifted and skewed for tests.
+	unsigned long long LocalNow() const;
+	void Request(unsigned long long now);
+	void Received(const BYTE* data, size_t size, unsigned long long now);
+	void NewSession(DWORD session);
+	void Buffer(unsigned long long presentation, BYTE status, const RZEventData* frame, unsigned long long now);
+	//! Plays the entries due by now, returns when the next one is due, 0 for none.
+	unsigned long long Play(unsigned long long now, SYNC_PLAYOUT_CALLBACK callback, void* user);
+
+	RZSyncFollowerConfig Config;
+	CUdpSocket Socket;
+	CSyncClock Clock;
+	CEffectDecoder Decoder;
+	DWORD Session;
+	bool HasSession;
+	BYTE Played;                            //!< Status last called back, 0 for none.
+	unsigned long long LastHeard;
+	unsigned long long NextRequest;
+	RZSyncEntry Entries[SYNC_BUFFER_DEPTH]; //!< Ordered by presentation time, from First.
+	size_t First;
+	size_t Count;
+	CLock Lock;                             //!< Guards Stats.
+	RZSyncFollowerStats Stats;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <vector>
+#include <new>
+#include "json.hpp"
+#include "Platform.h"
+#include "Trace.h"
+
+static const char* TraceSpanNames[TRACE_SPAN_COUNT] =
+{
+	"Init",
+	"VerifyAppId",
+	"StartThreads",
+	"Wait",
+	"Snapshot",
+	"HealthCheck",
+	"Filter",
+	"Callback",
+	"ServicePoll",
+};
+
+std::atomic<bool> CBroadcastTrace::Enabled(false);
+std::atomic<CTraceBuffer*> CBroadcastTrace::Buffers(nullptr);
+
+struct CTraceThread
+{
+	CTraceBuffer* Buffer = nullptr;
+
+	~CTraceThread()
+	{
+		if (Buffer)
+			Buffer->InUse.store(false, std::memory_order_release);
+	}
+};
+
+static thread_local CTraceThread TraceThread;
+
+CTraceBuffer* CBroadcastTrace::AcquireBuffer()
+{
+	// Recycle the buffer of a thread that has exited, its spans are overwritten from here on
+	for (CTraceBuffer* buffer = Buffers.load(std::memory_order_acquire); buffer; buffer = buffer->Next)
+	{
+		bool inUse = false;
+		if (buffer->InUse.compare_exchange_strong(inUse, true, std::memory_order_acq_rel))
+		{
+			buffer->Head.store(0, std::memory_order_relaxed);
+			buffer->ThreadId.store(CPlatform::ThreadId(), std::memory_order_relaxed);
+			buffer->ThreadName = nullptr;
+			return buffer;
+		}
+	}
+
+	CTraceBuffer* buffer = new (std::nothrow) CTraceBuffer;
+	if (!buffer)
+		return nullptr;
+	buffer->Head.store(0, std::memory_order_relaxed);
+	buffer->InUse.store(true, std::memory_order_relaxed);
+	buffer->ThreadId.store(CPlatform::ThreadId(), std::memory_order_relaxed);
+	buffer->ThreadName = nullptr;
+
+	CTraceBuffer* head = Buffers.load(std::memory_order_relaxed);
+	do
+	{
+		buffer->Next = head;
+	} while (!Buffers.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+	return buffer;
+}
+
+void CBroadcastTrace::SetThreadName(const char* name)
+{
+	if (!TraceThread.Buffer)
+		TraceThread.Buffer = AcquireBuffer();
+	if (TraceThread.Buffer)
+		TraceThread.Buffer->ThreadName = name;
+}
+
+void CBroadcastTrace::Record(TRACE_SPAN span, unsigned long long start, unsigned long long end)
+{
+	CTraceBuffer* buffer = TraceThread.Buffer;
+	if (!buffer)
+	{
+		buffer = TraceThread.Buffer = AcquireBuffer();
+		if (!buffer)
+			return;
+	}
+
+	unsigned long long head = buffer->Head.load(std::memory_order_relaxed);
+	RZTraceEvent& event = buffer->Events[head % CTraceBuffer::CAPACITY];
+	event.Start = start;
+	event.Duration = end - start;
+	event.Span = span;
+	buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+bool CBroadcastTrace::Dump(const char* path)
+{
+	if (!path || !*path)
+		return false;
+
+	nlohmann::json events = nlohmann::json::array();
+	DWORD pid = CPlatform::ProcessId();
+
+	for (CTraceBuffer* buffer = Buffers.load(std::memory_order_acquire); buffer; buffer = buffer->Next)
+	{
+		unsigned long tid = buffer->ThreadId.load(std::memory_order_relaxed);
+		unsigned long long head = buffer->Head.load(std::memory_order_acquire);
+		unsigned long long first = head > CTraceBuffer::CAPACITY ? head - CTraceBuffer::CAPACITY : 0;
+
+		std::vector<RZTraceEvent> copy;
+		copy.reserve((size_t)(head - first));
+		for (unsigned long long i = first; i < head; i++)
+			copy.push_back(buffer->Events[i % CTraceBuffer::CAPACITY]);
+
+		// Drop whatever the owner overwrote while we were copying, and the slot of index after it may be
+		// writing without having published it yet. The fence orders the plain reads of the copy before the reload.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		unsigned long long after = buffer->Head.load(std::memory_order_relaxed);
+		unsigned long long valid = after + 1 > CTraceBuffer::CAPACITY ? after + 1 - CTraceBuffer::CAPACITY : 0;
+
+		if (buffer->ThreadName)
+		{
+			events.push_back({ {"name", "thread_name"}, {"ph", "M"}, {"pid", pid}, {"tid", tid}, {"args", { {"name", buffer->ThreadName} }} });
+		}
+
+		for (unsigned long long i = first; i < head; i++)
+		{
+			if (i < valid)
+				continue;
+
+			const RZTraceEvent& event = copy[(size_t)(i - first)];
+			if (event.Span >= TRACE_SPAN_COUNT)
+				continue;
+
+			events.push_back({
+				{"name", TraceSpanNames[event.Span]},
+				{"cat", "ChromaBroadcastAPI"},
+				{"ph", "X"},
+				{"ts", event.Start / 1000.0},
+				{"dur", event.Duration / 1000.0},
+				{"pid", pid},
+				{"tid", tid},
+			});
+		}
+	}
+
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	nlohmann::json trace = { {"traceEvents", events}, {"displayTimeUnit", "ns"} };
+	std::string text = trace.dump();
+	bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+	fclose(f);
+	return ok;
+}
+
+unsigned long long CBroadcastTrace::Now()
+{
+	return CPlatform::Now();
+}
@@ -0,0 +1,104 @@
+//! \file Trace.h
+//! \brief Optional span tracing of the pipeline stages, dumped as Chrome trace event JSON.
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#pragma once
+
+#include <atomic>
+
+enum TRACE_SPAN : unsigned short
+{
+	TRACE_INIT,
+	TRACE_VERIFY_APP,
+	TRACE_START_THREADS,
+	TRACE_WAIT,
+	TRACE_SNAPSHOT,
+	TRACE_HEALTH_CHECK,
+	TRACE_FILTER,
+	TRACE_CALLBACK,
+	TRACE_SERVICE_POLL,
+	TRACE_SPAN_COUNT
+};
+
+struct RZTraceEvent
+{
+	unsigned long long Start;
+	unsigned long long Duration;
+	TRACE_SPAN Span;
+};
+
+//! Single producer ring owned by one thread. Buffers are recycled, never freed.
+struct CTraceBuffer
+{
+	static const unsigned int CAPACITY = 16384;
+
+	std::atomic<unsigned long long> Head;
+	std::atomic<bool> InUse;
+	std::atomic<unsigned long> ThreadId;
+	const char* ThreadName;
+	CTraceBuffer* Next;
+	RZTraceEvent Events[CAPACITY];
+};
+
+class CBroadcastTrace
+{
+public:
+	//! A span reads this once, while tracing is off it costs the load and one predictable branch.
+	static bool IsEnabled() { return Enabled.load(std::memory_order_relaxed); }
+	static void Enable(bool enable) { Enabled.store(enable, std::memory_order_relaxed); }
+
+	//! Names the calling thread in the trace.
+	static void SetThreadName(const char* name);
+	static void Record(TRACE_SPAN span, unsigned long long start, unsigned long long end);
+
+	//! Writes all buffered spans as Chrome trace JSON. Safe while the workers are still recording.
+	static bool Dump(const char* path);
+
+	//! Monotonic clock in nanoseconds.
+	static unsigned long long Now();
+
+private:
+	static CTraceBuffer* AcquireBuffer();
+
+	static std::atomic<bool> Enabled;
+	static std::atomic<CTraceBuffer*> Buffers;
+};
+
+//! Scoped span, records from construction to destruction when tracing was enabled at its construction.
+//! The flag is read once, the checks after it test the same register and fold into the first.
+class CTraceSpan
+{
+public:
+	explicit CTraceSpan(TRACE_SPAN span) : Span(span), Tracing(CBroadcastTrace::IsEnabled()), Start(0)
+	{
+		if (Tracing)
+			Start = CBroadcastTrace::Now();
+	}
+
+	~CTraceSpan()
+	{
+		End();
+	}
+
+	//! Closes the span before the end of its scope.
+	void End()
+	{
+		if (Tracing)
+		{
+			CBroadcastTrace::Record(Span, Start, CBroadcastTrace::Now());
+			Tracing = false;
+		}
+	}
+
+private:
+	CTraceSpan(const CTraceSpan&) = delete;
+	CTraceSpan& operator=(const CTraceSpan&) = delete;
+
+	TRACE_SPAN Span;
+	bool Tracing;
+	unsigned long long Start;
+};
+
+#endif
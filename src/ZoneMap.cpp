@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include "json.hpp"
+#include "ZoneMap.h"
+
+using namespace RzChromaBroadcastAPI;
+
+//! Planes start on cache lines of their own.
+static const size_t ZONE_PLANE_ALIGN = 64 / sizeof(float);
+
+CZoneMap::CZoneMap(SIMD_LEVEL level) : Count(0), Stride(0)
+{
+	Simd = CSimd::IsSupported(level) ? level : CSimd::Level();
+	Kernels = ColorKernelsFor(Simd);
+	memset(Used, 0, sizeof(Used));
+}
+
+void CZoneMap::Reset(size_t leds)
+{
+	Count = leds;
+	Stride = (leds + ZONE_PLANE_ALIGN - 1) / ZONE_PLANE_ALIGN * ZONE_PLANE_ALIGN;
+	Weights.assign(BLEND_MAX_COLORS * Stride, 0.0f);
+	memset(Used, 0, sizeof(Used));
+}
+
+bool CZoneMap::AddSolid(size_t first, size_t count, int color)
+{
+	if (!InRange(first, count) || color < 0 || color >= BLEND_MAX_COLORS)
+		return false;
+
+	for (int k = 0; k < BLEND_MAX_COLORS; k++)
+	{
+		float* plane = Plane(k) + first;
+		float weight = k == color ? 1.0f : 0.0f;
+		for (size_t i = 0; i < count; i++)
+			plane[i] = weight;
+	}
+	Used[color] = Used[color] || count > 0;
+	return true;
+}
+
+bool CZoneMap::AddGradient(size_t first, size_t count, const int* stops, int stopCount)
+{
+	if (!InRange(first, count) || stopCount < 1)
+		return false;
+	for (int s = 0; s < stopCount; s++)
+	{
+		if (stops[s] < 0 || stops[s] >= BLEND_MAX_COLORS)
+			return false;
+	}
+	if (stopCount == 1)
+		return AddSolid(first, count, stops[0]);
+
+	for (int k = 0; k < BLEND_MAX_COLORS; k++)
+		memset(Plane(k) + first, 0, count * sizeof(float));
+
+	// Each LED sits between two stops and weighs them by how close it is to each
+	for (size_t i = 0; i < count; i++)
+	{
+		double position = count > 1 ? (double)i * (stopCount - 1) / (count - 1) : 0.0;
+		int stop = (int)position;
+		if (stop >= stopCount - 1)
+			stop = stopCount - 2;
+		float along = (float)(position - stop);
+		Plane(stops[stop])[first + i] += 1.0f - along;
+		Plane(stops[stop + 1])[first + i] += along;
+	}
+	for (int s = 0; s < stopCount; s++)
+		Used[stops[s]] = Used[stops[s]] || count > 0;
+	return true;
+}
+
+bool CZoneMap::AddWeights(size_t first, size_t count, const float* weights)
+{
+	if (!InRange(first, count))
+		return false;
+
+	for (int k = 0; k < BLEND_MAX_COLORS; k++)
+	{
+		float* plane = Plane(k) + first;
+		for (size_t i = 0; i < count; i++)
+		{
+			plane[i] = weights[i * BLEND_MAX_COLORS + k];
+			if (plane[i] != 0.0f)
+				Used[k] = true;
+		}
+	}
+	return true;
+}
+
+bool CZoneMap::Load(const char* path, std::string& error)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	nlohmann::json jsn = nlohmann::json::parse(f, nullptr, false);
+	fclose(f);
+	if (jsn.is_discarded() || !jsn.is_object() || !jsn.contains("leds") || !jsn["leds"].is_number_unsigned())
+	{
+		error = std::string(path) + " is not a layout, it needs \"leds\"";
+		return false;
+	}
+
+	Reset(jsn["leds"].get<size_t>());
+	if (!jsn.contains("zones"))
+		return true;
+
+	size_t index = 0;
+	for (const auto& zone : jsn["zones"])
+	{
+		std::string name = "zone " + std::to_string(index++);
+		if (!zone.is_object() || !zone.contains("first") || !zone["first"].is_number_unsigned())
+		{
+			error = name + " needs \"first\"";
+			return false;
+		}
+		size_t first = zone["first"].get<size_t>();
+		bool hasCount = zone.contains("count") && zone["count"].is_number_unsigned();
+		size_t count = hasCount ? zone["count"].get<size_t>() : 0;
+		if (!hasCount && !zone.contains("weights"))
+		{
+			error = name + " needs \"count\"";
+			return false;
+		}
+
+		bool added = false;
+		if (zone.contains("solid") && zone["solid"].is_number_integer())
+			added = AddSolid(first, count, zone["solid"].get<int>());
+		else if (zone.contains("gradient") && zone["gradient"].is_array())
+		{
+			int stops[16];
+			int stopCount = 0;
+			for (const auto& stop : zone["gradient"])
+			{
+				if (stopCount == 16 || !stop.is_number_integer())
+				{
+					stopCount = 0;
+					break;
+				}
+				stops[stopCount++] = stop.get<int>();
+			}
+			added = AddGradient(first, count, stops, stopCount);
+		}
+		else if (zone.contains("weights") && zone["weights"].is_array())
+		{
+			// One row of five weights per LED, missing weights are 0
+			const auto& rows = zone["weights"];
+			std::unique_ptr<float[]> weights(new float[rows.size() * BLEND_MAX_COLORS]());
+			size_t row = 0;
+			added = true;
+			for (const auto& led : rows)
+			{
+				if (!led.is_array() || led.size() > BLEND_MAX_COLORS)
+				{
+					added = false;
+					break;
+				}
+				for (size_t k = 0; k < led.size(); k++)
+				{
+					if (!led[k].is_number())
+						added = false;
+					else
+						weights[row * BLEND_MAX_COLORS + k] = led[k].get<float>();
+				}
+				row++;
+			}
+			added = added && AddWeights(first, rows.size(), weights.get());
+		}
+		else
+		{
+			error = name + " needs \"solid\", \"gradient\" or \"weights\"";
+			return false;
+		}
+
+		if (!added)
+		{
+			error = name + " is out of range or has colors other than 0 to 4";
+			return false;
+		}
+	}
+	return true;
+}
+
+void CZoneMap::Render(const RZLinearEffect& effect, const RZLedPlanes& out) const
+{
+	// Only the colors some LED uses are blended
+	const float* weights[BLEND_MAX_COLORS];
+	float values[BLEND_MAX_COLORS * 3];
+	int colors = 0;
+	for (int k = 0; k < BLEND_MAX_COLORS; k++)
+	{
+		if (!Used[k])
+			continue;
+		weights[colors] = Weights.data() + k * Stride;
+		values[colors * 3] = effect.R[k];
+		values[colors * 3 + 1] = effect.G[k];
+		values[colors * 3 + 2] = effect.B[k];
+		colors++;
+	}
+
+	float* const planes[3] = { out.R, out.G, out.B };
+	Kernels->Blend(weights, values, colors, 0, Count, planes);
+}
+
+void CZoneMap::Render(const CHROMA_BROADCAST_EFFECT& effect, const RZLedPlanes& out) const
+{
+	RZLinearEffect linear;
+	CEffectInterpolator::ToLinear(effect, linear);
+	Render(linear, out);
+}
@@ -0,0 +1,69 @@
+//! \file ZoneMap.h
+//! \brief Spreads the five colors of an effect over the LEDs of an installation. A layout gives each LED a blend
+//! of the colors, as a solid color, a gradient through some of them or explicit weights, and is compiled into one
+//! weight plane per color. Each frame is then a weighted sum of at most five colors per LED, in linear light,
+//! written to planes the caller owns.
+
+#ifndef _ZONEMAP_H_
+#define _ZONEMAP_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "BroadcastProtocol.h"
+#include "ColorKernels.h"
+#include "Interpolator.h"
+#include "Simd.h"
+
+//! Output of a render, one float per LED in each plane, linear light 0 to 1.
+struct RZLedPlanes
+{
+	float* R;
+	float* G;
+	float* B;
+};
+
+class CZoneMap
+{
+public:
+	//! Uses level when the CPU supports it, else the best supported level.
+	explicit CZoneMap(SIMD_LEVEL level = CSimd::Level());
+
+	SIMD_LEVEL Level() const { return Simd; }
+
+	//! Starts a layout of leds LEDs, all dark until a zone covers them.
+	void Reset(size_t leds);
+	size_t Leds() const { return Count; }
+
+	//! The zones below replace what earlier zones gave their LEDs, and fail when they reach past the last LED or
+	//! name a color other than 0 to 4.
+	bool AddSolid(size_t first, size_t count, int color);
+	//! count LEDs fade evenly through stopCount colors, the first LED shows the first stop and the last the last.
+	bool AddGradient(size_t first, size_t count, const int* stops, int stopCount);
+	//! LEDs from first take weights 5 at a time, the weights of CL1 to CL5 of one LED.
+	bool AddWeights(size_t first, size_t count, const float* weights);
+
+	//! Replaces the layout with a JSON file:
+	//! { "leds": 300, "zones": [ { "first": 0, "count": 100, "solid": 0 },
+	//!                           { "first": 100, "count": 150, "gradient": [1, 2, 3] },
+	//!                           { "first": 250, "weights": [[0.5, 0.5, 0, 0, 0], ...] } ] }
+	bool Load(const char* path, std::string& error);
+
+	//! Writes Leds() values to each plane. Allocates nothing.
+	void Render(const RZLinearEffect& effect, const RZLedPlanes& out) const;
+	void Render(const RzChromaBroadcastAPI::CHROMA_BROADCAST_EFFECT& effect, const RZLedPlanes& out) const;
+
+private:
+	bool InRange(size_t first, size_t count) const { return first <= Count && count <= Count - first; }
+	float* Plane(int color) { return Weights.data() + color * Stride; }
+
+	std::vector<float> Weights;             //!< BLEND_MAX_COLORS planes of Stride floats.
+	size_t Count;
+	size_t Stride;                          //!< Count rounded up to a whole number of cache lines.
+	bool Used[BLEND_MAX_COLORS];            //!< Colors some LED weighs in, the others are not blended.
+	const RZColorKernels* Kernels;
+	SIMD_LEVEL Simd;
+};
+
+#endif
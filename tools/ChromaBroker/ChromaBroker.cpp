@@ -0,0 +1,228 @@
+//! \file ChromaBroker.cpp
+//! \brief chroma-broker: reads the Synapse broadcast ring once for the machine and republishes the frames to every
+//! process using the DLL, which then runs neither its own reader nor its own service monitor.
+//!
+//! Usage: chroma-broker [-n depth] [-s port [-a address]] [-y port] [-v]
+//!   -n  slots of the frame ring the clients read, a power of two, 4096 by default
+//!   -s  also streams the frames and the status over TCP and WebSocket on port, see StreamServer.h
+//!   -a  address the stream server listens on, 127.0.0.1 by default
+//!   -y  also leads synchronized playout on UDP port of every interface, see SyncPlayout.h
+//!   -v  prints the frames published and the clients attached every second
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <signal.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "../../src/BroadcastReader.h"
+#include "../../src/Broker.h"
+#include "../../src/Metrics.h"
+#include "../../src/Platform.h"
+#include "../../src/StreamServer.h"
+#include "../../src/SyncPlayout.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static CEvent StopEvent;
+static std::atomic<bool> ServiceRunning(true);
+
+#ifdef _WIN32
+static BOOL WINAPI OnConsoleCtrl(DWORD type)
+{
+	StopEvent.Set();
+	return TRUE;
+}
+#else
+static void OnSignal(int signal)
+{
+	StopEvent.Set();
+}
+#endif
+
+static unsigned long long Milliseconds()
+{
+	return CPlatform::Now() / 1000000ULL;
+}
+
+//! Polls the Synapse service every 3 s like the DLL's monitor thread did in every process.
+static DWORD Thread_MonitorOnline(void* lpThreadParameter)
+{
+	CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_MONITOR);
+	do
+	{
+		ServiceRunning.store(CPlatform::IsServiceRunning(RZSYNAPSE3_NAME), std::memory_order_relaxed);
+		metrics.Add(METRIC_HEALTH_CHECKS);
+	} while (!StopEvent.Wait(3000));
+	return 0;
+}
+
+static bool IsChromaBroadcastEnabled()
+{
+	DWORD Enable = 0;
+	return CSettings::GetDword(RZBROADCAST_REG_SUBKEY, "Enable", Enable) && Enable != 0;
+}
+
+int main(int argc, char** argv)
+{
+	bool verbose = false;
+	DWORD depth = FRAME_RING_DEFAULT_DEPTH;
+	bool stream = false;
+	RZStreamConfig streamConfig = CStreamServer::Defaults();
+	bool sync = false;
+	RZSyncLeaderConfig syncConfig = CSyncLeader::Defaults();
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-v"))
+			verbose = true;
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			depth = (DWORD)strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			stream = true;
+			streamConfig.Port = (WORD)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc && CUdpSocket::ParseAddress(argv[i + 1], streamConfig.Address))
+			i++;
+		else if (!strcmp(argv[i], "-y") && i + 1 < argc)
+		{
+			sync = true;
+			syncConfig.Port = (WORD)strtoul(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-n depth] [-s port [-a address]] [-y port] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+#ifdef _WIN32
+	SetConsoleCtrlHandler(OnConsoleCtrl, TRUE);
+#else
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+#endif
+
+	CBroadcastMetrics::Publish();
+	CBroadcastMetrics::SetTitle("chroma-broker");
+
+	CBrokerServer server;
+	if (!server.Open(depth))
+	{
+		fprintf(stderr, "Another chroma-broker is running, or the broker page could not be created\n");
+		CBroadcastMetrics::Unpublish();
+		return 1;
+	}
+
+	CSharedMemory shared;
+	CNamedEvent event;
+	if (!shared.Open(RZBROADCAST_SHARED_MEMORY, sizeof(RZEventSharedMemoryData), SHARED_MEMORY_OPEN_OR_CREATE) || !event.Open(RZBROADCAST_EVENT))
+	{
+		fprintf(stderr, "Failed to open the broadcast shared memory and event\n");
+		server.Close();
+		CBroadcastMetrics::Unpublish();
+		return 1;
+	}
+	const RZEventSharedMemoryData* ring = (const RZEventSharedMemoryData*)shared.Data();
+
+	CStreamServer streamServer;
+	std::string error;
+	if (stream && !streamServer.Open(streamConfig, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		server.Close();
+		CBroadcastMetrics::Unpublish();
+		return 1;
+	}
+
+	CSyncLeader syncLeader;
+	if (sync && !syncLeader.Open(syncConfig, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		streamServer.Close();
+		server.Close();
+		CBroadcastMetrics::Unpublish();
+		return 1;
+	}
+
+	CThread monitor;
+	monitor.Start(Thread_MonitorOnline);
+
+	printf("chroma-broker %lu serving, %lu frame ring\n", (unsigned long)CPlatform::ProcessId(), (unsigned long)server.RingDepth());
+	if (stream)
+		printf("streaming on port %u\n", (unsigned)streamServer.Port());
+	if (sync)
+		printf("leading sync on port %u\n", (unsigned)syncLeader.Port());
+	fflush(stdout);
+
+	CMetricsShard& metrics = CBroadcastMetrics::Shard(METRICS_SHARD_BROADCAST);
+	CRingReader reader;
+	unsigned long long lastCheck = 0;
+	unsigned long long lastReport = Milliseconds();
+	ULONGLONG published = 0;
+	for (;;)
+	{
+		// The timeout keeps the health checks and the client table current while Synapse is silent
+		WAIT_RESULT wait = reader.Wait(ring, event, 500, &StopEvent);
+		if (wait == WAIT_RESULT_CANCELLED || wait == WAIT_RESULT_FAILED)
+			break;
+
+		ULONGLONG ingested = CPlatform::Now();
+		unsigned long long now = ingested / 1000000ULL;
+		bool live = (server.Status() & BROKER_STATUS_LIVE) == BROKER_STATUS_LIVE;
+		if (!lastCheck || now - lastCheck > (live ? 2000u : 500u))
+		{
+			DWORD status = 0;
+			if (CNamedMutex::Exists(RZSYNAPSE3_MUTEX))
+				status |= BROKER_STATUS_SYNAPSE_ONLINE;
+			if (IsChromaBroadcastEnabled())
+				status |= BROKER_STATUS_ENABLED;
+			if (ServiceRunning.load(std::memory_order_relaxed))
+				status |= BROKER_STATUS_SERVICE_RUNNING;
+			server.SetStatus(status);
+			server.CheckClients();
+			metrics.Add(METRIC_HEALTH_CHECKS);
+			lastCheck = now;
+			live = status == BROKER_STATUS_LIVE;
+			streamServer.SetStatus(live ? LIVE : NOT_LIVE);
+			syncLeader.SetStatus(live ? LIVE : NOT_LIVE);
+		}
+
+		RZEventData frame;
+		if (wait == WAIT_RESULT_SIGNALED && reader.Read(ring, metrics, frame) && live)
+		{
+			// Remote consumers serve no app here, they get every frame
+			streamServer.Publish(frame);
+			syncLeader.Publish(frame);
+			// Frames for apps no client serves, or serves with broadcast disabled, stop here
+			RZID app = CRingReader::TargetApp(frame);
+			if (!app || server.IsAppServed(app))
+			{
+				server.Publish(frame, ingested);
+				metrics.Add(METRIC_FRAMES_DELIVERED);
+				published++;
+			}
+			else
+				metrics.Add(METRIC_FRAMES_FILTERED);
+		}
+
+		if (verbose && now - lastReport >= 1000)
+		{
+			printf("status 0x%lx clients %lu published %llu\n", (unsigned long)server.Status(), (unsigned long)server.ClientCount(), (unsigned long long)published);
+			fflush(stdout);
+			lastReport = now;
+		}
+	}
+
+	StopEvent.Set();
+	monitor.Join(INFINITE);
+	syncLeader.Close();
+	streamServer.Close();
+	server.Close();
+	CBroadcastMetrics::Unpublish();
+	printf("chroma-broker stopped, %llu frames published\n", (unsigned long long)published);
+	return 0;
+}
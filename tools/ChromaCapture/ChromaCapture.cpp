@@ -0,0 +1,277 @@
+//! \file ChromaCapture.cpp
+//! \brief chroma-capture: summarises, exports and slices a time range of a capture recorded with RZBROADCAST_RECORD.
+//! The capture is memory mapped and the range found through its block index, so only the pages of the range are
+//! read and captures of any length can be handled.
+//!
+//! Usage: chroma-capture summary <capture> [-f from] [-t to]
+//!        chroma-capture export <capture> [-f from] [-t to] [-F csv|json] [-o output]
+//!        chroma-capture slice <capture> -o output [-f from] [-t to]
+//!   -f, -t  range in seconds since the start of the capture, to is excluded. The whole capture by default.
+//!   -F      export format, csv by default. The export goes to stdout without -o.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include "../../src/Capture.h"
+
+using namespace RzChromaBroadcastAPI;
+
+static const ULONGLONG TIME_END = ~0ULL;
+
+//! The range and options shared by the commands.
+struct RZCaptureRange
+{
+	const char* Capture;
+	const char* Output;
+	const char* Format;
+	ULONGLONG From;                         //!< Microseconds since the start of the capture.
+	ULONGLONG To;
+};
+
+static const char* StatusName(int status)
+{
+	switch (status)
+	{
+	case LIVE:
+		return "LIVE";
+	case NOT_LIVE:
+		return "NOT_LIVE";
+	default:
+		return "";
+	}
+}
+
+static ULONGLONG ParseSeconds(const char* text)
+{
+	double seconds = atof(text);
+	return seconds > 0 ? (ULONGLONG)(seconds * 1e6 + 0.5) : 0;
+}
+
+//! Seeks to From. Returns false with a message when the capture cannot be read.
+static bool OpenRange(CCaptureReader& reader, const RZCaptureRange& range)
+{
+	if (!reader.Open(range.Capture))
+	{
+		fprintf(stderr, "%s is not a capture\n", range.Capture);
+		return false;
+	}
+	// Past the last record there is nothing to read, which is not an error
+	reader.Seek(range.From);
+	return true;
+}
+
+static int Summary(const RZCaptureRange& range)
+{
+	CCaptureReader reader;
+	if (!OpenRange(reader, range))
+		return 1;
+
+	const RZCaptureHeader* header = reader.Header();
+	ULONGLONG first = reader.FrameNumber();
+	int status = reader.Status();
+
+	ULONGLONG frames = 0, statuses = 0, appSpecific = 0, maxGap = 0;
+	ULONGLONG start = TIME_END, end = 0, lastFrame = TIME_END;
+	std::map<RZID, ULONGLONG> apps;
+	RZCaptureRecord record;
+	while (reader.Next(record) && record.Time < range.To)
+	{
+		if (start == TIME_END)
+			start = record.Time;
+		end = record.Time;
+		if (record.Type == CAPTURE_RECORD_STATUS)
+		{
+			statuses++;
+			continue;
+		}
+
+		frames++;
+		if (lastFrame != TIME_END && record.Time - lastFrame > maxGap)
+			maxGap = record.Time - lastFrame;
+		lastFrame = record.Time;
+		if (record.Frame.effect.IsAppSpecific)
+		{
+			appSpecific++;
+			apps[record.Frame.index]++;
+		}
+	}
+
+	// The duration of the whole capture is the time of its last record
+	reader.Seek(TIME_END);
+
+	printf("capture      %s, version %lu, recorded by process %lu\n", range.Capture, (unsigned long)header->Version, (unsigned long)header->ProcessId);
+	printf("duration     %.3f s, %llu frames, %llu status changes\n", reader.Time() / 1e6, (unsigned long long)header->Frames, (unsigned long long)header->Statuses);
+	printf("size         %llu bytes of records, %.1f bytes per frame, %zu blocks, %s\n", (unsigned long long)header->Length.load(),
+		header->Frames ? (double)header->Length.load() / header->Frames : 0.0, reader.Blocks(), reader.HasIndex() ? "indexed" : "no index");
+	if (start == TIME_END)
+	{
+		printf("range        no records\n");
+		return 0;
+	}
+
+	double seconds = (end - start) / 1e6;
+	printf("range        %.6f s to %.6f s, frames %llu to %llu, status at start %s\n", start / 1e6, end / 1e6,
+		(unsigned long long)first, (unsigned long long)(first + frames), status ? StatusName(status) : "none");
+	printf("frames       %llu, %.1f per second, longest gap %.3f ms\n", (unsigned long long)frames, seconds > 0 ? frames / seconds : 0.0, maxGap / 1e3);
+	printf("statuses     %llu\n", (unsigned long long)statuses);
+	printf("app specific %llu frames for %zu apps\n", (unsigned long long)appSpecific, apps.size());
+	for (const auto& app : apps)
+		printf("  app %-8lu %llu\n", (unsigned long)app.first, (unsigned long long)app.second);
+	return 0;
+}
+
+static int Export(const RZCaptureRange& range)
+{
+	bool json = !strcmp(range.Format, "json");
+	if (!json && strcmp(range.Format, "csv"))
+	{
+		fprintf(stderr, "Unknown format %s, use csv or json\n", range.Format);
+		return 1;
+	}
+
+	CCaptureReader reader;
+	if (!OpenRange(reader, range))
+		return 1;
+
+	FILE* f = range.Output ? fopen(range.Output, "w") : stdout;
+	if (!f)
+	{
+		fprintf(stderr, "Failed to write %s\n", range.Output);
+		return 1;
+	}
+
+	// Rows are written as they are decoded, nothing of the range is kept in memory
+	if (json)
+		fprintf(f, "[");
+	else
+		fprintf(f, "time_us,type,frame,index,cl1,cl2,cl3,cl4,cl5,app_specific,tick_count,status\n");
+
+	bool firstRow = true;
+	RZCaptureRecord record;
+	ULONGLONG number = reader.FrameNumber();
+	while (reader.Next(record) && record.Time < range.To)
+	{
+		bool frame = record.Type == CAPTURE_RECORD_FRAME;
+		const RZEventData& data = record.Frame;
+		if (json)
+		{
+			fprintf(f, "%s\n  {\"time_us\": %llu, \"type\": \"%s\"", firstRow ? "" : ",", (unsigned long long)record.Time, frame ? "frame" : "status");
+			if (frame)
+				fprintf(f, ", \"frame\": %llu, \"index\": %lu, \"cl\": [%lu, %lu, %lu, %lu, %lu], \"app_specific\": %s, \"tick_count\": %lu}",
+					(unsigned long long)number, (unsigned long)data.index, (unsigned long)data.effect.CL1, (unsigned long)data.effect.CL2,
+					(unsigned long)data.effect.CL3, (unsigned long)data.effect.CL4, (unsigned long)data.effect.CL5,
+					data.effect.IsAppSpecific ? "true" : "false", (unsigned long)data.TickCount);
+			else
+				fprintf(f, ", \"status\": \"%s\"}", StatusName(record.Status));
+		}
+		else if (frame)
+		{
+			fprintf(f, "%llu,frame,%llu,%lu,0x%08lX,0x%08lX,0x%08lX,0x%08lX,0x%08lX,%d,%lu,\n", (unsigned long long)record.Time, (unsigned long long)number,
+				(unsigned long)data.index, (unsigned long)data.effect.CL1, (unsigned long)data.effect.CL2, (unsigned long)data.effect.CL3,
+				(unsigned long)data.effect.CL4, (unsigned long)data.effect.CL5, data.effect.IsAppSpecific ? 1 : 0, (unsigned long)data.TickCount);
+		}
+		else
+			fprintf(f, "%llu,status,,,,,,,,,,%s\n", (unsigned long long)record.Time, StatusName(record.Status));
+
+		if (frame)
+			number++;
+		firstRow = false;
+	}
+	if (json)
+		fprintf(f, "%s]\n", firstRow ? "" : "\n");
+
+	bool failed = ferror(f) != 0;
+	if (f != stdout)
+		fclose(f);
+	return failed ? 1 : 0;
+}
+
+static int Slice(const RZCaptureRange& range)
+{
+	if (!range.Output)
+	{
+		fprintf(stderr, "slice needs -o output\n");
+		return 1;
+	}
+
+	CCaptureReader reader;
+	if (!OpenRange(reader, range))
+		return 1;
+
+	// The slice starts at From, its first frame is encoded against nothing and the status carries over
+	ULONGLONG start = reader.Header()->StartTime;
+	CCaptureWriter writer;
+	if (!writer.Open(range.Output, start + range.From * 1000))
+	{
+		fprintf(stderr, "Failed to create %s\n", range.Output);
+		return 1;
+	}
+	if (reader.Status())
+		writer.SetStatus((CHROMA_BROADCAST_STATUS)reader.Status(), start + range.From * 1000);
+
+	ULONGLONG frames = 0;
+	RZCaptureRecord record;
+	while (reader.Next(record) && record.Time < range.To)
+	{
+		ULONGLONG time = start + record.Time * 1000;
+		if (record.Type == CAPTURE_RECORD_STATUS)
+			writer.SetStatus(record.Status, time);
+		else
+		{
+			writer.AddFrame(record.Frame, time);
+			frames++;
+		}
+		if (!writer.FlushIfDue(time))
+		{
+			fprintf(stderr, "Failed to write %s\n", range.Output);
+			return 1;
+		}
+	}
+	if (!writer.Flush())
+	{
+		fprintf(stderr, "Failed to write %s\n", range.Output);
+		return 1;
+	}
+	writer.Close();
+
+	printf("%llu frames written to %s\n", (unsigned long long)frames, range.Output);
+	return 0;
+}
+
+static int Usage(const char* name)
+{
+	fprintf(stderr, "usage: %s summary <capture> [-f from] [-t to]\n", name);
+	fprintf(stderr, "       %s export <capture> [-f from] [-t to] [-F csv|json] [-o output]\n", name);
+	fprintf(stderr, "       %s slice <capture> -o output [-f from] [-t to]\n", name);
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+		return Usage(argv[0]);
+
+	RZCaptureRange range = { argv[2], nullptr, "csv", 0, TIME_END };
+	for (int i = 3; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			range.From = ParseSeconds(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			range.To = ParseSeconds(argv[++i]);
+		else if (!strcmp(argv[i], "-F") && i + 1 < argc)
+			range.Format = argv[++i];
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			range.Output = argv[++i];
+		else
+			return Usage(argv[0]);
+	}
+
+	if (!strcmp(argv[1], "summary"))
+		return Summary(range);
+	if (!strcmp(argv[1], "export"))
+		return Export(range);
+	if (!strcmp(argv[1], "slice"))
+		return Slice(range);
+	return Usage(argv[0]);
+}
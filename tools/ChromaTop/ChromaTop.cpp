@@ -0,0 +1,184 @@
+//! \file ChromaTop.cpp
+//! \brief chroma-top: live view of the metrics pages published by every process using the Chroma Broadcast DLL.
+//!
+//! Usage: chroma-top [-p pid] [-i interval_ms] [-n iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "../../src/Metrics.h"
+#include "../../src/Platform.h"
+
+using namespace RzChromaBroadcastAPI;
+
+struct CProcessPage
+{
+	CSharedMemory Memory;
+	CHROMA_BROADCAST_METRICS Last;
+	bool HasLast = false;
+	DWORD Shards = 0;                       //!< Shards mapped, those of the page up to METRICS_SHARD_COUNT.
+
+	const RZMetricsPage* Page() const { return (const RZMetricsPage*)Memory.Data(); }
+};
+
+static bool MapPage(unsigned long pid, CProcessPage& process)
+{
+	char name[128];
+	snprintf(name, sizeof(name), RZBROADCAST_METRICS_SHARED_MEMORY, pid);
+
+	// Pages of other versions hold another number of shards, the header tells how many to map
+	CSharedMemory header;
+	if (!header.Open(name, sizeof(RZMetricsPageHeader), SHARED_MEMORY_READ_ONLY, SHARED_MEMORY_GLOBAL_OR_SESSION))
+		return false;
+	const RZMetricsPageHeader* page = (const RZMetricsPageHeader*)header.Data();
+	if (page->Magic != RZBROADCAST_METRICS_MAGIC || !page->ShardCount)
+		return false;
+	process.Shards = page->ShardCount < METRICS_SHARD_COUNT ? page->ShardCount : METRICS_SHARD_COUNT;
+	return process.Memory.Open(name, MetricsPageSize(process.Shards), SHARED_MEMORY_READ_ONLY, SHARED_MEMORY_GLOBAL_OR_SESSION);
+}
+
+//! Upper bound, in microseconds, of the bucket holding the given percentile.
+static double Percentile(const ULONGLONG* current, const ULONGLONG* last, double percentile)
+{
+	ULONGLONG total = 0;
+	for (int i = 0; i < CHROMA_BROADCAST_METRICS_BUCKETS; i++)
+		total += current[i] - (last ? last[i] : 0);
+	if (!total)
+		return -1.0;
+
+	ULONGLONG rank = (ULONGLONG)(percentile * total + 0.5);
+	ULONGLONG seen = 0;
+	for (int i = 0; i < CHROMA_BROADCAST_METRICS_BUCKETS; i++)
+	{
+		seen += current[i] - (last ? last[i] : 0);
+		if (seen >= rank && seen)
+			return (double)(1ULL << i);
+	}
+	return (double)(1ULL << (CHROMA_BROADCAST_METRICS_BUCKETS - 1));
+}
+
+static void FormatTime(char* out, size_t size, double us)
+{
+	if (us < 0)
+		snprintf(out, size, "-");
+	else if (us < 1000.0)
+		snprintf(out, size, "%.0fus", us);
+	else if (us < 1000000.0)
+		snprintf(out, size, "%.1fms", us / 1000.0);
+	else
+		snprintf(out, size, "%.1fs", us / 1000000.0);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long onlyPid = 0;
+	unsigned int intervalMs = 1000;
+	unsigned int iterations = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			onlyPid = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			intervalMs = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else
+		{
+			fprintf(stderr, "usage: %s [-p pid] [-i interval_ms] [-n iterations]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!intervalMs)
+		intervalMs = 1000;
+
+	std::map<unsigned long, std::unique_ptr<CProcessPage>> processes;
+	auto lastTick = std::chrono::steady_clock::now();
+
+	for (unsigned int iteration = 0; !iterations || iteration < iterations; iteration++)
+	{
+		std::vector<DWORD> pids;
+		if (onlyPid)
+			pids.push_back(onlyPid);
+		else
+			pids = CPlatform::ListProcesses();
+
+		for (auto pid : pids)
+		{
+			if (processes.count(pid))
+				continue;
+			std::unique_ptr<CProcessPage> process(new CProcessPage());
+			if (MapPage(pid, *process))
+				processes[pid] = std::move(process);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - lastTick).count();
+		lastTick = now;
+
+		printf("\x1b[2J\x1b[H");
+		printf("%-8s %-20s %9s %9s %9s %8s %8s %7s %6s %8s %8s %8s %8s\n",
+			"PID", "TITLE", "READ/s", "DELIV/s", "DEDUP/s", "DROP/s", "FILT/s", "HEALTH", "TRANS", "CB p50", "CB p99", "LAT p50", "LAT p99");
+
+		for (auto it = processes.begin(); it != processes.end();)
+		{
+			CProcessPage& process = *it->second;
+			const RZMetricsPage* page = process.Page();
+			if (page->Header.Magic != RZBROADCAST_METRICS_MAGIC || !CPlatform::IsProcessAlive(it->first))
+			{
+				it = processes.erase(it);
+				continue;
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			CHROMA_BROADCAST_METRICS current;
+			CBroadcastMetrics::Snapshot(page->Shards, process.Shards, current);
+
+			const CHROMA_BROADCAST_METRICS* last = process.HasLast ? &process.Last : nullptr;
+			auto rate = [&](ULONGLONG CHROMA_BROADCAST_METRICS::*field)
+			{
+				return last && seconds > 0 ? (double)(current.*field - last->*field) / seconds : 0.0;
+			};
+
+			char cb50[16], cb99[16], lat50[16], lat99[16];
+			FormatTime(cb50, sizeof(cb50), Percentile(current.CallbackTime, last ? last->CallbackTime : nullptr, 0.50));
+			FormatTime(cb99, sizeof(cb99), Percentile(current.CallbackTime, last ? last->CallbackTime : nullptr, 0.99));
+			FormatTime(lat50, sizeof(lat50), Percentile(current.Latency, last ? last->Latency : nullptr, 0.50));
+			FormatTime(lat99, sizeof(lat99), Percentile(current.Latency, last ? last->Latency : nullptr, 0.99));
+
+			char title[sizeof(page->Header.Title)];
+			memcpy(title, page->Header.Title, sizeof(title));
+			title[sizeof(title) - 1] = 0;
+
+			printf("%-8lu %-20.20s %9.1f %9.1f %9.1f %8.1f %8.1f %7llu %6llu %8s %8s %8s %8s\n",
+				it->first, title[0] ? title : "-",
+				rate(&CHROMA_BROADCAST_METRICS::FramesRead),
+				rate(&CHROMA_BROADCAST_METRICS::FramesDelivered),
+				rate(&CHROMA_BROADCAST_METRICS::FramesDeduped),
+				rate(&CHROMA_BROADCAST_METRICS::FramesDropped),
+				rate(&CHROMA_BROADCAST_METRICS::FramesFiltered),
+				(unsigned long long)current.HealthChecks,
+				(unsigned long long)current.StatusTransitions,
+				cb50, cb99, lat50, lat99);
+
+			process.Last = current;
+			process.HasLast = true;
+			++it;
+		}
+
+		if (processes.empty())
+			printf("No process is publishing Chroma Broadcast metrics.\n");
+		fflush(stdout);
+
+		if (iterations && iteration + 1 >= iterations)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+	}
+
+	return 0;
+}